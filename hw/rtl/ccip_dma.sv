@@ -280,12 +280,21 @@ module ccip_dma
         rx_base_addr_d <= rx_base_addr;
     end
 
+    // Ring lap of each flow, the CPU expects phase 1 on the first lap
+    logic[2**LMAX_NUM_OF_FLOWS-1:0] tx_out_phase;
+    RpcIf tx_out_data;
+    always_comb begin
+        tx_out_data = tx_fifo_pop_data;
+        tx_out_data.rpc_data.hdr.ctl.phase = tx_out_phase[tx_out_flow];
+    end
+
     // Write to CCI-P
     always_ff @(posedge clk) begin
         if (reset) begin
             sTx_c1.valid   <= 1'b0;
             tx_out_cnt     <= {($bits(tx_out_cnt)){1'b0}};
             tx_out_flow    <= {($bits(tx_out_flow)){1'b0}};
+            tx_out_phase   <= {($bits(tx_out_phase)){1'b1}};
 
         end else begin
             // Data
@@ -295,7 +304,7 @@ module ccip_dma
             sTx_c1.hdr.req_type           <= eREQ_WRLINE_I;
             sTx_c1.hdr.address            <= rx_base_addr_d + tx_out_flow_shift + tx_out_cnt;
             sTx_c1.hdr.sop                <= tx_out_cnt == 0;
-            sTx_c1.data[$bits(RpcIf)-1:0] <= tx_fifo_pop_data;
+            sTx_c1.data[$bits(RpcIf)-1:0] <= tx_out_data;
 
             // Control
             sTx_c1.valid <= 1'b0;
@@ -307,6 +316,8 @@ module ccip_dma
 
                 // Counters
                 if (tx_out_cnt == tx_batch_size - 1) begin
+                    // The flow region holds one batch, so every batch is a lap
+                    tx_out_phase[tx_out_flow] <= ~tx_out_phase[tx_out_flow];
                     if (tx_out_flow == number_of_flows) begin
                         tx_out_flow <= {($bits(tx_out_flow)){1'b0}};
                     end else begin
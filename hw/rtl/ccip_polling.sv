@@ -184,9 +184,19 @@ module ccip_polling
     // NIC - CPU datapath
     // - eREQ_WRPUSH_I mode
     // =============================================================
+    // Ring lap of each flow, the CPU expects phase 1 on the first lap; the
+    // flow region is a single line, so every write is a lap
+    logic[2**LMAX_NUM_OF_FLOWS-1:0] rx_phase;
+    RpcIf rpc_in_stamped;
+    always_comb begin
+        rpc_in_stamped = rpc_in;
+        rpc_in_stamped.rpc_data.hdr.ctl.phase = rx_phase[rpc_flow_id_in];
+    end
+
     always_ff @(posedge clk) begin
         if (reset) begin
             sTx_c1.valid <= 1'b0; 
+            rx_phase     <= {($bits(rx_phase)){1'b1}};
 
         end else begin
             // Initial value
@@ -207,9 +217,11 @@ module ccip_polling
                 sTx_c1.hdr.vc_sel   <= BACKWARD_VC;
                 sTx_c1.hdr.req_type <= BACKWARD_WR_TYPE;
 
-                sTx_c1.data[$bits(RpcIf)-1:0] <= rpc_in;
+                sTx_c1.data[$bits(RpcIf)-1:0] <= rpc_in_stamped;
 
                 sTx_c1.valid        <= 1'b1; 
+
+                rx_phase[rpc_flow_id_in] <= ~rx_phase[rpc_flow_id_in];
             end
 
         end
@@ -66,7 +66,8 @@ module ccip_queue_polling
         output t_if_ccip_c0_Tx sTx_c0,
         output t_if_ccip_c1_Tx sTx_c1,
 
-        input logic lb_select,
+        input LbScheme lb_select,
+        input logic[2**LMAX_NUM_OF_FLOWS-1:0] flow_mask,
 
         // RPC interface
         output RpcPckt                      rpc_out,
@@ -79,7 +80,10 @@ module ccip_queue_polling
         input logic[LMAX_NUM_OF_FLOWS-1:0] rpc_flow_id_in,
 
         // Statistics
-        output logic pdrop_tx_flows_out
+        output logic pdrop_tx_flows_out,
+        output logic[2**LMAX_NUM_OF_FLOWS-1:0]      pdrop_tx_flow_vec_out,
+        output logic[2**LMAX_NUM_OF_FLOWS-1:0]      tx_flow_congestion_out,
+        output logic[2**LMAX_NUM_OF_FLOWS-1:0][7:0] tx_flow_occupancy_out
     );
 
 
@@ -343,13 +347,17 @@ module ccip_queue_polling
             .sTx_c1(sTx_c1),
 
             .lb_select(lb_select),
+            .flow_mask(flow_mask),
 
             .ccip_tx_ready(ccip_tx_ready),
             .rpc_in(rpc_in),
             .rpc_in_valid(rpc_in_valid),
             .rpc_flow_id_in(rpc_flow_id_in),
 
-            .pdrop_tx_flows_out(pdrop_tx_flows_out)
+            .pdrop_tx_flows_out(pdrop_tx_flows_out),
+            .pdrop_tx_flow_vec_out(pdrop_tx_flow_vec_out),
+            .tx_flow_congestion_out(tx_flow_congestion_out),
+            .tx_flow_occupancy_out(tx_flow_occupancy_out)
         );
 
 
@@ -40,7 +40,9 @@ module ccip_transmitter
         output logic initialized,
         output logic error,
 
-        input logic lb_select,
+        input LbScheme lb_select,
+        // Flows the load balancer steers requests to
+        input logic[2**LMAX_NUM_OF_FLOWS-1:0] flow_mask,
 
         // CPU interface
         input  logic           sRx_c1TxAlmFull,
@@ -52,12 +54,17 @@ module ccip_transmitter
         input logic[LMAX_NUM_OF_FLOWS-1:0] rpc_flow_id_in,
 
         // Statistics
-        output logic pdrop_tx_flows_out
+        output logic pdrop_tx_flows_out,
+        output logic[2**LMAX_NUM_OF_FLOWS-1:0]      pdrop_tx_flow_vec_out,
+        output logic[2**LMAX_NUM_OF_FLOWS-1:0]      tx_flow_congestion_out,
+        output logic[2**LMAX_NUM_OF_FLOWS-1:0][7:0] tx_flow_occupancy_out
     );
 
     // Parameters
     localparam LTX_FIFO_DEPTH = 3;
     localparam MAX_TX_FLOWS = 2**LMAX_NUM_OF_FLOWS;
+    // Flow FIFO occupancy at which the flow is reported as congested
+    localparam TX_FIFO_CONGESTION_THR = 3*(2**LTX_FIFO_DEPTH)/4;
     localparam RQ_LNUM_OF_SLOTS = LMAX_NUM_OF_FLOWS + LTX_FIFO_DEPTH;
 
     // Types
@@ -71,6 +78,7 @@ module ccip_transmitter
         TxQueueAddress region_begin;
         TxQueueAddress current;
         TxQueueAddress region_end;
+        logic          phase;   // flips on every lap of the queue
     } TxQueueAddressTuple;
 
     // Request queue
@@ -111,6 +119,7 @@ module ccip_transmitter
     ReqQueueSlotId ff_pop_data[MAX_TX_FLOWS];
     logic [LTX_FIFO_DEPTH-1:0] ff_dw[MAX_TX_FLOWS];
     logic ff_ovf[MAX_TX_FLOWS];
+    logic ff_loss[MAX_TX_FLOWS];
 
     genvar gi;
     generate
@@ -129,7 +138,7 @@ module ccip_transmitter
                 .pop_valid(ff_pop_valid[gi]),
                 .pop_data(ff_pop_data[gi]),
                 .pop_dw(ff_dw[gi]),
-                .loss_out(),
+                .loss_out(ff_loss[gi]),
                 .error(ff_ovf[gi])
             );
     end
@@ -139,9 +148,41 @@ module ccip_transmitter
     // Push logic
     //
     FlowId rpc_flow_id_in_d, rpc_flow_id_in_1d, rpc_flow_id_in_2d;
+    FlowId rpc_affinity_flow_1d, rpc_affinity_flow_2d;
+    logic  rpc_is_req_d, rpc_is_req_1d, rpc_is_req_2d;
+    logic [7:0] rpc_affinity_in_d;
 
     logic [15:0] lb_flow_cnt;
 
+    // Round-robin steering only goes to the flows set in flow_mask:
+    //  - lb_next_flow is the first active flow after lb_flow_cnt
+    //  - lb_rr_flow is the flow to steer the current request to
+    //  - if no flow is active, the mask is ignored
+    FlowId lb_next_flow, lb_rr_flow;
+    logic  lb_any_active;
+    logic [15:0] lb_cand;
+    integer i8;
+    always_comb begin
+        lb_any_active = 1'b0;
+        lb_next_flow  = FlowId'(lb_flow_cnt == number_of_flows ? 0 : lb_flow_cnt + 1);
+        lb_cand       = {($bits(lb_cand)){1'b0}};
+
+        // Walk from the farthest flow down, so the closest active one wins
+        for(i8=MAX_TX_FLOWS; i8>0; i8=i8-1) begin
+            lb_cand = lb_flow_cnt + 16'(i8);
+            if (lb_cand > number_of_flows) begin
+                lb_cand = lb_cand - number_of_flows - 1;
+            end
+            if (i8 <= number_of_flows + 1 && flow_mask[FlowId'(lb_cand)]) begin
+                lb_next_flow  = FlowId'(lb_cand);
+                lb_any_active = 1'b1;
+            end
+        end
+
+        lb_rr_flow = (flow_mask[FlowId'(lb_flow_cnt)] || !lb_any_active)?
+                                                FlowId'(lb_flow_cnt): lb_next_flow;
+    end
+
     integer i2, i3;
     always @(posedge clk) begin
         // Defaults
@@ -153,6 +194,8 @@ module ccip_transmitter
         // Put request to request queue (TODO: move bellow)
         rq_push_data <= rpc_in;
         rpc_flow_id_in_d <= rpc_flow_id_in;
+        rpc_affinity_in_d <= rpc_in.rpc_data.hdr.affinity;
+        rpc_is_req_d <= (rpc_in.rpc_data.hdr.ctl.req_type == rpcReq);
 
         if (start && rpc_in_valid) begin
             $display("NIC%d: CCI-P transmitter, rpc_in requesed for flow= %d, rpc_data= %d",
@@ -163,19 +206,27 @@ module ccip_transmitter
         // Delay rpc_flow_id to align with rq look-up
         rpc_flow_id_in_1d <= rpc_flow_id_in_d;
         rpc_flow_id_in_2d <= rpc_flow_id_in_1d;
+        rpc_is_req_1d <= rpc_is_req_d;
+        rpc_is_req_2d <= rpc_is_req_1d;
+
+        // Map the affinity hash onto the configured flows, the mapping is
+        // stable as long as number_of_flows does not change
+        rpc_affinity_flow_1d <= rpc_affinity_in_d % (number_of_flows + 1);
+        rpc_affinity_flow_2d <= rpc_affinity_flow_1d;
 
         // Put slot_id to corresponding flow FIFO
         if (rq_push_done) begin
             $display("NIC%d: CCI-P transmitter, writing request to flow fifo= %d, rq_slot_id= %d",
                                         NIC_ID, rpc_flow_id_in_2d, rq_slot_id);
-            if (lb_select && rpc_in.rpc_data.hdr.ctl.req_type == rpcReq) begin
-                ff_push_data[lb_flow_cnt] <= rq_slot_id;
-                ff_push_en[lb_flow_cnt] <= 1'b1;
-                if (lb_flow_cnt == number_of_flows) begin
-                    lb_flow_cnt <= {($bits(lb_flow_cnt)){1'b0}};
-                end else begin
-                    lb_flow_cnt <= lb_flow_cnt + 1;
-                end
+            if (lb_select == lbAffinity && rpc_is_req_2d && flow_mask[rpc_affinity_flow_2d]) begin
+                ff_push_data[rpc_affinity_flow_2d] <= rq_slot_id;
+                ff_push_en[rpc_affinity_flow_2d] <= 1'b1;
+            end else if ((lb_select == lbRoundRobin || lb_select == lbAffinity) && rpc_is_req_2d) begin
+                // Keys of the masked out flows go round-robin while the flows
+                // are inactive
+                ff_push_data[lb_rr_flow] <= rq_slot_id;
+                ff_push_en[lb_rr_flow] <= 1'b1;
+                lb_flow_cnt <= 16'(lb_next_flow);
             end else begin
                 ff_push_data[rpc_flow_id_in_2d] <= rq_slot_id;
                 ff_push_en[rpc_flow_id_in_2d] <= 1'b1;
@@ -206,7 +257,7 @@ module ccip_transmitter
     TxQueueAddress tx_queue_addr_table_r_addr, tx_queue_addr_table_w_addr;
     logic tx_queue_addr_table_w_en;
 
-    // {flow_id -> [address begin, address current, address end]}
+    // {flow_id -> [address begin, address current, address end, phase]}
     single_clock_wr_ram #(
             .DATA_WIDTH($bits(TxQueueAddressTuple)),
             .ADR_WIDTH(LMAX_NUM_OF_FLOWS)
@@ -228,10 +279,12 @@ module ccip_transmitter
         tx_queue_addr = tx_queue_addr_tabe_init_cnt * tx_queue_size;
 
         // Compute address tuple
+        // The CPU expects phase 1 on the first lap, as the queues are zeroed
         tx_queue_addr_table_init_w = '{
             region_begin: tx_queue_addr,
             current: tx_queue_addr,
-            region_end: tx_queue_addr + tx_queue_size - tx_batch_size};
+            region_end: tx_queue_addr + tx_queue_size - tx_batch_size,
+            phase: 1'b1};
     end
 
     always_ff @(posedge clk) begin
@@ -256,6 +309,7 @@ module ccip_transmitter
     // TX path
     FlowId tx_flow_cnt;
     TxQueueAddress tx_queue_address;
+    logic tx_queue_phase;
     t_ccip_clLen tx_cl_len;
     TxBatch tx_batch_cnt;
     TxState tx_state;
@@ -313,22 +367,25 @@ module ccip_transmitter
             if (tx_batch_cnt == 0) begin
                 // Save tx_queue_address for the following transmission
                 tx_queue_address <= tx_queue_addr_table_r_data.current;
+                tx_queue_phase   <= tx_queue_addr_table_r_data.phase;
 
                 // Update tx_queue_address
                 // Increment queue entry in tx_queue_address_tb for the given flow_id
                 tx_queue_addr_table_w_addr <= tx_flow_cnt;
                 if (tx_queue_addr_table_r_data.current == tx_queue_addr_table_r_data.region_end) begin
-                    // Wrap around
+                    // Wrap around, next lap
                     tx_queue_addr_table_w_data <= '{
                         region_begin: tx_queue_addr_table_r_data.region_begin,
                         current: tx_queue_addr_table_r_data.region_begin,
-                        region_end: tx_queue_addr_table_r_data.region_end};
+                        region_end: tx_queue_addr_table_r_data.region_end,
+                        phase: ~tx_queue_addr_table_r_data.phase};
                 end else begin
                    // Increment
                     tx_queue_addr_table_w_data <= '{
                         region_begin: tx_queue_addr_table_r_data.region_begin,
                         current: tx_queue_addr_table_r_data.current + tx_batch_size,
-                        region_end: tx_queue_addr_table_r_data.region_end};
+                        region_end: tx_queue_addr_table_r_data.region_end,
+                        phase: tx_queue_addr_table_r_data.phase};
                 end
                 tx_queue_addr_table_w_en <= 1'b1;
             end
@@ -364,9 +421,19 @@ module ccip_transmitter
     //  - STAGE 2: look-up payload from request queue
     //  - STAGE 3: transmit over CCI-P
     TxQueueAddress tx_queue_address_d, tx_queue_address_d1;
+    logic tx_queue_phase_d, tx_queue_phase_d1;
     FlowId tx_flow_cnt_d, tx_flow_cnt_d1;
     TxBatch tx_out_batch_cnt;
     logic rq_read_d;
+    RpcPckt tx_pckt;
+
+    // Stamp the lap of the flow queue into the packet, so the CPU can tell
+    // it from the packet of the previous lap in the same slot
+    always_comb begin
+        tx_pckt = rq_pop_data.rpc_data;
+        tx_pckt.hdr.ctl.phase = tx_queue_phase_d1;
+    end
+
     always @(posedge clk) begin
         // Defaults
         rq_pop_en <= 1'b0;
@@ -374,6 +441,7 @@ module ccip_transmitter
         // Delay to alight with flow FIFO look-up
         tx_flow_cnt_d <= tx_flow_cnt;
         tx_queue_address_d <= tx_queue_address;
+        tx_queue_phase_d <= tx_queue_phase;
 
         // Request RPC packets from request queue
         if (ff_pop_valid[tx_flow_cnt_d]) begin
@@ -385,6 +453,7 @@ module ccip_transmitter
         rq_read_d          <= rq_pop_en;
         tx_flow_cnt_d1     <= tx_flow_cnt_d;
         tx_queue_address_d1 <= tx_queue_address_d;
+        tx_queue_phase_d1   <= tx_queue_phase_d;
 
         // Transmit over CCI-P
         // Data
@@ -394,7 +463,7 @@ module ccip_transmitter
         sTx_c1.hdr.req_type             <= eREQ_WRLINE_I;
         sTx_c1.hdr.address              <= tx_base_addr + tx_queue_address_d1 + tx_out_batch_cnt;
         sTx_c1.hdr.sop                  <= tx_out_batch_cnt == 0;
-        sTx_c1.data[$bits(RpcPckt)-1:0] <= rq_pop_data.rpc_data;
+        sTx_c1.data[$bits(RpcPckt)-1:0] <= tx_pckt;
 
         // CCI-P Batch control
         sTx_c1.valid <= 1'b0;
@@ -433,6 +502,23 @@ module ccip_transmitter
         end
     end
 
+    // Per-flow statistics
+    //  - drop pulses for the per-flow drop counters
+    //  - flow FIFO occupancy and congestion (FIFO is about to overflow)
+    integer i7;
+    always @(posedge clk) begin
+        for(i7=0; i7<MAX_TX_FLOWS; i7=i7+1) begin
+            pdrop_tx_flow_vec_out[i7]  <= ff_loss[i7];
+            tx_flow_occupancy_out[i7]  <= 8'(ff_dw[i7]);
+            tx_flow_congestion_out[i7] <= ff_loss[i7] || (ff_dw[i7] >= TX_FIFO_CONGESTION_THR);
+        end
+
+        if (reset) begin
+            pdrop_tx_flow_vec_out  <= {(MAX_TX_FLOWS){1'b0}};
+            tx_flow_congestion_out <= {(MAX_TX_FLOWS){1'b0}};
+        end
+    end
+
     // Assign status
     assign initialized = rq_initialized & (tx_queue_addr_table_init_state == TxTblInitialized);
 
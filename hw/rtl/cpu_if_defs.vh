@@ -33,6 +33,15 @@ typedef struct packed {
     CcipMode ccip_mode;
 } NicMode;
 
+
+// =============================================================
+// Load balancing schemes of the request steering
+// This should be consistent with the LbScheme in sw/nic.h
+// =============================================================
+typedef enum logic[1:0] { lbStatic,
+                          lbRoundRobin,
+                          lbAffinity } LbScheme;
+
 typedef struct packed {
     logic  err_rpc;
     logic  err_ccip;
@@ -53,7 +62,10 @@ typedef struct packed {
 typedef enum logic[0:0] { rpcReq, rpcResp } RpcReqType;
 
 typedef struct packed {
-    logic      [4:0] padding;
+    logic      [1:0] padding;
+    logic      end_of_stream;  // last frame of a streamed response
+    logic      one_way;      // request without response
+    logic      phase;        // lap of the rx ring, set by the NIC on the way to CPU
     logic      valid;
     logic      update_flag;
     RpcReqType req_type;
@@ -62,7 +74,8 @@ typedef struct packed {
 typedef struct packed {
     logic [7:0]  connection_id;
     logic [15:0] argl;
-    logic [15:0] fn_id;
+    logic [7:0]  fn_id;
+    logic [7:0]  affinity;
     logic [7:0]  frame_id;
     logic [7:0]  n_of_frames;
     logic [31:0] rpc_id;
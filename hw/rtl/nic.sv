@@ -164,6 +164,10 @@ module nic
                         = t_ccip_mmioAddr'(SRF_BASE_MMIO_ADDRESS + 42);
     localparam t_ccip_mmioAddr addrTxQueueSize
                         = t_ccip_mmioAddr'(SRF_BASE_MMIO_ADDRESS + 44);
+    localparam t_ccip_mmioAddr addrFlowCongestion
+                        = t_ccip_mmioAddr'(SRF_BASE_MMIO_ADDRESS + 46);
+    localparam t_ccip_mmioAddr addrFlowMask
+                        = t_ccip_mmioAddr'(SRF_BASE_MMIO_ADDRESS + 48);
 
     // Registers
     t_ccip_clAddr                  iRegMemTxAddr;
@@ -183,12 +187,14 @@ module nic
     ConnSetupFrame                 iRegConnSetupFrame;
     logic                          iRegConnSetupFrame_en;
     ConnSetupStatus                iRegConnStatus;
-    logic                          iLB;
+    LbScheme                       iLB;
+    logic[2**LMAX_NUM_OF_FLOWS-1:0] iRegFlowMask;     // flows the LB steers to
     PhyAddr                        iRegPhyNetAddr;
     IPv4                           iRegIpv4NetAddr;
     logic                          iRegReadNetDropCntValid;
     logic[4:0]                     iRegReadNetDropCnt;
     logic[63:0]                    iRegNetDropCnt;
+    logic[63:0]                    iRegFlowCongestion;  // sticky until read
     NicMode                        iNicMode;
 
     // CSR read logic
@@ -269,6 +275,10 @@ module nic
                 sTx.c2.data <= iRegNetDropCnt;
             end
 
+            addrFlowCongestion: begin
+                sTx.c2.data <= iRegFlowCongestion;
+            end
+
             default: sTx.c2.data <= t_ccip_mmioData'(0);
         endcase
 
@@ -338,6 +348,10 @@ module nic
     assign is_lb_write = is_csr_write &&
                                         (mmio_req_hdr.address == addrLB);
 
+    logic is_flow_mask_write;
+    assign is_flow_mask_write = is_csr_write &&
+                                        (mmio_req_hdr.address == addrFlowMask);
+
     logic is_phy_net_addr_write;
     assign is_phy_net_addr_write = is_csr_write &&
                                         (mmio_req_hdr.address == addrPhyNetAddr);
@@ -421,6 +435,11 @@ module nic
             iLB <= sRx.c0.data[$bits(iLB)-1:0];
         end
 
+        if (is_flow_mask_write) begin
+            $display("NIC%d: iRegFlowMask received: %08h", NIC_ID, sRx.c0.data);
+            iRegFlowMask <= sRx.c0.data[$bits(iRegFlowMask)-1:0];
+        end
+
         if (is_phy_net_addr_write) begin
             iRegPhyNetAddr.b0 <= sRx.c0.data[7:0];
             iRegPhyNetAddr.b1 <= sRx.c0.data[15:8];
@@ -447,6 +466,7 @@ module nic
             iRegNicInit  <= 1'b0;
             iRegConnSetupFrame_en <= 1'b0;
             iRegReadNetDropCntValid <= 1'b0;
+            iRegFlowMask <= {($bits(iRegFlowMask)){1'b1}};
         end
     end
 
@@ -464,6 +484,9 @@ module nic
     logic to_ccip_valid;
 
     logic pdrop_tx_flows;
+    logic[2**LMAX_NUM_OF_FLOWS-1:0]      pdrop_tx_flow_vec;
+    logic[2**LMAX_NUM_OF_FLOWS-1:0]      tx_flow_congestion;
+    logic[2**LMAX_NUM_OF_FLOWS-1:0][7:0] tx_flow_occupancy;
     logic ccip_error;
 
 `ifdef CCIP_MMIO
@@ -499,13 +522,17 @@ module nic
         .rpc_flow_id_out(from_ccip.flow_id),
 
         .lb_select(iLB),
+        .flow_mask(iRegFlowMask),
 
         .ccip_tx_ready(ccip_tx_ready),
         .rpc_in(to_ccip.rpc_data),
         .rpc_in_valid(to_ccip_valid),
         .rpc_flow_id_in(to_ccip.flow_id),
 
-        .pdrop_tx_flows_out(pdrop_tx_flows)
+        .pdrop_tx_flows_out(pdrop_tx_flows),
+        .pdrop_tx_flow_vec_out(pdrop_tx_flow_vec),
+        .tx_flow_congestion_out(tx_flow_congestion),
+        .tx_flow_occupancy_out(tx_flow_occupancy)
     );
 
     // Set NIC mode infrmation register
@@ -553,6 +580,11 @@ module nic
         .pdrop_tx_flows_out(pdrop_tx_flows)
     );
 
+    // No per-flow statistics in this mode
+    assign pdrop_tx_flow_vec  = {($bits(pdrop_tx_flow_vec)){1'b0}};
+    assign tx_flow_congestion = {($bits(tx_flow_congestion)){1'b0}};
+    assign tx_flow_occupancy  = {($bits(tx_flow_occupancy)){1'b0}};
+
     // Set NIC mode infrmation register
     assign iNicMode.ccip_mode = ccipPolling;
 
@@ -599,6 +631,11 @@ module nic
         .pdrop_tx_flows_out(pdrop_tx_flows)
     );
 
+    // No per-flow statistics in this mode
+    assign pdrop_tx_flow_vec  = {($bits(pdrop_tx_flow_vec)){1'b0}};
+    assign tx_flow_congestion = {($bits(tx_flow_congestion)){1'b0}};
+    assign tx_flow_occupancy  = {($bits(tx_flow_occupancy)){1'b0}};
+
     // Set NIC mode infrmation register
     assign iNicMode.ccip_mode = ccipDMA;
 
@@ -642,13 +679,17 @@ module nic
         .rpc_flow_id_out(from_ccip.flow_id),
 
         .lb_select(iLB),
+        .flow_mask(iRegFlowMask),
 
         .ccip_tx_ready(ccip_tx_ready),
         .rpc_in(to_ccip.rpc_data),
         .rpc_in_valid(to_ccip_valid),
         .rpc_flow_id_in(to_ccip.flow_id),
 
-        .pdrop_tx_flows_out(pdrop_tx_flows)
+        .pdrop_tx_flows_out(pdrop_tx_flows),
+        .pdrop_tx_flow_vec_out(pdrop_tx_flow_vec),
+        .tx_flow_congestion_out(tx_flow_congestion),
+        .tx_flow_occupancy_out(tx_flow_occupancy)
     );
 
     // Set NIC mode infrmation register
@@ -905,16 +946,36 @@ module nic
     end
 
 
+    // =============================================================
+    // Per-flow congestion flags
+    //  - a flag is set when the flow is congested or drops, and stays set
+    //    until the register is read by software
+    // =============================================================
+    always @(posedge ccip_clk) begin
+        if (reset) begin
+            iRegFlowCongestion <= {($bits(iRegFlowCongestion)){1'b0}};
+        end else if (is_csr_read && mmio_req_hdr.address == addrFlowCongestion) begin
+            iRegFlowCongestion <= 64'(tx_flow_congestion);
+        end else begin
+            iRegFlowCongestion <= iRegFlowCongestion | 64'(tx_flow_congestion);
+        end
+    end
+
+
     // =============================================================
     // Packet counters
     // =============================================================
-    nic_counters nic_pck_counters_ (
+    nic_counters #(
+            .NUM_OF_FLOWS(2**LMAX_NUM_OF_FLOWS)
+        ) nic_pck_counters_ (
             .reset(reset),
 
             .clk_0(ccip_clk),
             .t_incoming_rpc(from_ccip_valid),
             .t_outcoming_rpc(to_ccip_valid),
             .t_pdrop_tx_flows(pdrop_tx_flows),
+            .t_pdrop_tx_flow_vec(pdrop_tx_flow_vec),
+            .tx_flow_occupancy(tx_flow_occupancy),
 
             .clk_1(network_clk),
             .t_outcoming_network_packets(network_tx.valid),
@@ -5,6 +5,10 @@
 // Description :    different nic counters
 
 module nic_counters
+    #(
+        // Number of flows with per-flow counters
+        parameter NUM_OF_FLOWS = 1
+    )
     (
     input logic reset,
 
@@ -13,6 +17,8 @@ module nic_counters
     input logic t_incoming_rpc,
     input logic t_outcoming_rpc,
     input logic t_pdrop_tx_flows,
+    input logic[NUM_OF_FLOWS-1:0]      t_pdrop_tx_flow_vec,
+    input logic[NUM_OF_FLOWS-1:0][7:0] tx_flow_occupancy,
 
     input logic clk_1,
     input logic t_outcoming_network_packets,
@@ -25,8 +31,17 @@ module nic_counters
 
     );
 
+    // Counter ids
+    //  - 0 - 4: global counters
+    //  - FLOW_DROP_CNT_BASE + flow: number of requests dropped in the flow
+    //  - FLOW_OCCUPANCY_BASE + flow: current occupancy of the flow FIFO
+    // This should be consistent with sw/nic_impl/nic_ccip.h
+    localparam FLOW_DROP_CNT_BASE  = 16;
+    localparam FLOW_OCCUPANCY_BASE = 32;
+
     // Counters
     logic[63:0] counters [5];
+    logic[63:0] flow_drop_counters [NUM_OF_FLOWS];
 
     // Count: clock domain clk_0
     logic t_incoming_rpc_d;
@@ -50,6 +65,22 @@ module nic_counters
         end
     end
 
+    // Count: clock domain clk_0, per-flow
+    logic[NUM_OF_FLOWS-1:0] t_pdrop_tx_flow_vec_d;
+
+    integer i;
+    always @(posedge clk_0) begin
+        t_pdrop_tx_flow_vec_d <= t_pdrop_tx_flow_vec;
+
+        for (i=0; i<NUM_OF_FLOWS; i=i+1) begin
+            if (reset) begin
+                flow_drop_counters[i] <= {(64){1'b0}};
+            end else if (t_pdrop_tx_flow_vec_d[i]) begin
+                flow_drop_counters[i] <= flow_drop_counters[i] + 1;
+            end
+        end
+    end
+
     // Count: clock domain clk_1
     logic t_outcoming_network_packets_d;
     logic t_incoming_network_packets_d;
@@ -73,7 +104,15 @@ module nic_counters
         if (reset) begin
             counter_value_out <= {(64){1'b0}};
         end else begin
-            counter_value_out <= counters[counter_id_in];
+            if (counter_id_in >= FLOW_OCCUPANCY_BASE &&
+                counter_id_in < FLOW_OCCUPANCY_BASE + NUM_OF_FLOWS) begin
+                counter_value_out <= 64'(tx_flow_occupancy[counter_id_in - FLOW_OCCUPANCY_BASE]);
+            end else if (counter_id_in >= FLOW_DROP_CNT_BASE &&
+                         counter_id_in < FLOW_DROP_CNT_BASE + NUM_OF_FLOWS) begin
+                counter_value_out <= flow_drop_counters[counter_id_in - FLOW_DROP_CNT_BASE];
+            end else begin
+                counter_value_out <= counters[counter_id_in];
+            end
         end
     end
 
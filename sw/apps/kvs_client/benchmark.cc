@@ -209,14 +209,14 @@ int run_set_get_benchmark(dagger::RpcClient* rpc_client,
 
     for(int i=0; i<num_iterations; ++i) {
         if (i%set_get_fraction != 0) {
-            GetRequest req;
+            GetRequest req = {};
             req.timestamp = dagger::utils::rdtsc();
            // sprintf(req.key, dataset[set_get_distr[i%50000000]+1000*thread_id].first.c_str());
             size_t data = set_get_distr[i%10000000]+1000000*thread_id;
             memcpy(req.key, &data, 8);
             rpc_client->get(req);
         } else {
-            SetRequest req;
+            SetRequest req = {};
             req.timestamp = dagger::utils::rdtsc();
             //sprintf(req.key, dataset[set_get_distr[i%50000000]+1000*thread_id].first.c_str());
             //sprintf(req.value, dataset[set_get_distr[i%50000000]+1000*thread_id].second.c_str());
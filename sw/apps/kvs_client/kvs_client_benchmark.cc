@@ -60,8 +60,6 @@ int main(int argc, char* argv[]) {
     if (res != 0)
         return res;
 
-    sleep(1);
-
     // Run client threads
     std::vector<std::thread> threads;
     for (int thread_id=0; thread_id<num_of_threads; ++thread_id) {
@@ -92,6 +92,9 @@ int main(int argc, char* argv[]) {
     if (res != 0)
         return res;
 
+    // Steer requests by key so that each thread only serves its own partition
+    server.set_lb(dagger::lb_affinity);
+
     // set and enable perf
     res = server.run_perf_thread({true, true, true}, &perf_callback);
     if (res != 0)
@@ -129,6 +132,15 @@ int main(int argc, char* argv[]) {
 
     while (keepRunning) {
         sleep(1);
+
+        // Report flows dropping requests
+        for (size_t i=0; i<num_of_threads; ++i) {
+            dagger::Nic::FlowStats stats;
+            if (server.flow_stats(i, stats) == 0 && stats.drops > 0) {
+                std::cout << "Flow " << i << ": dropped requests= " << stats.drops
+                          << ", occupancy= " << stats.occupancy << std::endl;
+            }
+        }
     }
 
     res = server.stop_all_listening_threads();
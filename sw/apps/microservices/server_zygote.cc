@@ -0,0 +1,209 @@
+/**
+ * @file server_zygote.cc
+ * @brief Zygote of a mid-tier microservice.
+ * @author Nikita Lazarev
+ */
+// A single tier of a microservice chain. Every tier serves the `process` RPC
+// and, unless it is the last tier, forwards the request downstream with the
+// depth decremented. The handler suspends on the downstream RPC, so the
+// dispatch threads keep serving new requests in the meantime.
+//
+// Chain of three tiers on one FPGA (loopback):
+//   tier 2 (leaf): dagger_server_zygote -t 1 -l 0 -s 0x20000
+//   tier 1:        dagger_server_zygote -t 1 -l 0 -s 0x40000 -d 0x60000 \
+//                      --downstream-ip 192.168.0.2
+#include <unistd.h>
+
+#include <csignal>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "config.h"
+#include "rpc_call.h"
+#include "rpc_client.h"
+#include "rpc_client_pool.h"
+#include "rpc_coro.h"
+#include "rpc_server_callback.h"
+#include "rpc_threaded_server.h"
+#include "rpc_types.h"
+#include "utils.h"
+#include "CLI11.hpp"
+
+#ifndef __cpp_impl_coroutine
+#   error The zygote requires C++20 coroutines, build WITH_COROUTINES
+#endif
+
+// HW parameters
+#ifdef PLATFORM_PAC_A10
+    static constexpr int fpga_bus = dagger::cfg::platform::pac_a10_fpga_bus_1;
+#else
+    static constexpr int fpga_bus = -1;
+#endif
+
+// Ctl-C handler
+static volatile int keepRunning = 1;
+void intHandler(int dummy) {
+    keepRunning = 0;
+}
+
+// Downstream client of each dispatch thread, indexed by thread_id; empty for
+// the last tier
+static std::vector<dagger::RpcClient*> downstream_clients;
+
+// Downstream request timeout
+static uint64_t downstream_timeout_cycles = 0;
+
+// RPC functions
+static dagger::Task<RpcRetCode> process(CallHandler handler, Request args, Response* ret);
+
+int main(int argc, char* argv[]) {
+    // Parse input
+    CLI::App app{"Microservice Zygote"};
+
+    size_t num_of_threads;
+    app.add_option("-t, --threads", num_of_threads, "number of dispatch threads")->required();
+    int load_balancer;
+    app.add_option("-l, --load-balancer", load_balancer,
+                   "load balancer (0 - static, 1 - round robin, 2 - key affinity)")->required();
+    uint64_t server_nic_address = 0x20000;
+    app.add_option("-s, --server-nic", server_nic_address, "address of the server nic");
+    uint64_t client_nic_address = 0;
+    app.add_option("-d, --downstream-nic", client_nic_address,
+                   "address of the client nic, only used with --downstream-ip");
+    std::string downstream_ip;
+    app.add_option("--downstream-ip", downstream_ip, "ip of the downstream tier, last tier if not set");
+    std::string upstream_ip = "192.168.0.1";
+    app.add_option("--upstream-ip", upstream_ip, "ip of the upstream tier");
+    size_t timeout_us = 1000;
+    app.add_option("-o, --timeout", timeout_us, "downstream request timeout in us");
+
+    CLI11_PARSE(app, argc, argv);
+
+    // Downstream clients, one per dispatch thread
+    std::unique_ptr<dagger::RpcClientPool<dagger::RpcClient>> rpc_client_pool;
+    if (!downstream_ip.empty()) {
+        rpc_client_pool.reset(
+            new dagger::RpcClientPool<dagger::RpcClient>(client_nic_address, num_of_threads));
+
+        int res = rpc_client_pool->init_nic(fpga_bus);
+        if (res != 0)
+            return res;
+
+        res = rpc_client_pool->start_nic();
+        if (res != 0)
+            return res;
+
+        for (size_t i=0; i<num_of_threads; ++i) {
+            dagger::RpcClient* rpc_client = rpc_client_pool->pop();
+            if (rpc_client == nullptr) {
+                std::cout << "Failed to get a downstream client" << std::endl;
+                return 1;
+            }
+
+            dagger::IPv4 server_addr(downstream_ip, 3136);
+            if (rpc_client->connect(server_addr, i) != 0) {
+                std::cout << "Failed to open downstream connection" << std::endl;
+                return 1;
+            }
+
+            downstream_clients.push_back(rpc_client);
+        }
+
+        uint64_t a = dagger::utils::rdtsc();
+        sleep(1);
+        uint64_t b = dagger::utils::rdtsc();
+        downstream_timeout_cycles = (b - a) / 1000000 * timeout_us;
+    }
+
+    // Server
+    dagger::RpcThreadedServer server(server_nic_address, num_of_threads);
+
+    int res = server.init_nic(fpga_bus);
+    if (res != 0)
+        return res;
+
+    res = server.start_nic();
+    if (res != 0)
+        return res;
+
+    // Open upstream connections
+    for (size_t i=0; i<num_of_threads; ++i) {
+        dagger::IPv4 client_addr(upstream_ip, 3136);
+        if (server.connect(client_addr, i, i) != 0) {
+            std::cout << "Failed to open connection on server" << std::endl;
+            return 1;
+        }
+    }
+
+    server.set_lb(load_balancer);
+
+    // Register RPC functions
+    std::vector<const void*> fn_ptr;
+    fn_ptr.push_back(reinterpret_cast<const void*>(&process));
+
+    dagger::RpcServerCallBack server_callback(fn_ptr);
+
+    for (size_t i=0; i<num_of_threads; ++i) {
+        res = server.run_new_listening_thread(&server_callback);
+        if (res != 0)
+            return res;
+    }
+
+    std::cout << "------- Zygote is running "
+              << (downstream_clients.empty() ? "as the last tier" : "as a mid-tier")
+              << "... -------" << std::endl;
+
+    std::cout << "Press Ctrl+C to stop..." << std::endl;
+    signal(SIGINT, intHandler);
+
+    while (keepRunning) {
+        sleep(1);
+    }
+
+    res = server.stop_all_listening_threads();
+    if (res != 0)
+        return res;
+
+    std::cout << "------- Zygote is stopped. -------" << std::endl;
+
+    res = server.stop_nic();
+    if (res != 0)
+        return res;
+
+    if (rpc_client_pool) {
+        res = rpc_client_pool->stop_nic();
+        if (res != 0)
+            return res;
+    }
+
+    return 0;
+}
+
+static dagger::Task<RpcRetCode> process(CallHandler handler, Request args, Response* ret) {
+    ret->timestamp = args.timestamp;
+
+    // Last tier: do the work here
+    if (args.depth == 0 || downstream_clients.empty()) {
+        ret->value = args.key;
+        co_return RpcRetCode::Success;
+    }
+
+    // Mid-tier: forward downstream; only this dispatch thread awaits on its
+    // client
+    dagger::RpcClient* rpc_client = downstream_clients[handler.thread_id];
+    auto res = co_await rpc_client->co_process({args.timestamp, args.depth - 1, args.key},
+                                               downstream_timeout_cycles);
+    if (!res.ok()) {
+#ifdef VERBOSE_RPCS
+        std::cout << "downstream request failed on thread " << handler.thread_id
+                  << " with " << res.status << std::endl;
+#endif
+        co_return RpcRetCode::Fail;
+    }
+
+    ret->value = res.resp.value + 1;
+    co_return RpcRetCode::Success;
+}
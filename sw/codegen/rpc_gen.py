@@ -14,6 +14,7 @@ from shutil import copyfile
 CLIENT_FILENAME = "rpc_client.h"
 SERVER_FILENAME = "rpc_server_callback.h"
 TYPE_HDR_FILENAME = "rpc_types.h"
+BENCH_FILENAME_PREFIX = "rpc_bench_"
 WRITE_TMPL_FILENAME = "dagger_write.tmpl"
 
 # <proto_type: (C++_type, sizeof)>
@@ -27,6 +28,18 @@ type_dict = {
 	'double': ('double', 8)
 }
 
+# <proto_type: C++_type> of variable-length fields, declared as type<max>
+var_type_dict = {
+	'bytes': 'dagger::Bytes',
+	'string': 'dagger::String'
+}
+
+# Frame geometry, must be consistent with config.h and rpc_header.h (checked
+# by the static_asserts of the generated rpc_types.h)
+CL_SIZE_BYTES = 64
+RPC_HEADER_SIZE_BYTES = 12
+RPC_PAYLOAD_SIZE_BYTES = CL_SIZE_BYTES - RPC_HEADER_SIZE_BYTES
+
 
 #
 # RPCGenerator class
@@ -35,21 +48,35 @@ class RPCGenerator:
 	#
 	# Public
 	#
-	def __init__(self, idl_file_path, src_file_path):
+	def __init__(self, idl_file_path, src_file_path, gen_bench=False):
 		self.__idl_file_path = idl_file_path
 		self.__src_file_path = src_file_path
 
+		# Whether to also generate the stub benchmarks of the services
+		self.__gen_bench = gen_bench
+
+		# <message: layout mode> of the messages annotated with [optimize]
+		# or [packed], and their fields in the declaration order
+		self.__layout_modes = {}
+		self.__declared_fields = {}
+
 	def generate(self):
 		idef = self.__read_idl_file()
 		iframes = self.__parse_frames(idef)
 
 		# Parse
 		imessages = {}
+		iaffinity = {}
 		iservices = {}
 		for f_name, f_lines in iframes:
 			if f_name == 'message':
-				name, arg_list = self.__parse_as_message(f_lines)
+				name, arg_list, affinity_key, layout_mode = self.__parse_as_message(f_lines)
 				imessages[name] = arg_list
+				if not layout_mode == None:
+					self.__layout_modes[name] = layout_mode
+					self.__declared_fields[name] = list(arg_list)
+				if not affinity_key == None:
+					iaffinity[name] = affinity_key
 
 			elif f_name == 'service':
 				name, f_list = self.__parse_as_service(f_lines)
@@ -58,19 +85,55 @@ class RPCGenerator:
 			else:
 				assert False, "Error parsing frames, undefined token"
 
-		# Generate
+		# Layout of the messages
+		ilayouts = self.__message_layouts(imessages)
+		self.__print_layout_report(imessages, ilayouts)
+
+		if len(iservices) == 0:
+			return
+
+		# Functions get globally unique ids, so several services can share
+		# the same flows: the services take consecutive ranges of the fn_id
+		# space in the order of declaration
+		fn_id_base = 0
 		for s_name, s_functions in iservices.items():
-			# Type header
-			with open(self.__src_file_path + '/' + TYPE_HDR_FILENAME, 'w+') as type_hdr_f:
-				type_hdr_f.write(self.__gen_type_hdr(imessages))
+			iservices[s_name] = [f + (fn_id_base + f[3],) for f in s_functions]
+			fn_id_base = fn_id_base + len(s_functions)
+		if fn_id_base > 256:
+			assert False, "Too many RPC functions, the fn_id space is 256"
+
+		all_functions = [f for s_functions in iservices.values() for f in s_functions]
+		self.__print_frames(imessages, ilayouts, all_functions)
 
-			# Service
-			with open(self.__src_file_path + '/' + SERVER_FILENAME, 'w+') as server_f:
+		# Generate
+		#  - each service gets its client and callback classes in the
+		#    dagger::<service> namespace; the first service is also
+		#    available as dagger::RpcClient and dagger::RpcServerCallBack
+		first_service = list(iservices.keys())[0]
+
+		# Type header
+		with open(self.__src_file_path + '/' + TYPE_HDR_FILENAME, 'w+') as type_hdr_f:
+			type_hdr_f.write(self.__gen_type_hdr(imessages, ilayouts, all_functions))
+
+		# Services
+		with open(self.__src_file_path + '/' + SERVER_FILENAME, 'w+') as server_f:
+			server_f.write(self.__gen_service_header())
+			for s_name, s_functions in iservices.items():
 				server_f.write(self.__gen_service(imessages, s_name, s_functions))
+			server_f.write(self.__gen_footer('RpcServerCallBack', first_service, '_RPC_SERVER_CALLBACK_H_'))
 
-			# Client
-			with open(self.__src_file_path + '/' + CLIENT_FILENAME, 'w+') as client_f:
-				client_f.write(self.__gen_client(imessages, s_name, s_functions))
+		# Clients
+		with open(self.__src_file_path + '/' + CLIENT_FILENAME, 'w+') as client_f:
+			client_f.write(self.__gen_client_header())
+			for s_name, s_functions in iservices.items():
+				client_f.write(self.__gen_client(imessages, iaffinity, s_name, s_functions))
+			client_f.write(self.__gen_footer('RpcClient', first_service, '_RPC_CLIENT_NONBLOCKING_H_'))
+
+		# Stub benchmarks, one source per service
+		if self.__gen_bench:
+			for s_name, s_functions in iservices.items():
+				with open(self.__src_file_path + '/' + BENCH_FILENAME_PREFIX + s_name + '.cc', 'w+') as bench_f:
+					bench_f.write(self.__gen_bench_source(imessages, s_name, s_functions))
 
 
 	#
@@ -129,25 +192,72 @@ class RPCGenerator:
 
 	def __parse_as_message(self, frame):
 		arg_list = []
+		affinity_key = None
 		for l, i in zip(frame, range(len(frame))):
 			if i == 0:
 				# First line
-				regexp = r"^message ([a-zA-Z][a-zA-Z0-9_]*) {$"
+				#  - messages can be annotated with [optimize] to reorder the
+				#    fields for the least padding, or [packed] to also pack
+				#    them and allow bit-fields
+				regexp = r"^message ([a-zA-Z][a-zA-Z0-9_]*)( \[(optimize|packed)\])? {$"
 				m = re.search(regexp, l)
 				if not m == None:
 					m_name = m.group(1)
+					layout_mode = m.group(3)
 				else:
 					assert False, "Message parsing error, wrong header format"
 
 			elif i < len(frame)-1:
 				# Body lines
-				regexp_simple = r"^([a-z][a-z0-9]*) ([a-zA-Z][a-zA-Z0-9_]*);$"
-				regexp_array = r"^([a-z][a-z0-9]*)\[([0-9]+)\] ([a-zA-Z][a-zA-Z0-9_]*);$"
+				#  - fields can be annotated with [affinity] to be used as the
+				#    request steering key, at most one per message
+				regexp_affinity = r"^(.*) \[affinity\];$"
+				m_affinity = re.search(regexp_affinity, l)
+				if not m_affinity == None:
+					l = m_affinity.group(1) + ';'
+					if not affinity_key == None:
+						assert False, "Message parsing error, more than one [affinity] field"
+
+				#  - field types are scalars or previously declared messages
+				regexp_simple = r"^([a-zA-Z][a-zA-Z0-9_]*) ([a-zA-Z][a-zA-Z0-9_]*);$"
+				regexp_array = r"^([a-zA-Z][a-zA-Z0-9_]*)\[([0-9]+)\] ([a-zA-Z][a-zA-Z0-9_]*);$"
+				regexp_var = r"^(bytes|string)<([0-9]+)> ([a-zA-Z][a-zA-Z0-9_]*);$"
+				regexp_repeated = r"^repeated ([a-zA-Z][a-zA-Z0-9_]*) ([a-zA-Z][a-zA-Z0-9_]*)\[([0-9]+)\];$"
+				regexp_bits = r"^(int8|int16|int32|int64):([0-9]+) ([a-zA-Z][a-zA-Z0-9_]*);$"
 				m = re.search(regexp_simple, l)
-				if not m == None:
+				m_var = re.search(regexp_var, l)
+				m_repeated = re.search(regexp_repeated, l)
+				m_bits = re.search(regexp_bits, l)
+				if not m_bits == None:
+					# Bit-field, the size is the scalar type and the width
+					bits_type = m_bits.group(1)
+					bits_width = int(m_bits.group(2))
+					arg_name = m_bits.group(3)
+					if bits_width == 0 or bits_width > 8*type_dict[bits_type][1]:
+						assert False, "Message parsing error, wrong bit-field width in line <" + l + ">"
+					arg_list.append(('bits', arg_name, (bits_type, bits_width)))
+					if not m_affinity == None:
+						assert False, "Message parsing error, bit-fields can not be [affinity] keys"
+				elif not m_repeated == None:
+					# Bounded list, the size is the max number of elements
+					arg_name = m_repeated.group(2)
+					arg_list.append(('repeated', arg_name, (m_repeated.group(1), int(m_repeated.group(3)))))
+					if not m_affinity == None:
+						assert False, "Message parsing error, repeated fields can not be [affinity] keys"
+				elif not m_var == None:
+					# Variable-length field, the size is the max size
+					arg_type = m_var.group(1)
+					arg_max_size = int(m_var.group(2))
+					arg_name = m_var.group(3)
+					arg_list.append((arg_type, arg_name, arg_max_size))
+					if not m_affinity == None:
+						affinity_key = arg_name
+				elif not m == None:
 					arg_type = m.group(1)
 					arg_name = m.group(2)
 					arg_list.append((arg_type, arg_name, None))
+					if not m_affinity == None:
+						affinity_key = arg_name
 				else:
 					m = re.search(regexp_array, l)
 					if not m == None:
@@ -155,6 +265,8 @@ class RPCGenerator:
 						arg_array_size = int(m.group(2))
 						arg_name = m.group(3)
 						arg_list.append((arg_type, arg_name, arg_array_size))
+						if not m_affinity == None:
+							affinity_key = arg_name
 					else:
 						assert False, "Message parsing error, wrong body format in line <" + l + ">"
 
@@ -163,7 +275,7 @@ class RPCGenerator:
 				if not l == '}':
 					assert False, "Message parsing error, missing }"
 				else:
-					return (m_name, arg_list)
+					return (m_name, arg_list, affinity_key, layout_mode)
 
 	def __parse_as_service(self, frame):
 		f_list = []
@@ -180,13 +292,32 @@ class RPCGenerator:
 
 			elif i < len(frame)-1:
 				# Body lines
-				regexp = r"^rpc ([a-zA-Z][a-zA-Z0-9_]*)\(([a-zA-Z][a-zA-Z0-9_]*)\) returns \(([a-zA-Z][a-zA-Z0-9_]*)\);$"
+				#  - `async` functions have suspendable (coroutine) handlers
+				#  - `inplace` functions take their arguments by const reference
+				#    right from the rx ring (see cfg::sys::server_inplace_dispatch)
+				#  - functions returning `void` are one-way: the server sends no
+				#    response and the client does not wait for any
+				#  - functions returning `stream <message>` answer with a sequence
+				#    of items (see rpc_stream.h)
+				regexp = r"^(async |inplace )?rpc ([a-zA-Z][a-zA-Z0-9_]*)\(([a-zA-Z][a-zA-Z0-9_]*)\) returns \((stream )?([a-zA-Z][a-zA-Z0-9_]*)\);$"
 				m = re.search(regexp, l)
 				if not m == None:
-					f_name = m.group(1)
-					arg_name = m.group(2)
-					ret_name = m.group(3)
-					f_list.append((f_name, arg_name, ret_name, f_id))
+					is_async = m.group(1) == 'async '
+					is_inplace = m.group(1) == 'inplace '
+					f_name = m.group(2)
+					arg_name = m.group(3)
+					is_stream = m.group(4) == 'stream '
+					ret_name = m.group(5)
+					if is_async and ret_name == 'void':
+						assert False, "One-way function " + f_name + " can not be async"
+					if is_stream and ret_name == 'void':
+						assert False, "Streaming function " + f_name + " must return a message"
+					if is_async and is_stream:
+						assert False, "Streaming function " + f_name + " can not be async"
+					# The stream writer releases the request slot, see rpc_stream.h
+					if is_inplace and is_stream:
+						assert False, "Streaming function " + f_name + " can not be inplace"
+					f_list.append((f_name, arg_name, ret_name, f_id, is_async, is_inplace, is_stream))
 					f_id = f_id + 1
 				else:
 					assert False, "Service parsing error, wrong body format"
@@ -198,13 +329,8 @@ class RPCGenerator:
 				else:
 					return (s_name, f_list)
 
-	def __gen_service(self, imessages, s_name, s_functions):
-		print("generating service " + s_name)
-
-		c_codegen = CodeGen()
-
-		# Generate skeleton
-		skeleton_header = \
+	def __gen_service_header(self):
+		return \
 """
 /*
  * Autogenerated with rpc_gen.py
@@ -214,22 +340,52 @@ class RPCGenerator:
 #ifndef _RPC_SERVER_CALLBACK_H_
 #define _RPC_SERVER_CALLBACK_H_
 
+#include "ccip_tx.h"
 #include "logger.h"
 #include "rpc_call.h"
 #include "rpc_header.h"
 #include "rpc_server_thread.h"
+#include "rpc_stream.h"
 #include "rx_queue.h"
 #include "utils.h"
 
+#include "rpc_coro.h"
 #include "rpc_types.h"
 
 #include <cstring>
 #include <immintrin.h>
 
 namespace dagger {
+"""
+
+	def __gen_footer(self, class_name, first_service, guard):
+		return \
+"""
+using """ + first_service + """::""" + class_name + """;
+
+}  // namespace dagger
+
+#endif // """ + guard + """
+"""
+
+	def __gen_service(self, imessages, s_name, s_functions):
+		print("generating service " + s_name)
+
+		c_codegen = CodeGen()
+
+		# Generate skeleton
+		#  - the function table of the service is indexed by the fn_id
+		#    relative to the base of the service
+		skeleton_header = \
+"""
+namespace """ + s_name + """ {
 
 class RpcServerCallBack: public RpcServerCallBack_Base {
 public:
+	// Function ids of the service: [fn_id_base, fn_id_base + num_of_functions)
+	static constexpr uint8_t fn_id_base = """ + str(s_functions[0][7] if len(s_functions) > 0 else 0) + """;
+	static constexpr size_t num_of_functions = """ + str(len(s_functions)) + """;
+
 	RpcServerCallBack(const std::vector<const void*>& rpc_fn_ptr):
 		RpcServerCallBack_Base(rpc_fn_ptr) {}
 	~RpcServerCallBack() {};
@@ -237,12 +393,20 @@ public:
 	virtual void operator()(const CallHandler handler,
 	                        const RpcPckt* rpc_in, TxQueue& tx_queue) const final {
 		uint8_t ret_buff[cfg::sys::cl_size_bytes];
-		size_t ret_size;
-		RpcRetCode ret_code;
-
-		// Check the fn_id is withing the scope
-		if (rpc_in->hdr.fn_id > rpc_fn_ptr_.size() - 1) {
-			FRPC_ERROR("Too large RPC function id is received, this call will stop here and "
+		size_t ret_size = 0;
+		RpcRetCode ret_code = RpcRetCode::Fail;
+
+		// The response is addressed with a copy of the request header: with
+		// in-place dispatch, the nic can overwrite the rx slot of the request
+		// while its handler runs
+		const RpcHeader req_hdr = rpc_in->hdr;
+
+		// Check the fn_id is within the service, and the function table has
+		// its handler
+		if (req_hdr.fn_id < fn_id_base ||
+		    static_cast<size_t>(req_hdr.fn_id - fn_id_base) >= num_of_functions ||
+		    static_cast<size_t>(req_hdr.fn_id - fn_id_base) >= rpc_fn_ptr_.size()) {
+			FRPC_ERROR("RPC function id out of the service is received, this call will stop here and "
 					   "no value will be returned\\n");
 			return;
 		}
@@ -252,10 +416,12 @@ public:
 
 		# Generate function calls
 		c_codegen.append(self.__switch_block(
-							'rpc_in->hdr.fn_id',
-							[str(f[3]) for f in s_functions],
-							[self.__gen_casted_f_call(f, imessages) for f in s_functions],
-							2
+							'req_hdr.fn_id',
+							[str(f[7]) for f in s_functions],
+							[self.__gen_async_call(f, imessages) if f[4] else self.__gen_casted_f_call(f, imessages)
+								for f in s_functions],
+							2,
+							'return;\n'
 						))
 
 		# Generate
@@ -269,8 +435,18 @@ public:
 """
 		c_codegen.append_snippet(skeleton_ret_code_check)
 
+		# Responses are written by a separate function, so suspendable
+		# handlers can send them after the dispatch has returned
 		skeleton_change_bit = \
 """
+		send_response(req_hdr, ret_buff, ret_size, tx_queue);
+	}
+
+private:
+	// Write the response to the request @param req_hdr into @param tx_queue.
+	inline void send_response(const RpcHeader& req_hdr, const uint8_t* ret_buff,
+	                          size_t ret_size, TxQueue& tx_queue) const
+	                          __attribute__((always_inline)) {
 		uint8_t change_bit;
 		char* tx_ptr = tx_queue.get_write_ptr(change_bit);
 
@@ -280,47 +456,185 @@ public:
 		# Append return code
 		c_codegen.append_from_file(WRITE_TMPL_FILENAME)
 
-		c_codegen.replace('<CONN_ID>', 'rpc_in->hdr.c_id')
-		c_codegen.replace('<RPC_ID>', 'rpc_in->hdr.rpc_id')
+		c_codegen.replace('<CONN_ID>', 'req_hdr.c_id')
+		c_codegen.replace('<RPC_ID>', 'req_hdr.rpc_id')
 		c_codegen.replace('<FUN_NUM_OF_FRAMES>', str(1))
 		c_codegen.replace('<FUN_FUNCTION_ID>', str(1))
 		c_codegen.replace('<FUN_ARG_LENGTH_BYTES>', 'ret_size')
 		c_codegen.replace('<REQ_TYPE>', 'rpc_response')
+		c_codegen.replace('<ONE_WAY>', '0')
+		c_codegen.replace('<AFFINITY>', 'req_hdr.affinity')
+		c_codegen.replace('<TX_QUEUE>', 'tx_queue')
 
-		# Make data layout for MMIO-based interface
-		c_codegen.seek('/*DATA_LAYOUT_MMIO*/')
-		c_codegen.remove_token('/*DATA_LAYOUT_MMIO*/')
+		# Make data layout
+		c_codegen.seek('/*DATA_LAYOUT*/')
+		c_codegen.remove_token('/*DATA_LAYOUT*/')
 		c_codegen.append(
 			self.__new_line(
-			self.__memcpy('request.argv', 'ret_buff', 'ret_size'), 2)
+			self.__memcpy('argv', 'ret_buff', 'ret_size'), 3).rstrip('\n')
 		)
 
-		# Make data layout for polling- and DMA-based interfaces
-		for i in range(2):
-			c_codegen.seek('/*DATA_LAYOUT*/')
-			c_codegen.remove_token('/*DATA_LAYOUT*/')
-			c_codegen.append(
-				self.__new_line(
-				self.__memcpy('tx_ptr_casted->argv', 'ret_buff', 'ret_size'), 2)
-			)
+		c_codegen.append_snippet('\t}\n')
+
+		# Generate suspendable handler wrappers
+		async_functions = [f for f in s_functions if f[4]]
+		if len(async_functions) > 0:
+			c_codegen.append('\n#ifdef __cpp_impl_coroutine\n')
+			for f in async_functions:
+				c_codegen.append(self.__gen_async_wrapper(f, imessages))
+			c_codegen.append('#endif  // __cpp_impl_coroutine\n')
 
 		skeleton_footer = \
 """
-	}
-
 };
 
-}  // namespace dagger
-
-#endif // _RPC_SERVER_CALLBACK_H_
+}  // namespace """ + s_name + """
 """
 		c_codegen.append_snippet(skeleton_footer)
 		return c_codegen.get_code()
 
+	def __gen_async_call(self, fn, imessages):
+		f_name = fn[0]
+		arg_name = fn[1]
+
+		# The handler runs as a coroutine on the scheduler of the dispatch
+		# thread, the response is sent by the wrapper when it finishes
+		result = '// Suspendable handler, see async_' + f_name + '\n'
+		result = result + '#ifdef __cpp_impl_coroutine\n'
+		result = result + '\t\t\t\tif (RpcScheduler::current() == nullptr) {\n'
+		result = result + '\t\t\t\t\tFRPC_ERROR("Suspendable RPC handlers can only be called on server threads\\n");\n'
+		result = result + '\t\t\t\t\treturn;\n'
+		result = result + '\t\t\t\t}\n'
+		if self.__is_var_message(imessages[arg_name]):
+			result = result + self.__gen_arg_decode(arg_name, 4)
+			args = 'args'
+		else:
+			args = self.__dereference(self.__reinterpret_cast(
+						self.__make_const(self.__make_ptr(arg_name)), 'rpc_in->argv'))
+		result = result + '\t\t\t\tRpcScheduler::current()->spawn(async_' + f_name + '(handler, req_hdr, ' + \
+							args + ', tx_queue));\n'
+		result = result + '#else\n'
+		result = result + '\t\t\t\tFRPC_ERROR("Suspendable RPC handlers require C++20 coroutines, "\n'
+		result = result + '\t\t\t\t           "this call will stop here and no value will be returned\\n");\n'
+		result = result + '#endif\n'
+		result = result + '\t\t\t\treturn;\n'
+
+		return result
+
+	def __gen_async_wrapper(self, fn, imessages):
+		f_name = fn[0]
+		arg_name = fn[1]
+		ret_name = fn[2]
+		rpc_id = fn[3]
+
+		result = '\t// Suspendable handler of ' + f_name + ': the request header is kept in\n'
+		result = result + '\t// the coroutine frame until the response is sent\n'
+		result = result + '\tTask<void> async_' + f_name + '(CallHandler handler, RpcHeader req_hdr, ' + \
+							arg_name + ' args, TxQueue& tx_queue) const {\n'
+		result = result + '\t\t' + ret_name + ' ret;\n'
+		result = result + '\t\tRpcRetCode ret_code = co_await ' + \
+							self.__f_call(
+								self.__closure(
+								self.__dereference(
+								self.__reinterpret_cast('Task<RpcRetCode>(*)(CallHandler, ' + arg_name + ', '
+								                        + self.__make_ptr(ret_name) + ')',
+								                        'rpc_fn_ptr_[' + str(rpc_id) + ']'))),
+								'handler, args, &ret') + ';\n'
+		result = result + '\t\tif (ret_code == RpcRetCode::Fail) {\n'
+		result = result + '\t\t\tFRPC_ERROR("RPC returned an error, this call will stop here and "\n'
+		result = result + '\t\t\t           "no value will be returned\\n");\n'
+		result = result + '\t\t\tco_return;\n'
+		result = result + '\t\t}\n\n'
+		if self.__is_var_message(imessages[ret_name]):
+			result = result + self.__gen_ret_size_check('co_return', 2)
+			result = result + '\t\tuint8_t ret_buff[sizeof(RpcPckt::argv)];\n'
+			result = result + '\t\tsend_response(req_hdr, ret_buff, ret.encode(ret_buff), tx_queue);\n'
+		else:
+			result = result + '\t\tsend_response(req_hdr, reinterpret_cast<const uint8_t*>(&ret), sizeof(' + \
+								ret_name + '), tx_queue);\n'
+		result = result + '\t}\n\n'
+
+		return result
+
 	def __gen_casted_f_call(self, fn, imessages):
 		arg_name = fn[1]
 		ret_name = fn[2]
 		rpc_id = fn[3]
+		is_inplace = fn[5]
+
+		# In-place handlers get a reference to the arguments in the request
+		arg_type = 'const ' + arg_name + '&' if is_inplace else arg_name
+
+		# Messages with variable-length fields are decoded from the request
+		# and encoded into the response
+		prologue = ''
+		is_var_arg = self.__is_var_message(imessages[arg_name])
+		if is_var_arg:
+			prologue = prologue + self.__gen_arg_decode(arg_name, 4).lstrip('\t')
+			args = 'args'
+		else:
+			args = self.__dereference(
+				   self.__reinterpret_cast(
+				   	self.__make_const(self.__make_ptr(arg_name)),
+				    'rpc_in->argv'))
+
+		# Streaming handlers write the items themselves, the stream is closed
+		# once they return; the credit grants of the client are picked up by
+		# the writer, the ones dispatched after the handler has returned are
+		# dropped
+		if self.__is_stream(fn):
+			writer_type = 'RpcStreamWriter<' + ret_name + '>'
+			result = 'if (req_hdr.ctl.one_way) {\n'
+			result = result + '\t\t\t\t\t// Credit grant of a finished stream\n'
+			result = result + '\t\t\t\t\treturn;\n'
+			result = result + '\t\t\t\t}\n'
+			if prologue != '':
+				result = result + '\t\t\t\t' + prologue
+			result = result + '\t\t\t\t' + writer_type + ' writer(req_hdr, tx_queue);\n'
+			result = result + '\t\t\t\t' + self.__assignment('ret_code',
+						  self.__new_line(
+						  self.__f_call(
+							  self.__closure(
+							  self.__dereference(
+							  self.__reinterpret_cast('RpcRetCode(*)(' + 'CallHandler' + ', '
+							                                           + arg_type + ', '
+							                                           + self.__make_ptr(writer_type) + ')',
+							                          'rpc_fn_ptr_[' + str(rpc_id) + ']')
+							  )),
+							  'handler' + ', ' + args + ', ' + self.__pointer('writer')
+						  )))
+			result = result + '\t\t\t\tif (ret_code == RpcRetCode::Fail) {\n'
+			result = result + '\t\t\t\t\tFRPC_ERROR("Streaming RPC returned an error, the stream is closed\\n");\n'
+			result = result + '\t\t\t\t}\n'
+			result = result + '\t\t\t\twriter.close();\n'
+			return result + '\t\t\t\treturn;\n'
+
+		# One-way handlers have no return value, and there is no response
+		# to report their errors in
+		if self.__is_one_way(fn):
+			cast_string = self.__new_line(
+						  self.__f_call(
+							  self.__closure(
+							  self.__dereference(
+							  self.__reinterpret_cast('RpcRetCode(*)(' + 'CallHandler' + ', ' + arg_type + ')',
+								                      'rpc_fn_ptr_[' + str(rpc_id) + ']')
+							  )),
+							  'handler' + ', ' + args
+						  ))
+			if prologue != '':
+				cast_string = prologue + '\t\t\t\t' + cast_string
+			return cast_string + '\t\t\t\t// One-way call, no response is sent\n' + '\t\t\t\treturn;\n'
+
+		# Return values with variable-length or repeated fields are
+		# constructed, the handler can not fill them in the raw buffer
+		is_var_ret = self.__is_var_message(imessages[ret_name])
+		is_constructed_ret = is_var_ret or self.__is_constructed_message(imessages, ret_name)
+		if is_constructed_ret:
+			ret = self.__pointer('ret')
+			line = ret_name + ' ret;\n'
+			prologue = prologue + (line if prologue == '' else '\t\t\t\t' + line)
+		else:
+			ret = self.__reinterpret_cast(self.__make_ptr(ret_name), 'ret_buff')
 
 		cast_string = self.__assignment('ret_code',
 					  self.__new_line(
@@ -328,36 +642,49 @@ public:
 						  self.__closure(
 						  self.__dereference(
 						  self.__reinterpret_cast('RpcRetCode(*)(' + 'CallHandler' + ', '
-						  										   + arg_name + ', '
+						  										   + arg_type + ', '
 						  	                                       + self.__make_ptr(ret_name) + ')',
 							                      'rpc_fn_ptr_[' + str(rpc_id) + ']')
 						  )),
-
-						  'handler' + ', ' +
-						  self.__dereference(
-						  self.__reinterpret_cast(
-						  	self.__make_const(self.__make_ptr(arg_name)),
-						    'rpc_in->argv')) + ', ' +
-						  self.__reinterpret_cast(
-						  	self.__make_ptr(ret_name),
-							'ret_buff')
+						  'handler' + ', ' + args + ', ' + ret
 					  )
 		))
+		if prologue != '':
+			cast_string = prologue + '\t\t\t\t' + cast_string
 
 		# Gen return size
-		ret_size_string = self.__new_line(self.__assignment('ret_size', 'sizeof(' + ret_name + ')'), 4)
+		if is_var_ret:
+			ret_size_string = self.__gen_ret_size_check('return', 4)
+			ret_size_string = ret_size_string + self.__new_line(self.__assignment('ret_size', 'ret.encode(ret_buff)'), 4)
+		elif is_constructed_ret:
+			ret_size_string = self.__new_line(self.__memcpy('ret_buff', self.__pointer('ret'), 'sizeof(' + ret_name + ')'), 4)
+			ret_size_string = ret_size_string + self.__new_line(self.__assignment('ret_size', 'sizeof(' + ret_name + ')'), 4)
+		else:
+			ret_size_string = self.__new_line(self.__assignment('ret_size', 'sizeof(' + ret_name + ')'), 4)
 
 		return cast_string + ret_size_string
 
-	def __gen_client(self, imessages, s_name, s_functions):
-		print("generating cient for service " + s_name)
-		for f in s_functions:
-			print("  <" + f[2] + " " + f[0] + "(" + f[1] + "))>")
+	def __gen_arg_decode(self, arg_name, tabs):
+		t = "".join(['\t']*tabs)
+		result = t + arg_name + ' args;\n'
+		result = result + t + 'if (!args.decode(rpc_in->argv, req_hdr.argl)) {\n'
+		result = result + t + '\tFRPC_ERROR("Malformed RPC arguments are received, this call will stop here and "\n'
+		result = result + t + '\t           "no value will be returned\\n");\n'
+		result = result + t + '\treturn;\n'
+		result = result + t + '}\n'
+		return result
 
-		c_codegen = CodeGen()
+	def __gen_ret_size_check(self, ret_stmt, tabs):
+		t = "".join(['\t']*tabs)
+		result = t + 'if (ret.encoded_size() > sizeof(RpcPckt::argv)) {\n'
+		result = result + t + '\tFRPC_ERROR("RPC return value does not fit into a frame, this call will stop here and "\n'
+		result = result + t + '\t           "no value will be returned\\n");\n'
+		result = result + t + '\t' + ret_stmt + ';\n'
+		result = result + t + '}\n'
+		return result
 
-		# Generate skeleton header
-		skeleton_header = \
+	def __gen_client_header(self):
+		return \
 """
 /*
  * Autogenerated with rpc_gen.py
@@ -367,8 +694,11 @@ public:
 #ifndef _RPC_CLIENT_NONBLOCKING_H_
 #define _RPC_CLIENT_NONBLOCKING_H_
 
+#include "ccip_tx.h"
 #include "logger.h"
 #include "rpc_client_nonblocking_base.h"
+#include "rpc_coro.h"
+#include "rpc_stream.h"
 #include "utils.h"
 
 #include "rpc_types.h"
@@ -377,11 +707,26 @@ public:
 #include <immintrin.h>
 
 namespace dagger {
+"""
+
+	def __gen_client(self, imessages, iaffinity, s_name, s_functions):
+		print("generating cient for service " + s_name)
+		for f in s_functions:
+			print("  <" + f[2] + " " + f[0] + "(" + f[1] + "))>")
+
+		c_codegen = CodeGen()
+
+		# Generate skeleton header
+		skeleton_header = \
+"""
+namespace """ + s_name + """ {
 
 class RpcClient: public RpcClientNonBlock_Base {
 public:
     RpcClient(const Nic* nic, size_t nic_flow_id, uint16_t client_id):
         RpcClientNonBlock_Base(nic, nic_flow_id, client_id) {}
+    RpcClient(RpcClientNonBlock_Base* flow_client, uint16_t client_id):
+        RpcClientNonBlock_Base(flow_client, client_id) {}
     virtual ~RpcClient() {}
 
     virtual void abstract_class() const { return; }
@@ -390,29 +735,88 @@ public:
 """
 		c_codegen.append_snippet(skeleton_header)
 
-		# Generate function calls
-		for f in s_functions:
+		# Generate function calls, each function has a non-blocking stub and
+		# a synchronous <function>_sync one
+		#  - one-way functions only have the non-blocking stub, and their
+		#    requests are not tracked as there is no response
+		#  - streaming functions only have the non-blocking stub, which takes
+		#    the stream the items are delivered to
+		for (f, is_sync) in [(f, is_sync) for f in s_functions for is_sync in (False, True)]:
+			is_one_way = self.__is_one_way(f)
+			is_stream = self.__is_stream(f)
+			if is_sync and (is_one_way or is_stream):
+				continue
+
 			f_codegen = CodeGen()
 
 			# Get name and args
 			f_name = f[0]
 			arg_name = f[1]
-			f_id = str(f[3])
+			ret_name = f[2]
+			f_id = str(f[7])
 			if arg_name in imessages:
 				msg = imessages[arg_name]
 			else:
 				assert False, "Message type " + arg_name + " not found"
 
 			# Generate function prototype
-			f_codegen.append(self.__function(
-								'int', f_name, self.__make_const(self.__make_ref(arg_name)) + ' args', 1));
+			if is_sync:
+				f_codegen.append(self.__function(
+									'int', f_name + '_sync', self.__make_const(self.__make_ref(arg_name)) + ' args, '
+									               + self.__make_ref(ret_name) + ' ret, '
+									               + 'uint64_t timeout_cycles = cfg::sys::sync_timeout_cycles', 1));
+			elif is_one_way:
+				f_codegen.append(self.__function(
+									'int', f_name, self.__make_const(self.__make_ref(arg_name)) + ' args', 1));
+			elif is_stream:
+				f_codegen.append(self.__function(
+									'int', f_name, self.__make_const(self.__make_ref(arg_name)) + ' args, '
+									               + self.__make_ref('RpcClientStream<' + ret_name + '>') + ' stream', 1));
+			else:
+				f_codegen.append(self.__function(
+									'int', f_name, self.__make_const(self.__make_ref(arg_name)) + ' args, '
+									               + 'uint64_t timeout_cycles = 0, '
+									               + 'uint32_t* issued_rpc_id = nullptr', 1));
+
+			# Steer requests by the [affinity] field if any, otherwise
+			# spread them with the rpc counter
+			if arg_name in iaffinity:
+				key = 'args.' + iaffinity[arg_name]
+				if self.__is_var_field(msg, iaffinity[arg_name]):
+					# Only the used bytes of variable-length keys
+					affinity = 'utils::affinity_hash(' + key + '.data(), ' + key + '.size())'
+				else:
+					affinity = 'utils::affinity_hash(' + self.__pointer(key) + ', sizeof(' + key + '))'
+			else:
+				affinity = 'static_cast<uint8_t>(rpc_cnt)'
+
+			# Messages with variable-length fields are sent encoded, check
+			# they fit before taking a tx slot
+			is_var_arg = self.__is_var_message(msg)
+			if is_var_arg:
+				f_codegen.append(
+"""
+	    // Variable-length arguments are sent encoded, they must fit one frame
+	    size_t argl = args.encoded_size();
+	    if (argl > sizeof(RpcPckt::argv)) {
+	        FRPC_ERROR("RPC arguments of %zu bytes do not fit into a frame\\n", argl);
+	        return rpc_fail;
+	    }
+""")
 
 			# Generate function header
 			f_codegen.append(
 """
+	    // Back-off if the flow is congested
+	    if (check_congestion_ && nic_->is_flow_congested(nic_flow_id_)) {
+	        return rpc_congested;
+	    }
+
 	    // Get current buffer pointer
 	    uint8_t change_bit;
-	    char* tx_ptr = tx_queue_.get_write_ptr(change_bit);
+	    uint16_t rpc_cnt;
+	    uint64_t tx_ticket;
+	    char* tx_ptr = reserve_tx_slot(change_bit, rpc_cnt, tx_ticket);
 	    if (tx_ptr >= nic_->get_tx_buff_end()) {
 	        FRPC_ERROR("Nic tx buffer overflow \\n");
 	        assert(false);
@@ -420,7 +824,31 @@ public:
 	    assert(reinterpret_cast<size_t>(tx_ptr) % nic_->get_mtu_size_bytes() == 0);
 
 	    // Make RPC id
-	    uint32_t rpc_id = client_id_ | static_cast<uint32_t>(rpc_id_cnt_ << 16);
+	    uint32_t rpc_id = client_id_ | static_cast<uint32_t>(rpc_cnt << 16);
+""")
+			if not is_one_way and not is_stream:
+				f_codegen.append(
+"""
+	    // Register as outstanding before the response can arrive
+""")
+			if is_one_way:
+				f_codegen.append('\n')
+			elif is_stream:
+				f_codegen.append(
+"""
+	    // Register the stream before its items can arrive, the credit grants
+	    // are steered like the request
+	    uint8_t affinity = """ + affinity + """;
+	    track_stream_request(rpc_id, """ + f_id + """, affinity, stream);
+""")
+			elif is_sync:
+				f_codegen.append(
+"""	    track_sync_request(rpc_id);
+""")
+			else:
+				f_codegen.append(
+"""	    track_request(rpc_id, timeout_cycles);
+	    if (issued_rpc_id != nullptr) *issued_rpc_id = rpc_id;
 """)
 			# Append buffer writing template
 			f_codegen.append_from_file(WRITE_TMPL_FILENAME)
@@ -430,36 +858,46 @@ public:
 			f_codegen.replace('<RPC_ID>', 'rpc_id')
 			f_codegen.replace('<FUN_NUM_OF_FRAMES>', str(1))
 			f_codegen.replace('<FUN_FUNCTION_ID>', f_id)
-			f_codegen.replace('<FUN_ARG_LENGTH_BYTES>', 'sizeof(' + arg_name + ')')
+			if is_var_arg:
+				f_codegen.replace('<FUN_ARG_LENGTH_BYTES>', 'static_cast<uint16_t>(argl)')
+			else:
+				f_codegen.replace('<FUN_ARG_LENGTH_BYTES>', 'sizeof(' + arg_name + ')')
 			f_codegen.replace('<REQ_TYPE>', 'rpc_request')
+			f_codegen.replace('<ONE_WAY>', '1' if is_one_way else '0')
 
-			# Make data layout for MMIO-based interface
-			f_codegen.seek('/*DATA_LAYOUT_MMIO*/')
-			f_codegen.remove_token('/*DATA_LAYOUT_MMIO*/')
-			f_codegen.append(
-				self.__new_line(
-				self.__memcpy('request.argv',
-					          self.__reinterpret_cast(self.__make_const(self.__make_ptr('void')), self.__pointer('args')),
-					          'sizeof(' + arg_name + ')'), 2)
-			)
-
-			# Make data layout for polling- and DMA-based interfaces
-			for i in range(2):
-				f_codegen.seek('/*DATA_LAYOUT*/')
-				f_codegen.remove_token('/*DATA_LAYOUT*/')
+			f_codegen.replace('<AFFINITY>', 'affinity' if is_stream else affinity)
+			f_codegen.replace('<TX_QUEUE>', '*tx_q_')
+
+			# Make data layout, the same for all the transports
+			f_codegen.seek('/*DATA_LAYOUT*/')
+			f_codegen.remove_token('/*DATA_LAYOUT*/')
+			if is_var_arg:
+				f_codegen.append(self.__new_line(
+								 self.__f_call('args.encode', 'argv'), 3).rstrip('\n')
+				)
+			else:
 				f_codegen.append(self.__new_line(
 								 self.__assignment(
 									 self.__dereference(
 									 self.__reinterpret_cast(
 									 	self.__make_ptr(arg_name),
-									 	'tx_ptr_casted->argv')),
-									 'args'), 2)
+									 	'argv')),
+									 'args'), 3).rstrip('\n')
 				)
 
 			# Generate function footer
-			f_codegen.append("""
+			if is_sync:
+				f_codegen.append("""
+
+        publish_tx_slot(tx_ticket);
+
+        // Wait for the response on this thread
+        return wait_sync_response(rpc_id, timeout_cycles, ret);
+}\n""")
+			else:
+				f_codegen.append("""
 
-        ++rpc_id_cnt_;
+        publish_tx_slot(tx_ticket);
 
         return 0;
 }\n""")
@@ -467,31 +905,204 @@ public:
 			# Append function
 			c_codegen.append_codegen(f_codegen)
 
+		# Generate awaitable variants of the function calls
+		c_codegen.append_snippet("""
+#ifdef __cpp_impl_coroutine
+    // Awaitable section
+""")
+		for f in s_functions:
+			if self.__is_one_way(f) or self.__is_stream(f):
+				continue
+
+			f_name = f[0]
+			arg_name = f[1]
+			ret_name = f[2]
+			if ret_name not in imessages:
+				assert False, "Message type " + ret_name + " not found"
+
+			c_codegen.append_snippet("""
+    RpcAwait<""" + ret_name + """> co_""" + f_name + """(const """ + arg_name + """& args, uint64_t timeout_cycles = 0) {
+        uint32_t rpc_id = 0;
+        int res = """ + f_name + """(args, timeout_cycles, &rpc_id);
+        return RpcAwait<""" + ret_name + """>(get_completion_queue(), res, rpc_id);
+    }
+""")
+		c_codegen.append_snippet("""#endif
+""")
+
 		# Generate skeleton footer
 		skeleton_footer = \
 """
 };
 
-}  // namespace dagger
-
-#endif // _RPC_CLIENT_NONBLOCKING_H_
+}  // namespace """ + s_name + """
 """
 
 		c_codegen.append_snippet(skeleton_footer)
 		return c_codegen.get_code()
 
-	def __gen_type_hdr(self, imessages):
+	def __gen_bench_source(self, imessages, s_name, s_functions):
+		print("generating stub benchmarks for service " + s_name)
+
+		# Google Benchmark source measuring the stubs of the service without
+		# a nic (see microbenchmarks/benchmark_stubs/stub_bench.h):
+		#  - ClientEncode: client stub writing the request into a host tx ring
+		#  - ServerDispatch: server callback decoding the request, calling a
+		#    no-op handler and writing the response
+		#  - ResponseEncode: writing the response alone, so the decode and
+		#    dispatch cost is the difference of the two
+		# Synchronous stubs wait for responses and streaming ones for the end
+		# of the streams, so only the non-blocking stubs of the other
+		# functions are measured on the client; suspendable handlers need
+		# the scheduler of a server thread, so they are not dispatched
+		result = \
+"""
+/*
+ * Autogenerated with rpc_gen.py
+ *
+ *        DO NOT CHANGE
+*/
+#include "stub_bench.h"
+
+#include "rpc_client.h"
+#include "rpc_server_callback.h"
+
+#include <vector>
+
+namespace dagger {
+
+// No-op handlers of """ + s_name + """
+"""
+		for f in s_functions:
+			f_name = f[0]
+			arg_name = f[1]
+			ret_name = f[2]
+			if f[4]:
+				continue
+
+			arg_type = 'const ' + arg_name + '&' if f[5] else arg_name
+			if self.__is_one_way(f):
+				args = 'CallHandler, ' + arg_type
+			elif self.__is_stream(f):
+				args = 'CallHandler, ' + arg_type + ', RpcStreamWriter<' + ret_name + '>*'
+			else:
+				args = 'CallHandler, ' + arg_type + ', ' + ret_name + '*'
+			result = result + 'static RpcRetCode ' + s_name + '_' + f_name + '_noop(' + args + ') {\n'
+			result = result + '\treturn RpcRetCode::Success;\n'
+			result = result + '}\n\n'
+
+		# Function table of the service, indexed by the local function id; the
+		# server callback keeps a reference to it
+		result = result + 'static const std::vector<const void*> ' + s_name + '_noop_handlers = {\n'
+		for f in s_functions:
+			if f[4]:
+				result = result + '\tnullptr,\n'
+			else:
+				result = result + '\treinterpret_cast<const void*>(&' + s_name + '_' + f[0] + '_noop),\n'
+		result = result + '};\n'
+
+		for f in s_functions:
+			f_name = f[0]
+			arg_name = f[1]
+			ret_name = f[2]
+			f_id = str(f[7])
+			bm_name = 'BM_' + s_name + '_' + f_name
+
+			if not self.__is_stream(f):
+				result = result + """
+static void """ + bm_name + """_ClientEncode(benchmark::State& state) {
+	bench::HostNic nic;
+	""" + s_name + """::RpcClient client(&nic, 0, 1);
+	""" + arg_name + """ args = """ + arg_name + """();
+
+	uint64_t start_tsc = utils::rdtsc();
+	for (auto _ : state) {
+		benchmark::DoNotOptimize(client.""" + f_name + """(args));
+	}
+	bench::report_cycles(state, start_tsc);
+}
+BENCHMARK(""" + bm_name + """_ClientEncode);
+"""
+
+			if not f[4]:
+				result = result + """
+static void """ + bm_name + """_ServerDispatch(benchmark::State& state) {
+	bench::HostTxRing tx_ring;
+	""" + s_name + """::RpcServerCallBack callback(""" + s_name + """_noop_handlers);
+	RpcPckt request = bench::make_request(""" + f_id + """, """ + arg_name + """());
+
+	uint64_t start_tsc = utils::rdtsc();
+	for (auto _ : state) {
+		callback({0}, &request, tx_ring.get());
+		benchmark::ClobberMemory();
+	}
+	bench::report_cycles(state, start_tsc);
+}
+BENCHMARK(""" + bm_name + """_ServerDispatch);
+"""
+
+			if not self.__is_one_way(f):
+				result = result + """
+static void """ + bm_name + """_ResponseEncode(benchmark::State& state) {
+	bench::HostTxRing tx_ring;
+	RpcHeader req_hdr = bench::make_request(""" + f_id + """, """ + arg_name + """()).hdr;
+	""" + ret_name + """ ret = """ + ret_name + """();
+
+	uint64_t start_tsc = utils::rdtsc();
+	for (auto _ : state) {
+		bench::send_response(req_hdr, ret, tx_ring.get());
+		benchmark::ClobberMemory();
+	}
+	bench::report_cycles(state, start_tsc);
+}
+BENCHMARK(""" + bm_name + """_ResponseEncode);
+"""
+
+		result = result + """
+}  // namespace dagger
+"""
+		return result
+
+	def __gen_type_hdr(self, imessages, ilayouts, s_functions):
 		skeleton_header = \
 """
 #ifndef _RPC_TYPES_H_
 #define _RPC_TYPES_H_
 
+#include "rpc_bytes.h"
+#include "rpc_header.h"
+
 """
+		rpc_messages = set([f[1] for f in s_functions] + [f[2] for f in s_functions if not self.__is_one_way(f)])
+
 		body = ""
 		for (name, arg_list) in imessages.items():
 			body = body + self.__c_struct(name, arg_list)
+
+			# The layout must be the one the frame counts were computed for,
+			# and the messages sent as they are must fit into a frame
+			(size, align) = ilayouts[name]
+			body = body + 'static_assert(sizeof(' + name + ') == ' + str(size) + ' && alignof(' + name + ') == ' \
+			            + str(align) + ',\n'
+			body = body + '              "' + name + ' layout differs from the one computed by rpc_gen.py");\n'
+			if name in rpc_messages and not self.__is_var_message(arg_list):
+				body = body + 'static_assert(sizeof(' + name + ') <= dagger::cfg::sys::cl_size_bytes - ' \
+				            + 'dagger::rpc_header_size_bytes,\n'
+				body = body + '              "' + name + ' does not fit into a frame");\n'
 			body = body + '\n'
 
+			# Messages with variable-length fields are decoded from the
+			# wire, also by the awaitable stubs, and encoded into the items of
+			# streams
+			if self.__is_var_message(arg_list):
+				body = body + 'inline bool rpc_decode(const uint8_t* argv, size_t argl, ' + name + '& msg) {\n'
+				body = body + '\treturn msg.decode(argv, argl);\n'
+				body = body + '}\n\n'
+				body = body + 'inline size_t rpc_encode(const ' + name + '& msg, uint8_t* argv, size_t max_argl) {\n'
+				body = body + '\tif (msg.encoded_size() > max_argl) return 0;\n'
+				body = body + '\treturn msg.encode(argv);\n'
+				body = body + '}\n\n'
+
 		skeleton_footer = \
 """
 #endif	// _RPC_TYPES_H_
@@ -537,13 +1148,16 @@ public:
 	def __var_def(self, type_, name):
 		return type_ + ' ' + name
 
-	def __switch_block(self, var_name, case_var_list, case_list, tabs=0):
+	def __switch_block(self, var_name, case_var_list, case_list, tabs=0, default_case=None):
 		result = "".join(['\t']*tabs) + 'switch (' + var_name + ') {\n'
 		for case_var, case in zip(case_var_list, case_list):
 			result = result + "".join(['\t']*(tabs+1)) + 'case ' + case_var + ': {\n'
 			result = result + "".join(['\t']*(tabs+2)) + case
 			result = result + "".join(['\t']*(tabs+2)) + 'break;\n'
 			result = result + "".join(['\t']*(tabs+1)) + '}\n'
+		if default_case is not None:
+			result = result + "".join(['\t']*(tabs+1)) + 'default:\n'
+			result = result + "".join(['\t']*(tabs+2)) + default_case
 		result = result + "".join(['\t']*tabs) + '}\n'
 
 		return result
@@ -551,21 +1165,323 @@ public:
 	def __function(self, ret_type, name, args, tabs=0):
 		return "".join(['\t']*tabs) + ret_type + ' ' + name + '(' + args + ') {\n'
 
+	def __c_type(self, type_):
+		# Scalars are mapped to C++ types, messages are used as they are
+		if type_ in type_dict:
+			return type_dict[type_][0]
+		return type_
+
+	def __message_layouts(self, imessages):
+		# <message: (sizeof, alignof)> of the generated structs, messages
+		# can only nest the ones declared before them
+		layouts = {}
+		self.__declared_sizes = {}
+		for (name, arg_list) in imessages.items():
+			mode = self.__layout_modes.get(name)
+			fields = []
+			bits = []
+			for arg in arg_list:
+				if arg[0] == 'bits':
+					if not mode == 'packed':
+						assert False, "Message " + name + " has bit-fields, they are only supported in [packed] messages"
+					if self.__is_var_message(arg_list):
+						assert False, "Message " + name + " has bit-fields and variable-length fields"
+					bits.append(arg)
+				else:
+					fields.append((arg, self.__field_layout(imessages, layouts, name, arg[0], arg[2])))
+
+			# As declared, bit-fields taking their whole type
+			declared = []
+			for arg in arg_list:
+				if arg[0] == 'bits':
+					declared.append((type_dict[arg[2][0]][1], type_dict[arg[2][0]][1]))
+				else:
+					declared.append(self.__field_layout(imessages, layouts, name, arg[0], arg[2]))
+			self.__declared_sizes[name] = self.__struct_layout(declared)[0]
+
+			if mode == None:
+				layouts[name] = self.__struct_layout([l for (_, l) in fields])
+				continue
+
+			# Optimized: the most aligned fields go first, so no padding is
+			# needed in between, and the bit-fields go last, next to each
+			# other (the sort is stable)
+			fields = sorted(fields, key=lambda f: -f[1][1])
+			imessages[name] = [arg for (arg, _) in fields] + bits
+
+			if mode == 'packed':
+				# No padding at all, the bit-fields take their width only
+				size = sum([l[0] for (_, l) in fields])
+				size = size + (sum([arg[2][1] for arg in bits]) + 7) // 8
+				layouts[name] = (max(size, 1), 1)
+			else:
+				layouts[name] = self.__struct_layout([l for (_, l) in fields])
+
+		return layouts
+
+	def __struct_layout(self, field_layouts):
+		# (sizeof, alignof) of the struct with the fields @field_layouts
+		offset = 0
+		align = 1
+		for (f_size, f_align) in field_layouts:
+			offset = self.__round_up(offset, f_align) + f_size
+			align = max(align, f_align)
+
+		return (max(self.__round_up(offset, align), 1), align)
+
+	def __print_layout_report(self, imessages, ilayouts):
+		# Report the bytes saved by the layout optimizer, and the ones it
+		# could save
+		report = []
+		for name in imessages:
+			declared = self.__declared_sizes[name]
+			size = ilayouts[name][0]
+			mode = self.__layout_modes.get(name)
+			if not mode == None:
+				report.append("  <" + name + " [" + mode + "]: " + str(size) + " B, " + str(declared) + " B as declared, " \
+				              + str(declared - size) + " B saved>")
+			elif not self.__is_var_message(imessages[name]):
+				packed = sum([self.__field_layout(imessages, ilayouts, name, arg[0], arg[2])[0] for arg in imessages[name]])
+				if packed < size:
+					report.append("  <" + name + ": " + str(size) + " B, " + str(packed) + " B with [packed]>")
+
+		if len(report) > 0:
+			print("layout optimizer:")
+			for l in report:
+				print(l)
+
+	def __field_layout(self, imessages, layouts, msg, arg_type, arg_array_size):
+		# (sizeof, alignof) of the field, following the natural alignment
+		# rules of the x86-64 ABI
+		if arg_type in var_type_dict:
+			l = self.__len_size(arg_array_size)
+			buff = arg_array_size + 1 if arg_type == 'string' else arg_array_size
+			return (self.__round_up(l + buff, l), l)
+
+		if arg_type == 'repeated':
+			(elem_type, max_size) = arg_array_size
+			(e_size, e_align) = self.__type_layout(imessages, layouts, msg, elem_type)
+			l = self.__len_size(max_size)
+			align = max(l, e_align)
+			return (self.__round_up(self.__round_up(l, e_align) + max_size*e_size, align), align)
+
+		(size, align) = self.__type_layout(imessages, layouts, msg, arg_type)
+		if not arg_array_size == None:
+			size = size * arg_array_size
+		return (size, align)
+
+	def __type_layout(self, imessages, layouts, msg, type_):
+		if type_ in type_dict:
+			return (type_dict[type_][1], type_dict[type_][1])
+		if not type_ in layouts:
+			assert False, "Message " + msg + " uses type " + type_ + ", which is neither a scalar nor a message declared before it"
+		if self.__is_var_message(imessages[type_]):
+			assert False, "Message " + type_ + " has variable-length fields and can not be nested into " + msg
+		return layouts[type_]
+
+	def __len_size(self, max_size):
+		# See LenType of VarBytes and Repeated
+		return 1 if max_size < 256 else 2
+
+	def __round_up(self, x, align):
+		return (x + align - 1) // align * align
+
+	def __print_frames(self, imessages, ilayouts, s_functions):
+		# Report how many frames the RPC messages take
+		print("message layouts (" + str(RPC_PAYLOAD_SIZE_BYTES) + " B of payload per frame):")
+		rpc_messages = []
+		for f in s_functions:
+			for m in (f[1], f[2]):
+				if m == 'void':
+					continue
+				if not m in imessages:
+					assert False, "Message type " + m + " not found"
+				if not m in rpc_messages:
+					rpc_messages.append(m)
+
+		for m in rpc_messages:
+			if self.__is_var_message(imessages[m]):
+				# Encoded, only the used bytes are sent
+				min_size = 0
+				max_size = 0
+				for (arg_type, arg_name, arg_array_size) in imessages[m]:
+					if arg_type in var_type_dict:
+						l = self.__len_size(arg_array_size)
+						min_size = min_size + l
+						max_size = max_size + l + arg_array_size
+					else:
+						f_size = self.__field_layout(imessages, ilayouts, m, arg_type, arg_array_size)[0]
+						min_size = min_size + f_size
+						max_size = max_size + f_size
+				min_frames = max((min_size + RPC_PAYLOAD_SIZE_BYTES - 1) // RPC_PAYLOAD_SIZE_BYTES, 1)
+				max_frames = (max_size + RPC_PAYLOAD_SIZE_BYTES - 1) // RPC_PAYLOAD_SIZE_BYTES
+				print("  <" + m + ": " + str(min_size) + ".." + str(max_size) + " B encoded, " + str(min_frames) + ".." \
+				      + str(max_frames) + " frame(s)>")
+				if min_size > RPC_PAYLOAD_SIZE_BYTES:
+					print("WARNING: " + m + " never fits into a frame")
+			else:
+				size = ilayouts[m][0]
+				frames = (size + RPC_PAYLOAD_SIZE_BYTES - 1) // RPC_PAYLOAD_SIZE_BYTES
+				print("  <" + m + ": " + str(size) + " B, " + str(frames) + " frame(s)>")
+				if frames > 1:
+					print("WARNING: " + m + " does not fit into a frame, the generated code will not compile")
+
+	def __is_constructed_message(self, imessages, name):
+		# Whether the message has a default constructor, i.e. has repeated
+		# fields itself or in the nested messages
+		for (arg_type, arg_name, arg_array_size) in imessages[name]:
+			if arg_type == 'repeated' or arg_type in var_type_dict:
+				return True
+			if arg_type in imessages and self.__is_constructed_message(imessages, arg_type):
+				return True
+		return False
+
+	def __is_one_way(self, fn):
+		return fn[2] == 'void'
+
+	def __is_stream(self, fn):
+		return fn[6]
+
+	def __is_var_message(self, arg_list):
+		return any(arg_type in var_type_dict for (arg_type, _, _) in arg_list)
+
+	def __is_var_field(self, arg_list, name):
+		return any(arg_type in var_type_dict and arg_name == name for (arg_type, arg_name, _) in arg_list)
+
 	def __c_struct(self, name, arg_list, tabs=0):
-		result = "".join(['\t']*tabs) + "struct " + name + " {\n";
+		if self.__layout_modes.get(name) == 'packed':
+			result = "".join(['\t']*tabs) + "struct __attribute__((__packed__)) " + name + " {\n";
+		else:
+			result = "".join(['\t']*tabs) + "struct " + name + " {\n";
 		for (arg_type, arg_name, arg_array_size) in arg_list:
-			if arg_array_size == None:
-				# Simple field
-				result = result + "".join(['\t']*(tabs+1)) + type_dict[arg_type][0] + ' ' + arg_name + ';\n'
+			if arg_type == 'bits':
+				# Bit-field
+				(bits_type, bits_width) = arg_array_size
+				result = result + "".join(['\t']*(tabs+1)) + type_dict[bits_type][0] + ' ' + arg_name + ' : ' \
+				                + str(bits_width) + ';\n'
+			elif arg_type in var_type_dict:
+				# Variable-length field
+				result = result + "".join(['\t']*(tabs+1)) + var_type_dict[arg_type] + '<' \
+				                + str(arg_array_size) + '> ' + arg_name + ';\n'
+			elif arg_type == 'repeated':
+				# Bounded list
+				(elem_type, max_size) = arg_array_size
+				result = result + "".join(['\t']*(tabs+1)) + 'dagger::Repeated<' + self.__c_type(elem_type) + ', ' \
+				                + str(max_size) + '> ' + arg_name + ';\n'
+			elif arg_array_size == None:
+				# Simple or nested field
+				result = result + "".join(['\t']*(tabs+1)) + self.__c_type(arg_type) + ' ' + arg_name + ';\n'
 			else:
 				# Array field
-				result = result + "".join(['\t']*(tabs+1)) + type_dict[arg_type][0] + ' ' \
+				result = result + "".join(['\t']*(tabs+1)) + self.__c_type(arg_type) + ' ' \
 				                + arg_name + '[' + str(arg_array_size) + ']' + ';\n'
 
+		if name in self.__layout_modes:
+			result = result + self.__c_struct_ctor(name, arg_list, tabs+1)
+
+		if self.__is_var_message(arg_list):
+			result = result + self.__c_struct_codec(arg_list, tabs+1)
+
 		result = result + "".join(['\t']*tabs) + "};\n"
 
 		return result;
 
+	def __c_struct_ctor(self, name, arg_list, tabs):
+		# The optimizer reorders the fields, so brace-initialization
+		# follows the declaration order through this constructor
+		t = "".join(['\t']*tabs)
+		params = []
+		for (arg_type, arg_name, arg_array_size) in self.__declared_fields[name]:
+			if arg_type == 'bits':
+				params.append(type_dict[arg_array_size[0]][0] + ' ' + arg_name)
+			elif arg_type in var_type_dict:
+				params.append('const ' + var_type_dict[arg_type] + '<' + str(arg_array_size) + '>& ' + arg_name)
+			elif arg_type == 'repeated':
+				(elem_type, max_size) = arg_array_size
+				params.append('const dagger::Repeated<' + self.__c_type(elem_type) + ', ' + str(max_size) + '>& '
+				              + arg_name)
+			elif arg_array_size == None:
+				if arg_type in type_dict:
+					params.append(self.__c_type(arg_type) + ' ' + arg_name)
+				else:
+					params.append('const ' + arg_type + '& ' + arg_name)
+			else:
+				params.append('const ' + self.__c_type(arg_type) + ' (&' + arg_name + ')[' + str(arg_array_size) + ']')
+
+		# Arrays are copied in the body, the rest is initialized in the
+		# layout order
+		inits = []
+		copies = []
+		for (arg_type, arg_name, arg_array_size) in arg_list:
+			is_array = not arg_array_size == None and not arg_type in var_type_dict \
+			           and not arg_type in ('bits', 'repeated')
+			if is_array:
+				copies.append(self.__memcpy('this->' + arg_name, arg_name, 'sizeof(this->' + arg_name + ')'))
+			else:
+				inits.append(arg_name + '(' + arg_name + ')')
+
+		result = '\n' + t + '// Fields are reordered by the layout optimizer, these take them in\n'
+		result = result + t + '// the declaration order\n'
+		result = result + t + name + '() = default;\n'
+		result = result + t + name + '(' + ', '.join(params) + ')'
+		if len(inits) > 0:
+			result = result + '\n' + t + '\t: ' + ', '.join(inits)
+		if len(copies) == 0:
+			result = result + ' {}\n'
+		else:
+			result = result + ' {\n'
+			for c in copies:
+				result = result + t + '\t' + c + ';\n'
+			result = result + t + '}\n'
+
+		return result
+
+	def __c_struct_codec(self, arg_list, tabs):
+		t = "".join(['\t']*tabs)
+		result = '\n' + t + '// Compact wire encoding: the fields are packed back to back,\n'
+		result = result + t + '// variable-length ones as their length and used bytes only\n'
+
+		# Encoded size
+		sizes = []
+		for (arg_type, arg_name, _) in arg_list:
+			if arg_type in var_type_dict:
+				sizes.append(arg_name + '.encoded_size()')
+			else:
+				sizes.append('sizeof(' + arg_name + ')')
+		result = result + t + 'size_t encoded_size() const {\n'
+		result = result + t + '\treturn ' + ' + '.join(sizes) + ';\n'
+		result = result + t + '}\n\n'
+
+		# Encoder
+		result = result + t + 'size_t encode(uint8_t* out) const {\n'
+		result = result + t + '\tuint8_t* p = out;\n'
+		for (arg_type, arg_name, _) in arg_list:
+			if arg_type in var_type_dict:
+				result = result + t + '\tp += ' + arg_name + '.encode(p);\n'
+			else:
+				result = result + t + '\tmemcpy(p, &' + arg_name + ', sizeof(' + arg_name + '));\n'
+				result = result + t + '\tp += sizeof(' + arg_name + ');\n'
+		result = result + t + '\treturn static_cast<size_t>(p - out);\n'
+		result = result + t + '}\n\n'
+
+		# Decoder
+		result = result + t + 'bool decode(const uint8_t* in, size_t len) {\n'
+		result = result + t + '\t// len comes from the wire, it can not exceed the frame\n'
+		result = result + t + '\tif (len > sizeof(dagger::RpcPckt::argv)) return false;\n'
+		result = result + t + '\tconst uint8_t* p = in;\n'
+		result = result + t + '\tconst uint8_t* end = in + len;\n'
+		for (arg_type, arg_name, _) in arg_list:
+			if arg_type in var_type_dict:
+				result = result + t + '\tif (!' + arg_name + '.decode(p, end)) return false;\n'
+			else:
+				result = result + t + '\tif (static_cast<size_t>(end - p) < sizeof(' + arg_name + ')) return false;\n'
+				result = result + t + '\tmemcpy(&' + arg_name + ', p, sizeof(' + arg_name + '));\n'
+				result = result + t + '\tp += sizeof(' + arg_name + ');\n'
+		result = result + t + '\treturn true;\n'
+		result = result + t + '}\n'
+
+		return result
+
 	def __memcpy(self, dest, src, size):
 		return "memcpy(" + dest + ', ' + src + ', ' + size + ")"
 
@@ -574,7 +1490,8 @@ public:
 # Main
 #
 def main():
-	rpc_gen = RPCGenerator(sys.argv[1], sys.argv[2])
+	# rpc_gen.py <idl file> <output dir> [--bench]
+	rpc_gen = RPCGenerator(sys.argv[1], sys.argv[2], len(sys.argv) > 3 and sys.argv[3] == '--bench')
 	rpc_gen.generate()
 
 if __name__ == "__main__":
@@ -0,0 +1,157 @@
+#include <unistd.h>
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+#include "defs.h"
+#include "config.h"
+#include "rpc_call.h"
+#include "rpc_client.h"
+#include "rpc_client_pool.h"
+#include "rpc_coro.h"
+#include "rpc_types.h"
+#include "utils.h"
+#include "CLI11.hpp"
+
+#ifndef __cpp_impl_coroutine
+#   error The benchmark requires C++20 coroutines, build WITH_COROUTINES
+#endif
+
+// HW parameters
+#ifdef PLATFORM_PAC_A10
+    // Allocate FPGA on bus_1 for the client when running on PAC_A10
+    static constexpr int fpga_bus = dagger::cfg::platform::pac_a10_fpga_bus_1;
+#else
+    // Only loopback is possible here, so -1 for bus
+    static constexpr int fpga_bus = -1;
+#endif
+
+// Client NIC is always at 0x00000, the latency/throughput server runs at 0x20000
+static constexpr uint64_t nic_address = 0x00000;
+
+static double rdtsc_in_ns() {
+    uint64_t a = dagger::utils::rdtsc();
+    sleep(1);
+    uint64_t b = dagger::utils::rdtsc();
+
+    return (b - a)/1000000000.0;
+}
+
+struct ChainStats {
+    size_t completed = 0;
+    size_t failed = 0;
+    std::vector<uint64_t> latency;
+};
+
+// Independent request chain: every request is issued after the response to
+// the previous one
+static dagger::Task<void> request_chain(dagger::RpcClient* rpc_client,
+                                        size_t num_iterations,
+                                        uint64_t timeout_cycles,
+                                        ChainStats& stats) {
+    for (size_t i=0; i<num_iterations; ++i) {
+        uint64_t start = dagger::utils::rdtsc();
+        auto res = co_await rpc_client->co_loopback({start, i}, timeout_cycles);
+        if (!res.ok()) {
+            ++stats.failed;
+            continue;
+        }
+
+        stats.latency.push_back(dagger::utils::rdtsc() - start);
+        ++stats.completed;
+    }
+}
+
+// Keep many request chains in flight on a single core
+int main(int argc, char* argv[]) {
+    // Parse input
+    CLI::App app{"Coroutine Client Benchmark"};
+
+    size_t num_of_chains;
+    app.add_option("-c, --chains", num_of_chains, "number of request chains in flight")->required();
+    size_t num_of_requests;
+    app.add_option("-r, --requests", num_of_requests, "number of requests per chain")->required();
+    size_t timeout_us = 1000;
+    app.add_option("-o, --timeout", timeout_us, "request timeout in us");
+
+    CLI11_PARSE(app, argc, argv);
+
+    double cycles_in_ns = rdtsc_in_ns();
+    std::cout << "Cycles in ns: " << cycles_in_ns << std::endl;
+
+    dagger::RpcClientPool<dagger::RpcClient> rpc_client_pool(nic_address, 1);
+
+    // Init client pool
+    int res = rpc_client_pool.init_nic(fpga_bus);
+    if (res != 0)
+        return res;
+
+    // Start NIC
+    res = rpc_client_pool.start_nic();
+    if (res != 0)
+        return res;
+
+    dagger::RpcClient* rpc_client = rpc_client_pool.pop();
+    assert(rpc_client != nullptr);
+
+    dagger::IPv4 server_addr("192.168.0.2", 3136);
+    if (rpc_client->connect(server_addr, 0) != 0) {
+        std::cout << "Failed to open connection on client" << std::endl;
+        return 1;
+    }
+
+    // Run all chains on this thread
+    dagger::RpcScheduler scheduler;
+    std::vector<ChainStats> stats(num_of_chains);
+
+    auto start = std::chrono::steady_clock::now();
+
+    for (size_t c=0; c<num_of_chains; ++c) {
+        scheduler.spawn(request_chain(rpc_client,
+                                      num_of_requests,
+                                      static_cast<uint64_t>(timeout_us*1000*cycles_in_ns),
+                                      stats[c]));
+    }
+    scheduler.run();
+
+    auto end = std::chrono::steady_clock::now();
+    double duration_s = std::chrono::duration<double>(end - start).count();
+
+    // Get data
+    size_t completed = 0;
+    size_t failed = 0;
+    std::vector<uint64_t> latency;
+    for (auto& s: stats) {
+        completed += s.completed;
+        failed += s.failed;
+        latency.insert(latency.end(), s.latency.begin(), s.latency.end());
+    }
+
+    std::cout << "***** " << num_of_chains << " request chains *****" << std::endl;
+    std::cout << "  completed= " << completed << ", failed= " << failed
+              << ", unclaimed= " << scheduler.get_number_of_unclaimed_responses() << std::endl;
+    std::cout << "  throughput= " << completed / duration_s / 1000000 << " Mrps" << std::endl;
+    std::cout << "  frame heap allocations= "
+              << dagger::FramePool::get_number_of_heap_allocations() << std::endl;
+
+    std::sort(latency.begin(), latency.end());
+    if (latency.size() != 0) {
+        std::cout << "  median= "
+                  << latency[latency.size()*0.5]/cycles_in_ns
+                  << " ns" << std::endl;
+        std::cout << "  99th= "
+                  << latency[latency.size()*0.99]/cycles_in_ns
+                  << " ns" << std::endl;
+    }
+
+    // Stop NIC
+    res = rpc_client_pool.stop_nic();
+    if (res != 0)
+        return res;
+
+    return 0;
+}
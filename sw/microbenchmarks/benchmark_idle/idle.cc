@@ -0,0 +1,168 @@
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "config.h"
+#include "idle_policy.h"
+#include "utils.h"
+#include "CLI11.hpp"
+
+// Wake-up latency of the idle policy stages. A poller thread waits on a
+// cache line like the dispatch thread waits on the rx ring, the writer thread
+// writes the line after the poller has been idle long enough to be in a given
+// stage, and the poller measures the time from the write to the wake-up. No
+// FPGA is needed.
+
+static double rdtsc_in_ns() {
+    uint64_t a = dagger::utils::rdtsc();
+    sleep(1);
+    uint64_t b = dagger::utils::rdtsc();
+
+    return (b - a)/1000000000.0;
+}
+
+// Imitation of an rx line
+struct Line {
+    std::atomic<uint64_t> seq;
+    std::atomic<uint64_t> tsc;
+} __attribute__((aligned(64)));
+
+struct Case {
+    std::string name;
+    // How long the poller is idle before the write
+    uint64_t idle_cycles;
+    // Whether the writer notifies the poller
+    bool notify;
+};
+
+struct Sample {
+    uint64_t latency;
+    dagger::IdlePolicy::Stage stage;
+};
+
+static const char* stage_name(dagger::IdlePolicy::Stage stage) {
+    switch (stage) {
+        case dagger::IdlePolicy::sSpin: return "spin";
+        case dagger::IdlePolicy::sPause: return "pause";
+        case dagger::IdlePolicy::sUmwait: return "umwait";
+        default: return "sleep";
+    }
+}
+
+int main(int argc, char* argv[]) {
+    // Parse input
+    CLI::App app{"Idle Policy Benchmark"};
+
+    size_t num_of_samples = 200;
+    app.add_option("-n, --samples", num_of_samples, "number of samples per stage");
+    uint64_t spin_cycles = dagger::cfg::sys::idle_spin_cycles;
+    app.add_option("--spin", spin_cycles, "spin budget in TSC cycles");
+    uint64_t pause_cycles = dagger::cfg::sys::idle_pause_cycles;
+    app.add_option("--pause", pause_cycles, "pause backoff budget in TSC cycles");
+    uint64_t umwait_cycles = dagger::cfg::sys::idle_umwait_cycles;
+    app.add_option("--umwait", umwait_cycles, "umwait budget in TSC cycles");
+    uint64_t sleep_us = dagger::cfg::sys::idle_sleep_us;
+    app.add_option("--sleep", sleep_us, "futex sleep timeout in us");
+
+    CLI11_PARSE(app, argc, argv);
+
+    double cycles_in_ns = rdtsc_in_ns();
+    std::cout << "Cycles in ns: " << cycles_in_ns << std::endl;
+    std::cout << "umwait is "
+              << (dagger::IdlePolicy::is_umwait_supported() ? "" : "not ")
+              << "supported" << std::endl;
+
+    // Write in the middle of each stage
+    uint64_t deep = spin_cycles + pause_cycles + umwait_cycles;
+    std::vector<Case> cases = {
+        {"spin", spin_cycles / 2, false},
+        {"pause", spin_cycles + pause_cycles / 2, false},
+        {"umwait", spin_cycles + pause_cycles + umwait_cycles / 2, false},
+        {"sleep", deep + static_cast<uint64_t>(10 * sleep_us * 1000 * cycles_in_ns), false},
+        {"sleep+notify", deep + static_cast<uint64_t>(10 * sleep_us * 1000 * cycles_in_ns), true}};
+
+    dagger::IdlePolicy policy(spin_cycles, pause_cycles, umwait_cycles, sleep_us);
+    Line line;
+    line.seq = 0;
+    line.tsc = 0;
+    std::atomic<uint64_t> ack(0);
+    std::atomic<bool> done(false);
+    std::vector<Sample> samples(cases.size() * num_of_samples);
+
+    std::thread poller([&]() {
+        uint64_t seen = 0;
+        auto has_work = [&]() {
+            return line.seq.load(std::memory_order_acquire) != seen || done;
+        };
+
+        while (true) {
+            while (!has_work()) {
+                policy.idle(&line, has_work);
+            }
+            uint64_t now = dagger::utils::rdtsc();
+            if (done) break;
+
+            seen = line.seq.load(std::memory_order_acquire);
+            samples[seen - 1] = {now - line.tsc.load(std::memory_order_relaxed),
+                                 policy.get_stage()};
+            policy.reset();
+            ack.store(seen, std::memory_order_release);
+        }
+    });
+
+    uint64_t seq = 0;
+    for (auto& c: cases) {
+        for (size_t i=0; i<num_of_samples; ++i) {
+            while (ack.load(std::memory_order_acquire) != seq) {
+            }
+
+            // Let the poller go idle; sleep most of the time to not steal
+            // its core
+            uint64_t start = dagger::utils::rdtsc();
+            uint64_t coarse = static_cast<uint64_t>(c.idle_cycles / cycles_in_ns / 1000);
+            if (coarse > 100) usleep(static_cast<useconds_t>(coarse - 100));
+            while (dagger::utils::rdtsc() - start < c.idle_cycles) {
+            }
+
+            line.tsc.store(dagger::utils::rdtsc(), std::memory_order_relaxed);
+            line.seq.store(++seq, std::memory_order_release);
+            if (c.notify) policy.notify();
+        }
+    }
+    while (ack.load(std::memory_order_acquire) != seq) {
+    }
+
+    done = true;
+    policy.notify();
+    poller.join();
+
+    // Get data
+    for (size_t c=0; c<cases.size(); ++c) {
+        std::vector<uint64_t> latency;
+        size_t in_stage[dagger::IdlePolicy::sNumOfStages] = {0};
+        for (size_t i=0; i<num_of_samples; ++i) {
+            const Sample& s = samples[c*num_of_samples + i];
+            latency.push_back(s.latency);
+            ++in_stage[s.stage];
+        }
+        std::sort(latency.begin(), latency.end());
+
+        size_t stage = std::max_element(in_stage, in_stage + dagger::IdlePolicy::sNumOfStages) - in_stage;
+
+        std::cout << "***** " << cases[c].name << " *****" << std::endl;
+        std::cout << "  woken in " << stage_name(static_cast<dagger::IdlePolicy::Stage>(stage))
+                  << " " << in_stage[stage] << "/" << num_of_samples << " times" << std::endl;
+        std::cout << "  median= " << latency[latency.size()*0.5]/cycles_in_ns
+                  << " ns" << std::endl;
+        std::cout << "  99th= " << latency[latency.size()*0.99]/cycles_in_ns
+                  << " ns" << std::endl;
+    }
+
+    return 0;
+}
@@ -10,6 +10,7 @@
 
 #include "defs.h"
 #include "config.h"
+#include "load_generator.h"
 #include "rpc_call.h"
 #include "rpc_client.h"
 #include "rpc_client_pool.h"
@@ -43,12 +44,33 @@
 
 #endif
 
+// Per-thread results of an open-loop run
+struct OpenLoopResult {
+    std::vector<uint32_t> latency_records;
+    // When the thread is done issuing requests
+    uint64_t issue_end_tsc;
+    size_t late_requests;
+};
+
 static int run_benchmark(dagger::RpcClient* rpc_client,
                              int thread_id,
                              size_t num_iterations,
                              size_t req_delay,
                              double cycles_in_ns,
-                             int function_to_call);
+                             int function_to_call,
+                             uint64_t timeout_cycles,
+                             bool sync,
+                             dagger::LoadGenerator* load_gen,
+                             OpenLoopResult* result);
+
+static int run_open_loop(const std::vector<dagger::RpcClient*>& rpc_clients,
+                         size_t num_iterations,
+                         double rps,
+                         const dagger::BurstParams& burst,
+                         double cycles_in_ns,
+                         int function_to_call,
+                         uint64_t timeout_cycles,
+                         std::vector<double>& summary);
 
 static double rdtsc_in_ns() {
     uint64_t a = dagger::utils::rdtsc();
@@ -69,13 +91,37 @@ int main(int argc, char* argv[]) {
     app.add_option("-t, --threads", num_of_threads, "number of threads")->required();
     size_t num_of_requests;
     app.add_option("-r, --requests", num_of_requests, "number of requests")->required();
-    size_t req_delay;
-    app.add_option("-d, --delay", req_delay, "delay")->required();
+    size_t req_delay = 0;
+    auto delay_opt = app.add_option("-d, --delay", req_delay, "delay");
     std::string fn_name;
     app.add_option("-f, --function", fn_name, "function to call")->required();
+    size_t timeout_us = 0;
+    app.add_option("-o, --timeout", timeout_us, "request timeout in us, 0 - no timeout");
+    bool sync = false;
+    app.add_flag("-s, --sync", sync, "issue synchronous requests and wait for the responses on the calling thread");
+    double rps = 0;
+    auto rps_opt = app.add_option("--rps", rps, "aggregate request rate of the open-loop load with Poisson arrivals, instead of --delay");
+    double rps_max = 0;
+    app.add_option("--rps-max", rps_max, "sweep the open-loop rate from --rps up to this one");
+    double rps_step = 0;
+    app.add_option("--rps-step", rps_step, "rate increment of the sweep, --rps by default");
+    dagger::BurstParams burst = {1, 100, 900};
+    app.add_option("--burst-factor", burst.factor, "rate in bursts over the calm rate, > 1 for bursty (MMPP) arrivals");
+    app.add_option("--burst-us", burst.burst_us, "mean duration of the bursts in us");
+    app.add_option("--calm-us", burst.calm_us, "mean duration of the calm phases in us");
 
     CLI11_PARSE(app, argc, argv);
 
+    if ((delay_opt->count() == 0) == (rps_opt->count() == 0)) {
+        std::cout << "wrong parameters: either --delay or --rps is required" << std::endl;
+        return 1;
+    }
+    if (rps_opt->count() != 0 && (sync || rps <= 0)) {
+        std::cout << "wrong parameters: the open-loop load needs a positive rate"
+                     " and non-blocking requests" << std::endl;
+        return 1;
+    }
+
     int function_to_call = 0;
     if (fn_name == "loopback")
         function_to_call = 0;
@@ -87,6 +133,8 @@ int main(int argc, char* argv[]) {
         function_to_call = 3;
     else if (fn_name == "getUserData")
         function_to_call = 4;
+    else if (fn_name == "notify")
+        function_to_call = 5;
     else {
         std::cout << "wrong parameter: function name" << std::endl;
         return 1;
@@ -115,15 +163,12 @@ int main(int argc, char* argv[]) {
     if (res != 0)
         return res;
 
-    sleep(1);
-
-    // Run client threads
-    std::vector<std::thread> threads;
+    // Open connections
+    std::vector<dagger::RpcClient*> rpc_clients;
     for (int thread_id=0; thread_id<num_of_threads; ++thread_id) {
         dagger::RpcClient* rpc_client = rpc_client_pool.pop();
         assert(rpc_client != nullptr);
 
-        // Open connection
         dagger::IPv4 server_addr("192.168.0.2", 3136);
         if (rpc_client->connect(server_addr, thread_id) != 0) {
             std::cout << "Failed to open connection on client" << std::endl;
@@ -132,18 +177,70 @@ int main(int argc, char* argv[]) {
             std::cout << "Connection is open on client" << std::endl;
         }
 
-        std::thread thr = std::thread(&run_benchmark,
-                                      rpc_client,
-                                      thread_id,
-                                      num_of_requests,
-                                      req_delay,
-                                      cycles_in_ns,
-                                      function_to_call);
-        threads.push_back(std::move(thr));
+        rpc_clients.push_back(rpc_client);
     }
 
-    for (auto& thr: threads) {
-        thr.join();
+    uint64_t timeout_cycles = static_cast<uint64_t>(timeout_us*1000*cycles_in_ns);
+    if (rps_opt->count() != 0) {
+        // Open-loop load, one run per rate of the sweep
+        if (rps_step <= 0)
+            rps_step = rps;
+
+        std::vector<std::vector<double>> summary;
+        size_t num_of_steps = rps_max > rps ? static_cast<size_t>((rps_max - rps)/rps_step + 1e-9) + 1 : 1;
+        for (size_t step=0; step<num_of_steps; ++step) {
+            // Each step starts with empty completion queues, so the
+            // completions of the previous rates are not counted again
+            for (auto rpc_client: rpc_clients) {
+                auto cq = rpc_client->get_completion_queue();
+                cq->clear_queue();
+#ifdef PROFILE_LATENCY
+                cq->clear_latency_records();
+#endif
+            }
+
+            std::vector<double> step_summary;
+            run_open_loop(rpc_clients,
+                          num_of_requests,
+                          rps + step*rps_step,
+                          burst,
+                          cycles_in_ns,
+                          function_to_call,
+                          timeout_cycles,
+                          step_summary);
+            summary.push_back(step_summary);
+        }
+
+        // Throughput vs tail latency curve
+        std::cout << "***** open-loop sweep *****" << std::endl;
+        std::cout << "target_rps,achieved_rps,median_ns,90th_ns,99th_ns,99.9th_ns" << std::endl;
+        for (auto& step_summary: summary) {
+            for (size_t i=0; i<step_summary.size(); ++i) {
+                std::cout << (i == 0 ? "" : ",") << step_summary[i];
+            }
+            std::cout << std::endl;
+        }
+    } else {
+        // Run client threads
+        std::vector<std::thread> threads;
+        for (int thread_id=0; thread_id<num_of_threads; ++thread_id) {
+            std::thread thr = std::thread(&run_benchmark,
+                                          rpc_clients[thread_id],
+                                          thread_id,
+                                          num_of_requests,
+                                          req_delay,
+                                          cycles_in_ns,
+                                          function_to_call,
+                                          timeout_cycles,
+                                          sync,
+                                          nullptr,
+                                          nullptr);
+            threads.push_back(std::move(thr));
+        }
+
+        for (auto& thr: threads) {
+            thr.join();
+        }
     }
 
     // Check for HW errors
@@ -165,35 +262,172 @@ static bool sortbysec(const uint64_t &a, const uint64_t &b) {
     return a < b;
 }
 
+static int run_open_loop(const std::vector<dagger::RpcClient*>& rpc_clients,
+                         size_t num_iterations,
+                         double rps,
+                         const dagger::BurstParams& burst,
+                         double cycles_in_ns,
+                         int function_to_call,
+                         uint64_t timeout_cycles,
+                         std::vector<double>& summary) {
+    size_t num_of_threads = rpc_clients.size();
+    std::cout << "***** open-loop run at " << rps << " rps *****" << std::endl;
+
+    // All the threads start their schedules at the same time, leave them 10ms
+    // to get there
+    uint64_t start_tsc = dagger::utils::rdtsc() +
+                         static_cast<uint64_t>(10000000*cycles_in_ns);
+
+    std::vector<dagger::LoadGenerator> load_gens;
+    for (size_t thread_id=0; thread_id<num_of_threads; ++thread_id) {
+        load_gens.push_back(dagger::LoadGenerator(rps,
+                                                  num_of_threads,
+                                                  thread_id,
+                                                  cycles_in_ns,
+                                                  start_tsc,
+                                                  burst));
+    }
+
+    std::vector<OpenLoopResult> results(num_of_threads);
+    std::vector<std::thread> threads;
+    for (size_t thread_id=0; thread_id<num_of_threads; ++thread_id) {
+        std::thread thr = std::thread(&run_benchmark,
+                                      rpc_clients[thread_id],
+                                      thread_id,
+                                      num_iterations,
+                                      0,
+                                      cycles_in_ns,
+                                      function_to_call,
+                                      timeout_cycles,
+                                      false,
+                                      &load_gens[thread_id],
+                                      &results[thread_id]);
+        threads.push_back(std::move(thr));
+    }
+
+    for (auto& thr: threads) {
+        thr.join();
+    }
+
+    // Aggregate the threads
+    std::vector<uint32_t> latency_records;
+    uint64_t issue_end_tsc = start_tsc;
+    size_t late_requests = 0;
+    for (auto& result: results) {
+        latency_records.insert(latency_records.end(),
+                               result.latency_records.begin(),
+                               result.latency_records.end());
+        issue_end_tsc = std::max(issue_end_tsc, result.issue_end_tsc);
+        late_requests += result.late_requests;
+    }
+    std::sort(latency_records.begin(), latency_records.end());
+
+    double achieved_rps = latency_records.size() /
+                          ((issue_end_tsc - start_tsc)/cycles_in_ns/1000000000.0);
+    summary.push_back(rps);
+    summary.push_back(achieved_rps);
+
+    std::cout << "  achieved= " << achieved_rps << " rps"
+              << ", late requests= " << late_requests << std::endl;
+    if (latency_records.size() == 0) {
+        summary.insert(summary.end(), 4, 0.0);
+        return 1;
+    }
+
+    // Latency from the intended send times
+    std::cout << "  total records= " << latency_records.size() << std::endl;
+    const double percentiles[] = {0.5, 0.9, 0.99, 0.999};
+    const char* names[] = {"median", "90th", "99th", "99.9th"};
+    for (size_t i=0; i<4; ++i) {
+        double lat_ns = latency_records[latency_records.size()*percentiles[i]]/cycles_in_ns;
+        summary.push_back(lat_ns);
+        std::cout << "  " << names[i] << "= " << lat_ns << " ns" << std::endl;
+    }
+
+    return 0;
+}
+
 static int run_benchmark(dagger::RpcClient* rpc_client,
                          int thread_id,
                          size_t num_iterations,
                          size_t req_delay,
                          double cycles_in_ns,
-                         int function_to_call) {
-    // Make an RPC call
+                         int function_to_call,
+                         uint64_t timeout_cycles,
+                         bool sync,
+                         dagger::LoadGenerator* load_gen,
+                         OpenLoopResult* result) {
+    // Synchronous calls wait for the responses themselves, the latency is
+    // recorded the same way as for the non-blocking ones
+    if (sync && timeout_cycles == 0) {
+        timeout_cycles = dagger::cfg::sys::sync_timeout_cycles;
+    }
+
+    NumericalResult numerical_ret;
+    Signature signature_ret;
+    UserData user_data_ret;
+
+    auto cq = rpc_client->get_completion_queue();
+
+    // Make an RPC call; with an open-loop load, the requests are stamped
+    // with their intended send time, so the latency includes the time they
+    // wait behind the previous ones
     for(int i=0; i<num_iterations; ++i) {
-        switch (function_to_call) {
-            case 0: rpc_client->loopback({dagger::utils::rdtsc(), i}); break;
+        uint64_t send_tsc = load_gen != nullptr ? load_gen->wait_next()
+                                                : dagger::utils::rdtsc();
 
-            case 1: rpc_client->add({dagger::utils::rdtsc(), i, i+1}); break;
+        if (sync) {
+            switch (function_to_call) {
+                case 0: rpc_client->loopback_sync({send_tsc, i}, numerical_ret, timeout_cycles); break;
 
-            case 2: rpc_client->sign({dagger::utils::rdtsc(),
-                                     0xaabbccdd,
-                                     0x11223344,
-                                     i, i+1, i+2, i+3}); break;
+                case 1: rpc_client->add_sync({send_tsc, i, i+1}, numerical_ret, timeout_cycles); break;
 
-            case 3: rpc_client->xor_({dagger::utils::rdtsc(),
-                                     i, i+1, i+2, i+3, i+4, i+5}); break;
+                case 2: rpc_client->sign_sync({send_tsc,
+                                              0xaabbccdd,
+                                              0x11223344,
+                                              i, i+1, i+2, i+3}, signature_ret, timeout_cycles); break;
 
-            case 4: {
-                UserName request;
-                request.timestamp = dagger::utils::rdtsc();
-                sprintf(request.first_name, "Buffalo");
-                sprintf(request.given_name, "Bill");
+                case 3: rpc_client->xor__sync({send_tsc,
+                                              i, i+1, i+2, i+3, i+4, i+5}, numerical_ret, timeout_cycles); break;
 
-                rpc_client->getUserData(request);
-                break;
+                case 4: {
+                    UserName request;
+                    request.timestamp = send_tsc;
+                    sprintf(request.first_name, "Buffalo");
+                    sprintf(request.given_name, "Bill");
+
+                    rpc_client->getUserData_sync(request, user_data_ret, timeout_cycles);
+                    break;
+                }
+
+                // One-way, there is nothing to wait for
+                case 5: rpc_client->notify({send_tsc, i}); break;
+            }
+        } else {
+            switch (function_to_call) {
+                case 0: rpc_client->loopback({send_tsc, i}, timeout_cycles); break;
+
+                case 1: rpc_client->add({send_tsc, i, i+1}, timeout_cycles); break;
+
+                case 2: rpc_client->sign({send_tsc,
+                                         0xaabbccdd,
+                                         0x11223344,
+                                         i, i+1, i+2, i+3}, timeout_cycles); break;
+
+                case 3: rpc_client->xor_({send_tsc,
+                                         i, i+1, i+2, i+3, i+4, i+5}, timeout_cycles); break;
+
+                case 4: {
+                    UserName request;
+                    request.timestamp = send_tsc;
+                    sprintf(request.first_name, "Buffalo");
+                    sprintf(request.given_name, "Bill");
+
+                    rpc_client->getUserData(request, timeout_cycles);
+                    break;
+                }
+
+                case 5: rpc_client->notify({send_tsc, i}); break;
             }
         }
 
@@ -203,13 +437,23 @@ static int run_benchmark(dagger::RpcClient* rpc_client,
         }
     }
 
-    // Wait a bit
-    sleep(5);
+    if (result != nullptr) {
+        result->issue_end_tsc = dagger::utils::rdtsc();
+        result->late_requests = load_gen->get_number_of_late_requests();
+    }
+
+    // Wait until all requests are either completed or expired, but not more
+    // than 5 seconds
+    for (int i=0; i<5000 && cq->get_number_of_outstanding_requests() != 0; ++i) {
+        usleep(1000);
+    }
 
     // Get data
-    auto cq = rpc_client->get_completion_queue();
     size_t cq_size = cq->get_number_of_completed_requests();
-    std::cout << "Thread #" << thread_id << ": CQ size= " << cq_size << std::endl;
+    std::cout << "Thread #" << thread_id << ": CQ size= " << cq_size
+              << ", timeouts= " << cq->get_number_of_timeouts()
+              << ", late responses= " << cq->get_number_of_late_responses()
+              << ", lost= " << cq->get_number_of_outstanding_requests() << std::endl;
 
 #ifdef VERBOSE_RPCS
     // Output data
@@ -237,6 +481,9 @@ static int run_benchmark(dagger::RpcClient* rpc_client,
 
     // Get latency profile
     auto latency_records = cq->get_latency_records();
+    if (result != nullptr) {
+        result->latency_records = latency_records;
+    }
 
     std::sort(latency_records.begin(), latency_records.end(), sortbysec);
 
@@ -54,6 +54,8 @@ static RpcRetCode xor_(CallHandler handler, XorArgs args, NumericalResult* ret);
 
 static RpcRetCode getUserData(CallHandler handler, UserName args, UserData* ret);
 
+static RpcRetCode notify(CallHandler handler, LoopBackArgs args);
+
 // <max number of threads, run duration>
 int main(int argc, char* argv[]) {
     // Parse input
@@ -62,7 +64,8 @@ int main(int argc, char* argv[]) {
     size_t num_of_threads;
     app.add_option("-t, --threads", num_of_threads, "number of threads")->required();
     int load_balancer;
-    app.add_option("-l, --load-balancer", load_balancer, "load balancer")->required();
+    app.add_option("-l, --load-balancer", load_balancer,
+                   "load balancer (0 - static, 1 - round robin, 2 - key affinity)")->required();
 
     CLI11_PARSE(app, argc, argv);
 
@@ -105,6 +108,7 @@ int main(int argc, char* argv[]) {
     fn_ptr.push_back(reinterpret_cast<const void*>(&sign));
     fn_ptr.push_back(reinterpret_cast<const void*>(&xor_));
     fn_ptr.push_back(reinterpret_cast<const void*>(&getUserData));
+    fn_ptr.push_back(reinterpret_cast<const void*>(&notify));
 
     dagger::RpcServerCallBack server_callback(fn_ptr);
 
@@ -195,3 +199,11 @@ static RpcRetCode getUserData(CallHandler handler, UserName args, UserData* ret)
 
     return RpcRetCode::Success;
 }
+
+static RpcRetCode notify(CallHandler handler, LoopBackArgs args) {
+#ifdef VERBOSE_RPCS
+    std::cout << "notify is called on thread " << handler.thread_id << " with "
+                                               << args.data << std::endl;
+#endif
+    return RpcRetCode::Success;
+}
@@ -0,0 +1,177 @@
+#include <unistd.h>
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "defs.h"
+#include "config.h"
+#include "rpc_call.h"
+#include "rpc_client.h"
+#include "rpc_client_pool.h"
+#include "rpc_types.h"
+#include "utils.h"
+#include "CLI11.hpp"
+
+// HW parameters
+#ifdef PLATFORM_PAC_A10
+    // Allocate FPGA on bus_1 for the client when running on PAC_A10
+    static constexpr int fpga_bus = dagger::cfg::platform::pac_a10_fpga_bus_1;
+#else
+    // Only loopback is possible here, so -1 for bus
+    static constexpr int fpga_bus = -1;
+#endif
+
+// Client NIC is always at 0x00000, the latency/throughput server runs at 0x20000
+static constexpr uint64_t nic_address = 0x00000;
+
+static double rdtsc_in_ns() {
+    uint64_t a = dagger::utils::rdtsc();
+    sleep(1);
+    uint64_t b = dagger::utils::rdtsc();
+
+    return (b - a)/1000000000.0;
+}
+
+// Application thread: issue requests through a client shared with other
+// application threads
+static void run_producer(dagger::RpcClient* rpc_client,
+                         size_t num_iterations,
+                         size_t req_delay) {
+    for (size_t i=0; i<num_iterations; ++i) {
+        rpc_client->loopback({static_cast<int64_t>(dagger::utils::rdtsc()),
+                              static_cast<int64_t>(i)});
+
+        // Blocking delay to control rps rate
+        for (size_t delay=0; delay<req_delay; ++delay) {
+            asm("");
+        }
+    }
+}
+
+// Scale the number of application threads sharing one nic flow
+int main(int argc, char* argv[]) {
+    // Parse input
+    CLI::App app{"Multi-Producer Client Benchmark"};
+
+    size_t num_of_flows;
+    app.add_option("-f, --flows", num_of_flows, "number of clients (nic flows)")->required();
+    size_t num_of_producers;
+    app.add_option("-p, --producers", num_of_producers, "number of application threads per flow")->required();
+    size_t num_of_requests;
+    app.add_option("-r, --requests", num_of_requests, "number of requests per application thread")->required();
+    size_t req_delay = 0;
+    app.add_option("-d, --delay", req_delay, "delay");
+
+    CLI11_PARSE(app, argc, argv);
+
+    double cycles_in_ns = rdtsc_in_ns();
+    std::cout << "Cycles in ns: " << cycles_in_ns << std::endl;
+
+    dagger::RpcClientPool<dagger::RpcClient> rpc_client_pool(nic_address,
+                                                         num_of_flows);
+
+    // Init client pool
+    int res = rpc_client_pool.init_nic(fpga_bus);
+    if (res != 0)
+        return res;
+
+    // Start NIC
+    res = rpc_client_pool.start_nic();
+    if (res != 0)
+        return res;
+
+    // Open connections, one multi-producer client per flow
+    std::vector<dagger::RpcClient*> rpc_clients;
+    for (size_t flow=0; flow<num_of_flows; ++flow) {
+        dagger::RpcClient* rpc_client = rpc_client_pool.pop();
+        assert(rpc_client != nullptr);
+
+        res = rpc_client->set_multi_producer(true);
+        if (res != 0)
+            return res;
+
+        dagger::IPv4 server_addr("192.168.0.2", 3136);
+        if (rpc_client->connect(server_addr, flow) != 0) {
+            std::cout << "Failed to open connection on client" << std::endl;
+            return 1;
+        }
+
+        rpc_clients.push_back(rpc_client);
+    }
+
+    // Run application threads
+    auto start = std::chrono::steady_clock::now();
+
+    std::vector<std::thread> threads;
+    for (auto rpc_client: rpc_clients) {
+        for (size_t p=0; p<num_of_producers; ++p) {
+            threads.push_back(std::thread(&run_producer,
+                                          rpc_client,
+                                          num_of_requests,
+                                          req_delay));
+        }
+    }
+
+    for (auto& thr: threads) {
+        thr.join();
+    }
+
+    auto end = std::chrono::steady_clock::now();
+    double duration_s = std::chrono::duration<double>(end - start).count();
+
+    // Wait until all requests are completed, but not more than 5 seconds
+    for (auto rpc_client: rpc_clients) {
+        auto cq = rpc_client->get_completion_queue();
+        for (int i=0; i<5000 && cq->get_number_of_outstanding_requests() != 0; ++i) {
+            usleep(1000);
+        }
+    }
+
+    // Get data
+    size_t total_issued = num_of_flows * num_of_producers * num_of_requests;
+    size_t total_completed = 0;
+    std::vector<uint32_t> latency_records;
+    for (size_t flow=0; flow<num_of_flows; ++flow) {
+        auto cq = rpc_clients[flow]->get_completion_queue();
+        total_completed += cq->get_number_of_completed_requests();
+
+        auto records = cq->get_latency_records();
+        latency_records.insert(latency_records.end(), records.begin(), records.end());
+
+        std::cout << "Flow #" << flow << ": CQ size= " << cq->get_number_of_completed_requests()
+                  << ", lost= " << cq->get_number_of_outstanding_requests() << std::endl;
+    }
+
+    std::cout << "***** " << num_of_producers << " application threads per flow *****" << std::endl;
+    std::cout << "  issued= " << total_issued << ", completed= " << total_completed << std::endl;
+    std::cout << "  issue rate= " << total_issued / duration_s / 1000000 << " Mrps" << std::endl;
+
+    std::sort(latency_records.begin(), latency_records.end());
+    if (latency_records.size() != 0) {
+        std::cout << "  median= "
+                  << latency_records[latency_records.size()*0.5]/cycles_in_ns
+                  << " ns" << std::endl;
+        std::cout << "  99th= "
+                  << latency_records[latency_records.size()*0.99]/cycles_in_ns
+                  << " ns" << std::endl;
+    }
+
+    // Check for HW errors
+    res = rpc_client_pool.check_hw_errors();
+    if (res != 0)
+        std::cout << "HW errors found, check error log" << std::endl;
+    else
+        std::cout << "No HW errors found" << std::endl;
+
+    // Stop NIC
+    res = rpc_client_pool.stop_nic();
+    if (res != 0)
+        return res;
+
+    return 0;
+}
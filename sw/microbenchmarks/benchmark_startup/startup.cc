@@ -0,0 +1,153 @@
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "config.h"
+#include "nic.h"
+#include "nic_ccip_factory.h"
+#include "utils.h"
+#include "CLI11.hpp"
+
+// HW parameters
+#ifdef PLATFORM_PAC_A10
+    // Use FPGA on bus_1 when running on PAC_A10
+    static constexpr int fpga_bus = dagger::cfg::platform::pac_a10_fpga_bus_1;
+#else
+    // Single-FPGA system, so -1 for bus
+    static constexpr int fpga_bus = -1;
+#endif
+
+// In ASE, multiple nics share the same FPGA, so run the nic in slave mode
+#ifdef ASE_SIMULATION
+    static constexpr bool master_nic = false;
+#else
+    static constexpr bool master_nic = true;
+#endif
+
+// Phase timing
+struct Phase {
+    std::string name;
+    double duration_us;
+};
+
+template <typename F>
+static int time_phase(std::vector<Phase>& phases, const char* name, F fn) {
+    auto start = std::chrono::steady_clock::now();
+    int res = fn();
+    auto end = std::chrono::steady_clock::now();
+
+    if (res != 0) {
+        std::cout << "phase " << name << " failed" << std::endl;
+        return res;
+    }
+
+    phases.push_back({name,
+                      std::chrono::duration<double, std::micro>(end - start).count()});
+    return 0;
+}
+
+// Measure the time of every phase of the nic bring-up and tear-down
+int main(int argc, char* argv[]) {
+    // Parse input
+    CLI::App app{"Nic Startup Benchmark"};
+
+    size_t num_of_flows = 1;
+    app.add_option("-f, --flows", num_of_flows, "number of flows");
+    size_t num_of_connections = 1;
+    app.add_option("-c, --connections", num_of_connections, "number of connections to set-up");
+    size_t num_of_iterations = 1;
+    app.add_option("-i, --iterations", num_of_iterations, "number of bring-up iterations");
+    uint64_t nic_address = 0x00000;
+    app.add_option("-a, --address", nic_address, "nic MMIO base address");
+
+    CLI11_PARSE(app, argc, argv);
+
+    dagger::PhyAddr phy_addr = {0x1A, 0x2B, 0x3C, 0x4D, 0x5E, 0x6D};
+    dagger::IPv4 ipv4_addr("192.168.0.1", 0);
+    dagger::IPv4 dest_addr("192.168.0.2", 3136);
+
+    for (size_t it=0; it<num_of_iterations; ++it) {
+        std::unique_ptr<dagger::Nic> nic;
+        std::vector<Phase> phases;
+        int res;
+
+        auto total_start = std::chrono::steady_clock::now();
+
+        // Reads the CCI-P mode from the hardware unless it is set at build time
+        res = time_phase(phases, "make_nic", [&]() {
+            nic = dagger::make_ccip_nic(nic_address, num_of_flows, master_nic, fpga_bus);
+            return nic == nullptr ? 1 : 0;
+        });
+        if (res != 0)
+            return res;
+
+        res = time_phase(phases, "connect_to_nic", [&]() {
+            return nic->connect_to_nic(fpga_bus);
+        });
+        if (res != 0)
+            return res;
+
+        res = time_phase(phases, "configure_data_plane", [&]() {
+            return nic->configure_data_plane();
+        });
+        if (res != 0)
+            return res;
+
+        res = time_phase(phases, "initialize_nic", [&]() {
+            return nic->initialize_nic(phy_addr, ipv4_addr);
+        });
+        if (res != 0)
+            return res;
+
+        res = time_phase(phases, "start", [&]() {
+            return nic->start();
+        });
+        if (res != 0)
+            return res;
+
+        res = time_phase(phases, "add_connection", [&]() {
+            for (size_t c=0; c<num_of_connections; ++c) {
+                int r = nic->add_connection(c, dest_addr, c % num_of_flows);
+                if (r != 0)
+                    return r;
+            }
+            return 0;
+        });
+        if (res != 0)
+            return res;
+
+        res = time_phase(phases, "close_connection", [&]() {
+            for (size_t c=0; c<num_of_connections; ++c) {
+                int r = nic->close_connection(c);
+                if (r != 0)
+                    return r;
+            }
+            return 0;
+        });
+        if (res != 0)
+            return res;
+
+        res = time_phase(phases, "stop", [&]() {
+            return nic->stop();
+        });
+        if (res != 0)
+            return res;
+
+        auto total_end = std::chrono::steady_clock::now();
+
+        std::cout << "***** iteration " << it << " *****" << std::endl;
+        for (auto& p: phases) {
+            std::cout << p.name << ": " << p.duration_us << " us" << std::endl;
+        }
+        std::cout << "total: "
+                  << std::chrono::duration<double, std::micro>(total_end - total_start).count()
+                  << " us" << std::endl;
+    }
+
+    return 0;
+}
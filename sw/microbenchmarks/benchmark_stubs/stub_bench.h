@@ -0,0 +1,175 @@
+/**
+ * @file stub_bench.h
+ * @brief Host-memory harness of the RPC stub benchmarks generated with
+ * `rpc_gen.py <idl> <out> --bench`.
+ * @author Nikita Lazarev
+ */
+#ifndef _STUB_BENCH_H_
+#define _STUB_BENCH_H_
+
+#include <benchmark/benchmark.h>
+#include <stdlib.h>
+
+#include <cstring>
+#include <new>
+
+#include "ccip_tx.h"
+#include "config.h"
+#include "nic.h"
+#include "rpc_bytes.h"
+#include "rpc_header.h"
+#include "tx_queue.h"
+#include "utils.h"
+
+namespace dagger {
+namespace bench {
+
+// Allocate a page-aligned ring of 2^@param l_depth frames.
+inline char* alloc_ring(size_t l_depth) {
+  void* buff = nullptr;
+  if (posix_memalign(&buff, 4096, cfg::sys::cl_size_bytes << l_depth) != 0) {
+    throw std::bad_alloc();
+  }
+  memset(buff, 0, cfg::sys::cl_size_bytes << l_depth);
+  return static_cast<char*>(buff);
+}
+
+/// Nic with a single polling flow made of two rings in host memory: the
+/// requests written by the client stubs go nowhere, and no responses ever
+/// arrive. All the control calls succeed without doing anything.
+class HostNic : public Nic {
+ public:
+  HostNic()
+      : tx_buff_(alloc_ring(cfg::nic::l_tx_queue_size)),
+        rx_buff_(alloc_ring(cfg::nic::l_rx_queue_size)) {}
+  virtual ~HostNic() {
+    free(tx_buff_);
+    free(rx_buff_);
+  }
+
+  virtual int connect_to_nic(int bus = -1) { return 0; }
+  virtual int initialize_nic(const PhyAddr& host_phy, const IPv4& host_ipv4) {
+    return 0;
+  }
+  virtual int configure_data_plane() { return 0; }
+  virtual int start() { return 0; }
+  virtual int stop() { return 0; }
+  virtual int check_hw_errors() const { return 0; }
+
+  virtual int open_connection(ConnectionId& c_id, const IPv4& dest_addr,
+                              ConnectionFlowId c_flow_id) const {
+    c_id = 0;
+    return 0;
+  }
+  virtual int add_connection(ConnectionId c_id, const IPv4& dest_addr,
+                             ConnectionFlowId c_flow_id) const {
+    return 0;
+  }
+  virtual int close_connection(ConnectionId c_d) const { return 0; }
+
+  virtual int notify_nic_of_new_dma(size_t flow, size_t bucket) const {
+    return 0;
+  }
+
+  virtual char* get_tx_flow_buffer(size_t flow) const { return tx_buff_; }
+  virtual volatile char* get_rx_flow_buffer(size_t flow) const {
+    return rx_buff_;
+  }
+  virtual const char* get_tx_buff_end() const {
+    return tx_buff_ + (cfg::sys::cl_size_bytes << cfg::nic::l_tx_queue_size);
+  }
+  virtual const char* get_rx_buff_end() const {
+    return rx_buff_ + (cfg::sys::cl_size_bytes << cfg::nic::l_rx_queue_size);
+  }
+
+  virtual size_t get_mtu_size_bytes() const { return cfg::sys::cl_size_bytes; }
+  virtual TxMode get_tx_mode() const { return tx_polling; }
+
+  virtual int run_perf_thread(NicPerfMask perf_mask,
+                              void (*callback)(const std::vector<uint64_t>&)) {
+    return 0;
+  }
+  virtual int get_perf_counters(PerfCounters& counters) const { return 0; }
+  virtual void set_lb(int lb) const {}
+  virtual int set_flow_mask(uint64_t mask) const { return 0; }
+  virtual int get_flow_stats(size_t flow, FlowStats& stats) const {
+    memset(&stats, 0, sizeof(stats));
+    return 0;
+  }
+  virtual int run_flow_monitor(uint32_t period_us) { return 0; }
+  virtual bool is_flow_congested(size_t flow) const { return false; }
+
+ private:
+  char* tx_buff_;
+  char* rx_buff_;
+};
+
+/// Tx queue of a server flow over a ring in host memory.
+class HostTxRing {
+ public:
+  HostTxRing() : buff_(alloc_ring(cfg::nic::l_tx_queue_size)) {
+    tx_queue_ = TxQueue(buff_, cfg::sys::cl_size_bytes,
+                        cfg::nic::l_tx_queue_size);
+    tx_queue_.init();
+  }
+  ~HostTxRing() { free(buff_); }
+
+  TxQueue& get() { return tx_queue_; }
+
+ private:
+  char* buff_;
+  TxQueue tx_queue_;
+};
+
+/// Build the request to the function @param fn_id with @param args the way
+/// the client stubs send it.
+template <typename Arg>
+inline RpcPckt make_request(uint8_t fn_id, const Arg& args) {
+  RpcPckt request;
+  memset(&request, 0, sizeof(RpcPckt));
+  request.hdr.rpc_id = 1;
+  request.hdr.n_of_frames = 1;
+  request.hdr.fn_id = fn_id;
+  request.hdr.argl = static_cast<uint16_t>(
+      rpc_encode(args, request.argv, sizeof(RpcPckt::argv)));
+  request.hdr.ctl.req_type = rpc_request;
+  return request;
+}
+
+/// Write the response @param ret to the request @param req_hdr into
+/// @param tx_queue the way the generated server callbacks do: the return
+/// value goes through the response buffer of the callback.
+template <typename Ret>
+inline void send_response(const RpcHeader& req_hdr, const Ret& ret,
+                          TxQueue& tx_queue) {
+  uint8_t ret_buff[sizeof(RpcPckt::argv)];
+  size_t ret_size = rpc_encode(ret, ret_buff, sizeof(ret_buff));
+
+  uint8_t change_bit;
+  char* tx_ptr = tx_queue.get_write_ptr(change_bit);
+
+  RpcHeader hdr = RpcHeader();
+  hdr.c_id = req_hdr.c_id;
+  hdr.rpc_id = req_hdr.rpc_id;
+  hdr.n_of_frames = 1;
+  hdr.fn_id = req_hdr.fn_id;
+  hdr.argl = static_cast<uint16_t>(ret_size);
+  hdr.affinity = req_hdr.affinity;
+  hdr.ctl.req_type = rpc_response;
+
+  ccip_send(tx_queue, tx_ptr, change_bit, hdr,
+            [&](uint8_t* argv) { memcpy(argv, ret_buff, ret_size); });
+}
+
+/// Report the TSC cycles per iteration of @param state, measured from
+/// @param start_tsc.
+inline void report_cycles(benchmark::State& state, uint64_t start_tsc) {
+  state.counters["cycles"] =
+      benchmark::Counter(static_cast<double>(utils::rdtsc() - start_tsc),
+                         benchmark::Counter::kAvgIterations);
+}
+
+}  // namespace bench
+}  // namespace dagger
+
+#endif
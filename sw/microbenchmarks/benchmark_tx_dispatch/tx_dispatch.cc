@@ -0,0 +1,146 @@
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "ccip_tx.h"
+#include "config.h"
+#include "rpc_header.h"
+#include "tx_queue.h"
+#include "utils.h"
+#include "CLI11.hpp"
+
+// Cost of selecting the CCI-P transport at runtime. Requests are written into
+// a tx queue in host memory with the transport policy pinned at compile time
+// (as in the builds for a single CCI-P mode) and with the runtime dispatch on
+// the mode of the queue (as in the builds for all the modes), and the time
+// per request is compared. No FPGA is needed.
+
+static double rdtsc_in_ns() {
+    uint64_t a = dagger::utils::rdtsc();
+    sleep(1);
+    uint64_t b = dagger::utils::rdtsc();
+
+    return (b - a)/1000000000.0;
+}
+
+// Typical fixed-size arguments
+struct Args {
+    int64_t a, b, c, d, e, f;
+};
+
+// One send is one stub call, so the dispatch can not be hoisted out of the
+// benchmark loop
+template <typename Send>
+static __attribute__((noinline)) void send_request(dagger::TxQueue& tx_queue,
+                                                   uint32_t rpc_id,
+                                                   const Args& args) {
+    uint8_t change_bit;
+    char* tx_ptr = tx_queue.get_write_ptr(change_bit);
+
+    dagger::RpcHeader hdr = dagger::RpcHeader();
+    hdr.c_id        = 0;
+    hdr.rpc_id      = rpc_id;
+    hdr.n_of_frames = 1;
+    hdr.frame_id    = 0;
+
+    hdr.fn_id    = 0;
+    hdr.argl     = sizeof(Args);
+    hdr.affinity = static_cast<uint8_t>(rpc_id);
+
+    hdr.ctl.req_type = dagger::rpc_request;
+
+    Send::send(tx_queue, tx_ptr, change_bit, hdr, [&](uint8_t* argv) {
+        *reinterpret_cast<Args*>(argv) = args;
+    });
+}
+
+struct PinnedPolling {
+    template <typename F>
+    static inline void send(dagger::TxQueue& tx_queue, char* tx_ptr, uint8_t change_bit,
+                            const dagger::RpcHeader& hdr, const F& write_argv) {
+        dagger::PollingTx::send(tx_queue, tx_ptr, change_bit, hdr, write_argv);
+    }
+};
+
+struct PinnedMmio {
+    template <typename F>
+    static inline void send(dagger::TxQueue& tx_queue, char* tx_ptr, uint8_t change_bit,
+                            const dagger::RpcHeader& hdr, const F& write_argv) {
+        dagger::MmioTx::send(tx_queue, tx_ptr, change_bit, hdr, write_argv);
+    }
+};
+
+struct Runtime {
+    template <typename F>
+    static inline void send(dagger::TxQueue& tx_queue, char* tx_ptr, uint8_t change_bit,
+                            const dagger::RpcHeader& hdr, const F& write_argv) {
+        dagger::ccip_send_by_mode(tx_queue, tx_ptr, change_bit, hdr, write_argv);
+    }
+};
+
+struct Case {
+    std::string name;
+    dagger::TxMode mode;
+    void (*send)(dagger::TxQueue&, uint32_t, const Args&);
+};
+
+int main(int argc, char* argv[]) {
+    // Parse input
+    CLI::App app{"Tx Transport Dispatch Benchmark"};
+
+    size_t num_of_requests = 1000000;
+    app.add_option("-r, --requests", num_of_requests, "number of requests per round");
+    size_t num_of_rounds = 11;
+    app.add_option("-n, --rounds", num_of_rounds, "number of rounds per case");
+
+    CLI11_PARSE(app, argc, argv);
+
+    double cycles_in_ns = rdtsc_in_ns();
+    std::cout << "Cycles in ns: " << cycles_in_ns << std::endl;
+
+    // Host memory in place of the nic buffers
+    const size_t l_depth = dagger::cfg::nic::l_tx_queue_size;
+    char* buff = reinterpret_cast<char*>(
+                    aligned_alloc(4096, sizeof(dagger::RpcPckt) << l_depth));
+    memset(buff, 0, sizeof(dagger::RpcPckt) << l_depth);
+
+    std::vector<Case> cases = {
+        {"polling, pinned", dagger::tx_polling, &send_request<PinnedPolling>},
+        {"polling, runtime", dagger::tx_polling, &send_request<Runtime>},
+        {"mmio, pinned", dagger::tx_mmio, &send_request<PinnedMmio>},
+        {"mmio, runtime", dagger::tx_mmio, &send_request<Runtime>}};
+
+    for (auto& c: cases) {
+        dagger::TxQueue tx_queue(buff, sizeof(dagger::RpcPckt),
+                                 dagger::TxQueue::get_l_depth(c.mode));
+        tx_queue.init();
+        tx_queue.bind_transport(c.mode, nullptr, 0);
+
+        Args args = {1, 2, 3, 4, 5, 6};
+        std::vector<double> per_request;
+        for (size_t r=0; r<num_of_rounds; ++r) {
+            uint64_t start = dagger::utils::rdtsc();
+            for (size_t i=0; i<num_of_requests; ++i) {
+                args.a = static_cast<int64_t>(i);
+                c.send(tx_queue, static_cast<uint32_t>(i), args);
+            }
+            uint64_t end = dagger::utils::rdtsc();
+
+            per_request.push_back((end - start)/cycles_in_ns/num_of_requests);
+        }
+        std::sort(per_request.begin(), per_request.end());
+
+        std::cout << "***** " << c.name << " *****" << std::endl;
+        std::cout << "  median= " << per_request[per_request.size()/2]
+                  << " ns/request" << std::endl;
+        std::cout << "  min= " << per_request[0] << " ns/request" << std::endl;
+    }
+
+    free(buff);
+    return 0;
+}
@@ -0,0 +1,192 @@
+#include "async_logger.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "logger.h"
+
+namespace dagger {
+
+thread_local LogRing* AsyncLogger::ring_ = nullptr;
+
+std::atomic<LogSite*> LogSite::first(nullptr);
+
+LogSite::LogSite(int level, const char* file, int line)
+    : level(level),
+      file(file),
+      line(line),
+      window_start(0),
+      window_records(0),
+      suppressed(0) {
+  next = first.load(std::memory_order_relaxed);
+  while (!first.compare_exchange_weak(
+      next, this, std::memory_order_release, std::memory_order_relaxed)) {
+  }
+}
+
+LogRing::LogRing()
+    : records_(new LogRecord[cfg::sys::log_ring_size]),
+      head_(0),
+      padding_(),
+      tail_(0),
+      dropped_(0),
+      orphaned_(false) {
+  static_assert(
+      (cfg::sys::log_ring_size & (cfg::sys::log_ring_size - 1)) == 0,
+      "log ring size must be a power of 2");
+}
+
+LogRing::~LogRing() { delete[] records_; }
+
+namespace {
+
+const char* level_name(int level) {
+  switch (level) {
+    case FRPC_LOG_LEVEL_ERROR: return "ERROR";
+    case FRPC_LOG_LEVEL_WARN: return "WARNG";
+    case FRPC_LOG_LEVEL_INFO: return "INFOR";
+    default: return "UNKWN";
+  }
+}
+
+// Background formatting thread and the registry of the rings.
+class LogBackend {
+ public:
+  LogBackend() : stream_(stdout), stop_(false), dropped_(0) {
+    thread_ = std::thread(&LogBackend::run, this);
+  }
+
+  ~LogBackend() {
+    {
+      std::unique_lock<std::mutex> lck(mtx_);
+      stop_ = true;
+    }
+    cv_.notify_one();
+    thread_.join();
+
+    // Rings of the threads still running are left alone, they might be
+    // logging right now
+    drain();
+  }
+
+  void add(LogRing* ring) {
+    std::unique_lock<std::mutex> lck(mtx_);
+    rings_.push_back(ring);
+  }
+
+  void set_stream(FILE* stream) {
+    std::unique_lock<std::mutex> lck(mtx_);
+    stream_ = stream;
+  }
+
+  uint64_t get_number_of_dropped() {
+    std::unique_lock<std::mutex> lck(mtx_);
+    uint64_t dropped = dropped_;
+    for (auto ring : rings_) {
+      dropped += ring->get_number_of_dropped();
+    }
+    return dropped;
+  }
+
+  // Format everything recorded so far.
+  void drain() {
+    std::unique_lock<std::mutex> lck(mtx_);
+    bool written = false;
+
+    for (size_t i = 0; i < rings_.size();) {
+      LogRing* ring = rings_[i];
+      bool orphaned = ring->is_orphaned();
+
+      ring->consume([&](const LogRecord& rec) {
+        fprintf(stream_, "%u:%06u %s: ",
+                static_cast<uint32_t>(rec.time.tv_sec % 100),
+                static_cast<uint32_t>(rec.time.tv_nsec / 1000),
+                level_name(rec.site->level));
+        rec.print(stream_, rec.fmt, rec.args);
+        written = true;
+      });
+
+      if (orphaned) {
+        dropped_ += ring->get_number_of_dropped();
+        delete ring;
+        rings_[i] = rings_.back();
+        rings_.pop_back();
+      } else {
+        ++i;
+      }
+    }
+
+    // Report the rate limited sites
+    for (LogSite* site = LogSite::first.load(std::memory_order_acquire);
+         site != nullptr; site = site->next) {
+      uint64_t suppressed =
+          site->suppressed.exchange(0, std::memory_order_relaxed);
+      if (suppressed != 0) {
+        fprintf(stream_, "%s: %lu messages suppressed at %s:%d\n",
+                level_name(site->level), suppressed, site->file, site->line);
+        written = true;
+      }
+    }
+
+    if (written) fflush(stream_);
+  }
+
+ private:
+  void run() {
+    std::unique_lock<std::mutex> lck(mtx_);
+    while (!stop_) {
+      cv_.wait_for(lck, std::chrono::microseconds(cfg::sys::log_flush_us));
+      lck.unlock();
+      drain();
+      lck.lock();
+    }
+  }
+
+  std::thread thread_;
+  std::mutex mtx_;
+  std::condition_variable cv_;
+
+  FILE* stream_;
+  bool stop_;
+  std::vector<LogRing*> rings_;
+
+  // Records dropped on the freed rings.
+  uint64_t dropped_;
+};
+
+LogBackend& backend() {
+  static LogBackend backend;
+  return backend;
+}
+
+// Orphans the ring of a thread when the thread exits.
+struct RingOwner {
+  LogRing* ring = nullptr;
+
+  ~RingOwner() {
+    if (ring != nullptr) ring->orphan();
+  }
+};
+
+thread_local RingOwner ring_owner;
+
+}  // namespace
+
+void AsyncLogger::register_ring() {
+  ring_ = new LogRing();
+  ring_owner.ring = ring_;
+  backend().add(ring_);
+}
+
+void AsyncLogger::flush() { backend().drain(); }
+
+void AsyncLogger::set_stream(FILE* stream) { backend().set_stream(stream); }
+
+uint64_t AsyncLogger::get_number_of_dropped() {
+  return backend().get_number_of_dropped();
+}
+
+}  // namespace dagger
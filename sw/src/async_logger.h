@@ -0,0 +1,295 @@
+/**
+ * @file async_logger.h
+ * @brief Asynchronous backend of the FRPC_* logging macros.
+ * @author Nikita Lazarev
+ */
+#ifndef _ASYNC_LOGGER_H_
+#define _ASYNC_LOGGER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include <atomic>
+#include <type_traits>
+
+#include "config.h"
+#include "utils.h"
+
+namespace dagger {
+
+/// Static call site of a logging macro. Holds the per-site rate limiter: at
+/// most cfg::sys::log_site_max_records records are taken per
+/// cfg::sys::log_site_window_cycles, the rest are dropped and reported by the
+/// backend as suppressed.
+struct LogSite {
+  LogSite(int level, const char* file, int line);
+
+  LogSite(const LogSite&) = delete;
+
+  /// Critical path function to check the rate limit of the site.
+  inline bool admit() __attribute__((always_inline)) {
+    uint64_t now = utils::rdtsc();
+    uint64_t start = window_start.load(std::memory_order_relaxed);
+    if (now - start >= cfg::sys::log_site_window_cycles &&
+        window_start.compare_exchange_strong(start, now,
+                                             std::memory_order_relaxed)) {
+      window_records.store(0, std::memory_order_relaxed);
+    }
+
+    if (window_records.fetch_add(1, std::memory_order_relaxed) <
+        cfg::sys::log_site_max_records) {
+      return true;
+    }
+    suppressed.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+
+  const int level;
+  const char* const file;
+  const int line;
+
+  std::atomic<uint64_t> window_start;
+  std::atomic<uint32_t> window_records;
+  std::atomic<uint64_t> suppressed;
+
+  // All sites are chained, so the backend can report the suppressed records
+  // of sites that went quiet.
+  LogSite* next;
+  static std::atomic<LogSite*> first;
+};
+
+/// Binary log record. The arguments are stored as they are passed to the
+/// macro, strings are copied (and truncated to fit the record); formatting is
+/// done by the backend with the print function instantiated for the argument
+/// types.
+struct LogRecord {
+  static constexpr size_t size_bytes = 128;
+
+  const LogSite* site;
+  const char* fmt;
+  void (*print)(FILE* stream, const char* fmt, const char* args);
+  struct timespec time;
+  char args[size_bytes - sizeof(const LogSite*) - sizeof(const char*) -
+            sizeof(void (*)(FILE*, const char*, const char*)) -
+            sizeof(struct timespec)];
+};
+
+static_assert(sizeof(LogRecord) == LogRecord::size_bytes,
+              "log record must be exactly two cache lines");
+
+/// Per-thread single-producer/single-consumer ring of log records. The
+/// producer never waits: records are dropped when the ring is full.
+class LogRing {
+ public:
+  LogRing();
+  ~LogRing();
+
+  LogRing(const LogRing&) = delete;
+
+  /// Critical path function to get the next free record, nullptr if the ring
+  /// is full.
+  inline LogRecord* reserve() __attribute__((always_inline)) {
+    size_t head = head_.load(std::memory_order_relaxed);
+    if (head - tail_.load(std::memory_order_acquire) ==
+        cfg::sys::log_ring_size) {
+      dropped_.fetch_add(1, std::memory_order_relaxed);
+      return nullptr;
+    }
+    return &records_[head & (cfg::sys::log_ring_size - 1)];
+  }
+
+  /// Critical path function to publish the record returned by reserve().
+  inline void commit() __attribute__((always_inline)) {
+    head_.store(head_.load(std::memory_order_relaxed) + 1,
+                std::memory_order_release);
+  }
+
+  /// Consumer interface: pass all published records to @param f and free
+  /// them.
+  template <typename F>
+  void consume(F f) {
+    size_t tail = tail_.load(std::memory_order_relaxed);
+    size_t head = head_.load(std::memory_order_acquire);
+    for (; tail != head; ++tail) {
+      f(records_[tail & (cfg::sys::log_ring_size - 1)]);
+    }
+    tail_.store(tail, std::memory_order_release);
+  }
+
+  /// The owning thread has exited.
+  void orphan() { orphaned_.store(true, std::memory_order_release); }
+  bool is_orphaned() const {
+    return orphaned_.load(std::memory_order_acquire);
+  }
+
+  uint64_t get_number_of_dropped() const {
+    return dropped_.load(std::memory_order_relaxed);
+  }
+
+ private:
+  LogRecord* records_;
+
+  // The producer and the consumer indices are kept on separate cache lines.
+  std::atomic<size_t> head_;
+  char padding_[64 - sizeof(std::atomic<size_t>)];
+  std::atomic<size_t> tail_;
+
+  // Records dropped because the ring was full.
+  std::atomic<uint64_t> dropped_;
+
+  // Set when the owning thread exits; the ring is freed by the backend once
+  // drained.
+  std::atomic<bool> orphaned_;
+};
+
+///
+/// Argument encoding.
+///
+
+/// Type a macro argument is stored as.
+template <typename T>
+struct LogArg {
+  typedef T type;
+};
+
+template <>
+struct LogArg<char*> {
+  typedef const char* type;
+};
+
+/// Space the arguments take in a record at least (strings take at least
+/// their terminator).
+template <typename... Ts>
+struct LogArgsSize;
+
+template <>
+struct LogArgsSize<> {
+  static constexpr size_t value = 0;
+};
+
+template <typename T, typename... Ts>
+struct LogArgsSize<T, Ts...> {
+  static constexpr size_t value =
+      (std::is_same<T, const char*>::value ? 1 : sizeof(T)) +
+      LogArgsSize<Ts...>::value;
+};
+
+template <typename... Ts>
+struct LogCodec;
+
+template <>
+struct LogCodec<> {
+  static inline void encode(char*, char*) {}
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wformat-security"
+#pragma GCC diagnostic ignored "-Wformat-nonliteral"
+  template <typename... Done>
+  static void decode(FILE* stream, const char* fmt, const char*,
+                     Done... done) {
+    fprintf(stream, fmt, done...);
+  }
+#pragma GCC diagnostic pop
+};
+
+template <typename T, typename... Ts>
+struct LogCodec<T, Ts...> {
+  static_assert(std::is_scalar<T>::value,
+                "only scalars and strings can be logged");
+
+  static inline void encode(char* p, char* end, T v, Ts... rest)
+      __attribute__((always_inline)) {
+    memcpy(p, &v, sizeof(T));
+    LogCodec<Ts...>::encode(p + sizeof(T), end, rest...);
+  }
+
+  template <typename... Done>
+  static void decode(FILE* stream, const char* fmt, const char* p,
+                     Done... done) {
+    T v;
+    memcpy(&v, p, sizeof(T));
+    LogCodec<Ts...>::decode(stream, fmt, p + sizeof(T), done..., v);
+  }
+};
+
+template <typename... Ts>
+struct LogCodec<const char*, Ts...> {
+  static inline void encode(char* p, char* end, const char* v, Ts... rest)
+      __attribute__((always_inline)) {
+    // Leave space for the rest of the arguments
+    size_t len = v == nullptr ? 0 : strlen(v);
+    size_t max_len =
+        static_cast<size_t>(end - p) - LogArgsSize<Ts...>::value - 1;
+    if (len > max_len) len = max_len;
+
+    if (len != 0) memcpy(p, v, len);
+    p[len] = '\0';
+    LogCodec<Ts...>::encode(p + len + 1, end, rest...);
+  }
+
+  template <typename... Done>
+  static void decode(FILE* stream, const char* fmt, const char* p,
+                     Done... done) {
+    LogCodec<Ts...>::decode(stream, fmt, p + strlen(p) + 1, done..., p);
+  }
+};
+
+/// Asynchronous logging backend. Logging threads write binary records into
+/// their own rings, a background thread formats them every
+/// cfg::sys::log_flush_us and writes them to the stream; the critical path
+/// cost is a clock read, the rate limiter and a copy of the arguments.
+///
+/// Enabled with FRPC_LOG_ASYNC, the FRPC_* macros and their compile-time
+/// level filtering stay the same.
+class AsyncLogger {
+ public:
+  /// Record a message of @param site.
+  template <typename... Args>
+  static inline void log(LogSite* site, const char* fmt, Args... args) {
+    typedef LogCodec<typename LogArg<Args>::type...> Codec;
+    static_assert(LogArgsSize<typename LogArg<Args>::type...>::value <=
+                      sizeof(LogRecord::args),
+                  "too many arguments to log");
+
+    if (!site->admit()) return;
+
+    LogRing* ring = get_ring();
+    LogRecord* rec = ring->reserve();
+    if (rec == nullptr) return;
+
+    rec->site = site;
+    rec->fmt = fmt;
+    rec->print = &Codec::template decode<>;
+    clock_gettime(CLOCK_REALTIME, &rec->time);
+    Codec::encode(rec->args, rec->args + sizeof(rec->args), args...);
+
+    ring->commit();
+  }
+
+  /// Format and write all recorded messages now; can be called from any
+  /// thread, e.g. before exiting on a fatal error.
+  static void flush();
+
+  /// Redirect the output, stdout by default.
+  static void set_stream(FILE* stream);
+
+  /// Number of records dropped because the ring of their thread was full.
+  static uint64_t get_number_of_dropped();
+
+ private:
+  static inline LogRing* get_ring() __attribute__((always_inline)) {
+    if (__builtin_expect(ring_ == nullptr, 0)) register_ring();
+    return ring_;
+  }
+
+  static void register_ring();
+
+  static thread_local LogRing* ring_;
+};
+
+}  // namespace dagger
+
+#endif
@@ -0,0 +1,168 @@
+/**
+ * @file ccip_tx.h
+ * @brief Transport policies to send RPCs over the CCI-P nics.
+ * @author Nikita Lazarev
+ */
+#ifndef _CCIP_TX_H_
+#define _CCIP_TX_H_
+
+#include <immintrin.h>
+#include <stdint.h>
+
+#include "nic.h"
+#include "rpc_header.h"
+#include "tx_queue.h"
+
+namespace dagger {
+
+/// Each policy writes a single-frame RPC with the header @param hdr into the
+/// tx queue slot @param tx_ptr (obtained with the @param change_bit from
+/// @param tx_queue), and publishes it to the nic. The payload is written by
+/// @param write_argv, called with the location of the argv.
+///
+/// The RPC stubs instantiate all the policies, and ccip_send() picks the one
+/// of the queue's transport.
+
+/// The nic polls the tx queues: the request is published by flipping the
+/// update flag, so it goes last.
+struct PollingTx {
+  template <typename F>
+  static inline __attribute__((always_inline)) void send(
+      TxQueue& tx_queue, char* tx_ptr, uint8_t change_bit, const RpcHeader& hdr,
+      const F& write_argv) {
+    (void)tx_queue;
+    RpcPckt* tx_ptr_casted = reinterpret_cast<RpcPckt*>(tx_ptr);
+
+    tx_ptr_casted->hdr.c_id = hdr.c_id;
+    tx_ptr_casted->hdr.rpc_id = hdr.rpc_id;
+    tx_ptr_casted->hdr.n_of_frames = hdr.n_of_frames;
+    tx_ptr_casted->hdr.frame_id = hdr.frame_id;
+
+    tx_ptr_casted->hdr.fn_id = hdr.fn_id;
+    tx_ptr_casted->hdr.argl = hdr.argl;
+    tx_ptr_casted->hdr.affinity = hdr.affinity;
+
+    tx_ptr_casted->hdr.ctl.req_type = hdr.ctl.req_type;
+    tx_ptr_casted->hdr.ctl.one_way = hdr.ctl.one_way;
+    tx_ptr_casted->hdr.ctl.end_of_stream = hdr.ctl.end_of_stream;
+
+    write_argv(tx_ptr_casted->argv);
+
+    _mm_mfence();
+    tx_ptr_casted->hdr.ctl.valid = 1;
+    tx_ptr_casted->hdr.ctl.update_flag = change_bit;
+  }
+};
+
+/// The request is written right into the nic's MMIO space. MMIO only
+/// supports AVX writes, so the frame is built on the stack first.
+struct MmioTx {
+  template <typename F>
+  static inline __attribute__((always_inline)) void send(
+      TxQueue& tx_queue, char* tx_ptr, uint8_t change_bit, const RpcHeader& hdr,
+      const F& write_argv) {
+    (void)tx_queue;
+    (void)change_bit;
+    RpcPckt request __attribute__((aligned(64))) = RpcPckt();
+
+    request.hdr = hdr;
+    request.hdr.ctl.valid = 1;
+
+    _mm_mfence();
+
+    write_argv(request.argv);
+
+#ifdef PLATFORM_PAC_A10
+    // PAC_A10 supports AVX-512 - easy!
+    _mm512_store_si512(reinterpret_cast<__m512i*>(tx_ptr),
+                       *(reinterpret_cast<__m512i*>(&request)));
+#else
+    // BDX only supports AVX-256, so split into two writes
+    //  - performance will not be good
+    //  - better to avoid the MMIO interface for BDX
+    _mm256_store_si256(reinterpret_cast<__m256i*>(tx_ptr),
+                       *(reinterpret_cast<__m256i*>(&request)));
+    _mm256_store_si256(
+        reinterpret_cast<__m256i*>(tx_ptr + 32),
+        *(reinterpret_cast<__m256i*>(reinterpret_cast<uint8_t*>(&request) +
+                                     32)));
+#endif
+  }
+};
+
+/// The request is written into the shared memory, and the nic is notified to
+/// fetch it once a batch is ready (see TxQueue::commit_dma_write()).
+struct DmaTx {
+  template <typename F>
+  static inline __attribute__((always_inline)) void send(
+      TxQueue& tx_queue, char* tx_ptr, uint8_t change_bit, const RpcHeader& hdr,
+      const F& write_argv) {
+    RpcPckt* tx_ptr_casted = reinterpret_cast<RpcPckt*>(tx_ptr);
+
+    tx_ptr_casted->hdr.c_id = hdr.c_id;
+    tx_ptr_casted->hdr.rpc_id = hdr.rpc_id;
+    tx_ptr_casted->hdr.n_of_frames = hdr.n_of_frames;
+    tx_ptr_casted->hdr.frame_id = hdr.frame_id;
+
+    tx_ptr_casted->hdr.fn_id = hdr.fn_id;
+    tx_ptr_casted->hdr.argl = hdr.argl;
+    tx_ptr_casted->hdr.affinity = hdr.affinity;
+
+    tx_ptr_casted->hdr.ctl.req_type = hdr.ctl.req_type;
+    tx_ptr_casted->hdr.ctl.one_way = hdr.ctl.one_way;
+    tx_ptr_casted->hdr.ctl.end_of_stream = hdr.ctl.end_of_stream;
+    tx_ptr_casted->hdr.ctl.update_flag = change_bit;
+
+    write_argv(tx_ptr_casted->argv);
+
+    tx_ptr_casted->hdr.ctl.valid = 1;
+    _mm_mfence();
+
+    tx_queue.commit_dma_write();
+  }
+};
+
+/// Send the request with the transport @param tx_queue is bound to. The
+/// transport is a property of the hardware flow, so the branch is perfectly
+/// predicted, and it is taken once per request rather than per written field.
+template <typename F>
+inline __attribute__((always_inline)) void ccip_send_by_mode(
+    TxQueue& tx_queue, char* tx_ptr, uint8_t change_bit, const RpcHeader& hdr,
+    const F& write_argv) {
+  switch (tx_queue.get_tx_mode()) {
+    case tx_mmio:
+      MmioTx::send(tx_queue, tx_ptr, change_bit, hdr, write_argv);
+      break;
+    case tx_dma:
+      DmaTx::send(tx_queue, tx_ptr, change_bit, hdr, write_argv);
+      break;
+    default:
+      PollingTx::send(tx_queue, tx_ptr, change_bit, hdr, write_argv);
+      break;
+  }
+}
+
+/// Send the request through the nic. If the software is built for a single
+/// CCI-P mode (NIC_CCIP_POLLING, NIC_CCIP_MMIO or NIC_CCIP_DMA), the policy
+/// of this mode is pinned at compile time; otherwise, the transport is
+/// selected at runtime from the nic the tx queue is bound to.
+template <typename F>
+inline __attribute__((always_inline)) void ccip_send(TxQueue& tx_queue,
+                                                     char* tx_ptr,
+                                                     uint8_t change_bit,
+                                                     const RpcHeader& hdr,
+                                                     const F& write_argv) {
+#if defined(NIC_CCIP_POLLING)
+  PollingTx::send(tx_queue, tx_ptr, change_bit, hdr, write_argv);
+#elif defined(NIC_CCIP_MMIO)
+  MmioTx::send(tx_queue, tx_ptr, change_bit, hdr, write_argv);
+#elif defined(NIC_CCIP_DMA)
+  DmaTx::send(tx_queue, tx_ptr, change_bit, hdr, write_argv);
+#else
+  ccip_send_by_mode(tx_queue, tx_ptr, change_bit, hdr, write_argv);
+#endif
+}
+
+}  // namespace dagger
+
+#endif
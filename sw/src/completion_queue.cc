@@ -1,31 +1,100 @@
 #include "completion_queue.h"
 
+#include <immintrin.h>
+
+#include <cassert>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
 #include "config.h"
 #include "logger.h"
+#include "rpc_stream.h"
 #include "unistd.h"
 #include "utils.h"
 
 namespace dagger {
 
-CompletionQueue::CompletionQueue() : rpc_client_id_(0), stop_signal_(0) {}
+CompletionQueue::CompletionQueue()
+    : rpc_client_id_(0),
+      flow_cq_(nullptr),
+      outstanding_table_(nullptr),
+      timeouts_(0),
+      late_responses_(0),
+      stop_signal_(0) {
+  rx_lock_ = false;
+  sync_waiters_ = 0;
+}
 
 CompletionQueue::CompletionQueue(size_t rpc_client_id, volatile char* rx_buff,
                                  size_t mtu_size_bytes)
-    : rpc_client_id_(rpc_client_id), stop_signal_(0) {
+    : rpc_client_id_(rpc_client_id),
+      flow_cq_(nullptr),
+      routes_(new std::atomic<CompletionQueue*>[route_table_size]),
+      outstanding_(new OutstandingTable()),
+      timeouts_(0),
+      late_responses_(0),
+      stop_signal_(0) {
+  rx_lock_ = false;
+  sync_waiters_ = 0;
   // Allocate RX queue
   rx_queue_ = RxQueue(rx_buff, mtu_size_bytes, cfg::nic::l_rx_queue_size);
   rx_queue_.init();
+
+  outstanding_table_ = outstanding_.get();
+
+  // Completions of the flow's own client
+  routes_[0] = this;
+  for (size_t i = 1; i < route_table_size; ++i) {
+    routes_[i] = nullptr;
+  }
+}
+
+CompletionQueue::CompletionQueue(size_t rpc_client_id,
+                                 CompletionQueue* flow_cq)
+    : rpc_client_id_(rpc_client_id),
+      flow_cq_(flow_cq),
+      outstanding_table_(flow_cq->outstanding_table_),
+      timeouts_(0),
+      late_responses_(0),
+      stop_signal_(0) {
+  rx_lock_ = false;
+  sync_waiters_ = 0;
+  assert(route_of(rpc_client_id) != 0);
 }
 
 CompletionQueue::~CompletionQueue() {}
 
+void* CompletionQueue::operator new(size_t size) {
+  void* ptr = nullptr;
+  if (posix_memalign(&ptr, alignof(CompletionQueue), size) != 0) {
+    throw std::bad_alloc();
+  }
+  return ptr;
+}
+
+void CompletionQueue::operator delete(void* ptr) { free(ptr); }
+
 void CompletionQueue::bind() {
+  if (flow_cq_ != nullptr) {
+    flow_cq_->routes_[route_of(rpc_client_id_)].store(
+        this, std::memory_order_release);
+    return;
+  }
+
   stop_signal_ = 0;
   thread_ = std::thread(&CompletionQueue::_PullListen, this);
 }
 
 void CompletionQueue::unbind() {
+  if (flow_cq_ != nullptr) {
+    flow_cq_->routes_[route_of(rpc_client_id_)].store(
+        nullptr, std::memory_order_release);
+    return;
+  }
+
   stop_signal_ = 1;
+  idle_policy_.notify();
   thread_.join();
   FRPC_INFO("Completion queue is unbound from RPC client %d\n", rpc_client_id_);
 }
@@ -36,51 +105,271 @@ void CompletionQueue::_PullListen() {
   volatile RpcPckt* resp_pckt;
 
   while (stop_signal_ == 0) {
+    if (!try_lock_rx()) {
+      _mm_pause();
+      continue;
+    }
+
+    // Expire requests, both when waiting and under load, and also while
+    // threads wait for synchronous requests
+    outstanding_->expire(dagger::utils::rdtsc(), expired_);
+    if (!expired_.empty()) {
+      complete_expired();
+    }
+
+    // Threads waiting for synchronous requests drain the rx queue
+    // themselves, keep off their way until they are done; umwait at most, so
+    // that the deadlines are still checked
+    if (sync_waiters_.load(std::memory_order_relaxed) != 0) {
+      unlock_rx();
+      idle_policy_.idle(
+          &sync_waiters_,
+          [&]() {
+            return sync_waiters_.load(std::memory_order_relaxed) == 0 ||
+                   stop_signal_;
+          },
+          IdlePolicy::sUmwait);
+      continue;
+    }
+
     // wait response
-    uint32_t rx_rpc_id;
+    uint8_t phase;
     resp_pckt =
-        reinterpret_cast<volatile RpcPckt*>(rx_queue_.get_read_ptr(rx_rpc_id));
+        reinterpret_cast<volatile RpcPckt*>(rx_queue_.get_read_ptr(phase));
+
+    if (rx_pckt_is_new(resp_pckt, phase) && deliver(resp_pckt)) {
+      unlock_rx();
+      idle_policy_.reset();
+      continue;
+    }
+    unlock_rx();
 
-    while (
-        (resp_pckt->hdr.ctl.valid == 0 || resp_pckt->hdr.rpc_id == rx_rpc_id) &&
-        !stop_signal_)
-      ;
+    // Only sleep if no response can come; with outstanding requests, the
+    // thread goes at most to umwait, so expiry is delayed by at most
+    // cfg::sys::idle_umwait_timeout_cycles. The read pointer is re-taken
+    // under the lock after waking up, as a synchronous waiter might have
+    // moved it in the meantime
+    size_t outstanding = outstanding_->get_number_of_outstanding_requests();
+    idle_policy_.idle(
+        resp_pckt,
+        [&]() {
+          return rx_pckt_is_new(resp_pckt, phase) || stop_signal_ ||
+                 outstanding_->get_number_of_outstanding_requests() !=
+                     outstanding;
+        },
+        outstanding == 0 ? IdlePolicy::sSleep : IdlePolicy::sUmwait);
+  }
+}
+
+bool CompletionQueue::deliver(volatile RpcPckt* resp_pckt) {
+  uint32_t rpc_id = resp_pckt->hdr.rpc_id;
+
+  // Picked up by the thread waiting for it
+  OutstandingTable::RequestType type = outstanding_->get_type(rpc_id);
+  if (type == OutstandingTable::rSync) return false;
+
+  rx_queue_.pop();
 
-    if (stop_signal_) continue;
+  if (type == OutstandingTable::rStream) {
+    deliver_stream_frame(resp_pckt);
+    return true;
+  }
 
-    rx_queue_.update_rpc_id(resp_pckt->hdr.rpc_id);
+  // Drop responses of requests which are not outstanding anymore or whose
+  // client has left the flow
+  uint64_t issue_tsc;
+  CompletionQueue* dst =
+      routes_[route_of(rpc_id)].load(std::memory_order_acquire);
+  if (!outstanding_->complete(rpc_id, issue_tsc) || dst == nullptr) {
+    late_responses_.fetch_add(1, std::memory_order_relaxed);
+    return true;
+  }
 
-    cq_lock_.lock();
+  dst->cq_lock_.lock();
 
 #ifdef PROFILE_LATENCY
-    // Record latency:
-    // the RPC definition should contain a 64-bit integer as the first entry
-    // e.g.
-    // message Msg {
-    //    int64 timestamp;
-    // }
-    // and it should be written with the current time stamp on the client when
-    // issuing the request.
-    uint32_t issuing_timestamp =
-        *reinterpret_cast<volatile uint32_t*>(resp_pckt->argv);
-    timestamps_.push_back(static_cast<uint32_t>(dagger::utils::rdtsc()) -
-                          issuing_timestamp);
+  dst->record_latency(resp_pckt);
 #endif
 
-    // Append to queue
-    // TODO: there is a potential optimization here:
-    //       the NIC hardware can directly write to this queue without
-    //       the needs to explicitly copy data
-    cq_.push_back(*const_cast<RpcPckt*>(resp_pckt));
+  // Append to queue
+  // TODO: there is a potential optimization here:
+  //       the NIC hardware can directly write to this queue without
+  //       the needs to explicitly copy data
+  dst->cq_.push_back(*const_cast<RpcPckt*>(resp_pckt));
+
+  dst->cq_lock_.unlock();
+  return true;
+}
+
+void CompletionQueue::track_stream_request(uint32_t rpc_id,
+                                           RpcClientStream_Base* stream,
+                                           bool concurrent) {
+  CompletionQueue* flow = flow_cq_ == nullptr ? this : flow_cq_;
 
-    cq_lock_.unlock();
+  // Streams whose requests were evicted never get their end-of-stream frame,
+  // they are dropped here; the request is issued under the lock, so the
+  // requests of other threads are never taken for evicted ones
+  flow->streams_lock_.lock();
+  size_t keep = 0;
+  for (size_t i = 0; i < flow->streams_.size(); ++i) {
+    if (outstanding_table_->get_type(flow->streams_[i].first) ==
+        OutstandingTable::rStream) {
+      flow->streams_[keep++] = flow->streams_[i];
+    }
   }
+  flow->streams_.resize(keep);
+  flow->streams_.push_back(std::make_pair(rpc_id, stream));
+
+  outstanding_table_->issue(rpc_id, utils::rdtsc(), 0, concurrent,
+                            OutstandingTable::rStream);
+  flow->streams_lock_.unlock();
+
+  flow->idle_policy_.notify();
+}
+
+void CompletionQueue::deliver_stream_frame(volatile RpcPckt* frame) {
+  uint32_t rpc_id = frame->hdr.rpc_id;
+
+  streams_lock_.lock();
+  auto it = streams_.begin();
+  while (it != streams_.end() && it->first != rpc_id) ++it;
+  if (it == streams_.end()) {
+    streams_lock_.unlock();
+    late_responses_.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+
+  it->second->push(frame);
+
+  if (frame->hdr.ctl.end_of_stream) {
+    uint64_t issue_tsc;
+    outstanding_->complete(rpc_id, issue_tsc);
+    streams_.erase(it);
+  }
+  streams_lock_.unlock();
+}
+
+#ifdef PROFILE_LATENCY
+void CompletionQueue::record_latency(volatile RpcPckt* resp_pckt) {
+  // Record latency:
+  // the RPC definition should contain a 64-bit integer as the first entry
+  // e.g.
+  // message Msg {
+  //    int64 timestamp;
+  // }
+  // and it should be written with the current time stamp on the client when
+  // issuing the request.
+  uint32_t issuing_timestamp =
+      *reinterpret_cast<volatile uint32_t*>(resp_pckt->argv);
+  timestamps_.push_back(static_cast<uint32_t>(dagger::utils::rdtsc()) -
+                        issuing_timestamp);
+}
+#endif
+
+int CompletionQueue::wait_response(uint32_t rpc_id, uint64_t timeout_cycles,
+                                   RpcPckt& response) {
+  CompletionQueue* flow = flow_cq_ == nullptr ? this : flow_cq_;
+  flow->sync_waiters_.fetch_add(1, std::memory_order_relaxed);
+
+  uint64_t deadline = timeout_cycles == 0
+                          ? UINT64_MAX
+                          : dagger::utils::rdtsc() + timeout_cycles;
+  size_t pause = 1;
+  int res = -1;
+
+  while (res < 0) {
+    if (flow->try_lock_rx()) {
+      // Route the responses ahead of ours; stop at the ones other threads
+      // are waiting for
+      uint8_t phase;
+      volatile RpcPckt* resp_pckt;
+      while (true) {
+        resp_pckt = reinterpret_cast<volatile RpcPckt*>(
+            flow->rx_queue_.get_read_ptr(phase));
+        if (!rx_pckt_is_new(resp_pckt, phase)) break;
+
+        if (resp_pckt->hdr.rpc_id == rpc_id) {
+          response = *const_cast<RpcPckt*>(resp_pckt);
+          flow->rx_queue_.pop();
+
+          uint64_t issue_tsc;
+          flow->outstanding_->complete(rpc_id, issue_tsc);
+
+#ifdef PROFILE_LATENCY
+          cq_lock_.lock();
+          record_latency(&response);
+          cq_lock_.unlock();
+#endif
+
+          res = 0;
+          break;
+        }
+
+        if (!flow->deliver(resp_pckt)) break;
+      }
+
+      if (res < 0 && dagger::utils::rdtsc() >= deadline) {
+        // Retire the request, the response is late from now on
+        uint64_t issue_tsc;
+        flow->outstanding_->complete(rpc_id, issue_tsc);
+        timeouts_.fetch_add(1, std::memory_order_relaxed);
+        res = 1;
+      }
+
+      flow->unlock_rx();
+    }
+
+    if (res < 0) {
+      for (size_t i = 0; i < pause; ++i) {
+        _mm_pause();
+      }
+      if (pause < cfg::sys::sync_max_pause) pause <<= 1;
+    }
+  }
+
+  flow->sync_waiters_.fetch_sub(1, std::memory_order_release);
+  return res;
+}
+
+void CompletionQueue::complete_expired() {
+  RpcPckt timeout_pckt;
+  memset(&timeout_pckt, 0, sizeof(RpcPckt));
+  timeout_pckt.hdr.ctl.req_type = rpc_response;
+  timeout_pckt.hdr.n_of_frames = 0;
+
+  for (auto rpc_id : expired_) {
+    CompletionQueue* dst =
+        routes_[route_of(rpc_id)].load(std::memory_order_acquire);
+    if (dst == nullptr) continue;
+
+    timeout_pckt.hdr.rpc_id = rpc_id;
+
+    dst->cq_lock_.lock();
+    dst->cq_.push_back(timeout_pckt);
+    dst->cq_lock_.unlock();
+
+    dst->timeouts_.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  expired_.clear();
 }
 
 size_t CompletionQueue::get_number_of_completed_requests() const {
   return cq_.size();
 }
 
+size_t CompletionQueue::get_number_of_outstanding_requests() const {
+  return outstanding_table_->get_number_of_outstanding_requests();
+}
+
+size_t CompletionQueue::get_number_of_timeouts() const {
+  return timeouts_.load(std::memory_order_relaxed);
+}
+
+size_t CompletionQueue::get_number_of_late_responses() const {
+  return late_responses_.load(std::memory_order_relaxed);
+}
+
 RpcPckt CompletionQueue::pop_response() {
   auto res = cq_.back();
 
@@ -91,6 +380,16 @@ RpcPckt CompletionQueue::pop_response() {
   return res;
 }
 
+size_t CompletionQueue::pop_responses(std::vector<RpcPckt>& completions) {
+  cq_lock_.lock();
+  size_t n = cq_.size();
+  completions.insert(completions.end(), cq_.begin(), cq_.end());
+  cq_.clear();
+  cq_lock_.unlock();
+
+  return n;
+}
+
 void CompletionQueue::clear_queue() { cq_.clear(); }
 
 #ifdef PROFILE_LATENCY
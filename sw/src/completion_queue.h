@@ -7,18 +7,44 @@
 #define _COMPLETION_QUEUE_H
 
 #include <atomic>
+#include <memory>
 #include <mutex>
 #include <thread>
 #include <utility>
 #include <vector>
 
+#include "config.h"
+#include "idle_policy.h"
+#include "outstanding_table.h"
 #include "rpc_header.h"
 #include "rx_queue.h"
+#include "utils.h"
 
 namespace dagger {
 
+class RpcClientStream_Base;
+
 /// Completion queue for non-blocking RPCs. Currently requires a separate
 /// management thread.
+///
+/// The queue keeps track of all outstanding requests of the client. Requests
+/// that are not answered before their deadline are completed with a timeout
+/// completion (see is_timeout()), and responses arriving after that are
+/// dropped.
+///
+/// Logical clients sharing a nic flow have their own routed completion
+/// queues: the queue of the flow receives all responses and routes them by
+/// the client_id part of the rpc_id, the requests of all the clients are
+/// tracked in the outstanding table of the flow.
+///
+/// Synchronous requests (see track_sync_request()) bypass the queue: the
+/// issuing thread waits for the response in wait_response() spinning on the
+/// rx queue of the flow itself, and routes the responses it finds ahead of
+/// its own like the completion queue thread does.
+///
+/// Frames of streamed responses (see track_stream_request()) go to the
+/// streams of their requests rather than to the queue, the requests are
+/// retired by the end-of-stream frames.
 class CompletionQueue {
  public:
   CompletionQueue();
@@ -26,16 +52,85 @@ class CompletionQueue {
   /// Construct a new completion queue based on the rx buffer @param rx_buff
   CompletionQueue(size_t rpc_client_id, volatile char* rx_buff,
                   size_t mtu_size_bytes);
+
+  /// Construct a routed completion queue of the logical client
+  /// @param rpc_client_id which shares the nic flow of @param flow_cq.
+  CompletionQueue(size_t rpc_client_id, CompletionQueue* flow_cq);
+
   ~CompletionQueue();
 
-  /// Bind/Unbind completion queue to the thread
+  // The rx queue is page-aligned, which plain new does not respect in C++11.
+  static void* operator new(size_t size);
+  static void operator delete(void* ptr);
+
+  /// Bind/Unbind completion queue to the thread; routed queues are
+  /// (un)registered in the queue of the flow instead.
   void bind();
   void unbind();
 
+  /// Register a request @param rpc_id issued by the client. If
+  /// @param timeout_cycles is not 0, the request expires after this number of
+  /// TSC cycles. Set @param concurrent if multiple threads issue requests.
+  /// Wakes up the completion queue thread if it sleeps.
+  inline void track_request(uint32_t rpc_id, uint64_t timeout_cycles,
+                            bool concurrent = false)
+      __attribute__((always_inline)) {
+    outstanding_table_->issue(rpc_id, utils::rdtsc(), timeout_cycles,
+                              concurrent);
+    (flow_cq_ == nullptr ? this : flow_cq_)->idle_policy_.notify();
+  }
+
+  /// Register a synchronous request @param rpc_id issued by the client; its
+  /// response is left in the rx queue for the issuing thread to pick up in
+  /// wait_response().
+  inline void track_sync_request(uint32_t rpc_id, bool concurrent = false)
+      __attribute__((always_inline)) {
+    outstanding_table_->issue(rpc_id, utils::rdtsc(), 0, concurrent,
+                              OutstandingTable::rSync);
+  }
+
+  /// Register a streaming request @param rpc_id issued by the client; the
+  /// frames of its response are delivered to @param stream until the
+  /// end-of-stream one. Streaming requests do not expire.
+  void track_stream_request(uint32_t rpc_id, RpcClientStream_Base* stream,
+                            bool concurrent = false);
+
+  /// Wait on the calling thread for the response to the synchronous request
+  /// @param rpc_id; while waiting, other responses are routed to their
+  /// completion queues. Returns 0 and the response in @param response, or 1
+  /// if no response arrives within @param timeout_cycles TSC cycles (0 -
+  /// wait forever); the request is retired then, and its response is
+  /// dropped as late.
+  int wait_response(uint32_t rpc_id, uint64_t timeout_cycles,
+                    RpcPckt& response);
+
+  /// Check whether the completion @param pckt is a timeout completion rather
+  /// than a response. Timeout completions only carry the rpc_id of the expired
+  /// request, they never have frames since real responses always do.
+  static bool is_timeout(const RpcPckt& pckt) {
+    return pckt.hdr.n_of_frames == 0;
+  }
+
   size_t get_number_of_completed_requests() const;
 
+  /// Number of requests that are issued but neither completed nor expired;
+  /// for routed queues, this counts all the requests of the flow.
+  size_t get_number_of_outstanding_requests() const;
+
+  /// Number of requests completed with a timeout completion, and of the
+  /// synchronous requests which timed out.
+  size_t get_number_of_timeouts() const;
+
+  /// Number of responses dropped because their requests had already expired
+  /// or been evicted from the outstanding table.
+  size_t get_number_of_late_responses() const;
+
   RpcPckt pop_response();
 
+  /// Move all completions to @param completions in the order of arrival.
+  /// Returns the number of moved completions.
+  size_t pop_responses(std::vector<RpcPckt>& completions);
+
   void clear_queue();
 
 #ifdef PROFILE_LATENCY
@@ -46,18 +141,83 @@ class CompletionQueue {
  private:
   void _PullListen();
 
+  // Push timeout completions for all requests in expired_.
+  void complete_expired();
+
+  // Pop the response @param resp_pckt from the rx queue and append it to
+  // the completion queue of its client, or drop it if it is late. Responses
+  // to synchronous requests are left in the rx queue, returns false then.
+  // Requires the rx lock.
+  bool deliver(volatile RpcPckt* resp_pckt);
+
+  // Append the frame @param frame to the stream of its request; the stream
+  // is done with the end-of-stream frame.
+  void deliver_stream_frame(volatile RpcPckt* frame);
+
+#ifdef PROFILE_LATENCY
+  // Record the latency of @param resp_pckt; requires the cq lock.
+  void record_latency(volatile RpcPckt* resp_pckt);
+#endif
+
+  // The rx queue of the flow is read, and its requests are retired, by the
+  // completion queue thread and the threads waiting for synchronous
+  // requests; they take turns with this lock.
+  inline bool try_lock_rx() __attribute__((always_inline)) {
+    return !rx_lock_.load(std::memory_order_relaxed) &&
+           !rx_lock_.exchange(true, std::memory_order_acquire);
+  }
+  inline void unlock_rx() __attribute__((always_inline)) {
+    rx_lock_.store(false, std::memory_order_release);
+  }
+
+  // Routing of completions to the queues of logical clients.
+  static constexpr size_t route_table_size =
+      1 << cfg::sys::l_max_logical_clients_per_flow;
+  static inline size_t route_of(uint32_t rpc_id) {
+    return (rpc_id & 0xffff) >> (16 - cfg::sys::l_max_logical_clients_per_flow);
+  }
+
  private:
   size_t rpc_client_id_;
 
+  // Queue of the flow for routed queues, nullptr otherwise.
+  CompletionQueue* flow_cq_;
+
+  // Queues of the clients sharing the flow, indexed by route_of(rpc_id); the
+  // flow's own client is at 0.
+  std::unique_ptr<std::atomic<CompletionQueue*>[]> routes_;
+
   RxQueue rx_queue_;
+  std::atomic<bool> rx_lock_;
+
+  // Number of threads in wait_response(), the completion queue thread only
+  // expires requests while there are any.
+  std::atomic<uint32_t> sync_waiters_;
+
+  // Outstanding requests of the client.
+  std::unique_ptr<OutstandingTable> outstanding_;
+  // Where requests are tracked: own table, or the table of the flow.
+  OutstandingTable* outstanding_table_;
+  std::vector<uint32_t> expired_;
+  std::atomic<size_t> timeouts_;
+  std::atomic<size_t> late_responses_;
 
   // Thread
   std::thread thread_;
   std::atomic<bool> stop_signal_;
 
+  // What the thread does when there are no responses; it only sleeps when
+  // there are no outstanding requests.
+  IdlePolicy idle_policy_;
+
   // CQ
   std::vector<RpcPckt> cq_;
 
+  // Open streams of the clients of the flow, <rpc_id, stream>; there are
+  // few of them at a time, so a linear lookup is fine.
+  std::vector<std::pair<uint32_t, RpcClientStream_Base*>> streams_;
+  std::mutex streams_lock_;
+
 #ifdef PROFILE_LATENCY
   // Timestamps
   std::vector<uint32_t> timestamps_;
@@ -25,13 +25,147 @@ namespace cfg {
     // Size of huge pages
     constexpr size_t hugepage_size = 2048 * 1024;
 
+    // Log size of the client outstanding request table
+    //   - in requests
+    //   - the table is indexed by the 16-bit rpc_id counter, so it must not
+    //     be larger than 16 and not smaller than the tx queue
+    //   - if the client issues more requests than this without receiving
+    //     responses, the oldest outstanding requests are evicted
+    constexpr size_t l_outstanding_table_size = 12;
+
+    // Granularity of the client request deadlines
+    //   - in TSC cycles
+    //   - requests expire at most one tick after their deadline
+    constexpr uint64_t deadline_tick_cycles = 1024;
+
+    // Number of ticks in the deadline timer wheel
+    //   - deadlines further than this number of ticks away are re-checked
+    //     once per wheel rotation
+    constexpr size_t deadline_wheel_size = 1024;
+
+    // Log max number of logical RPC clients sharing one nic flow
+    //   - see RpcClientPool
+    //   - the client_id of a logical client is <slot, flow>, with the slot in
+    //     the upper bits, so this must not be larger than 8
+    constexpr size_t l_max_logical_clients_per_flow = 8;
+
+    // Number of RPC clients cached per core in the RpcClientPool
+    //   - popping/releasing clients through the per-core caches is lock-free,
+    //     the pool only takes a lock when a cache is empty or full
+    constexpr size_t client_pool_cache_size = 8;
+
+    // Idle policy of the server dispatch and completion queue threads
+    //   - see IdlePolicy
+    //   - an idle thread spins for idle_spin_cycles, then backs off with
+    //     _mm_pause for idle_pause_cycles, then waits with umonitor/umwait on
+    //     the rx line for idle_umwait_cycles (if the CPU supports WAITPKG),
+    //     and finally sleeps on a futex for up to idle_sleep_us at a time
+    //   - all budgets are in TSC cycles since the thread became idle
+    //   - each stage adds wake-up latency, see benchmark_idle
+    constexpr uint64_t idle_spin_cycles = 1 << 20;
+    constexpr uint64_t idle_pause_cycles = 1 << 22;
+    constexpr uint64_t idle_umwait_cycles = 1 << 24;
+
+    // Max number of _mm_pause per poll in the backoff stage
+    constexpr size_t idle_max_pause = 64;
+
+    // Timeout of a single umwait
+    //   - in TSC cycles
+    //   - also bounds the request expiry delay of an idle completion queue
+    constexpr uint64_t idle_umwait_timeout_cycles = 1 << 14;
+
+    // Timeout of a single futex sleep
+    //   - in us
+    //   - the nic can not wake up sleeping threads, so this bounds the
+    //     wake-up latency of idle server threads; completion queue threads
+    //     only sleep without outstanding requests and are woken by the
+    //     client on the next request
+    constexpr uint64_t idle_sleep_us = 100;
+
+    // Synchronous RPC calls (the <function>_sync client stubs)
+    //   - the calling thread spins on the rx queue of its flow for the
+    //     response, with exponential _mm_pause backoff of up to
+    //     sync_max_pause per poll
+    //   - sync_timeout_cycles is the default timeout of the stubs, in TSC
+    //     cycles
+    constexpr size_t sync_max_pause = 4;
+    constexpr uint64_t sync_timeout_cycles = 1ULL << 32;
+
+    // Server-streaming RPCs (`returns (stream <Item>)` in the IDL)
+    //   - the server is at most stream_window items ahead of the client, the
+    //     client grants credits for half a window at a time as it consumes
+    //     the items; the window must fit the rx queue of the client
+    //   - the grants must reach the server flow of the stream, so streams
+    //     need the static or affinity-based load balancing on the server
+    //   - the other requests of the flow wait for the end of the stream,
+    //     the handler holds the dispatch thread
+    //   - a handler out of credits gives up the stream after
+    //     stream_credit_timeout_cycles TSC cycles
+    constexpr uint32_t stream_window = 8;
+    constexpr uint64_t stream_credit_timeout_cycles = 1ULL << 32;
+
+    // In-place request dispatch on server threads
+    //   - requests are handled straight from their rx ring slots instead of
+    //     being copied out of the ring first; the slot is only released once
+    //     the handler returns, and the next slot is prefetched meanwhile
+    //   - `inplace` handlers in the IDL take their arguments by const
+    //     reference, so they read the slot without any copy at all
+    //   - the nic does not wait for the slots to be released, so a handler
+    //     running longer than it takes to receive a full ring of requests
+    //     on its flow sees its arguments overwritten; off until the nic
+    //     respects the release of the slots
+    constexpr bool server_inplace_dispatch = false;
+
+    // Target load of a server thread for automatic flow rebalancing
+    //   - in requests per second
+    //   - see RpcThreadedServer::rebalance_flows(), the flows are packed
+    //     onto as many threads as needed to keep each below this load
+    constexpr double server_thread_target_rps = 2000000;
+
+    // Elastic scaling of server threads
+    //   - see RpcThreadedServer::run_autoscaler(), the handler utilization
+    //     and the flow backlog on the nic are sampled every
+    //     autoscaler_period_us
+    //   - a thread is added when the busiest thread is above
+    //     autoscaler_high_utilization or a flow backs up on the nic
+    //     (congested, or at least autoscaler_backlog RPCs in its FIFO)
+    //   - a thread is removed when the others can take over its load and stay
+    //     below autoscaler_low_utilization
+    //   - no decision is made for autoscaler_cooldown_us after a scaling
+    //     event, so the new configuration is given time to settle
+    constexpr uint32_t autoscaler_period_us = 10000;
+    constexpr double autoscaler_high_utilization = 0.8;
+    constexpr double autoscaler_low_utilization = 0.5;
+    constexpr uint64_t autoscaler_backlog = 4;
+    constexpr uint32_t autoscaler_cooldown_us = 100000;
+
+    // Draining of a flow taken out of the nic load balancing
+    //   - the flow is drained when its FIFO on the nic is empty and it has
+    //     received no requests for flow_drain_us
+    //   - draining fails after flow_drain_timeout_us, e.g. if the requests
+    //     are steered statically (lb_static)
+    constexpr uint32_t flow_drain_us = 1000;
+    constexpr uint32_t flow_drain_timeout_us = 1000000;
+
+    // Asynchronous logging (FRPC_LOG_ASYNC)
+    //   - every logging thread records into its own ring of log_ring_size
+    //     records, records are dropped when the ring is full
+    //   - the rings are formatted and written out every log_flush_us
+    //   - every call site takes at most log_site_max_records records per
+    //     log_site_window_cycles (in TSC cycles), the rest are counted and
+    //     reported as suppressed
+    constexpr size_t log_ring_size = 1024;
+    constexpr uint32_t log_flush_us = 10000;
+    constexpr uint32_t log_site_max_records = 100;
+    constexpr uint64_t log_site_window_cycles = 1ULL << 31;
+
   }  // namespace sys
 
   namespace nic {
     // tx DMA batch size
     //   - in MTUs
     //   - see NicCCIP for MTU definition
-    //   - only used with CCI-P DMA mode enabled
+    //   - only used with CCI-P DMA mode enabled, 0 means no batching
     constexpr size_t tx_batch_size = 0;
 
     // Log tx queue size
@@ -40,15 +174,11 @@ namespace cfg {
     // Constraints:
     //   - in UPI polling mode, any size allowed, but it should be at least
     //     log(RX_BATCH_SIZE) as defined in ccip_queue_polling.sv
-    //   - in MMIO mode, must be equal to 0
+    //   - in MMIO mode, ignored: the queues always have a single entry
     //   - in DMA mode, must be multiple of DMA batch size
     constexpr size_t l_tx_queue_size = 3;
     static_assert((1 << l_tx_queue_size) >= tx_batch_size,
                   "tx queue size should be multiple of tx batch size");
-#ifdef NIC_CCIP_MMIO
-    static_assert(l_tx_queue_size == 0,
-                  "tx queue size should be 0 for MMIO-based mode");
-#endif
 
     // Log rx batch size (depricated)
     //   - in MTUs
@@ -8,6 +8,8 @@
 
 #include <arpa/inet.h>
 
+#include <string>
+
 namespace dagger {
 
 //
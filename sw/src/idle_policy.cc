@@ -0,0 +1,65 @@
+#include "idle_policy.h"
+
+#include <cpuid.h>
+#include <immintrin.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+namespace dagger {
+
+IdlePolicy::IdlePolicy(uint64_t spin_cycles, uint64_t pause_cycles,
+                       uint64_t umwait_cycles, uint64_t sleep_us)
+    : spin_end_(spin_cycles),
+      pause_end_(spin_cycles + pause_cycles),
+      umwait_end_(spin_cycles + pause_cycles + umwait_cycles),
+      sleep_us_(sleep_us),
+      umwait_supported_(is_umwait_supported()),
+      idle_start_(0),
+      polls_(0),
+      pause_(1),
+      stage_(sSpin),
+      sleeping_(0) {
+  for (size_t i = 0; i < sNumOfStages; ++i) {
+    entries_[i] = 0;
+  }
+}
+
+bool IdlePolicy::is_umwait_supported() {
+  // CPUID.(EAX=7,ECX=0):ECX.WAITPKG[bit 5]
+  unsigned int eax, ebx, ecx, edx;
+  if (__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx) == 0) return false;
+  return (ecx & (1 << 5)) != 0;
+}
+
+__attribute__((target("waitpkg"))) void IdlePolicy::umonitor(
+    volatile const void* rx_line) {
+  _umonitor(const_cast<void*>(rx_line));
+}
+
+__attribute__((target("waitpkg"))) void IdlePolicy::umwait(uint64_t deadline) {
+  // Wakes up on a write to the monitored line, or at the deadline; 1 selects
+  // C0.1, the lighter state with the faster wake-up (0 would request the
+  // deeper C0.2), as the thread only gets here after short idle periods and
+  // sleeps on a futex for longer ones
+  _umwait(1, deadline);
+}
+
+void IdlePolicy::sleep() {
+  struct timespec timeout;
+  timeout.tv_sec = static_cast<time_t>(sleep_us_ / 1000000);
+  timeout.tv_nsec = static_cast<long>((sleep_us_ % 1000000) * 1000);
+
+  // Returns immediately if the thread has been notified already
+  syscall(SYS_futex, reinterpret_cast<uint32_t*>(&sleeping_),
+          FUTEX_WAIT_PRIVATE, 1, &timeout, nullptr, 0);
+}
+
+void IdlePolicy::wake() {
+  sleeping_.store(0, std::memory_order_release);
+  syscall(SYS_futex, reinterpret_cast<uint32_t*>(&sleeping_),
+          FUTEX_WAKE_PRIVATE, 1, nullptr, nullptr, 0);
+}
+
+}  // namespace dagger
@@ -0,0 +1,183 @@
+/**
+ * @file idle_policy.h
+ * @brief Idle policy of the polling threads.
+ * @author Nikita Lazarev
+ */
+#ifndef _IDLE_POLICY_H_
+#define _IDLE_POLICY_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+
+#include "config.h"
+#include "utils.h"
+
+namespace dagger {
+
+/// Idle policy of a polling thread (server dispatch and completion queue
+/// threads). The thread calls idle() on every empty poll and reset() when it
+/// finds work. The longer the thread stays idle, the deeper it goes:
+///   - sSpin: plain spinning on the rx line, no wake-up penalty;
+///   - sPause: spinning with exponential _mm_pause backoff, frees the
+///     pipeline for the hyperthread sibling;
+///   - sUmwait: umonitor/umwait on the rx line, the core goes to C0.1 and is
+///     woken by the nic's write to the line (only if the CPU supports
+///     WAITPKG, otherwise this stage is skipped);
+///   - sSleep: futex sleep with a timeout, the core is released to the OS.
+///
+/// The nic can not wake up a sleeping thread, so sleeps are bounded by
+/// cfg::sys::idle_sleep_us; threads of the same process can wake it up early
+/// with notify().
+class IdlePolicy {
+ public:
+  enum Stage : uint8_t {
+    sSpin = 0,
+    sPause = 1,
+    sUmwait = 2,
+    sSleep = 3,
+    sNumOfStages = 4
+  };
+
+  /// Budgets are in TSC cycles since the thread became idle, see
+  /// cfg::sys::idle_*.
+  IdlePolicy(uint64_t spin_cycles = cfg::sys::idle_spin_cycles,
+             uint64_t pause_cycles = cfg::sys::idle_pause_cycles,
+             uint64_t umwait_cycles = cfg::sys::idle_umwait_cycles,
+             uint64_t sleep_us = cfg::sys::idle_sleep_us);
+
+  IdlePolicy(const IdlePolicy&) = delete;
+
+  ///
+  /// Polling thread interface.
+  ///
+
+  /// The thread has found work.
+  inline void reset() __attribute__((always_inline)) {
+    idle_start_ = 0;
+    stage_ = sSpin;
+  }
+
+  /// The thread has found no work while polling @param rx_line. The call
+  /// returns after at most one wait of the current stage; @param has_work is
+  /// re-checked right before waiting to not miss the nic's write or a
+  /// notify(). The thread does not go deeper than @param max_stage.
+  template <typename F>
+  inline __attribute__((always_inline)) void idle(volatile const void* rx_line,
+                                                  F has_work,
+                                                  Stage max_stage = sSleep) {
+    // Only look at the clock every few polls while spinning
+    if (stage_ == sSpin && (++polls_ & (tsc_check_period - 1)) != 0) return;
+
+    uint64_t now = utils::rdtsc();
+    if (idle_start_ == 0) {
+      idle_start_ = now;
+      pause_ = 1;
+      return;
+    }
+
+    Stage stage = stage_of(now - idle_start_);
+    if (stage > max_stage) stage = max_stage;
+    if (stage == sUmwait && !umwait_supported_) stage = sPause;
+
+    if (stage != stage_) {
+      stage_ = stage;
+      ++entries_[stage];
+    }
+
+    switch (stage) {
+      case sSpin:
+        break;
+      case sPause:
+        backoff();
+        break;
+      case sUmwait:
+        // Arm the monitor before the last check, so a write in between
+        // is not missed
+        umonitor(rx_line);
+        if (!has_work()) umwait(now + cfg::sys::idle_umwait_timeout_cycles);
+        break;
+      default:
+        sleeping_.store(1, std::memory_order_seq_cst);
+        if (!has_work()) sleep();
+        sleeping_.store(0, std::memory_order_relaxed);
+        break;
+    }
+  }
+
+  /// Current stage.
+  Stage get_stage() const { return stage_; }
+
+  ///
+  /// Notifier interface, can be called from any thread.
+  ///
+
+  /// Wake up the thread if it is sleeping. The caller must have published
+  /// the work before calling. If the thread is not sleeping, this is a single
+  /// relaxed load, cheap enough for every request on the client hot path; the
+  /// fence is only paid on the sleep/wake handshake. A notify() racing with
+  /// the thread going to sleep can miss it, the thread then wakes up on its
+  /// own after at most one sleep (cfg::sys::idle_sleep_us).
+  inline void notify() __attribute__((always_inline)) {
+    if (sleeping_.load(std::memory_order_relaxed) == 0) return;
+
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    wake();
+  }
+
+  ///
+  /// Stats.
+  ///
+
+  /// Number of times the thread has entered @param stage.
+  size_t get_number_of_entries(Stage stage) const { return entries_[stage]; }
+
+  /// Whether the CPU supports umonitor/umwait.
+  static bool is_umwait_supported();
+
+ private:
+  static constexpr uint64_t tsc_check_period = 64;
+
+  inline Stage stage_of(uint64_t idle_cycles) const {
+    if (idle_cycles < spin_end_) return sSpin;
+    if (idle_cycles < pause_end_) return sPause;
+    if (idle_cycles < umwait_end_) return sUmwait;
+    return sSleep;
+  }
+
+  inline void backoff() __attribute__((always_inline)) {
+    for (size_t i = 0; i < pause_; ++i) {
+      __builtin_ia32_pause();
+    }
+    if (pause_ < cfg::sys::idle_max_pause) pause_ <<= 1;
+  }
+
+  void umonitor(volatile const void* rx_line);
+  void umwait(uint64_t deadline);
+  void sleep();
+  void wake();
+
+ private:
+  // Stage boundaries, in TSC cycles since the thread became idle.
+  uint64_t spin_end_;
+  uint64_t pause_end_;
+  uint64_t umwait_end_;
+  uint64_t sleep_us_;
+
+  bool umwait_supported_;
+
+  // Polling thread state.
+  uint64_t idle_start_;
+  uint64_t polls_;
+  size_t pause_;
+  Stage stage_;
+  size_t entries_[sNumOfStages];
+
+  // Futex word, 1 while the thread is (about to be) sleeping.
+  std::atomic<uint32_t> sleeping_;
+};
+
+}  // namespace dagger
+
+#endif
@@ -0,0 +1,84 @@
+#include "load_generator.h"
+
+#include <immintrin.h>
+
+#include <cassert>
+
+#include "utils.h"
+
+namespace dagger {
+
+LoadGenerator::LoadGenerator(double rps, size_t num_of_threads,
+                             size_t thread_id, double cycles_in_ns,
+                             uint64_t start_tsc, const BurstParams& burst,
+                             uint64_t seed)
+    : start_tsc_(start_tsc),
+      calm_cycles_(0),
+      burst_cycles_(0),
+      exp_(1.0),
+      now_(0),
+      phase_end_(0),
+      in_burst_(false),
+      late_(0) {
+  assert(rps > 0 && num_of_threads > 0 && cycles_in_ns > 0);
+
+  rate_ = rps / num_of_threads / (cycles_in_ns * 1000000000.0);
+  calm_rate_ = rate_;
+  burst_rate_ = rate_;
+
+  // Threads draw independent arrivals but the same phases
+  std::seed_seq arrival_seed{seed, static_cast<uint64_t>(thread_id)};
+  arrival_rng_.seed(arrival_seed);
+  phase_rng_.seed(seed);
+
+  if (burst.factor > 1 && burst.burst_us > 0 && burst.calm_us > 0) {
+    burst_cycles_ = burst.burst_us * 1000 * cycles_in_ns;
+    calm_cycles_ = burst.calm_us * 1000 * cycles_in_ns;
+
+    // Keep the time-average rate at rate_
+    double p_burst = burst_cycles_ / (burst_cycles_ + calm_cycles_);
+    calm_rate_ = rate_ / (1 - p_burst + burst.factor * p_burst);
+    burst_rate_ = burst.factor * calm_rate_;
+
+    // Start in the stationary phase distribution
+    in_burst_ = std::uniform_real_distribution<double>(0, 1)(phase_rng_) <
+                p_burst;
+    next_phase();
+  }
+}
+
+void LoadGenerator::next_phase() {
+  phase_end_ += exp_(phase_rng_) * (in_burst_ ? burst_cycles_ : calm_cycles_);
+}
+
+uint64_t LoadGenerator::next() {
+  double gap = exp_(arrival_rng_) / (in_burst_ ? burst_rate_ : calm_rate_);
+
+  // Arrivals are memoryless, so a gap crossing the end of the phase is
+  // redrawn from there at the rate of the next phase
+  while (calm_cycles_ != 0 && now_ + gap >= phase_end_) {
+    now_ = phase_end_;
+    in_burst_ = !in_burst_;
+    next_phase();
+    gap = exp_(arrival_rng_) / (in_burst_ ? burst_rate_ : calm_rate_);
+  }
+
+  now_ += gap;
+  return start_tsc_ + static_cast<uint64_t>(now_);
+}
+
+uint64_t LoadGenerator::wait_next() {
+  uint64_t send_tsc = next();
+
+  if (utils::rdtsc() > send_tsc) {
+    ++late_;
+    return send_tsc;
+  }
+
+  while (utils::rdtsc() < send_tsc) {
+    _mm_pause();
+  }
+  return send_tsc;
+}
+
+}  // namespace dagger
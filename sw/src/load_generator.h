@@ -0,0 +1,97 @@
+/**
+ * @file load_generator.h
+ * @brief Open-loop load generator: TSC schedule of request arrivals.
+ * @author Nikita Lazarev
+ */
+#ifndef _LOAD_GENERATOR_H_
+#define _LOAD_GENERATOR_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <random>
+
+namespace dagger {
+
+/// Bursty arrivals as a two-phase Markov-modulated Poisson process (MMPP):
+/// the load alternates between calm and burst phases of exponentially
+/// distributed durations, the rate in bursts being @a factor times the calm
+/// one. The rates are scaled so that the average one stays the target.
+struct BurstParams {
+  // Burst rate over calm rate, <= 1 for plain Poisson arrivals.
+  double factor;
+  // Mean durations of the phases, us.
+  double burst_us;
+  double calm_us;
+};
+
+/// Open-loop arrival schedule of one of the threads of a load generator.
+///
+/// Requests are issued at the times of a Poisson process whatever the state
+/// of the previous ones, so a slow server does not slow down the load, and
+/// their latency should be taken from the intended send time (see next())
+/// rather than from the actual one, otherwise the queueing delay at the
+/// client is lost (coordinated omission).
+///
+/// The threads of a generator share the aggregate rate: each one runs an
+/// independent Poisson process at rps/num_of_threads from the common
+/// @a start_tsc, and the superposition of them is a Poisson process at rps.
+/// With bursts, the phases of all the threads are drawn from the same seed,
+/// so the threads burst together.
+class LoadGenerator {
+ public:
+  /// Schedule of @param thread_id out of @param num_of_threads making
+  /// @param rps requests per second together, starting at @param start_tsc.
+  /// @param cycles_in_ns is the measured TSC frequency.
+  LoadGenerator(double rps, size_t num_of_threads, size_t thread_id,
+                double cycles_in_ns, uint64_t start_tsc,
+                const BurstParams& burst = BurstParams{1, 0, 0},
+                uint64_t seed = 1);
+
+  /// Get the intended send time of the next request, TSC.
+  uint64_t next();
+
+  /// Spin until the intended send time of the next request and return it.
+  /// A thread which is behind the schedule returns right away, so requests
+  /// are not dropped but sent late, and the delay shows up in their latency.
+  uint64_t wait_next();
+
+  /// Requests wait_next() found to be past their intended send time, i.e.
+  /// the thread can not sustain the rate.
+  size_t get_number_of_late_requests() const { return late_; }
+
+  /// Mean rate of this thread, requests per TSC cycle.
+  double get_rate() const { return rate_; }
+
+ private:
+  // Draw the duration of the current phase into phase_end_.
+  void next_phase();
+
+ private:
+  uint64_t start_tsc_;
+
+  // Requests per cycle: mean, and of the calm and burst phases.
+  double rate_;
+  double calm_rate_;
+  double burst_rate_;
+
+  // Mean phase durations, cycles; 0 if there are no bursts.
+  double calm_cycles_;
+  double burst_cycles_;
+
+  std::mt19937_64 arrival_rng_;
+  std::mt19937_64 phase_rng_;
+  std::exponential_distribution<double> exp_;
+
+  // Cycles since start_tsc_: intended time of the last request, and end of
+  // the current phase.
+  double now_;
+  double phase_end_;
+  bool in_burst_;
+
+  size_t late_;
+};
+
+}  // namespace dagger
+
+#endif
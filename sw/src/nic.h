@@ -18,6 +18,22 @@
 
 namespace dagger {
 
+/// Hardware load balancing schemes of the server-destinated requests.
+/// This should be consistent with the LbScheme in hw/rtl/cpu_if_defs.vh
+///   - lb_static: requests go to the flow set by the connection,
+///   - lb_round_robin: requests are spread across all flows in round robin,
+///   - lb_affinity: requests go to the flow hdr.affinity % num_of_flows, so
+///     requests with the same affinity key always land on the same flow.
+enum LbScheme { lb_static = 0, lb_round_robin = 1, lb_affinity = 2 };
+
+/// Transports of the outgoing RPCs, set by the CCI-P mode the hardware is
+/// built with:
+///   - tx_polling: the nic polls the tx queues in the shared memory,
+///   - tx_mmio: requests are written right into the nic's MMIO space,
+///   - tx_dma: requests are written into the shared memory, and the nic is
+///     notified to fetch them in batches.
+enum TxMode { tx_polling = 0, tx_mmio = 1, tx_dma = 2 };
+
 /// Inheritance hierarchy:
 ///   Nic -> NicCCIP -> NicPollingCCIP
 ///                  -> NicMmioCCIP
@@ -87,6 +103,9 @@ class Nic {
   /// TODO(Nikita): hide this method
   virtual size_t get_mtu_size_bytes() const = 0;
 
+  /// Transport the requests are sent through, see ccip_tx.h.
+  virtual TxMode get_tx_mode() const = 0;
+
   /// Run the perf_thread with the corresponsing @param perf_mask as the perf
   /// event filter and the post-processing callback function @param callback.
   /// The perf_thread runs periodically, reads hardware performance counters and
@@ -106,11 +125,76 @@ class Nic {
       NicPerfMask perf_mask,
       void (*callback)(const std::vector<uint64_t>&)) = 0;
 
+  /// Snapshot of the hardware performance counters.
+  struct PerfCounters {
+    uint64_t rps;                           // outgoing RPCs per second
+    std::vector<uint64_t> packet_counters;  // RPC packet counters
+  };
+
+  /// Read the hardware performance counters into @param counters.
+  /// This is a slow path call.
+  virtual int get_perf_counters(PerfCounters& counters) const = 0;
+
   /// Set-up the hardware load balancing scheme for the server-destinated
-  /// requests.
+  /// requests, @param lb is one of the LbScheme values.
   virtual void set_lb(int lb) const = 0;
+
+  /// Set the flows the load balancer steers requests to, bit i of
+  /// @param mask stands for flow i. With lb_affinity, requests whose key maps
+  /// onto an inactive flow go round-robin over the active ones. Has no effect
+  /// with lb_static; all flows are active after the nic reset.
+  virtual int set_flow_mask(uint64_t mask) const = 0;
+
+  /// Per-flow statistics of the nic-to-cpu path.
+  struct FlowStats {
+    uint64_t drops;      // number of RPCs dropped in the flow
+    uint64_t occupancy;  // current occupancy of the flow FIFO on the nic
+    bool congested;      // congestion flag as of the last flow monitor update
+  };
+
+  /// Read the statistics of the hardware flow @param flow.
+  /// This is a slow path call.
+  virtual int get_flow_stats(size_t flow, FlowStats& stats) const = 0;
+
+  /// Run the flow monitor that mirrors the hardware per-flow congestion flags
+  /// into host memory every @param period_us microseconds, so they can be
+  /// checked on the critical path with is_flow_congested(). A flow is
+  /// congested when its FIFO on the nic is about to overflow or has dropped
+  /// RPCs since the previous update.
+  virtual int run_flow_monitor(uint32_t period_us) = 0;
+
+  /// Check the congestion flag of the flow @param flow. Always false if the
+  /// flow monitor is not running.
+  virtual bool is_flow_congested(size_t flow) const = 0;
 };
 
+/// Aggregate the performance counters of several nics into @param counters:
+/// their rates and packet counters are summed up. @param read_counters reads
+/// the counters of one element of @param nics, the first error it returns
+/// is returned.
+template <typename Nics, typename ReadCounters>
+int aggregate_perf_counters(const Nics& nics, ReadCounters read_counters,
+                            Nic::PerfCounters& counters) {
+  counters.rps = 0;
+  counters.packet_counters.clear();
+
+  for (auto& nic : nics) {
+    Nic::PerfCounters nic_counters;
+    int res = read_counters(nic, nic_counters);
+    if (res != 0) return res;
+
+    counters.rps += nic_counters.rps;
+    if (counters.packet_counters.size() < nic_counters.packet_counters.size()) {
+      counters.packet_counters.resize(nic_counters.packet_counters.size(), 0);
+    }
+    for (size_t i = 0; i < nic_counters.packet_counters.size(); ++i) {
+      counters.packet_counters[i] += nic_counters.packet_counters[i];
+    }
+  }
+
+  return 0;
+}
+
 }  // namespace dagger
 
 #endif
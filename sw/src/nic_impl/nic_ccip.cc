@@ -4,6 +4,8 @@
 #include <sys/mman.h>
 #include <unistd.h>
 
+#include <algorithm>
+#include <chrono>
 #include <thread>
 #include <vector>
 
@@ -16,8 +18,9 @@
 namespace dagger {
 
 // Timeout values.
-#define NIC_INIT_DELAY_S 1
-#define NIC_INIT_TIMEOUT 15  // in # of iteration of NIC_INIT_DELAY_S
+#define NIC_POLL_MIN_DELAY_US 1u       // first back-off delay
+#define NIC_POLL_MAX_DELAY_US 10000u   // back-off delay cap
+#define NIC_POLL_TIMEOUT_US 15000000   // give up after this time
 #define NIC_PERF_DELAY_S 2
 
 NicCCIP::NicCCIP(uint64_t base_nic_addr, size_t num_of_flows,
@@ -31,6 +34,8 @@ NicCCIP::NicCCIP(uint64_t base_nic_addr, size_t num_of_flows,
       master_nic_(master_nic),
       phy_network_en_(false),
       collect_perf_(false),
+      monitor_flows_(false),
+      congested_flows_(0),
       conn_manager_(num_of_flows + 100) {}
 
 NicCCIP::~NicCCIP() {
@@ -65,6 +70,28 @@ int NicCCIP::connect_to_nic(int bus) {
   return 0;
 }
 
+template <typename F>
+int NicCCIP::poll_nic(F ready) const {
+  auto start = std::chrono::steady_clock::now();
+  uint32_t delay_us = 0;
+  while (true) {
+    bool done = false;
+    int res = ready(done);
+    if (res != 0) return res;
+    if (done) return 0;
+
+    if (std::chrono::steady_clock::now() - start >
+        std::chrono::microseconds(NIC_POLL_TIMEOUT_US)) {
+      return 1;
+    }
+
+    // The first re-check is immediate, then back-off exponentially
+    if (delay_us != 0) usleep(delay_us);
+    delay_us = std::min(std::max(2 * delay_us, NIC_POLL_MIN_DELAY_US),
+                        NIC_POLL_MAX_DELAY_US);
+  }
+}
+
 int NicCCIP::initialize_nic(const PhyAddr& host_phy, const IPv4& host_ipv4) {
   assert(connected_ == true);
   assert(dp_configured_ == true);
@@ -156,15 +183,12 @@ int NicCCIP::initialize_nic(const PhyAddr& host_phy, const IPv4& host_ipv4) {
   }
 
   // Wait until NIC is initialized
-  int wait_iteration = 0;
-  do {
-    int res = get_nic_hw_status(status);
-    if (res != 0) return res;
-    ++wait_iteration;
-    sleep(NIC_INIT_DELAY_S);
-  } while (status.ready == 0 && wait_iteration < NIC_INIT_TIMEOUT);
-
-  if (status.ready == 0) {
+  res = poll_nic([&](bool& done) {
+    int status_res = get_nic_hw_status(status);
+    done = status.ready == 1;
+    return status_res;
+  });
+  if (res != 0 || status.ready == 0) {
     FRPC_ERROR(
         "Nic configuration error, failed to initialize nic: timeout reached\n");
     return 1;
@@ -205,15 +229,12 @@ int NicCCIP::start_nic() {
   }
 
   // Wait until NIC is running
-  int wait_iteration = 0;
-  do {
-    int res = get_nic_hw_status(status);
-    if (res != 0) return res;
-    ++wait_iteration;
-    sleep(NIC_INIT_DELAY_S);
-  } while (status.running == 0 && wait_iteration < NIC_INIT_TIMEOUT);
-
-  if (status.running == 0) {
+  res = poll_nic([&](bool& done) {
+    int status_res = get_nic_hw_status(status);
+    done = status.running == 1;
+    return status_res;
+  });
+  if (res != 0 || status.running == 0) {
     FRPC_ERROR("Nic configuration error, failed to run nic: timeout reached\n");
     return 1;
   }
@@ -235,6 +256,28 @@ int NicCCIP::run_perf_thread(NicPerfMask perf_mask,
   return 0;
 }
 
+int NicCCIP::get_perf_counters(PerfCounters& counters) const {
+  assert(connected_ == true);
+
+  fpga_result res = fpgaReadMMIO64(accel_handle_, 0,
+                                   base_nic_addr_ + iRegCcipRps, &counters.rps);
+  if (res != FPGA_OK) {
+    FRPC_ERROR(
+        "Nic configuration error, failed to read performance counter"
+        "nic returned: %d\n",
+        res);
+    return 1;
+  }
+
+  counters.packet_counters.resize(iNumOfPckCnt);
+  for (uint8_t cnt_id = 0; cnt_id < iNumOfPckCnt; ++cnt_id) {
+    int ret = read_packet_counter(cnt_id, counters.packet_counters[cnt_id]);
+    if (ret != 0) return ret;
+  }
+
+  return 0;
+}
+
 int NicCCIP::stop_nic() {
   assert(started_ == true);
 
@@ -251,6 +294,13 @@ int NicCCIP::stop_nic() {
     perf_thread_.join();
   }
 
+  // Stop flow monitor if running
+  if (monitor_flows_) {
+    monitor_flows_ = false;
+    flow_monitor_thread_.join();
+    congested_flows_ = 0;
+  }
+
   // Stop
   fpga_result ret = fpgaWriteMMIO64(
       accel_handle_, 0, base_nic_addr_ + iRegNicStart, iConstNicStop);
@@ -263,17 +313,12 @@ int NicCCIP::stop_nic() {
   }
 
   // Wait until NIC is stopped
-  int wait_iteration = 0;
-  do {
-    int res = get_nic_hw_status(status);
-    if (res != 0) {
-      return res;
-    }
-    ++wait_iteration;
-    sleep(NIC_INIT_DELAY_S);
-  } while (status.running == 1 && wait_iteration < NIC_INIT_TIMEOUT);
-
-  if (status.running == 1) {
+  res = poll_nic([&](bool& done) {
+    int status_res = get_nic_hw_status(status);
+    done = status.running == 0;
+    return status_res;
+  });
+  if (res != 0 || status.running == 1) {
     FRPC_ERROR(
         "Nic configuration error, failed to stop nic: timeout reached\n");
     return 1;
@@ -302,6 +347,37 @@ int NicCCIP::check_hw_errors() const {
   return 0;
 }
 
+int NicCCIP::read_hw_tx_mode(TxMode& mode) const {
+  assert(connected_ == true);
+
+  uint64_t raw_mode;
+  fpga_result res =
+      fpgaReadMMIO64(accel_handle_, 0, base_nic_addr_ + iRegNicMode, &raw_mode);
+  if (res != FPGA_OK) {
+    FRPC_ERROR(
+        "Nic configuration error, failed to read ccip mode register"
+        "nic returned: %d\n",
+        res);
+    return 1;
+  }
+
+  const NicMode* ccip_mode = reinterpret_cast<const NicMode*>(&raw_mode);
+  switch (ccip_mode->ccip_mode) {
+    case iConstCcipMMIO:
+      mode = tx_mmio;
+      break;
+    case iConstCcipDma:
+      mode = tx_dma;
+      break;
+    default:
+      // Both the polling and the queue polling hardware poll the tx queues
+      mode = tx_polling;
+      break;
+  }
+
+  return 0;
+}
+
 int NicCCIP::open_connection(ConnectionId& c_id, const IPv4& dest_addr,
                              ConnectionFlowId c_flow_id) const {
   std::unique_lock<std::mutex> lck(conn_setup_mtx_);
@@ -435,12 +511,12 @@ int NicCCIP::register_connection(ConnectionId c_id, const IPv4& dest_addr,
   }
 
   // Wait until connection is registered
-  ConnSetupStatus* c_setup_status;
-  uint64_t raw_status;
-  int wait_iteration = 0;
-  do {
-    res = fpgaReadMMIO64(accel_handle_, 0, base_nic_addr_ + iRegConnStatus,
-                         &raw_status);
+  uint64_t raw_status = 0;
+  ConnSetupStatus* c_setup_status =
+      reinterpret_cast<ConnSetupStatus*>(&raw_status);
+  int poll_res = poll_nic([&](bool& done) {
+    fpga_result res = fpgaReadMMIO64(
+        accel_handle_, 0, base_nic_addr_ + iRegConnStatus, &raw_status);
     if (res != FPGA_OK) {
       FRPC_ERROR(
           "Nic configuration error, failed to register connection, "
@@ -449,14 +525,11 @@ int NicCCIP::register_connection(ConnectionId c_id, const IPv4& dest_addr,
       return 1;
     }
 
-    c_setup_status = reinterpret_cast<ConnSetupStatus*>(&raw_status);
-
-    ++wait_iteration;
-    sleep(NIC_INIT_DELAY_S);
-  } while (!(c_setup_status->valid == 1 && c_setup_status->conn_id == c_id) &&
-           wait_iteration < NIC_INIT_TIMEOUT);
-
-  if (!(c_setup_status->valid == 1 && c_setup_status->conn_id == c_id)) {
+    done = c_setup_status->valid == 1 && c_setup_status->conn_id == c_id;
+    return 0;
+  });
+  if (poll_res != 0 ||
+      !(c_setup_status->valid == 1 && c_setup_status->conn_id == c_id)) {
     FRPC_ERROR(
         "Nic configuration error, failed to register connection: timeout "
         "reached\n");
@@ -528,12 +601,12 @@ int NicCCIP::remove_connection(ConnectionId c_id) const {
   }
 
   // Wait until connection is closed
-  ConnSetupStatus* c_setup_status;
-  uint64_t raw_status;
-  int wait_iteration = 0;
-  do {
-    res = fpgaReadMMIO64(accel_handle_, 0, base_nic_addr_ + iRegConnStatus,
-                         &raw_status);
+  uint64_t raw_status = 0;
+  ConnSetupStatus* c_setup_status =
+      reinterpret_cast<ConnSetupStatus*>(&raw_status);
+  int poll_res = poll_nic([&](bool& done) {
+    fpga_result res = fpgaReadMMIO64(
+        accel_handle_, 0, base_nic_addr_ + iRegConnStatus, &raw_status);
     if (res != FPGA_OK) {
       FRPC_ERROR(
           "Nic configuration error, failed to remove connection, "
@@ -542,14 +615,11 @@ int NicCCIP::remove_connection(ConnectionId c_id) const {
       return 1;
     }
 
-    c_setup_status = reinterpret_cast<ConnSetupStatus*>(&raw_status);
-
-    ++wait_iteration;
-    sleep(NIC_INIT_DELAY_S);
-  } while (!(c_setup_status->valid == 1 && c_setup_status->conn_id == c_id) &&
-           wait_iteration < NIC_INIT_TIMEOUT);
-
-  if (!(c_setup_status->valid == 1 && c_setup_status->conn_id == c_id)) {
+    done = c_setup_status->valid == 1 && c_setup_status->conn_id == c_id;
+    return 0;
+  });
+  if (poll_res != 0 ||
+      !(c_setup_status->valid == 1 && c_setup_status->conn_id == c_id)) {
     FRPC_ERROR(
         "Nic configuration error, failed to remove connection: timeout "
         "reached\n");
@@ -578,12 +648,26 @@ int NicCCIP::remove_connection(ConnectionId c_id) const {
 void NicCCIP::set_lb(int lb) const {
   // setUpOpen
   int res = fpgaWriteMMIO64(accel_handle_, 0, base_nic_addr_ + iRegLb,
-                            *reinterpret_cast<uint64_t*>(&lb));
+                            static_cast<uint64_t>(lb));
   if (res != FPGA_OK) {
     FRPC_ERROR("Nic configuration error, failed to configure LB %d\n", res);
   }
 }
 
+int NicCCIP::set_flow_mask(uint64_t mask) const {
+  assert(connected_ == true);
+
+  int res =
+      fpgaWriteMMIO64(accel_handle_, 0, base_nic_addr_ + iRegFlowMask, mask);
+  if (res != FPGA_OK) {
+    FRPC_ERROR("Nic configuration error, failed to configure flow mask %d\n",
+               res);
+    return 1;
+  }
+
+  return 0;
+}
+
 int NicCCIP::get_nic_hw_status(NicHwStatus& status) const {
   assert(connected_ == true);
 
@@ -675,26 +759,8 @@ void NicCCIP::get_packet_counters(
   std::vector<uint64_t> counters;
   counters_str += "Nic RPC counters dump >> \n";
   for (uint8_t cnt_id = 0; cnt_id < iNumOfPckCnt; ++cnt_id) {
-    fpga_result res = fpgaWriteMMIO64(accel_handle_, 0,
-                                      base_nic_addr_ + iRegGetPckCnt, cnt_id);
-    if (res != FPGA_OK) {
-      FRPC_ERROR(
-          "Nic configuration error, failed to read packet counters"
-          "nic returned: %d\n",
-          res);
-    }
-
-    // Wait until fpgaWrite propagates and counter is read
-    usleep(1000);
     uint64_t pck_cnt = 0;
-    res =
-        fpgaReadMMIO64(accel_handle_, 0, base_nic_addr_ + iRegPckCnt, &pck_cnt);
-    if (res != FPGA_OK) {
-      FRPC_ERROR(
-          "Nic configuration error, failed to read packet counters"
-          "nic returned: %d\n",
-          res);
-    }
+    read_packet_counter(cnt_id, pck_cnt);
     counters.push_back(pck_cnt);
     counters_str += "  counter[" + std::to_string(cnt_id) +
                     "] = " + std::to_string(pck_cnt) + "\n";
@@ -707,6 +773,86 @@ void NicCCIP::get_packet_counters(
   }
 }
 
+int NicCCIP::read_packet_counter(uint8_t cnt_id, uint64_t& value) const {
+  std::unique_lock<std::mutex> lck(pck_cnt_mtx_);
+
+  fpga_result res = fpgaWriteMMIO64(accel_handle_, 0,
+                                    base_nic_addr_ + iRegGetPckCnt, cnt_id);
+  if (res != FPGA_OK) {
+    FRPC_ERROR(
+        "Nic configuration error, failed to read packet counters"
+        "nic returned: %d\n",
+        res);
+    return 1;
+  }
+
+  // Wait until fpgaWrite propagates and counter is read
+  usleep(1000);
+  res = fpgaReadMMIO64(accel_handle_, 0, base_nic_addr_ + iRegPckCnt, &value);
+  if (res != FPGA_OK) {
+    FRPC_ERROR(
+        "Nic configuration error, failed to read packet counters"
+        "nic returned: %d\n",
+        res);
+    return 1;
+  }
+
+  return 0;
+}
+
+int NicCCIP::get_flow_stats(size_t flow, FlowStats& stats) const {
+  assert(connected_ == true);
+
+  if (flow >= iMaxNumOfFlows) {
+    FRPC_ERROR("Flow %zu does not exist on the nic\n", flow);
+    return 1;
+  }
+
+  int res = read_packet_counter(
+      static_cast<uint8_t>(iPckCntFlowDropBase + flow), stats.drops);
+  if (res != 0) return res;
+
+  res = read_packet_counter(
+      static_cast<uint8_t>(iPckCntFlowOccupancyBase + flow), stats.occupancy);
+  if (res != 0) return res;
+
+  stats.congested = is_flow_congested(flow);
+  return 0;
+}
+
+int NicCCIP::run_flow_monitor(uint32_t period_us) {
+  assert(connected_ == true);
+
+  if (monitor_flows_) {
+    FRPC_ERROR("Flow monitor is already running\n");
+    return 1;
+  }
+
+  FRPC_INFO("Running flow monitor on the nic\n");
+  monitor_flows_ = true;
+  flow_monitor_thread_ =
+      std::thread{&NicCCIP::flow_monitor_loop, this, period_us};
+  return 0;
+}
+
+void NicCCIP::flow_monitor_loop(uint32_t period_us) {
+  while (monitor_flows_) {
+    // The hardware register is sticky and cleared on read, so flows that
+    // congested at any time since the previous read are reported
+    uint64_t flags = 0;
+    fpga_result res = fpgaReadMMIO64(accel_handle_, 0,
+                                     base_nic_addr_ + iRegFlowCongestion,
+                                     &flags);
+    if (res != FPGA_OK) {
+      FRPC_ERROR("Nic configuration error, failed to read congestion flags\n");
+    } else {
+      congested_flows_.store(flags, std::memory_order_relaxed);
+    }
+
+    usleep(period_us);
+  }
+}
+
 void NicCCIP::get_network_counters() const {
   assert(connected_ == true);
 
@@ -11,6 +11,7 @@
 #include <stdint.h>
 #include <uuid/uuid.h>
 
+#include <atomic>
 #include <mutex>
 #include <string>
 #include <thread>
@@ -63,6 +64,8 @@ class NicCCIP : public Nic {
   static constexpr uint8_t iRegNetDropCntRead = 160;  // hw: 40, W
   static constexpr uint8_t iRegNetDropCnt = 168;      // hw: 42, R
   static constexpr uint8_t iRegTxQueueSize = 176;     // hw: 44, W
+  static constexpr uint8_t iRegFlowCongestion = 184;  // hw: 46, R
+  static constexpr uint8_t iRegFlowMask = 192;        // hw: 48, W
   static constexpr uint16_t iMMIOSpaceStart = 256;    // hw: 64, -
 
   // Hardware register map constants.
@@ -76,6 +79,9 @@ class NicCCIP : public Nic {
   static constexpr int iPhyNetDisabled = 0;
   static constexpr int iPhyNetEnabled = 1;
   static constexpr uint8_t iNumOfPckCnt = 5;
+  static constexpr size_t iMaxNumOfFlows = 16;  // 2^LMAX_NUM_OF_FLOWS
+  static constexpr uint8_t iPckCntFlowDropBase = 16;
+  static constexpr uint8_t iPckCntFlowOccupancyBase = 32;
   static constexpr uint8_t iNumOfNetworkCnt = 9;
 
   /// Construct the nic based on the @param base_rf_addr MMIO base address,
@@ -101,7 +107,18 @@ class NicCCIP : public Nic {
   virtual int run_perf_thread(
       NicPerfMask perf_mask,
       void (*callback)(const std::vector<uint64_t>&)) final;
+  virtual int get_perf_counters(PerfCounters& counters) const final;
   virtual void set_lb(int lb) const final;
+  virtual int set_flow_mask(uint64_t mask) const final;
+  virtual int get_flow_stats(size_t flow, FlowStats& stats) const final;
+  virtual int run_flow_monitor(uint32_t period_us) final;
+  virtual bool is_flow_congested(size_t flow) const final {
+    return (congested_flows_.load(std::memory_order_relaxed) >> flow) & 1;
+  }
+
+  /// Read the transport the hardware is built with into @param mode; the nic
+  /// must be connected.
+  int read_hw_tx_mode(TxMode& mode) const;
 
   // CCI-P implementation dependent functionality. These APIs are implemented in
   // the inherited classes.
@@ -137,6 +154,14 @@ class NicCCIP : public Nic {
   /// Round-up a value to the size of the pages.
   size_t round_up_to_pagesize(size_t val) const;
 
+  /// Poll the nic until the @param ready callback reports completion through
+  /// its bool& argument. The nic is re-checked immediately and then with
+  /// exponentially growing delays up to a cap, so short hardware transitions
+  /// complete in microseconds. Returns non-zero on timeout or if @param ready
+  /// returns non-zero.
+  template <typename F>
+  int poll_nic(F ready) const;
+
   /// Low-level API to connect to the FPGA.
   fpga_handle connect_to_accel(const char* accel_uuid, int bus) const;
 
@@ -228,6 +253,12 @@ class NicCCIP : public Nic {
   /// Sump network counters.
   void get_network_counters() const;
 
+  /// Read the packet counter @param cnt_id into @param value.
+  int read_packet_counter(uint8_t cnt_id, uint64_t& value) const;
+
+  /// Flow monitor loop.
+  void flow_monitor_loop(uint32_t period_us);
+
  protected:
   uint64_t base_nic_addr_;
 
@@ -256,6 +287,15 @@ class NicCCIP : public Nic {
   volatile bool collect_perf_;
   std::thread perf_thread_;
 
+  // Flow monitor thread and the host copy of the congestion flags.
+  volatile bool monitor_flows_;
+  std::thread flow_monitor_thread_;
+  std::atomic<uint64_t> congested_flows_;
+
+  // Packet counters are read through the shared iRegGetPckCnt/iRegPckCnt
+  // register pair, so reads from different threads should not interleave.
+  mutable std::mutex pck_cnt_mtx_;
+
   // Connection manager.
   // TODO(Nikita): is this the right place for connection manager?
   //       I don't like 'mutable' here, the nic has always been const!
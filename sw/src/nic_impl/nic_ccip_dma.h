@@ -36,6 +36,8 @@ class NicDmaCCIP : public NicCCIP {
 
   virtual int configure_data_plane() final;
 
+  virtual TxMode get_tx_mode() const final { return tx_dma; }
+
   // Make sure to sync memory before calling this function.
   virtual int notify_nic_of_new_dma(size_t flow, size_t bucket) const final;
 
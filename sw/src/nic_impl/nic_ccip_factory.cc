@@ -0,0 +1,65 @@
+#include "nic_ccip_factory.h"
+
+#include "logger.h"
+#include "nic_ccip_dma.h"
+#include "nic_ccip_mmio.h"
+#include "nic_ccip_polling.h"
+
+namespace dagger {
+
+#if !defined(NIC_CCIP_POLLING) && !defined(NIC_CCIP_MMIO) && \
+    !defined(NIC_CCIP_DMA)
+// Read the transport the hardware on the bus @param bus is built with. The
+// mode register is common for all CCI-P nics, so any of them can read it;
+// the probing nic closes its connection when it goes out of scope.
+static int probe_ccip_tx_mode(uint64_t base_rf_addr, int bus, TxMode& mode) {
+  NicPollingCCIP probe(base_rf_addr, 1, true);
+  int res = probe.connect_to_nic(bus);
+  if (res != 0) {
+    FRPC_ERROR("Failed to connect to the nic to read its CCI-P mode\n");
+    return res;
+  }
+
+  return probe.read_hw_tx_mode(mode);
+}
+#endif
+
+std::unique_ptr<Nic> make_ccip_nic(uint64_t base_rf_addr, size_t num_of_flows,
+                                   bool master_nic, int bus) {
+#if defined(NIC_CCIP_POLLING)
+#  pragma message "compiling Nic to run in polling mode"
+  TxMode mode = tx_polling;
+  (void)bus;
+#elif defined(NIC_CCIP_MMIO)
+// MMIO intefrace only works either with write-combine buffering or AVX
+// intrinsics.
+#  pragma message "compiling Nic to run in MMIO mode"
+  TxMode mode = tx_mmio;
+  (void)bus;
+#elif defined(NIC_CCIP_DMA)
+#  pragma message "compiling Nic to run in DMA mode"
+  TxMode mode = tx_dma;
+  (void)bus;
+#else
+#  pragma message "compiling Nic to run in the CCI-P mode of the hardware"
+  TxMode mode;
+  if (probe_ccip_tx_mode(base_rf_addr, bus, mode) != 0) return nullptr;
+#endif
+
+  switch (mode) {
+    case tx_mmio:
+      FRPC_INFO("Creating CCI-P nic in MMIO mode\n");
+      return std::unique_ptr<Nic>(
+          new NicMmioCCIP(base_rf_addr, num_of_flows, master_nic));
+    case tx_dma:
+      FRPC_INFO("Creating CCI-P nic in DMA mode\n");
+      return std::unique_ptr<Nic>(
+          new NicDmaCCIP(base_rf_addr, num_of_flows, master_nic));
+    default:
+      FRPC_INFO("Creating CCI-P nic in polling mode\n");
+      return std::unique_ptr<Nic>(
+          new NicPollingCCIP(base_rf_addr, num_of_flows, master_nic));
+  }
+}
+
+}  // namespace dagger
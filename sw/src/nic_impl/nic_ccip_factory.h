@@ -0,0 +1,29 @@
+/**
+ * @file nic_ccip_factory.h
+ * @brief Creation of the CCI-P nic matching the hardware.
+ * @author Nikita Lazarev
+ */
+#ifndef _NIC_CCIP_FACTORY_H_
+#define _NIC_CCIP_FACTORY_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <memory>
+
+#include "nic.h"
+
+namespace dagger {
+
+/// Create the CCI-P nic with the @param base_rf_addr MMIO base address and
+/// @param num_of_flows hardware flows, see NicCCIP. If the software is built
+/// for a single CCI-P mode (NIC_CCIP_POLLING, NIC_CCIP_MMIO or NIC_CCIP_DMA),
+/// the nic of this mode is created. Otherwise, the mode is read from the
+/// hardware on the bus @param bus, so the same binary runs on all of them.
+/// The returned nic is not connected yet; nullptr is returned on failure.
+std::unique_ptr<Nic> make_ccip_nic(uint64_t base_rf_addr, size_t num_of_flows,
+                                   bool master_nic, int bus = -1);
+
+}  // namespace dagger
+
+#endif
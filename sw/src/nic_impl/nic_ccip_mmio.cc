@@ -86,8 +86,8 @@ int NicMmioCCIP::configure_data_plane() {
   }
 
   // Allocate Tx buffer.
-  // In MMIO mode, each Tx buffer has exactly one entry.
-  assert(cfg::nic::l_tx_queue_size == 0);
+  // In MMIO mode, each Tx buffer has exactly one entry, so the tx queues
+  // have a single slot (see TxQueue::get_l_depth()).
   res = fpgaMapMMIO(accel_handle_, 0, &tx_mmio_buf_);
   if (res != FPGA_OK) {
     FRPC_ERROR("Failed to allocate MMIO buffer, nic returned %d\n", res);
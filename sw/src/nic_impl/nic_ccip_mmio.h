@@ -34,6 +34,8 @@ class NicMmioCCIP : public NicCCIP {
 
   virtual int configure_data_plane() final;
 
+  virtual TxMode get_tx_mode() const final { return tx_mmio; }
+
   virtual int notify_nic_of_new_dma(size_t flow, size_t bucket) const {
     // No needs to explicitly notify NIC
     return 0;
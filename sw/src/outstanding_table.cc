@@ -0,0 +1,115 @@
+#include "outstanding_table.h"
+
+namespace dagger {
+
+OutstandingTable::OutstandingTable()
+    : table_(new Entry[table_size]),
+      issued_(0),
+      evicted_(0),
+      deadline_log_(new uint32_t[table_size]),
+      deadline_log_head_(0),
+      retired_(0),
+      wheel_(cfg::sys::deadline_wheel_size),
+      next_tick_(0),
+      next_tick_tsc_(0),
+      deadline_log_tail_(0) {
+  deadline_log_lock_.clear();
+
+  for (size_t i = 0; i < table_size; ++i) {
+    table_[i].tag = make_tag(0, sFree);
+    table_[i].issue_tsc = 0;
+    table_[i].deadline = 0;
+  }
+}
+
+bool OutstandingTable::complete(uint32_t rpc_id, uint64_t& issue_tsc) {
+  Entry& e = table_[slot_of(rpc_id)];
+
+  uint64_t expected = e.tag.load(std::memory_order_acquire);
+  if ((expected >> 3) != rpc_id || state_of(expected) < sPending) {
+    return false;
+  }
+
+  uint64_t tsc = e.issue_tsc.load(std::memory_order_relaxed);
+  if (!e.tag.compare_exchange_strong(expected, make_tag(rpc_id, sFree),
+                                     std::memory_order_acq_rel)) {
+    // Evicted by the client in the meantime
+    return false;
+  }
+
+  issue_tsc = tsc;
+  retired_.store(retired_.load(std::memory_order_relaxed) + 1,
+                 std::memory_order_relaxed);
+  return true;
+}
+
+void OutstandingTable::advance_wheel(uint64_t now,
+                                     std::vector<uint32_t>& expired) {
+  const uint64_t now_tick = now / cfg::sys::deadline_tick_cycles;
+  const size_t wheel_size = wheel_.size();
+
+  // Put newly issued requests with deadlines on the wheel; if the client has
+  // lapped the log, the lost entries belong to evicted requests anyway
+  uint64_t log_head = deadline_log_head_.load(std::memory_order_acquire);
+  if (log_head - deadline_log_tail_ > table_size) {
+    deadline_log_tail_ = log_head - table_size;
+  }
+  for (; deadline_log_tail_ < log_head; ++deadline_log_tail_) {
+    uint32_t rpc_id = deadline_log_[deadline_log_tail_ & (table_size - 1)];
+    size_t slot = slot_of(rpc_id);
+
+    uint64_t tick = table_[slot].deadline.load(std::memory_order_relaxed) /
+                    cfg::sys::deadline_tick_cycles;
+    if (tick < next_tick_) tick = next_tick_;
+
+    wheel_[tick % wheel_size].push_back(std::make_pair(rpc_id, slot));
+  }
+
+  // Process all fully elapsed ticks; if more than one rotation has elapsed,
+  // visiting each bucket once is enough
+  uint64_t from = next_tick_;
+  if (now_tick - from > wheel_size) {
+    from = now_tick - wheel_size;
+  }
+
+  for (uint64_t t = from; t < now_tick; ++t) {
+    auto& bucket = wheel_[t % wheel_size];
+
+    size_t keep = 0;
+    for (size_t i = 0; i < bucket.size(); ++i) {
+      uint32_t rpc_id = bucket[i].first;
+      Entry& e = table_[bucket[i].second];
+
+      // Already completed or evicted
+      uint64_t expected = make_tag(rpc_id, sPending);
+      if (e.tag.load(std::memory_order_acquire) != expected) continue;
+
+      // Deadline is more than one wheel rotation away
+      if (e.deadline.load(std::memory_order_relaxed) /
+              cfg::sys::deadline_tick_cycles >=
+          now_tick) {
+        bucket[keep++] = bucket[i];
+        continue;
+      }
+
+      if (e.tag.compare_exchange_strong(expected, make_tag(rpc_id, sFree),
+                                        std::memory_order_acq_rel)) {
+        expired.push_back(rpc_id);
+        retired_.store(retired_.load(std::memory_order_relaxed) + 1,
+                       std::memory_order_relaxed);
+      }
+    }
+    bucket.resize(keep);
+  }
+
+  next_tick_ = now_tick;
+  next_tick_tsc_ = (now_tick + 1) * cfg::sys::deadline_tick_cycles;
+}
+
+size_t OutstandingTable::get_number_of_outstanding_requests() const {
+  return issued_.load(std::memory_order_relaxed) -
+         retired_.load(std::memory_order_relaxed) -
+         evicted_.load(std::memory_order_relaxed);
+}
+
+}  // namespace dagger
@@ -0,0 +1,208 @@
+/**
+ * @file outstanding_table.h
+ * @brief Table of outstanding client requests with deadline tracking.
+ * @author Nikita Lazarev
+ */
+#ifndef _OUTSTANDING_TABLE_H_
+#define _OUTSTANDING_TABLE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "config.h"
+
+namespace dagger {
+
+/// Outstanding request table of a single RPC client. The client thread
+/// registers every issued request with its issue TSC and optional deadline;
+/// the completion queue thread retires requests when responses arrive and
+/// expires requests whose deadline has passed.
+///
+/// The table is indexed by the rpc_id counter (upper 16 bits of the rpc_id),
+/// so each request has a fixed slot and lookups are O(1). Expiry is done with
+/// a timer wheel that is only advanced by the completion queue thread, so no
+/// synchronization other than the per-slot state word is required.
+class OutstandingTable {
+ public:
+  static_assert(cfg::sys::l_outstanding_table_size <= 16,
+                "outstanding table can not be larger than the rpc_id space");
+  static_assert(cfg::sys::l_outstanding_table_size >=
+                    cfg::nic::l_tx_queue_size,
+                "outstanding table should not be smaller than the tx queue");
+
+  OutstandingTable();
+
+  OutstandingTable(const OutstandingTable&) = delete;
+
+  ///
+  /// Client thread interface.
+  ///
+
+  /// Kind of the request, i.e. who picks up its responses.
+  ///  - rAsync: the completion queue thread, into the completion queue
+  ///  - rSync: the thread waiting for it (see CompletionQueue::wait_response())
+  ///  - rStream: the completion queue thread, into the stream of the request;
+  ///    the request is only retired by the end-of-stream frame
+  enum RequestType { rAsync = 0, rSync = 1, rStream = 2 };
+
+  /// Register a new request @param rpc_id issued at @param issue_tsc. If
+  /// @param timeout_cycles is not 0, the request expires after this number of
+  /// TSC cycles. Set @param concurrent if multiple client threads can issue
+  /// requests at the same time. Synchronous and streaming requests
+  /// (@param type) have no deadline here: the waiting thread retires the
+  /// former on timeout, and streams last until their end.
+  inline void issue(uint32_t rpc_id, uint64_t issue_tsc,
+                    uint64_t timeout_cycles, bool concurrent = false,
+                    RequestType type = rAsync) __attribute__((always_inline)) {
+    Entry& e = table_[slot_of(rpc_id)];
+
+    // If the slot is still taken, the request it holds gets evicted; its
+    // response, if any, will be dropped as late
+    uint64_t prev = e.tag.exchange(make_tag(rpc_id, sIssuing),
+                                   std::memory_order_acq_rel);
+    if (state_of(prev) >= sPending) {
+      increment(evicted_, concurrent);
+    }
+
+    if (type != rAsync) timeout_cycles = 0;
+    e.issue_tsc.store(issue_tsc, std::memory_order_relaxed);
+    e.deadline.store(timeout_cycles == 0 ? 0 : issue_tsc + timeout_cycles,
+                     std::memory_order_relaxed);
+    e.tag.store(make_tag(rpc_id, static_cast<uint64_t>(sPending) +
+                                     static_cast<uint64_t>(type)),
+                std::memory_order_release);
+
+    increment(issued_, concurrent);
+
+    // Only requests with deadlines go to the timer wheel; concurrent clients
+    // serialize on the log as the completion queue thread expects entries
+    // below the head to be written
+    if (timeout_cycles != 0) {
+      if (concurrent) {
+        while (deadline_log_lock_.test_and_set(std::memory_order_acquire)) {
+        }
+      }
+
+      uint64_t n = deadline_log_head_.load(std::memory_order_relaxed);
+      deadline_log_[n & (table_size - 1)] = rpc_id;
+      deadline_log_head_.store(n + 1, std::memory_order_release);
+
+      if (concurrent) deadline_log_lock_.clear(std::memory_order_release);
+    }
+  }
+
+  ///
+  /// Completion queue thread interface.
+  ///
+
+  /// Retire the request @param rpc_id on response arrival. Returns true and
+  /// sets @param issue_tsc if the request was outstanding, false if it has
+  /// already expired, was evicted, or was never issued.
+  /// Threads waiting for synchronous requests also retire them, so the
+  /// calls must be serialized (see CompletionQueue::wait_response()).
+  bool complete(uint32_t rpc_id, uint64_t& issue_tsc);
+
+  /// Type @param rpc_id was issued with, rAsync if it is not outstanding.
+  inline RequestType get_type(uint32_t rpc_id) const
+      __attribute__((always_inline)) {
+    uint64_t tag = table_[slot_of(rpc_id)].tag.load(std::memory_order_acquire);
+    if ((tag >> 3) != rpc_id || state_of(tag) < sPending) return rAsync;
+    return static_cast<RequestType>(state_of(tag) - sPending);
+  }
+
+  /// Expire all requests whose deadline is before @param now and append their
+  /// rpc_ids to @param expired. The call is cheap (one comparison) unless a
+  /// new wheel tick has started since the last call.
+  inline void expire(uint64_t now, std::vector<uint32_t>& expired)
+      __attribute__((always_inline)) {
+    if (now < next_tick_tsc_) return;
+    advance_wheel(now, expired);
+  }
+
+  ///
+  /// Stats.
+  ///
+  size_t get_number_of_outstanding_requests() const;
+  size_t get_number_of_evicted_requests() const {
+    return evicted_.load(std::memory_order_relaxed);
+  }
+
+ private:
+  enum EntryState : uint64_t {
+    sFree = 0,
+    sIssuing = 1,
+    sPending = 2,
+    sPendingSync = 3,
+    sPendingStream = 4
+  };
+
+  struct Entry {
+    // rpc_id << 3 | state, all slot transitions are CAS on this word so
+    // reuse of the slot by a newer rpc_id can never be confused with the old
+    // request
+    std::atomic<uint64_t> tag;
+    std::atomic<uint64_t> issue_tsc;
+    std::atomic<uint64_t> deadline;
+  };
+
+  static inline uint64_t make_tag(uint32_t rpc_id, uint64_t state) {
+    return (static_cast<uint64_t>(rpc_id) << 3) | state;
+  }
+  static inline uint64_t state_of(uint64_t tag) { return tag & 0x7; }
+  static inline size_t slot_of(uint32_t rpc_id) {
+    return (rpc_id >> 16) & (table_size - 1);
+  }
+
+  // Counters written by the client thread(s); with a single client thread, a
+  // plain load/store is enough.
+  static inline void increment(std::atomic<uint64_t>& cnt, bool concurrent) {
+    if (concurrent) {
+      cnt.fetch_add(1, std::memory_order_relaxed);
+    } else {
+      cnt.store(cnt.load(std::memory_order_relaxed) + 1,
+                std::memory_order_relaxed);
+    }
+  }
+
+  void advance_wheel(uint64_t now, std::vector<uint32_t>& expired);
+
+ private:
+  static constexpr size_t table_size = 1
+                                       << cfg::sys::l_outstanding_table_size;
+
+  std::unique_ptr<Entry[]> table_;
+
+  // Number of requests issued by the client, only written by the client.
+  std::atomic<uint64_t> issued_;
+  std::atomic<uint64_t> evicted_;
+
+  // Log of the rpc_ids of requests with deadlines, this is how the
+  // completion queue thread learns about new requests to put on the wheel.
+  std::unique_ptr<uint32_t[]> deadline_log_;
+  std::atomic<uint64_t> deadline_log_head_;
+  std::atomic_flag deadline_log_lock_;
+
+  // Number of requests retired by the completion queue thread, both as
+  // completed and as expired.
+  std::atomic<uint64_t> retired_;
+
+  // Timer wheel, only accessed by the completion queue thread.
+  //  - each bucket holds <rpc_id, slot> of the requests with deadlines in the
+  //    corresponding tick
+  std::vector<std::vector<std::pair<uint32_t, size_t>>> wheel_;
+  // First tick not processed yet.
+  uint64_t next_tick_;
+  // TSC when the wheel has to be advanced next time.
+  uint64_t next_tick_tsc_;
+  // Position in the deadline log up to which requests are on the wheel.
+  uint64_t deadline_log_tail_;
+};
+
+}  // namespace dagger
+
+#endif
@@ -0,0 +1,170 @@
+/**
+ * @file rpc_bytes.h
+ * @brief Variable-length and repeated fields of the RPC messages.
+ * @author Nikita Lazarev
+ */
+#ifndef _RPC_BYTES_H_
+#define _RPC_BYTES_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <type_traits>
+
+#include "rpc_header.h"
+
+namespace dagger {
+
+/// Variable-length field of up to N bytes, declared in the IDL as bytes<N>
+/// (IsString = false) or string<N> (IsString = true). Strings are kept
+/// null-terminated, so c_str() can be passed to strlen() and friends.
+///
+/// On the wire, the field is a length prefix (1 byte if N < 256, 2 bytes
+/// otherwise) followed by the used bytes only; messages with such fields are
+/// encoded with all their fields packed back to back (see the generated
+/// encode()/decode() in rpc_types.h), and the header's argl is the encoded
+/// size.
+template <size_t N, bool IsString>
+struct VarBytes {
+  typedef typename std::conditional<(N < 256), uint8_t, uint16_t>::type
+      LenType;
+
+  static constexpr size_t max_size = N;
+
+  VarBytes() : len(0) {
+    if (IsString) buf[0] = '\0';
+  }
+
+  ///
+  /// Accessors.
+  ///
+
+  size_t size() const { return len; }
+  bool empty() const { return len == 0; }
+
+  const char* data() const { return buf; }
+  char* data() { return buf; }
+
+  /// Set the field to @param size bytes at @param src; returns 1 if they
+  /// do not fit.
+  int set(const void* src, size_t size) {
+    if (size > N) return 1;
+
+    memcpy(buf, src, size);
+    len = static_cast<LenType>(size);
+    if (IsString) buf[len] = '\0';
+    return 0;
+  }
+
+  /// String accessors.
+  int set(const char* str) { return set(str, strlen(str)); }
+  const char* c_str() const {
+    static_assert(IsString, "only string fields are null-terminated");
+    return buf;
+  }
+
+  ///
+  /// Wire encoding.
+  ///
+
+  size_t encoded_size() const { return sizeof(LenType) + len; }
+
+  /// Write the field to @param out, return the number of bytes written.
+  size_t encode(uint8_t* out) const {
+    memcpy(out, &len, sizeof(LenType));
+    memcpy(out + sizeof(LenType), buf, len);
+    return sizeof(LenType) + len;
+  }
+
+  /// Read the field at @param p and advance @param p past it; returns false
+  /// if the field is malformed or goes beyond @param end.
+  bool decode(const uint8_t*& p, const uint8_t* end) {
+    LenType size;
+    if (static_cast<size_t>(end - p) < sizeof(LenType)) return false;
+    memcpy(&size, p, sizeof(LenType));
+    p += sizeof(LenType);
+
+    if (size > N || static_cast<size_t>(end - p) < size) return false;
+    set(p, size);
+    p += size;
+    return true;
+  }
+
+  LenType len;
+  char buf[IsString ? N + 1 : N];
+};
+
+template <size_t N>
+using Bytes = VarBytes<N, false>;
+
+template <size_t N>
+using String = VarBytes<N, true>;
+
+/// Bounded list of up to N elements of type T, declared in the IDL as
+/// repeated T name[N]; T is a scalar or another message. Unlike bytes<N>, the
+/// list keeps the fixed layout of the message: all N slots are sent, and the
+/// generated rpc_types.h checks at compile time that the message still fits
+/// into a frame.
+template <typename T, size_t N>
+struct Repeated {
+  typedef typename std::conditional<(N < 256), uint8_t, uint16_t>::type
+      LenType;
+
+  static constexpr size_t max_size = N;
+
+  Repeated() : len(0) {}
+
+  /// The length comes from the wire, so it is clamped to N.
+  size_t size() const { return len < N ? len : N; }
+  bool empty() const { return len == 0; }
+  void clear() { len = 0; }
+
+  const T& operator[](size_t i) const { return items[i]; }
+  T& operator[](size_t i) { return items[i]; }
+
+  const T* begin() const { return items; }
+  const T* end() const { return items + size(); }
+  T* begin() { return items; }
+  T* end() { return items + size(); }
+
+  /// Append @param item; returns 1 if the list is full.
+  int push_back(const T& item) {
+    if (len >= N) return 1;
+
+    items[len++] = item;
+    return 0;
+  }
+
+  LenType len;
+  T items[N];
+};
+
+/// Read the message @param msg from the @param argl bytes of the RPC
+/// arguments @param argv. Messages without variable-length fields are sent
+/// as they are; the generated rpc_types.h overloads this for the others.
+/// Returns false for a malformed argl, which comes from the wire and can
+/// exceed the frame.
+template <typename T>
+inline bool rpc_decode(const uint8_t* argv, size_t argl, T& msg) {
+  if (argl > sizeof(RpcPckt::argv)) return false;
+
+  memcpy(&msg, argv, sizeof(T));
+  return true;
+}
+
+/// Write the message @param msg into the RPC arguments @param argv of up to
+/// @param max_argl bytes. Returns the number of bytes written, or 0 if the
+/// message does not fit; the generated rpc_types.h overloads this for
+/// messages with variable-length fields.
+template <typename T>
+inline size_t rpc_encode(const T& msg, uint8_t* argv, size_t max_argl) {
+  if (sizeof(T) > max_argl) return 0;
+
+  memcpy(argv, &msg, sizeof(T));
+  return sizeof(T);
+}
+
+}  // namespace dagger
+
+#endif
@@ -3,8 +3,10 @@
 #include <immintrin.h>
 
 #include <cassert>
+#include <cstring>
 #include <iostream>
 
+#include "ccip_tx.h"
 #include "config.h"
 #include "logger.h"
 #include "utils.h"
@@ -17,30 +19,42 @@ RpcClientNonBlock_Base::RpcClientNonBlock_Base(const Nic* nic,
     : client_id_(client_id),
       nic_(nic),
       nic_flow_id_(nic_flow_id),
-      cq_(nullptr),
-      rpc_id_cnt_(0) {
-#ifdef NIC_CCIP_MMIO
-  if (cfg::nic::l_tx_queue_size != 0) {
-    FRPC_ERROR("In MMIO mode, only one entry in the tx queue is allowed\n");
-    assert(false);
-  }
-#endif
-
-  // Allocate tx-queue.
+      tx_q_(&tx_queue_),
+      rpc_id_cnt_(0),
+      check_congestion_(false),
+      multi_producer_(false),
+      cq_(nullptr) {
+  // Allocate tx-queue and bind it to the transport of the nic.
   tx_queue_ = TxQueue(nic_->get_tx_flow_buffer(nic_flow_id_),
-                      nic_->get_mtu_size_bytes(), cfg::nic::l_tx_queue_size);
+                      nic_->get_mtu_size_bytes(),
+                      TxQueue::get_l_depth(nic_->get_tx_mode()));
   tx_queue_.init();
+  tx_queue_.bind_transport(nic_->get_tx_mode(), nic_, nic_flow_id_);
 
   // Allocate completion queue.
   cq_ = std::unique_ptr<CompletionQueue>(
       new CompletionQueue(nic_flow_id, nic_->get_rx_flow_buffer(nic_flow_id_),
                           nic_->get_mtu_size_bytes()));
   cq_->bind();
+}
 
-#ifdef NIC_CCIP_DMA
-  current_batch_ptr = 0;
-  batch_counter = 0;
-#endif
+RpcClientNonBlock_Base::RpcClientNonBlock_Base(
+    RpcClientNonBlock_Base* flow_client, uint16_t client_id)
+    : client_id_(client_id),
+      nic_(flow_client->nic_),
+      nic_flow_id_(flow_client->nic_flow_id_),
+      tx_q_(&flow_client->tx_queue_),
+      rpc_id_cnt_(0),
+      check_congestion_(false),
+      multi_producer_(true),
+      cq_(nullptr) {
+  // Requests of all clients of the flow go to the same tx queue.
+  assert(flow_client->multi_producer_);
+
+  // Completions are routed by the completion queue of the flow.
+  cq_ = std::unique_ptr<CompletionQueue>(
+      new CompletionQueue(client_id_, flow_client->cq_.get()));
+  cq_->bind();
 }
 
 RpcClientNonBlock_Base::~RpcClientNonBlock_Base() { cq_->unbind(); }
@@ -59,4 +73,52 @@ int RpcClientNonBlock_Base::disconnect() {
   return nic_->close_connection(c_id_);
 }
 
+int RpcClientNonBlock_Base::set_multi_producer(bool enable) {
+  if (enable && tx_q_->get_tx_mode() == tx_dma) {
+    FRPC_ERROR("Multi-producer clients are not supported in DMA mode\n");
+    return 1;
+  }
+  if (tx_q_ != &tx_queue_ && !enable) {
+    FRPC_ERROR("Logical clients can only run in the multi-producer mode\n");
+    return 1;
+  }
+
+  multi_producer_ = enable;
+  return 0;
+}
+
+int RpcClientNonBlock_Base::send_stream_credits(uint32_t rpc_id,
+                                                uint8_t fn_id,
+                                                uint8_t affinity,
+                                                uint32_t credits) {
+  // The grant is retried on the next poll of the stream
+  if (check_congestion_ && nic_->is_flow_congested(nic_flow_id_)) {
+    return rpc_congested;
+  }
+
+  uint8_t change_bit;
+  uint16_t rpc_cnt;
+  uint64_t tx_ticket;
+  char* tx_ptr = reserve_tx_slot(change_bit, rpc_cnt, tx_ticket);
+
+  RpcHeader hdr = RpcHeader();
+  hdr.c_id = c_id_;
+  hdr.rpc_id = rpc_id;
+  hdr.n_of_frames = 1;
+  hdr.frame_id = 0;
+
+  hdr.fn_id = fn_id;
+  hdr.argl = sizeof(credits);
+  hdr.affinity = affinity;
+
+  hdr.ctl.req_type = rpc_request;
+  hdr.ctl.one_way = 1;
+
+  ccip_send(*tx_q_, tx_ptr, change_bit, hdr,
+            [&](uint8_t* argv) { memcpy(argv, &credits, sizeof(credits)); });
+
+  publish_tx_slot(tx_ticket);
+  return rpc_ok;
+}
+
 }  // namespace dagger
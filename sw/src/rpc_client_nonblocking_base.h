@@ -14,11 +14,22 @@
 #include "completion_queue.h"
 #include "connection_manager.h"
 #include "nic.h"
+#include "rpc_bytes.h"
 #include "rpc_header.h"
+#include "rpc_stream.h"
 #include "tx_queue.h"
 
 namespace dagger {
 
+/// Return codes of the client RPC stubs; rpc_timeout is only reported by the
+/// awaitable (see rpc_coro.h) and synchronous stubs.
+enum RpcClientRetCode {
+  rpc_ok = 0,
+  rpc_fail = 1,
+  rpc_congested = 2,
+  rpc_timeout = 3
+};
+
 /// Non-blocking RPC client. Does not block the calling thread, returns the
 /// result through an async CompletionQueue.
 /// The RPC codegenerator extends (implements) this abstract class to define the
@@ -35,16 +46,108 @@ class RpcClientNonBlock_Base {
   /// all the requests coming from this client.
   RpcClientNonBlock_Base(const Nic* nic, size_t nic_flow_id,
                          uint16_t client_id);
+
+  /// Construct a logical client @param client_id which shares the nic flow,
+  /// tx queue and completion thread of @param flow_client. Responses to the
+  /// requests of the logical client are routed to its own completion queue.
+  /// The @param flow_client must be in the multi-producer mode and outlive the
+  /// logical client.
+  RpcClientNonBlock_Base(RpcClientNonBlock_Base* flow_client,
+                         uint16_t client_id);
   virtual ~RpcClientNonBlock_Base();
 
   /// Get associated bound completion queue.
   CompletionQueue* get_completion_queue() const;
 
+  /// Get the nic the client sends its requests through.
+  const Nic* get_nic() const { return nic_; }
+
   /// A wrapper on top of the nic's connection management functions.
   int connect(const IPv4& server_addr, ConnectionId c_id);
   int disconnect();
 
+  /// Enable/disable the congestion check in the RPC stubs. When enabled, the
+  /// stubs do not issue requests and return rpc_congested while the nic flow
+  /// of the client is congested, i.e. responses arrive faster than the client
+  /// drains them and new ones are likely to be dropped. Requires the flow
+  /// monitor to run on the nic.
+  void set_congestion_check(bool enable) { check_congestion_ = enable; }
+
+  /// Enable/disable the multi-producer mode. In this mode, the RPC stubs of
+  /// the client can be called concurrently from multiple threads: tx queue
+  /// slots and rpc_ids are allocated atomically, and requests are published
+  /// to the nic in any order. Responses are still delivered to the single
+  /// completion queue of the client. Must be set before the first request is
+  /// issued. Not supported in the DMA mode. Logical clients are always in
+  /// the multi-producer mode.
+  int set_multi_producer(bool enable);
+
  protected:
+  /// Register the request @param rpc_id as outstanding; requests with a
+  /// non-zero @param timeout_cycles get a timeout completion if not answered
+  /// within this number of TSC cycles.
+  inline void track_request(uint32_t rpc_id, uint64_t timeout_cycles)
+      __attribute__((always_inline)) {
+    cq_->track_request(rpc_id, timeout_cycles, multi_producer_);
+  }
+
+  /// Register the request @param rpc_id as a synchronous one, its response
+  /// is picked up by wait_sync_response() on the calling thread.
+  inline void track_sync_request(uint32_t rpc_id)
+      __attribute__((always_inline)) {
+    cq_->track_sync_request(rpc_id, multi_producer_);
+  }
+
+  /// Spin on the calling thread until the response to the synchronous
+  /// request @param rpc_id arrives and decode it into @param ret. Returns
+  /// rpc_ok, rpc_timeout if there is no response within @param timeout_cycles
+  /// TSC cycles, or rpc_fail if the response can not be decoded.
+  template <typename Resp>
+  int wait_sync_response(uint32_t rpc_id, uint64_t timeout_cycles,
+                         Resp& ret) {
+    RpcPckt response;
+    if (cq_->wait_response(rpc_id, timeout_cycles, response) != 0) {
+      return rpc_timeout;
+    }
+
+    if (!rpc_decode(response.argv, response.hdr.argl, ret)) return rpc_fail;
+    return rpc_ok;
+  }
+
+  /// Register the request @param rpc_id to the streaming function
+  /// @param fn_id, steered with @param affinity; the items of its response
+  /// go to @param stream.
+  inline void track_stream_request(uint32_t rpc_id, uint8_t fn_id,
+                                   uint8_t affinity,
+                                   RpcClientStream_Base& stream) {
+    stream.open(this, rpc_id, fn_id, affinity);
+    cq_->track_stream_request(rpc_id, &stream, multi_producer_);
+  }
+
+  /// Reserve the tx queue slot for the next request. Returns the slot with its
+  /// @param change_bit, the rpc_id counter @param rpc_cnt of the request and
+  /// the @param ticket to pass to publish_tx_slot() once the request is
+  /// written. In the multi-producer mode, the tx queue ticket also serves as
+  /// the rpc_id counter, so both come from a single atomic operation.
+  inline char* reserve_tx_slot(uint8_t& change_bit, uint16_t& rpc_cnt,
+                               uint64_t& ticket)
+      __attribute__((always_inline)) {
+    if (multi_producer_) {
+      char* tx_ptr = tx_q_->reserve_write_ptr(change_bit, ticket);
+      rpc_cnt = static_cast<uint16_t>(ticket);
+      return tx_ptr;
+    }
+
+    ticket = 0;
+    rpc_cnt = rpc_id_cnt_++;
+    return tx_queue_.get_write_ptr(change_bit);
+  }
+
+  /// Release the tx queue slot reserved with @param ticket.
+  inline void publish_tx_slot(uint64_t ticket) __attribute__((always_inline)) {
+    if (multi_producer_) tx_q_->release_write_ptr(ticket);
+  }
+
   /// client_id - a part of the rpc_id in the RPC header.
   uint16_t client_id_;
 
@@ -54,14 +157,18 @@ class RpcClientNonBlock_Base {
 
   /// Backed tx queue where the client writes requests into.
   TxQueue tx_queue_;
+  /// Tx queue used by the client: own, or the one of the flow client for
+  /// logical clients.
+  TxQueue* tx_q_;
 
   // rpc_id counter - a part of the RPC header.
   uint16_t rpc_id_cnt_;
 
-#ifdef NIC_CCIP_DMA
-  uint32_t current_batch_ptr;
-  size_t batch_counter;
-#endif
+  // Whether the stubs check the flow congestion flag.
+  bool check_congestion_;
+
+  // Whether the stubs can be called from multiple threads.
+  bool multi_producer_;
 
   // Connection ID associated with this client.
   // TODO(Nikita): so far, we only support a single connection per client;
@@ -70,6 +177,14 @@ class RpcClientNonBlock_Base {
   ConnectionId c_id_;
 
  private:
+  friend class RpcClientStream_Base;
+
+  // Grant the server @param credits more items of the stream @param rpc_id
+  // to the function @param fn_id, steered with @param affinity like its
+  // request. The grant is a one-way request with the rpc_id of the stream.
+  int send_stream_credits(uint32_t rpc_id, uint8_t fn_id, uint8_t affinity,
+                          uint32_t credits);
+
   // Binded completion queue.
   std::unique_ptr<CompletionQueue> cq_;
 };
@@ -6,21 +6,36 @@
 #ifndef _RPC_CLIENT_POOL_
 #define _RPC_CLIENT_POOL_
 
+#include <sched.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
 #include <memory>
 #include <mutex>
+#include <thread>
 #include <vector>
 
+#include "config.h"
 #include "logger.h"
 #include "nic.h"
-#include "nic_ccip_dma.h"
-#include "nic_ccip_mmio.h"
-#include "nic_ccip_polling.h"
+#include "nic_ccip_factory.h"
 
 namespace dagger {
 
 /// A pool of RPC clients. All the clients in the pool share the same nic. This
 /// class is the "owner" of the nic, i.e. it is responsible for initialization
 /// and configuration of the hardware for the RPC clients which it manages.
+///
+/// Clients can be returned to the pool with release() and are then reused by
+/// the next pop(). Both go through lock-free per-core caches of free clients;
+/// pop() only takes the clients cached on the other cores before it creates
+/// a new one.
+///
+/// By default, each client has its own nic flow. If the pool has fewer flows
+/// than clients, it hands out lightweight logical clients instead, which
+/// share the flows round-robin. Each logical client has its own client_id
+/// (and so rpc_id namespace) and its own completion queue.
 template <class T>
 class RpcClientPool {
  public:
@@ -28,11 +43,26 @@ class RpcClientPool {
 
   /// Create the RPC client pool object with the given capacity and
   /// based on the nic with the hardware MMIO address @param base_nic_addr.
-  RpcClientPool(uint64_t base_nic_addr, size_t max_pool_size)
+  /// If @param num_of_flows is not 0 and smaller than @param max_pool_size,
+  /// the pool hands out logical clients sharing this number of nic flows.
+  /// Logical clients are not supported in the DMA mode.
+  RpcClientPool(uint64_t base_nic_addr, size_t max_pool_size,
+                size_t num_of_flows = 0)
       : max_pool_size_(max_pool_size),
+        num_of_flows_(num_of_flows == 0 || num_of_flows > max_pool_size
+                          ? max_pool_size
+                          : num_of_flows),
         base_nic_addr_(base_nic_addr),
         rpc_client_cnt_(0),
-        nic_is_started_(false) {}
+        nic_is_started_(false),
+        num_of_caches_(std::max(std::thread::hardware_concurrency(), 1u)),
+        caches_(new CoreCache[num_of_caches_]) {
+    for (size_t i = 0; i < num_of_caches_; ++i) {
+      for (auto& slot : caches_[i].slots) {
+        slot = nullptr;
+      }
+    }
+  }
 
   ~RpcClientPool() {
     if (nic_is_started_) {
@@ -43,85 +73,57 @@ class RpcClientPool {
   /// This function initializes the backend's nic depending on the exact type of
   /// the nic. The function performs four actions to initialize the nic.
   int init_nic(int bus) {
+    PhyAddr cl_phy_addr = {0x1A, 0x2B, 0x3C, 0x4D, 0x5E, 0x6D};
+    IPv4 cl_ipv4_addr("192.168.0.1", 0);
+
+    return init_nic(bus, cl_phy_addr, cl_ipv4_addr);
+  }
+
+  /// Same as above, but with the host addresses @param host_phy and
+  /// @param host_ipv4 of the nic, e.g. if the process drives several nics.
+  int init_nic(int bus, const PhyAddr& host_phy, const IPv4& host_ipv4) {
     // (1) Create nic for all clients in the pool.
 #ifdef ASE_SIMULATION
 // If running is ASE, create a slave nic. We need this as in the ASE mode,
 // multiple nics share the same FPGA.
 #  pragma message "compiling client in ASE mode, running nic in slave mode"
-
-// Define Nic interface with CPU
-#  ifdef NIC_CCIP_POLLING
-#    pragma message "compiling Nic to run in polling mode"
-    // Simple case so far: number of NIC flows = max_pool_size_.
-    nic_ = std::unique_ptr<Nic>(
-        new NicPollingCCIP(base_nic_addr_, max_pool_size_, false));
-#  elif NIC_CCIP_MMIO
-// MMIO intefrace only works either with write-combine buffering or AVX
-// intrinsics.
-#    pragma message "compiling Nic to run in MMIO mode"
-    // Simple case so far: number of NIC flows = max_pool_size_.
-    nic_ = std::unique_ptr<Nic>(
-        new NicMmioCCIP(base_nic_addr_, max_pool_size_, false));
-#  elif NIC_CCIP_DMA
-#    pragma message "compiling Nic to run in DMA mode"
-    // Simple case so far: number of NIC flows = max_pool_size_.
-    nic_ = std::unique_ptr<Nic>(
-        new NicDmaCCIP(base_nic_addr_, max_pool_size_, false));
-#  else
-#    error Nic CCI-P mode is not specified
-#  endif
-
+    bool master_nic = false;
 #else
 // In the real-hardware mode, all the nics are master devices.
 #  pragma message "compiling client in HW mode, running nic in master mode"
-
-// Define nic interface with the CPU.
-#  ifdef NIC_CCIP_POLLING
-#    pragma message "compiling Nic to run in polling mode"
-    // Simple case so far: number of NIC flows = max_pool_size_
-    nic_ = std::unique_ptr<Nic>(
-        new NicPollingCCIP(base_nic_addr_, max_pool_size_, true));
-#  elif NIC_CCIP_MMIO
-// MMIO intefrace only works either with write-combine buffering or AVX
-// intrinsics
-#    pragma message "compiling Nic to run in MMIO mode"
-    // Simple case so far: number of NIC flows = max_pool_size_
-    nic_ = std::unique_ptr<Nic>(
-        new NicMmioCCIP(base_nic_addr_, max_pool_size_, true));
-#  elif NIC_CCIP_DMA
-#    pragma message "compiling Nic to run in DMA mode"
-    // Simple case so far: number of NIC flows = max_pool_size_
-    nic_ = std::unique_ptr<Nic>(
-        new NicDmaCCIP(base_nic_addr_, max_pool_size_, true));
-#  else
-#    error Nic CCI-P mode is not specified
-#  endif
-
+    bool master_nic = true;
 #endif
 
-    // (2) Connect to nic.
 #ifdef PLATFORM_PAC_A10
     // This is multi-FPGA system, so we need to explicitely set the bus.
-    int res = nic_->connect_to_nic(bus);
+    int nic_bus = bus;
 #elif PLATFORM_BDX
     // Single-FPGSA system.
-    int res = nic_->connect_to_nic();
+    int nic_bus = -1;
 #else
 #  error Platform is not specified
 #endif
+
+    // The nic of the CCI-P mode the software is built with, or the one the
+    // hardware runs
+    nic_ = make_ccip_nic(base_nic_addr_, num_of_flows_, master_nic, nic_bus);
+    if (nic_ == nullptr) {
+      FRPC_ERROR("Failed to create nic\n");
+      return 1;
+    }
+
+    // (2) Connect to nic.
+    int res = nic_->connect_to_nic(nic_bus);
     if (res != 0) return res;
     FRPC_INFO("Connected to NIC\n");
 
     // (3) Configure the nic dataplane. Of course, all the clients in this pool
     // share the same configuration.
-    PhyAddr cl_phy_addr = {0x1A, 0x2B, 0x3C, 0x4D, 0x5E, 0x6D};
-    IPv4 cl_ipv4_addr("192.168.0.1", 0);
-
     res = nic_->configure_data_plane();
     if (res != 0) return res;
 
     // (4) Run hardware initialization.
-    res = nic_->initialize_nic(cl_phy_addr, cl_ipv4_addr);
+    res = nic_->initialize_nic(host_phy, host_ipv4);
     if (res != 0) return res;
 
     return 0;
@@ -166,42 +168,166 @@ class RpcClientPool {
     return nic_->run_perf_thread(perf_mask, callback);
   }
 
-  /// Pop the next RPC client from the pool.
+  /// Read the hardware performance counters of the nic (slow path).
+  int perf_counters(Nic::PerfCounters& counters) const {
+    return nic_->get_perf_counters(counters);
+  }
+
+  /// The nic of the pool.
+  const Nic* get_nic() const { return nic_.get(); }
+
+  /// Read the statistics of the nic flow @param flow (slow path).
+  int flow_stats(size_t flow, Nic::FlowStats& stats) const {
+    return nic_->get_flow_stats(flow, stats);
+  }
+
+  /// A wrapper on top of the nic's flow monitor API. The monitor needs to run
+  /// for the clients' congestion checks to take effect.
+  int run_flow_monitor(uint32_t period_us) {
+    return nic_->run_flow_monitor(period_us);
+  }
+
+  /// Pop the next RPC client from the pool: a released one if any, otherwise
+  /// a new one.
   /// This method is thread-safe.
   T* pop() {
+    // Fast path: lock-free per-core cache
+    T* rpc_client = pop_cached(local_cache());
+    if (rpc_client != nullptr) return rpc_client;
+
     std::unique_lock<std::mutex> lck(mtx_);
 
-    if (rpc_client_cnt_ < max_pool_size_) {
-      // Directly map rpc clients to the NIC flows for now
+    // Released clients which did not fit into the caches
+    if (!free_clients_.empty()) {
+      rpc_client = free_clients_.back();
+      free_clients_.pop_back();
+      return rpc_client;
+    }
+
+    // Clients released on the other cores, e.g. before the thread migrated
+    for (size_t i = 0; i < num_of_caches_; ++i) {
+      rpc_client = pop_cached(caches_[i]);
+      if (rpc_client != nullptr) return rpc_client;
+    }
+
+    if (rpc_client_cnt_ == max_pool_size_) {
+      FRPC_ERROR("Max number of rpc clients is reached: %zu\n", max_pool_size_);
+      return nullptr;
+    }
+
+    if (num_of_flows_ == max_pool_size_) {
+      // Directly map rpc clients to the NIC flows
       rpc_client_pool.push_back(std::unique_ptr<T>(
           new T(nic_.get(), rpc_client_cnt_, rpc_client_cnt_)));
-      ++rpc_client_cnt_;
-      return rpc_client_pool.back().get();
     } else {
-      FRPC_ERROR("Max number of rpc clients is reached: %zu\n", max_pool_size_);
-      return nullptr;
+      // Spread logical clients over the NIC flows
+      size_t flow = rpc_client_cnt_ % num_of_flows_;
+      size_t slot = rpc_client_cnt_ / num_of_flows_ + 1;
+      if (slot >= (1 << cfg::sys::l_max_logical_clients_per_flow)) {
+        FRPC_ERROR("Max number of logical rpc clients per flow is reached\n");
+        return nullptr;
+      }
+
+      if (flow == flow_clients_.size()) {
+        flow_clients_.push_back(
+            std::unique_ptr<T>(new T(nic_.get(), flow, flow)));
+        if (flow_clients_.back()->set_multi_producer(true) != 0) {
+          flow_clients_.pop_back();
+          return nullptr;
+        }
+      }
+
+      uint16_t client_id =
+          (slot << (16 - cfg::sys::l_max_logical_clients_per_flow)) | flow;
+      rpc_client_pool.push_back(
+          std::unique_ptr<T>(new T(flow_clients_[flow].get(), client_id)));
+    }
+
+    ++rpc_client_cnt_;
+    return rpc_client_pool.back().get();
+  }
+
+  /// Return the RPC client @param rpc_client obtained with pop() to the pool.
+  /// The client keeps its connection and completion queue as they are, so it
+  /// should have no outstanding requests and its completions should be
+  /// consumed.
+  /// This method is thread-safe.
+  void release(T* rpc_client) {
+    assert(rpc_client != nullptr);
+
+    // Fast path: lock-free per-core cache
+    if (push_cached(rpc_client)) return;
+
+    std::unique_lock<std::mutex> lck(mtx_);
+    free_clients_.push_back(rpc_client);
+  }
+
+ private:
+  // Per-core cache of free clients.
+  struct CoreCache {
+    std::atomic<T*> slots[cfg::sys::client_pool_cache_size];
+  };
+
+  CoreCache& local_cache() {
+    int cpu = sched_getcpu();
+    return caches_[cpu < 0 ? 0 : cpu % num_of_caches_];
+  }
+
+  T* pop_cached(CoreCache& cache) {
+    for (auto& slot : cache.slots) {
+      T* rpc_client = slot.load(std::memory_order_relaxed);
+      if (rpc_client != nullptr &&
+          slot.compare_exchange_strong(rpc_client, nullptr,
+                                       std::memory_order_acquire)) {
+        return rpc_client;
+      }
+    }
+    return nullptr;
+  }
+
+  bool push_cached(T* rpc_client) {
+    for (auto& slot : local_cache().slots) {
+      T* expected = nullptr;
+      if (slot.load(std::memory_order_relaxed) == nullptr &&
+          slot.compare_exchange_strong(expected, rpc_client,
+                                       std::memory_order_release)) {
+        return true;
+      }
     }
+    return false;
   }
 
  private:
   size_t max_pool_size_;
+  size_t num_of_flows_;
   uint64_t base_nic_addr_;
 
   /// The NIC is shared by all RpcClients in the pool
   /// and owned by the RpcClientPool class.
   std::unique_ptr<Nic> nic_;
 
+  /// Clients owning the NIC flows in the logical client mode, they are never
+  /// handed out.
+  std::vector<std::unique_ptr<T>> flow_clients_;
+
   /// Rpc client pool.
   std::vector<std::unique_ptr<T>> rpc_client_pool;
 
   /// Rpc client counter.
   size_t rpc_client_cnt_;
 
+  /// Released clients which did not fit into the per-core caches.
+  std::vector<T*> free_clients_;
+
   /// Sync.
   std::mutex mtx_;
 
   /// Status of the underlying hardware nic.
   bool nic_is_started_;
+
+  /// Per-core caches of released clients.
+  size_t num_of_caches_;
+  std::unique_ptr<CoreCache[]> caches_;
 };
 
 }  // namespace dagger
@@ -0,0 +1,127 @@
+#include "rpc_coro.h"
+
+#ifdef __cpp_impl_coroutine
+
+#include "logger.h"
+
+namespace dagger {
+
+thread_local FramePool::Cache FramePool::cache_;
+
+FramePool::Cache::~Cache() {
+  for (size_t i = 0; i < num_of_classes; ++i) {
+    while (free[i] != nullptr) {
+      FreeFrame* frame = free[i];
+      free[i] = frame->next;
+      ::operator delete(frame);
+    }
+  }
+}
+
+thread_local RpcScheduler* RpcScheduler::current_ = nullptr;
+
+RpcScheduler::RpcScheduler() : tasks_(0), waiters_(0), unclaimed_(0) {
+  if (current_ != nullptr) {
+    FRPC_ERROR("Only one RPC scheduler per thread is allowed\n");
+    assert(false);
+  }
+  current_ = this;
+}
+
+RpcScheduler::~RpcScheduler() {
+  if (tasks_ != 0) {
+    FRPC_WARN("RPC scheduler is destroyed with %zu unfinished tasks\n",
+              tasks_);
+  }
+  current_ = nullptr;
+}
+
+void RpcScheduler::spawn(Task<void> task) {
+  auto h = std::exchange(task.h_, nullptr);
+  h.promise().scheduler = this;
+
+  ++tasks_;
+  h.resume();
+}
+
+void RpcScheduler::wait(CompletionQueue* cq, Waiter* waiter) {
+  Source* src = nullptr;
+  for (auto& s : sources_) {
+    if (s.cq == cq) {
+      src = &s;
+      break;
+    }
+  }
+
+  // First request on this client
+  if (src == nullptr) {
+    sources_.push_back(Source{cq, std::vector<Waiter*>(waiter_table_size)});
+    src = &sources_.back();
+  }
+
+  Waiter*& slot = src->waiters[slot_of(waiter->rpc_id)];
+  if (slot != nullptr) {
+    evicted_.push_back(slot);
+    --waiters_;
+  }
+
+  slot = waiter;
+  ++waiters_;
+}
+
+void RpcScheduler::resume(Waiter* waiter, const RpcPckt& pckt) {
+  *waiter->pckt = pckt;
+  waiter->handle.resume();
+}
+
+size_t RpcScheduler::poll() {
+  size_t resumed = 0;
+
+  if (!evicted_.empty()) {
+    RpcPckt timeout_pckt;
+    memset(&timeout_pckt, 0, sizeof(RpcPckt));
+    timeout_pckt.hdr.n_of_frames = 0;
+
+    std::vector<Waiter*> evicted;
+    evicted.swap(evicted_);
+    for (auto waiter : evicted) {
+      timeout_pckt.hdr.rpc_id = waiter->rpc_id;
+      resume(waiter, timeout_pckt);
+      ++resumed;
+    }
+  }
+
+  // Resumed coroutines can add new sources, so do not hold references to
+  // sources_ across resumptions
+  for (size_t i = 0; i < sources_.size(); ++i) {
+    completions_.clear();
+    sources_[i].cq->pop_responses(completions_);
+
+    for (const auto& pckt : completions_) {
+      Waiter*& slot = sources_[i].waiters[slot_of(pckt.hdr.rpc_id)];
+      if (slot == nullptr || slot->rpc_id != pckt.hdr.rpc_id) {
+        ++unclaimed_;
+        continue;
+      }
+
+      Waiter* waiter = slot;
+      slot = nullptr;
+      --waiters_;
+
+      resume(waiter, pckt);
+      ++resumed;
+    }
+  }
+
+  return resumed;
+}
+
+void RpcScheduler::run() {
+  while (tasks_ != 0) {
+    poll();
+  }
+}
+
+}  // namespace dagger
+
+#endif  // __cpp_impl_coroutine
@@ -0,0 +1,338 @@
+/**
+ * @file rpc_coro.h
+ * @brief C++20 coroutine layer on top of the non-blocking RPC clients.
+ * @author Nikita Lazarev
+ */
+#ifndef _RPC_CORO_H_
+#define _RPC_CORO_H_
+
+// The layer is only available when building with C++20 coroutines, see the
+// WITH_COROUTINES build option
+#ifdef __cpp_impl_coroutine
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <cassert>
+#include <coroutine>
+#include <cstring>
+#include <exception>
+#include <optional>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "completion_queue.h"
+#include "config.h"
+#include "rpc_bytes.h"
+#include "rpc_client_nonblocking_base.h"
+#include "rpc_header.h"
+
+namespace dagger {
+
+/// Pooled allocator of coroutine frames. Frames are taken from per-thread
+/// free lists of cache-line size classes, so once the lists are warmed up,
+/// calling a coroutine does not go to malloc. Frames larger than the largest
+/// size class are allocated from the heap.
+class FramePool {
+ public:
+  static inline void* allocate(size_t size) __attribute__((always_inline)) {
+    size_t cl = size_class(size);
+    if (cl < num_of_classes) {
+      Cache& c = cache_;
+      FreeFrame* frame = c.free[cl];
+      if (frame != nullptr) {
+        c.free[cl] = frame->next;
+        return frame;
+      }
+      ++c.heap_allocations;
+      return ::operator new((cl + 1) * granularity);
+    }
+
+    ++cache_.heap_allocations;
+    return ::operator new(size);
+  }
+
+  static inline void deallocate(void* ptr, size_t size)
+      __attribute__((always_inline)) {
+    size_t cl = size_class(size);
+    if (cl < num_of_classes) {
+      Cache& c = cache_;
+      FreeFrame* frame = reinterpret_cast<FreeFrame*>(ptr);
+      frame->next = c.free[cl];
+      c.free[cl] = frame;
+      return;
+    }
+
+    ::operator delete(ptr);
+  }
+
+  /// Number of frames the calling thread had to allocate from the heap.
+  static size_t get_number_of_heap_allocations() {
+    return cache_.heap_allocations;
+  }
+
+ private:
+  // Frames up to 4KB are pooled.
+  static constexpr size_t granularity = cfg::sys::cl_size_bytes;
+  static constexpr size_t num_of_classes = 64;
+
+  static inline size_t size_class(size_t size) {
+    return (size - 1) / granularity;
+  }
+
+  struct FreeFrame {
+    FreeFrame* next;
+  };
+
+  struct Cache {
+    FreeFrame* free[num_of_classes] = {};
+    size_t heap_allocations = 0;
+
+    ~Cache();
+  };
+
+  static thread_local Cache cache_;
+};
+
+class RpcScheduler;
+
+namespace internal {
+
+struct TaskPromiseBase {
+  // Coroutine awaiting this task, if any.
+  std::coroutine_handle<> continuation;
+  // Scheduler of a spawned (root) task, the frame destroys itself when done.
+  RpcScheduler* scheduler = nullptr;
+
+  static void* operator new(size_t size) { return FramePool::allocate(size); }
+  static void operator delete(void* ptr, size_t size) {
+    FramePool::deallocate(ptr, size);
+  }
+
+  // Tasks are lazy: they start when awaited or spawned.
+  std::suspend_always initial_suspend() noexcept { return {}; }
+
+  struct FinalAwaiter {
+    bool await_ready() noexcept { return false; }
+    template <typename P>
+    std::coroutine_handle<> await_suspend(
+        std::coroutine_handle<P> h) noexcept;
+    void await_resume() noexcept {}
+  };
+  FinalAwaiter final_suspend() noexcept { return {}; }
+
+  // The library does not use exceptions.
+  void unhandled_exception() noexcept { std::terminate(); }
+};
+
+template <typename T>
+struct TaskPromise : TaskPromiseBase {
+  std::optional<T> value;
+  void return_value(T v) { value = std::move(v); }
+};
+
+template <>
+struct TaskPromise<void> : TaskPromiseBase {
+  void return_void() {}
+};
+
+}  // namespace internal
+
+/// Coroutine type of request chains. A task starts when it is co_await-ed by
+/// another task or spawned on an RpcScheduler, and resumes its awaiter when
+/// done.
+template <typename T = void>
+class Task {
+ public:
+  struct promise_type : internal::TaskPromise<T> {
+    Task get_return_object() {
+      return Task(std::coroutine_handle<promise_type>::from_promise(*this));
+    }
+  };
+
+  Task(Task&& other) noexcept : h_(std::exchange(other.h_, nullptr)) {}
+  Task(const Task&) = delete;
+  Task& operator=(const Task&) = delete;
+
+  ~Task() {
+    if (h_) h_.destroy();
+  }
+
+  bool await_ready() const noexcept { return false; }
+
+  std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiter) {
+    h_.promise().continuation = awaiter;
+    return h_;
+  }
+
+  T await_resume() {
+    if constexpr (!std::is_void<T>::value) {
+      return std::move(*h_.promise().value);
+    }
+  }
+
+ private:
+  explicit Task(std::coroutine_handle<promise_type> h) : h_(h) {}
+
+  friend class RpcScheduler;
+
+  std::coroutine_handle<promise_type> h_;
+};
+
+/// Result of an awaited RPC.
+template <typename Resp>
+struct RpcResult {
+  /// rpc_ok, rpc_timeout, or the error of the stub if the request was not
+  /// issued (see RpcClientRetCode).
+  int status;
+  Resp resp;
+
+  bool ok() const { return status == rpc_ok; }
+  operator const Resp&() const { return resp; }
+};
+
+/// Per-thread scheduler of RPC coroutines. The scheduler drains the
+/// completion queues of the clients that coroutines are waiting on and
+/// resumes every waiting coroutine by the rpc_id of its response. A single
+/// thread can keep as many independent request chains in flight as the
+/// outstanding tables of its clients allow.
+///
+/// The scheduler becomes the current scheduler of the thread which creates
+/// it; all RPCs awaited on this thread are routed through it.
+class RpcScheduler {
+ public:
+  /// A coroutine waiting for the response to rpc_id.
+  struct Waiter {
+    uint32_t rpc_id;
+    std::coroutine_handle<> handle;
+    RpcPckt* pckt;
+  };
+
+  RpcScheduler();
+  ~RpcScheduler();
+
+  RpcScheduler(const RpcScheduler&) = delete;
+
+  /// The scheduler of the calling thread.
+  static RpcScheduler* current() { return current_; }
+
+  /// Start the request chain @param task; it runs until its first
+  /// suspension point, and its frame is released when it finishes.
+  void spawn(Task<void> task);
+
+  /// Drain all completions and resume the waiting coroutines. Returns the
+  /// number of resumed coroutines.
+  size_t poll();
+
+  /// Poll until all spawned tasks are finished.
+  void run();
+
+  /// Register @param waiter as waiting for a response in the completion
+  /// queue @param cq.
+  void wait(CompletionQueue* cq, Waiter* waiter);
+
+  /// Stats.
+  size_t get_number_of_tasks() const { return tasks_; }
+  size_t get_number_of_waiters() const { return waiters_; }
+  size_t get_number_of_unclaimed_responses() const { return unclaimed_; }
+
+ private:
+  friend struct internal::TaskPromiseBase;
+
+  void task_done() { --tasks_; }
+
+  // Resume @param waiter with @param pckt.
+  void resume(Waiter* waiter, const RpcPckt& pckt);
+
+  // Waiters are indexed by the rpc_id counter like in the OutstandingTable,
+  // so there can only be one outstanding request per slot.
+  static constexpr size_t waiter_table_size =
+      1 << cfg::sys::l_outstanding_table_size;
+  static inline size_t slot_of(uint32_t rpc_id) {
+    return (rpc_id >> 16) & (waiter_table_size - 1);
+  }
+
+  struct Source {
+    CompletionQueue* cq;
+    std::vector<Waiter*> waiters;
+  };
+
+  std::vector<Source> sources_;
+
+  // Waiters whose slot was taken by a newer request; the request has been
+  // evicted from the outstanding table too, so they are completed with a
+  // timeout.
+  std::vector<Waiter*> evicted_;
+
+  // Reused buffer of drained completions.
+  std::vector<RpcPckt> completions_;
+
+  size_t tasks_;
+  size_t waiters_;
+  size_t unclaimed_;
+
+  static thread_local RpcScheduler* current_;
+};
+
+/// Awaitable RPC returned by the co_<function> variants of the generated
+/// stubs. The request is issued when the awaitable is created, so a coroutine
+/// can issue several requests before awaiting them.
+template <typename Resp>
+class RpcAwait {
+ public:
+  RpcAwait(CompletionQueue* cq, int status, uint32_t rpc_id)
+      : cq_(cq), status_(status), waiter_{rpc_id, nullptr, &pckt_} {}
+
+  // The waiter points into the awaitable.
+  RpcAwait(const RpcAwait& other)
+      : cq_(other.cq_),
+        status_(other.status_),
+        waiter_{other.waiter_.rpc_id, nullptr, &pckt_} {}
+
+  bool await_ready() const noexcept { return status_ != rpc_ok; }
+
+  void await_suspend(std::coroutine_handle<> h) {
+    assert(RpcScheduler::current() != nullptr);
+    waiter_.handle = h;
+    RpcScheduler::current()->wait(cq_, &waiter_);
+  }
+
+  RpcResult<Resp> await_resume() {
+    RpcResult<Resp> res{status_, Resp()};
+    if (status_ != rpc_ok) return res;
+
+    if (CompletionQueue::is_timeout(pckt_)) {
+      res.status = rpc_timeout;
+    } else if (!rpc_decode(pckt_.argv, pckt_.hdr.argl, res.resp)) {
+      res.status = rpc_fail;
+    }
+    return res;
+  }
+
+ private:
+  CompletionQueue* cq_;
+  int status_;
+  RpcScheduler::Waiter waiter_;
+  RpcPckt pckt_;
+};
+
+template <typename P>
+std::coroutine_handle<> internal::TaskPromiseBase::FinalAwaiter::await_suspend(
+    std::coroutine_handle<P> h) noexcept {
+  TaskPromiseBase& p = h.promise();
+  if (p.continuation) return p.continuation;
+
+  // Spawned task, nobody owns the frame
+  if (p.scheduler != nullptr) {
+    p.scheduler->task_done();
+    h.destroy();
+  }
+  return std::noop_coroutine();
+}
+
+}  // namespace dagger
+
+#endif  // __cpp_impl_coroutine
+
+#endif  // _RPC_CORO_H_
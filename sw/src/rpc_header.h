@@ -26,9 +26,16 @@ struct __attribute__((__packed__)) RpcHeaderCtl {
   uint8_t req_type : 1;
   uint8_t update_flag : 1;
   uint8_t valid : 1;
+  uint8_t phase : 1;  // lap of the rx queue, set by the nic (see RxQueue)
+  uint8_t one_way : 1;  // request without response (`void` IDL functions)
+  uint8_t end_of_stream : 1;  // last frame of a streamed response
 };
 static_assert(sizeof(RpcHeaderCtl) == 1, "RpcHeaderCtl is too large");
 
+/// Bits of the RpcHeaderCtl byte, for checks with a single load.
+constexpr uint8_t rpc_ctl_valid_bit = 1 << 2;
+constexpr uint8_t rpc_ctl_phase_bit = 1 << 3;
+
 /// RPC main header.
 struct __attribute__((__packed__)) RpcHeader {
   RpcHeaderCtl ctl;
@@ -36,11 +43,13 @@ struct __attribute__((__packed__)) RpcHeader {
   // Transport data
   uint32_t rpc_id;      // unique RPC ID
   uint8_t n_of_frames;  // number of cl-sized frames
-  uint8_t frame_id;     // frame ID (0 for head)
+  uint8_t frame_id;     // frame ID (0 for head), or the sequence number
+                        // (mod 256) of the item in streamed responses
 
   // RPC data
-  uint16_t fn_id;  // remote function ID
-  uint16_t argl;   // length of args
+  uint8_t affinity;  // request steering hash (see LbScheme in nic.h)
+  uint8_t fn_id;     // remote function ID
+  uint16_t argl;     // length of args
 
   // Connection id
   uint8_t c_id;  // connection ID
@@ -60,6 +69,14 @@ struct __attribute__((__packed__)) RpcPckt {
 static_assert(sizeof(RpcPckt) == cfg::sys::cl_size_bytes,
               "RpcPckt does not fit a cache line");
 
+/// Whether the rx queue slot @param pckt holds a new packet, given the
+/// @param phase expected by the queue (see RxQueue::get_read_ptr()).
+inline bool rx_pckt_is_new(volatile const RpcPckt* pckt, uint8_t phase) {
+  uint8_t ctl = *reinterpret_cast<volatile const uint8_t*>(&pckt->hdr.ctl);
+  return (ctl & (rpc_ctl_valid_bit | rpc_ctl_phase_bit)) ==
+         (rpc_ctl_valid_bit | (phase != 0 ? rpc_ctl_phase_bit : 0));
+}
+
 }  // namespace dagger
 
 #endif
@@ -0,0 +1,200 @@
+/**
+ * @file rpc_multi_nic_client_pool.h
+ * @brief Implementation of the RPC client pool driving several nics.
+ * @author Nikita Lazarev
+ */
+#ifndef _RPC_MULTI_NIC_CLIENT_POOL_
+#define _RPC_MULTI_NIC_CLIENT_POOL_
+
+#include <sched.h>
+
+#include <atomic>
+#include <cassert>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "defs.h"
+#include "logger.h"
+#include "nic.h"
+#include "numa.h"
+#include "rpc_client_pool.h"
+
+namespace dagger {
+
+/// A pool of RPC clients striped over several nics, e.g. both FPGAs of the
+/// PAC_A10 platform. Each nic is driven by its own RpcClientPool; pop() hands
+/// out a client of a nic on the NUMA node of the calling thread, so requests
+/// and responses do not cross the socket interconnect. Without NUMA
+/// information, clients are spread across the nics round-robin.
+template <class T>
+class RpcMultiNicClientPool {
+ public:
+  /// Create the pool for nics with the hardware MMIO address
+  /// @param base_nic_addr and up to @param max_pool_size_per_nic clients
+  /// (over @param num_of_flows_per_nic flows, see RpcClientPool) on each nic.
+  RpcMultiNicClientPool(uint64_t base_nic_addr, size_t max_pool_size_per_nic,
+                        size_t num_of_flows_per_nic = 0)
+      : base_nic_addr_(base_nic_addr),
+        max_pool_size_per_nic_(max_pool_size_per_nic),
+        num_of_flows_per_nic_(num_of_flows_per_nic),
+        next_nic_(0) {
+    // NUMA node of each CPU, to pick the local nic on the critical path
+    unsigned int num_of_cpus = std::max(std::thread::hardware_concurrency(), 1u);
+    for (unsigned int cpu = 0; cpu < num_of_cpus; ++cpu) {
+      cpu_numa_node_.push_back(utils::get_cpu_numa_node(static_cast<int>(cpu)));
+    }
+  }
+
+  /// Open and initialize the nic on the bus @param bus with the host
+  /// addresses @param host_phy and @param host_ipv4 (the nics are on
+  /// different links, so they must differ). The nic gets the next nic id.
+  int add_nic(int bus, const PhyAddr& host_phy, const IPv4& host_ipv4) {
+    std::unique_ptr<RpcClientPool<T>> pool(new RpcClientPool<T>(
+        base_nic_addr_, max_pool_size_per_nic_, num_of_flows_per_nic_));
+    int res = pool->init_nic(bus, host_phy, host_ipv4);
+    if (res != 0) {
+      FRPC_ERROR("Failed to initialize the nic on bus %x\n", bus);
+      return res;
+    }
+
+    int node = utils::get_pci_bus_numa_node(bus);
+    FRPC_INFO("Nic %zu on bus %x is on NUMA node %d\n", pools_.size(), bus,
+              node);
+    pools_.push_back(std::move(pool));
+    nic_numa_node_.push_back(node);
+    return 0;
+  }
+
+  /// A wrapper on top of the nics' start/stop API.
+  int start_nics() {
+    for (auto& pool : pools_) {
+      int res = pool->start_nic();
+      if (res != 0) return res;
+    }
+    return 0;
+  }
+
+  int stop_nics() {
+    int res = 0;
+    for (auto& pool : pools_) {
+      if (pool->stop_nic() != 0) res = 1;
+    }
+    return res;
+  }
+
+  /// A wrapper on top of the nics' hardware error checking API.
+  int check_hw_errors() const {
+    int res = 0;
+    for (auto& pool : pools_) {
+      if (pool->check_hw_errors() != 0) res = 1;
+    }
+    return res;
+  }
+
+  size_t get_number_of_nics() const { return pools_.size(); }
+
+  /// NUMA node the nic @param nic is attached to, -1 if unknown.
+  int get_nic_numa_node(size_t nic) const {
+    assert(nic < nic_numa_node_.size());
+    return nic_numa_node_[nic];
+  }
+
+  /// Underlying pool of the nic @param nic.
+  RpcClientPool<T>* get_nic_pool(size_t nic) const {
+    assert(nic < pools_.size());
+    return pools_[nic].get();
+  }
+
+  /// Nic the client @param rpc_client is on.
+  size_t get_client_nic(const T* rpc_client) const {
+    for (size_t i = 0; i < pools_.size(); ++i) {
+      if (pools_[i]->get_nic() == rpc_client->get_nic()) return i;
+    }
+    assert(false);
+    return 0;
+  }
+
+  /// Pop the next RPC client: from a nic local to the calling thread if
+  /// there is one, falling back to the other nics when it runs out of
+  /// clients.
+  /// This method is thread-safe.
+  T* pop() {
+    if (pools_.empty()) return nullptr;
+
+    int cpu = sched_getcpu();
+    int node = cpu < 0 || static_cast<size_t>(cpu) >= cpu_numa_node_.size()
+                   ? -1
+                   : cpu_numa_node_[cpu];
+
+    // Local nics first, round-robin among them
+    size_t start = next_nic_.fetch_add(1, std::memory_order_relaxed);
+    if (node != -1) {
+      for (size_t i = 0; i < pools_.size(); ++i) {
+        size_t nic = (start + i) % pools_.size();
+        if (nic_numa_node_[nic] != node) continue;
+
+        T* rpc_client = pools_[nic]->pop();
+        if (rpc_client != nullptr) return rpc_client;
+      }
+    }
+
+    for (size_t i = 0; i < pools_.size(); ++i) {
+      size_t nic = (start + i) % pools_.size();
+      if (node != -1 && nic_numa_node_[nic] == node) continue;
+
+      T* rpc_client = pools_[nic]->pop();
+      if (rpc_client != nullptr) return rpc_client;
+    }
+
+    return nullptr;
+  }
+
+  /// Return the RPC client @param rpc_client obtained with pop() to the pool
+  /// of its nic, see RpcClientPool::release().
+  /// This method is thread-safe.
+  void release(T* rpc_client) {
+    assert(rpc_client != nullptr);
+    pools_[get_client_nic(rpc_client)]->release(rpc_client);
+  }
+
+  /// Read the hardware performance counters aggregated over all the nics
+  /// (slow path).
+  int perf_counters(Nic::PerfCounters& counters) const {
+    return aggregate_perf_counters(
+        pools_,
+        [](const std::unique_ptr<RpcClientPool<T>>& pool,
+           Nic::PerfCounters& nic_counters) {
+          return pool->perf_counters(nic_counters);
+        },
+        counters);
+  }
+
+  /// A wrapper on top of the nics' flow monitor API.
+  int run_flow_monitor(uint32_t period_us) {
+    for (auto& pool : pools_) {
+      int res = pool->run_flow_monitor(period_us);
+      if (res != 0) return res;
+    }
+    return 0;
+  }
+
+ private:
+  uint64_t base_nic_addr_;
+  size_t max_pool_size_per_nic_;
+  size_t num_of_flows_per_nic_;
+
+  /// Per-nic pools, they own the nics.
+  std::vector<std::unique_ptr<RpcClientPool<T>>> pools_;
+  std::vector<int> nic_numa_node_;
+
+  /// NUMA node of each CPU.
+  std::vector<int> cpu_numa_node_;
+
+  /// Round-robin counter of pop().
+  std::atomic<size_t> next_nic_;
+};
+
+}  // namespace dagger
+
+#endif
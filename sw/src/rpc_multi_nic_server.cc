@@ -0,0 +1,174 @@
+#include "rpc_multi_nic_server.h"
+
+#include <cassert>
+
+#include "logger.h"
+#include "numa.h"
+
+namespace dagger {
+
+RpcMultiNicServer::RpcMultiNicServer(uint64_t base_nic_addr,
+                                     size_t max_num_of_threads_per_nic)
+    : base_nic_addr_(base_nic_addr),
+      max_num_of_threads_per_nic_(max_num_of_threads_per_nic) {}
+
+// The underlying servers stop their threads and nics themselves.
+RpcMultiNicServer::~RpcMultiNicServer() {}
+
+int RpcMultiNicServer::add_nic(int bus, const PhyAddr& host_phy,
+                               const IPv4& host_ipv4) {
+  std::unique_lock<std::mutex> lck(mtx_);
+
+  NicCtx nic;
+  nic.server = std::unique_ptr<RpcThreadedServer>(
+      new RpcThreadedServer(base_nic_addr_, max_num_of_threads_per_nic_));
+  int res = nic.server->init_nic(bus, host_phy, host_ipv4);
+  if (res != 0) {
+    FRPC_ERROR("Failed to initialize the nic on bus %x\n", bus);
+    return res;
+  }
+
+  nic.numa_node = utils::get_pci_bus_numa_node(bus);
+  nic.cpus = utils::get_numa_node_cpus(nic.numa_node);
+  nic.next_cpu = 0;
+  if (nic.cpus.empty()) {
+    FRPC_WARN(
+        "NUMA node of the nic on bus %x is unknown, its threads will not be "
+        "pinned\n",
+        bus);
+  }
+
+  FRPC_INFO("Nic %zu on bus %x is on NUMA node %d\n", nics_.size(), bus,
+            nic.numa_node);
+  nics_.push_back(std::move(nic));
+  return 0;
+}
+
+int RpcMultiNicServer::start_nics() {
+  for (auto& nic : nics_) {
+    int res = nic.server->start_nic();
+    if (res != 0) return res;
+  }
+  return 0;
+}
+
+int RpcMultiNicServer::stop_nics() {
+  int res = 0;
+  for (auto& nic : nics_) {
+    if (nic.server->stop_nic() != 0) res = 1;
+  }
+  return res;
+}
+
+int RpcMultiNicServer::check_hw_errors() const {
+  int res = 0;
+  for (auto& nic : nics_) {
+    if (nic.server->check_hw_errors() != 0) res = 1;
+  }
+  return res;
+}
+
+int RpcMultiNicServer::get_nic_numa_node(size_t nic) const {
+  assert(nic < nics_.size());
+  return nics_[nic].numa_node;
+}
+
+RpcThreadedServer* RpcMultiNicServer::get_nic_server(size_t nic) const {
+  assert(nic < nics_.size());
+  return nics_[nic].server.get();
+}
+
+int RpcMultiNicServer::run_new_listening_thread(
+    const RpcServerCallBack_Base* rpc_callback, bool pin) {
+  std::unique_lock<std::mutex> lck(mtx_);
+
+  if (nics_.empty()) {
+    FRPC_ERROR("No nics to run listening threads on\n");
+    return -1;
+  }
+
+  // Spread the threads evenly across the nics
+  size_t target = 0;
+  for (size_t i = 1; i < nics_.size(); ++i) {
+    if (nics_[i].server->get_number_of_threads() <
+        nics_[target].server->get_number_of_threads()) {
+      target = i;
+    }
+  }
+
+  NicCtx& nic = nics_[target];
+  int pin_cpu = -1;
+  if (pin && !nic.cpus.empty()) {
+    pin_cpu = nic.cpus[nic.next_cpu % nic.cpus.size()];
+  }
+
+  if (nic.server->run_new_listening_thread(rpc_callback, pin_cpu) != 0) {
+    return -1;
+  }
+  if (pin_cpu != -1) ++nic.next_cpu;
+
+  return static_cast<int>(target);
+}
+
+int RpcMultiNicServer::stop_all_listening_threads() {
+  std::unique_lock<std::mutex> lck(mtx_);
+
+  int res = 0;
+  for (auto& nic : nics_) {
+    if (nic.server->stop_all_listening_threads() != 0) res = 1;
+    nic.next_cpu = 0;
+  }
+  return res;
+}
+
+size_t RpcMultiNicServer::get_number_of_threads() const {
+  std::unique_lock<std::mutex> lck(mtx_);
+
+  size_t num_of_threads = 0;
+  for (auto& nic : nics_) {
+    num_of_threads += nic.server->get_number_of_threads();
+  }
+  return num_of_threads;
+}
+
+void RpcMultiNicServer::set_lb(int lb) {
+  for (auto& nic : nics_) {
+    nic.server->set_lb(lb);
+  }
+}
+
+int RpcMultiNicServer::connect(size_t nic, const IPv4& client_addr,
+                               ConnectionId c_id, ConnectionFlowId c_flow_id) {
+  if (nic >= nics_.size()) {
+    FRPC_ERROR("Nic %zu does not exist\n", nic);
+    return 1;
+  }
+  return nics_[nic].server->connect(client_addr, c_id, c_flow_id);
+}
+
+int RpcMultiNicServer::disconnect(size_t nic, ConnectionId c_id) {
+  if (nic >= nics_.size()) {
+    FRPC_ERROR("Nic %zu does not exist\n", nic);
+    return 1;
+  }
+  return nics_[nic].server->disconnect(c_id);
+}
+
+int RpcMultiNicServer::perf_counters(Nic::PerfCounters& counters) const {
+  return aggregate_perf_counters(
+      nics_,
+      [](const NicCtx& nic, Nic::PerfCounters& nic_counters) {
+        return nic.server->perf_counters(nic_counters);
+      },
+      counters);
+}
+
+int RpcMultiNicServer::run_flow_monitor(uint32_t period_us) {
+  for (auto& nic : nics_) {
+    int res = nic.server->run_flow_monitor(period_us);
+    if (res != 0) return res;
+  }
+  return 0;
+}
+
+}  // namespace dagger
@@ -0,0 +1,101 @@
+/**
+ * @file rpc_multi_nic_server.h
+ * @brief Implementation of the RPC server driving several nics.
+ * @author Nikita Lazarev
+ */
+#ifndef _RPC_MULTI_NIC_SERVER_H_
+#define _RPC_MULTI_NIC_SERVER_H_
+
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "defs.h"
+#include "nic.h"
+#include "rpc_threaded_server.h"
+
+namespace dagger {
+
+/// This class stripes one RPC server over several nics, e.g. both FPGAs of
+/// the PAC_A10 platform, so a single process can use all their links. Each
+/// nic is driven by its own RpcThreadedServer with its own flows and
+/// connections; listening threads are spread across the nics and pinned to
+/// the CPUs of the NUMA node each nic is attached to.
+class RpcMultiNicServer {
+ public:
+  /// Create the server for nics with the hardware MMIO address
+  /// @param base_nic_addr and up to @param max_num_of_threads_per_nic
+  /// listening threads on each nic.
+  RpcMultiNicServer(uint64_t base_nic_addr, size_t max_num_of_threads_per_nic);
+  ~RpcMultiNicServer();
+
+  /// Open and initialize the nic on the bus @param bus with the host
+  /// addresses @param host_phy and @param host_ipv4 (the nics are on
+  /// different links, so they must differ). The nic gets the next nic id.
+  int add_nic(int bus, const PhyAddr& host_phy, const IPv4& host_ipv4);
+
+  /// A wrapper on top of the nics' start/stop API.
+  int start_nics();
+  int stop_nics();
+
+  /// A wrapper on top of the nics' hardware error checker API.
+  int check_hw_errors() const;
+
+  size_t get_number_of_nics() const { return nics_.size(); }
+
+  /// NUMA node the nic @param nic is attached to, -1 if unknown.
+  int get_nic_numa_node(size_t nic) const;
+
+  /// Underlying server of the nic @param nic, e.g. to manage its flows.
+  RpcThreadedServer* get_nic_server(size_t nic) const;
+
+  /// Run a new listening thread with the RPC handler @param rpc_callback on
+  /// the nic with the fewest threads. If @param pin, the thread is pinned to
+  /// the next CPU of the nic's NUMA node (if the node is known). Returns the
+  /// nic the thread is started on, or -1 on failure.
+  int run_new_listening_thread(const RpcServerCallBack_Base* rpc_callback,
+                               bool pin = true);
+
+  /// Stop all currently running RPC threads on all the nics.
+  int stop_all_listening_threads();
+
+  size_t get_number_of_threads() const;
+
+  /// Set the load balancing scheme of all the nics.
+  void set_lb(int lb);
+
+  // Connection management API: the connection is opened on the nic @param nic
+  // the client is linked to.
+  int connect(size_t nic, const IPv4& client_addr, ConnectionId c_id,
+              ConnectionFlowId c_flow_id);
+  int disconnect(size_t nic, ConnectionId c_id);
+
+  /// Read the hardware performance counters aggregated over all the nics
+  /// (slow path).
+  int perf_counters(Nic::PerfCounters& counters) const;
+
+  /// A wrapper on top of the nics' flow monitor API.
+  int run_flow_monitor(uint32_t period_us);
+
+ private:
+  struct NicCtx {
+    std::unique_ptr<RpcThreadedServer> server;
+    int numa_node;
+    // CPUs of the NUMA node, and the next one to pin a thread to.
+    std::vector<int> cpus;
+    size_t next_cpu;
+  };
+
+ private:
+  uint64_t base_nic_addr_;
+  size_t max_num_of_threads_per_nic_;
+
+  std::vector<NicCtx> nics_;
+
+  /// Sync.
+  mutable std::mutex mtx_;
+};
+
+}  // namespace dagger
+
+#endif
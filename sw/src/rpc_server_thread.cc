@@ -4,40 +4,63 @@
 #include <immintrin.h>
 #include <unistd.h>
 
+#include <cstdlib>
 #include <iostream>
+#include <new>
 
 #include "config.h"
 #include "logger.h"
+#include "rpc_coro.h"
 #include "rpc_header.h"
+#include "rpc_stream.h"
+#include "utils.h"
 
 namespace dagger {
 
+ServerFlow::ServerFlow(const Nic* nic, size_t nic_flow_id)
+    : nic_flow_id(nic_flow_id),
+      tx_queue(nic->get_tx_flow_buffer(nic_flow_id), nic->get_mtu_size_bytes(),
+               TxQueue::get_l_depth(nic->get_tx_mode())),
+      rx_queue(nic->get_rx_flow_buffer(nic_flow_id), nic->get_mtu_size_bytes(),
+               cfg::nic::l_rx_queue_size),
+      requests(0) {
+  tx_queue.init();
+  tx_queue.bind_transport(nic->get_tx_mode(), nic, nic_flow_id);
+  rx_queue.init();
+}
+
+void* ServerFlow::operator new(size_t size) {
+  void* ptr = nullptr;
+  if (posix_memalign(&ptr, alignof(ServerFlow), size) != 0) {
+    throw std::bad_alloc();
+  }
+  return ptr;
+}
+
+void ServerFlow::operator delete(void* ptr) { free(ptr); }
+
 RpcServerThread::RpcServerThread(const Nic* nic, size_t nic_flow_id,
                                  uint16_t thread_id,
                                  const RpcServerCallBack_Base* callback)
+    : RpcServerThread(
+          nic, std::unique_ptr<ServerFlow>(new ServerFlow(nic, nic_flow_id)),
+          thread_id, callback) {}
+
+RpcServerThread::RpcServerThread(const Nic* nic,
+                                 std::unique_ptr<ServerFlow> flow,
+                                 uint16_t thread_id,
+                                 const RpcServerCallBack_Base* callback)
     : thread_id_(thread_id),
       nic_(nic),
-      nic_flow_id_(nic_flow_id),
-      server_callback_(callback) {
-#ifdef NIC_CCIP_MMIO
-  if (cfg::nic::l_tx_queue_size != 0) {
-    FRPC_ERROR("In MMIO mode, only one entry in the tx queue is allowed\n");
-  }
-#endif
-
-  // Allocate queues in the nic.
-  tx_queue_ = TxQueue(nic_->get_tx_flow_buffer(nic_flow_id_),
-                      nic_->get_mtu_size_bytes(), cfg::nic::l_tx_queue_size);
-  tx_queue_.init();
-
-  rx_queue_ = RxQueue(nic_->get_rx_flow_buffer(nic_flow_id_),
-                      nic_->get_mtu_size_bytes(), cfg::nic::l_rx_queue_size);
-  rx_queue_.init();
-
-#ifdef NIC_CCIP_DMA
-  current_batch_ptr = 0;
-  batch_counter = 0;
-#endif
+      flows_version_(0),
+      flows_applied_version_(0),
+      server_callback_(callback),
+      stop_signal_(0),
+      busy_cycles_(0),
+      busy_since_(0) {
+  std::unique_lock<std::mutex> lck(flows_mtx_);
+  flows_.push_back(std::move(flow));
+  commit_flows(lck);
 
   FRPC_INFO("Thread %d is created\n", thread_id_);
 }
@@ -75,65 +98,228 @@ int RpcServerThread::start_listening(int pin_cpu) {
 
 void RpcServerThread::stop_listening() {
   stop_signal_ = 1;
+  idle_policy_.notify();
   thread_.join();
 }
 
+int RpcServerThread::attach_flow(std::unique_ptr<ServerFlow> flow) {
+  if (flow == nullptr) return 1;
+
+  std::unique_lock<std::mutex> lck(flows_mtx_);
+  for (auto& f : flows_) {
+    if (f->nic_flow_id == flow->nic_flow_id) {
+      FRPC_ERROR("Flow %zu is already served by thread %d\n", f->nic_flow_id,
+                 thread_id_);
+      return 1;
+    }
+  }
+
+  flows_.push_back(std::move(flow));
+  commit_flows(lck);
+  return 0;
+}
+
+std::unique_ptr<ServerFlow> RpcServerThread::detach_flow(size_t nic_flow_id) {
+  std::unique_lock<std::mutex> lck(flows_mtx_);
+  for (auto it = flows_.begin(); it != flows_.end(); ++it) {
+    if ((*it)->nic_flow_id == nic_flow_id) {
+      std::unique_ptr<ServerFlow> flow = std::move(*it);
+      flows_.erase(it);
+      commit_flows(lck);
+      return flow;
+    }
+  }
+
+  return nullptr;
+}
+
+void RpcServerThread::commit_flows(std::unique_lock<std::mutex>& lck) {
+  uint64_t version = flows_version_.load(std::memory_order_relaxed) + 1;
+  flows_version_.store(version, std::memory_order_release);
+  lck.unlock();
+
+  if (!thread_.joinable()) return;
+
+  // The thread might be sleeping on its idle policy
+  idle_policy_.notify();
+  while (flows_applied_version_.load(std::memory_order_acquire) < version &&
+         !stop_signal_) {
+    std::this_thread::yield();
+  }
+}
+
+uint64_t RpcServerThread::get_number_of_requests(size_t nic_flow_id) const {
+  std::unique_lock<std::mutex> lck(flows_mtx_);
+  for (auto& f : flows_) {
+    if (f->nic_flow_id == nic_flow_id) {
+      return f->requests.load(std::memory_order_relaxed);
+    }
+  }
+  return 0;
+}
+
+size_t RpcServerThread::get_number_of_flows() const {
+  std::unique_lock<std::mutex> lck(flows_mtx_);
+  return flows_.size();
+}
+
+uint64_t RpcServerThread::get_busy_cycles() const {
+  // The dispatch thread clears busy_since_ before adding the period to
+  // busy_cycles_, so a racing read can only miss a part of the current period
+  uint64_t cycles = busy_cycles_.load(std::memory_order_acquire);
+  uint64_t since = busy_since_.load(std::memory_order_acquire);
+  if (since != 0) {
+    uint64_t now = utils::rdtsc();
+    if (now > since) cycles += now - since;
+  }
+  return cycles;
+}
+
 // Pull-based listening on the dispatch thread.
 void RpcServerThread::_PullListen() {
   FRPC_INFO("Thread %d is listening now on CPU %d\n", thread_id_,
             sched_getcpu());
-  // if (rx_buff_ >= nic_->get_rx_buff_end()) {
-  //    FRPC_ERROR("Nic rx buffer overflow \n");
-  //    assert(false);
-  //}
 
-  constexpr size_t batch_size = 1 << cfg::nic::l_rx_batch_size;
+#ifdef __cpp_impl_coroutine
+  // Suspendable handlers run on this thread; the thread keeps dispatching
+  // new requests while they wait for their downstream RPCs
+  RpcScheduler scheduler;
+#endif
+
+  // Own copy of the served flows
+  std::vector<ServerFlow*> flows;
+  uint64_t version = 0;
+
+  RpcPckt req_pckt __attribute__((aligned(64)));
 
-  volatile RpcPckt* req_pckt;
+  // Start of the current busy period, 0 if idle
+  uint64_t busy_start = 0;
+
+  // Whether any flow has a request; the flows are polled round-robin
+  // starting from the one after the last served
+  size_t next = 0;
+  auto has_work = [&]() {
+    if (stop_signal_ ||
+        flows_version_.load(std::memory_order_relaxed) != version) {
+      return true;
+    }
+    for (ServerFlow* flow : flows) {
+      if (!flow->deferred.empty()) return true;
+
+      uint8_t phase;
+      volatile RpcPckt* pckt = reinterpret_cast<volatile RpcPckt*>(
+          flow->rx_queue.get_read_ptr(phase));
+      if (rx_pckt_is_new(pckt, phase)) return true;
+    }
+    return false;
+  };
 
   while (!stop_signal_) {
-    RpcPckt req_pckt_1[batch_size] __attribute__((aligned(64)));
-    for (int i = 0; i < batch_size && !stop_signal_; ++i) {
-      // wait response
-      uint32_t rx_rpc_id;
-      req_pckt = reinterpret_cast<volatile RpcPckt*>(
-          rx_queue_.get_read_ptr(rx_rpc_id));
-      while (
-          (req_pckt->hdr.ctl.valid == 0 || req_pckt->hdr.rpc_id == rx_rpc_id) &&
-          !stop_signal_) {
+    // Pick up the flow changes
+    if (flows_version_.load(std::memory_order_acquire) != version) {
+#ifdef __cpp_impl_coroutine
+      // Suspended handlers hold the tx rings of their flows, so they are
+      // finished first; no new requests are taken in the meantime
+      if (scheduler.get_number_of_tasks() != 0) {
+        scheduler.poll();
+        continue;
       }
+#endif
+      std::unique_lock<std::mutex> lck(flows_mtx_);
+      version = flows_version_.load(std::memory_order_relaxed);
+      flows.clear();
+      for (auto& f : flows_) {
+        flows.push_back(f.get());
+      }
+      next = 0;
+      flows_applied_version_.store(version, std::memory_order_release);
+    }
+
+    // Serve at most one request per flow in a round
+    bool busy = false;
+    for (size_t i = 0; i < flows.size(); ++i) {
+      ServerFlow* flow = flows[next];
+      if (++next == flows.size()) next = 0;
+
+      // Requests deferred by a streaming handler are always copied
+      bool in_place = false;
+      volatile RpcPckt* pckt = nullptr;
+      if (!flow->deferred.empty()) {
+        req_pckt = flow->deferred.front();
+        flow->deferred.pop_front();
+      } else {
+        uint8_t phase;
+        pckt = reinterpret_cast<volatile RpcPckt*>(
+            flow->rx_queue.get_read_ptr(phase));
+        if (!rx_pckt_is_new(pckt, phase)) continue;
+
+        if (!cfg::sys::server_inplace_dispatch) {
+          req_pckt = *const_cast<RpcPckt*>(pckt);
+          flow->rx_queue.pop();
+        } else {
+          flow->rx_queue.prefetch_next();
+          in_place = true;
+        }
+      }
+      flow->requests.store(flow->requests.load(std::memory_order_relaxed) + 1,
+                           std::memory_order_relaxed);
+
+      if (busy_start == 0) {
+        busy_start = utils::rdtsc();
+        busy_since_.store(busy_start, std::memory_order_release);
+      }
+
+      // Streaming handlers take the credit grants off the rx queue of the
+      // flow
+      RpcStreamWriter_Base::set_flow(&flow->rx_queue, &flow->deferred,
+                                     in_place);
 
-      if (stop_signal_) continue;
+      if (!in_place) {
+        server_callback_->operator()({thread_id_}, &req_pckt, flow->tx_queue);
+      } else {
+        // The handler reads the request from the ring, so the slot is only
+        // released after it returns, unless a streaming handler released it
+        // already; suspendable handlers copy their arguments into the
+        // coroutine frame before the first suspension
+        server_callback_->operator()({thread_id_},
+                                     const_cast<const RpcPckt*>(pckt),
+                                     flow->tx_queue);
+        if (RpcStreamWriter_Base::flow_request_in_queue()) {
+          flow->rx_queue.pop();
+        }
+      }
+      busy = true;
+    }
 
-      rx_queue_.update_rpc_id(req_pckt->hdr.rpc_id);
+#ifdef __cpp_impl_coroutine
+    // Resume handlers waiting on downstream RPCs, they also keep the thread
+    // busy
+    if (scheduler.get_number_of_tasks() != 0) {
+      scheduler.poll();
+      busy = true;
+    }
+#endif
 
-      req_pckt_1[i] = *const_cast<RpcPckt*>(req_pckt);
+    if (busy) {
+      idle_policy_.reset();
+      continue;
+    }
 
-      //_mm256_store_si256(&req_pckt_1[i],
-      //*(reinterpret_cast<__m256i*>(req_pckt)));
-      //_mm256_store_si256(reinterpret_cast<__m256i*>(&req_pckt_1[i] + 32),
-      //                   *(reinterpret_cast<__m256i*>(req_pckt + 32)));
+    if (busy_start != 0) {
+      uint64_t cycles = utils::rdtsc() - busy_start;
+      busy_since_.store(0, std::memory_order_release);
+      busy_cycles_.store(busy_cycles_.load(std::memory_order_relaxed) + cycles,
+                         std::memory_order_release);
+      busy_start = 0;
     }
-    if (stop_signal_) continue;
-
-    for (int i = 0; i < batch_size; ++i) {
-      //    std::cout << "DEBUG: recv packet: ********* "
-      //        << "\n hdr.ctl.req_type: " << (int)((req_pckt_1 +
-      //        i)->hdr.ctl.req_type)
-      //        << "\n hdr.ctl.valid: " << (int)((req_pckt_1 +
-      //        i)->hdr.ctl.valid)
-      //        << "\n hdr.argl: " << (int)((req_pckt_1 + i)->hdr.argl)
-      //        << "\n hdr.c_id: " << (int)((req_pckt_1 + i)->hdr.c_id)
-      //        << "\n hdr.rpc_id: " << (int)((req_pckt_1 + i)->hdr.rpc_id)
-      //        << "\n hdr.fn_id: " << (int)((req_pckt_1 + i)->hdr.fn_id)
-      //        << "\n argv: ";
-      //    for (int j=0; j<cfg::sys::cl_size_bytes - rpc_header_size_bytes;
-      //    ++j) {
-      //        std::cout << (int)(((req_pckt_1 + i)->argv)[j]) << " ";
-      //    }
-      //    std::cout << "\n **************** " << std::endl;
-
-      server_callback_->operator()({thread_id_}, req_pckt_1 + i, tx_queue_);
+
+    // A single line can be monitored, so umwait is on the first flow; the
+    // others are checked at least every cfg::sys::idle_umwait_timeout_cycles
+    if (flows.empty()) {
+      idle_policy_.idle(&flows_version_, has_work);
+    } else {
+      uint8_t phase;
+      idle_policy_.idle(flows[0]->rx_queue.get_read_ptr(phase), has_work);
     }
   }
 
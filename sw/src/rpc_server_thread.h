@@ -7,11 +7,15 @@
 #define _RPC_SERVER_THREAD_H_
 
 #include <atomic>
+#include <deque>
+#include <memory>
+#include <mutex>
 #include <thread>
 #include <utility>
 #include <vector>
 
 #include "connection_manager.h"
+#include "idle_policy.h"
 #include "nic.h"
 #include "rpc_call.h"
 #include "rpc_header.h"
@@ -23,6 +27,12 @@ namespace dagger {
 /// The base class for the RPC server callback (RPC handler).
 /// The RPC codegenerator extends (implements) this class to define the
 /// server RPC stubs.
+///
+/// Handlers of functions declared as `async rpc` in the IDL are coroutines of
+/// type Task<RpcRetCode>(CallHandler, Arg, Ret*) and can co_await outgoing
+/// RPCs (see rpc_coro.h). They run on the scheduler of the dispatch thread,
+/// and the response is sent when the handler finishes. The downstream clients
+/// they await must only be used from the same dispatch thread.
 class RpcServerCallBack_Base {
  public:
   RpcServerCallBack_Base(const std::vector<const void*>& rpc_fn_ptr)
@@ -37,10 +47,36 @@ class RpcServerCallBack_Base {
   const std::vector<const void*>& rpc_fn_ptr_;
 };
 
+/// A nic flow served by a server thread: its rx and tx rings. Responses to
+/// the requests of a flow always go to the tx ring of the same flow.
+struct ServerFlow {
+  ServerFlow(const Nic* nic, size_t nic_flow_id);
+
+  // The rx queue is page-aligned, which plain new does not respect in C++11.
+  static void* operator new(size_t size);
+  static void operator delete(void* ptr);
+
+  size_t nic_flow_id;
+  TxQueue tx_queue;
+  RxQueue rx_queue;
+
+  // Requests taken off the rx queue by a streaming handler (see
+  // RpcStreamWriter_Base), they come before the ones still in the queue.
+  std::deque<RpcPckt> deferred;
+
+  // Number of requests received on the flow, only written by the dispatch
+  // thread serving the flow.
+  std::atomic<uint64_t> requests;
+};
+
 /// This class implemens the basic functionality of an RPC server thread and
 /// provides the interfaces with the hardware.
 /// It encapsulates server hardware communication, RPC dispatch and worker
 /// threads, and interfaces with the server RPC stubs.
+///
+/// A server thread can serve several nic flows; the dispatch thread polls
+/// their rx rings round-robin. Flows can be attached and detached while the
+/// thread is listening.
 class RpcServerThread {
  public:
   /// Construct server thread based on the nic's @param nic flow id
@@ -49,6 +85,11 @@ class RpcServerThread {
   /// RpcServerCallBack_Base class.
   RpcServerThread(const Nic* nic, size_t nic_flow_id, uint16_t thread_id,
                   const RpcServerCallBack_Base* callback);
+
+  /// Construct server thread serving the existing flow @param flow, e.g. a
+  /// flow detached from a stopped thread; its rings keep their state.
+  RpcServerThread(const Nic* nic, std::unique_ptr<ServerFlow> flow,
+                  uint16_t thread_id, const RpcServerCallBack_Base* callback);
   virtual ~RpcServerThread();
 
   /// Connection management API.
@@ -60,20 +101,47 @@ class RpcServerThread {
   int start_listening(int pin_cpu);
   void stop_listening();
 
+  /// Start serving the flow @param flow.
+  int attach_flow(std::unique_ptr<ServerFlow> flow);
+
+  /// Stop serving the flow @param nic_flow_id and return it, or nullptr if
+  /// the thread does not serve it. When the call returns, the dispatch
+  /// thread does not touch the flow anymore; suspended handlers are finished
+  /// first since they hold the tx ring of their flow.
+  std::unique_ptr<ServerFlow> detach_flow(size_t nic_flow_id);
+
+  /// Number of requests received on the flow @param nic_flow_id, 0 if the
+  /// thread does not serve it.
+  uint64_t get_number_of_requests(size_t nic_flow_id) const;
+
+  size_t get_number_of_flows() const;
+
+  /// TSC cycles the dispatch thread has spent serving requests since it was
+  /// created, as opposed to polling empty rings; the handler utilization is
+  /// its rate of change.
+  uint64_t get_busy_cycles() const;
+
  private:
   // Dispatch thread
   void _PullListen();
 
+  // Publish a change of flows_ and wait for the dispatch thread to pick it
+  // up.
+  void commit_flows(std::unique_lock<std::mutex>& lck);
+
  private:
   uint16_t thread_id_;
 
   // Underlying nic.
   const Nic* nic_;
-  size_t nic_flow_id_;
 
-  // Underlying Tx and RX queues.
-  TxQueue tx_queue_;
-  RxQueue rx_queue_;
+  // Served flows. The dispatch thread works on its own copy of the list and
+  // reloads it when flows_version_ changes; flows_applied_version_ is the
+  // version it currently works on.
+  std::vector<std::unique_ptr<ServerFlow>> flows_;
+  mutable std::mutex flows_mtx_;
+  std::atomic<uint64_t> flows_version_;
+  std::atomic<uint64_t> flows_applied_version_;
 
   // The RPC callback object.
   const RpcServerCallBack_Base* server_callback_;
@@ -82,10 +150,13 @@ class RpcServerThread {
   std::thread thread_;
   std::atomic<bool> stop_signal_;
 
-#ifdef NIC_CCIP_DMA
-  uint32_t current_batch_ptr;
-  size_t batch_counter;
-#endif
+  // What the dispatch thread does when there are no requests.
+  IdlePolicy idle_policy_;
+
+  // Handler utilization: cycles of the finished busy periods and the start
+  // of the current one, 0 if the thread is idle.
+  std::atomic<uint64_t> busy_cycles_;
+  std::atomic<uint64_t> busy_since_;
 };
 
 }  // namespace dagger
@@ -0,0 +1,93 @@
+/**
+ * @file rpc_service_mux.h
+ * @brief Server callback hosting several RPC services on the same threads.
+ * @author Nikita Lazarev
+ */
+#ifndef _RPC_SERVICE_MUX_H_
+#define _RPC_SERVICE_MUX_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+#include "logger.h"
+#include "rpc_call.h"
+#include "rpc_header.h"
+#include "rpc_server_thread.h"
+#include "tx_queue.h"
+
+namespace dagger {
+
+/// Server callback routing the requests to the callbacks of several services,
+/// e.g. a KVS service and an admin/stats service served over the same flows.
+///
+/// The RPC codegenerator gives the functions of all the services of an IDL
+/// file globally unique fn_ids: each service takes the range
+/// [fn_id_base, fn_id_base + num_of_functions) of its RpcServerCallBack, so
+/// the routing is a single table lookup on the critical path.
+class RpcServiceMux : public RpcServerCallBack_Base {
+ public:
+  RpcServiceMux() : RpcServerCallBack_Base(no_functions()), services_(256) {}
+  virtual ~RpcServiceMux() {}
+
+  /// Route the fn_ids [fn_id_base, fn_id_base + num_of_functions) to the
+  /// service callback @param callback; returns 1 if some of them are already
+  /// routed.
+  /// Services must be added before the listening threads are started.
+  int add_service(const RpcServerCallBack_Base* callback, uint8_t fn_id_base,
+                  size_t num_of_functions) {
+    if (fn_id_base + num_of_functions > services_.size()) {
+      FRPC_ERROR("Service fn_ids are out of the fn_id space\n");
+      return 1;
+    }
+
+    for (size_t i = fn_id_base; i < fn_id_base + num_of_functions; ++i) {
+      if (services_[i] != nullptr) {
+        FRPC_ERROR("RPC function id %zu is already served\n", i);
+        return 1;
+      }
+    }
+
+    for (size_t i = fn_id_base; i < fn_id_base + num_of_functions; ++i) {
+      services_[i] = callback;
+    }
+    return 0;
+  }
+
+  /// Add the generated service callback @param callback.
+  template <class CallBack>
+  int add_service(const CallBack* callback) {
+    return add_service(callback, CallBack::fn_id_base,
+                       CallBack::num_of_functions);
+  }
+
+  virtual void operator()(const CallHandler handler, const RpcPckt* rpc_in,
+                          TxQueue& tx_queue) const final {
+    const RpcServerCallBack_Base* callback = services_[rpc_in->hdr.fn_id];
+    if (callback == nullptr) {
+      FRPC_ERROR(
+          "RPC function id %d is not served, this call will stop here and "
+          "no value will be returned\n",
+          rpc_in->hdr.fn_id);
+      return;
+    }
+
+    (*callback)(handler, rpc_in, tx_queue);
+  }
+
+ private:
+  // The mux has no functions of its own.
+  static const std::vector<const void*>& no_functions() {
+    static const std::vector<const void*> functions;
+    return functions;
+  }
+
+ private:
+  /// Service callback of each fn_id.
+  std::vector<const RpcServerCallBack_Base*> services_;
+};
+
+}  // namespace dagger
+
+#endif
@@ -0,0 +1,188 @@
+#include "rpc_stream.h"
+
+#include <immintrin.h>
+
+#include <cstring>
+
+#include "ccip_tx.h"
+#include "rpc_client_nonblocking_base.h"
+#include "utils.h"
+
+namespace dagger {
+
+thread_local RpcStreamWriter_Base::Flow RpcStreamWriter_Base::flow_ = {
+    nullptr, nullptr, false};
+
+RpcStreamWriter_Base::RpcStreamWriter_Base(const RpcHeader& req_hdr,
+                                           TxQueue& tx_queue)
+    : req_hdr_(req_hdr),
+      tx_queue_(tx_queue),
+      rx_queue_(flow_.rx_queue),
+      deferred_(flow_.deferred),
+      credits_(cfg::sys::stream_window),
+      items_(0),
+      stalled_(false),
+      closed_(false) {}
+
+void RpcStreamWriter_Base::close() {
+  if (closed_) return;
+
+  send(nullptr, 0, true);
+  closed_ = true;
+}
+
+int RpcStreamWriter_Base::write_frame(const uint8_t* data, size_t len) {
+  if (closed_ || stalled_) return 1;
+
+  // Keep up with the nic, it does not wait for the slots to be released
+  drain();
+  if (credits_ == 0 && !wait_for_credits()) {
+    // The client is gone or does not consume the stream, do not wait for
+    // it on every item
+    stalled_ = true;
+    return 1;
+  }
+
+  send(data, len, false);
+  --credits_;
+  ++items_;
+  return 0;
+}
+
+void RpcStreamWriter_Base::drain() {
+  if (rx_queue_ == nullptr) return;
+
+  // A request dispatched in place is not read from its slot anymore: the
+  // callback keeps a copy of the header, and the handler gets the arguments
+  // by value
+  if (flow_.request_in_queue) {
+    rx_queue_->pop();
+    flow_.request_in_queue = false;
+  }
+
+  while (true) {
+    uint8_t phase;
+    volatile RpcPckt* pckt =
+        reinterpret_cast<volatile RpcPckt*>(rx_queue_->get_read_ptr(phase));
+    if (!rx_pckt_is_new(pckt, phase)) return;
+
+    if (pckt->hdr.ctl.one_way && pckt->hdr.rpc_id == req_hdr_.rpc_id &&
+        pckt->hdr.c_id == req_hdr_.c_id) {
+      uint32_t grant;
+      memcpy(&grant, const_cast<uint8_t*>(pckt->argv), sizeof(grant));
+      credits_ += grant;
+    } else {
+      deferred_->push_back(*const_cast<RpcPckt*>(pckt));
+    }
+    rx_queue_->pop();
+  }
+}
+
+bool RpcStreamWriter_Base::wait_for_credits() {
+  if (rx_queue_ == nullptr) return false;
+
+  uint64_t deadline =
+      dagger::utils::rdtsc() + cfg::sys::stream_credit_timeout_cycles;
+  while (true) {
+    drain();
+    if (credits_ != 0) return true;
+
+    if (dagger::utils::rdtsc() >= deadline) return false;
+
+    _mm_pause();
+  }
+}
+
+void RpcStreamWriter_Base::send(const uint8_t* data, size_t len,
+                                bool end_of_stream) {
+  uint8_t change_bit;
+  char* tx_ptr = tx_queue_.get_write_ptr(change_bit);
+
+  RpcHeader hdr = RpcHeader();
+  hdr.c_id = req_hdr_.c_id;
+  hdr.rpc_id = req_hdr_.rpc_id;
+  hdr.n_of_frames = 1;
+  hdr.frame_id = static_cast<uint8_t>(items_);
+
+  hdr.fn_id = req_hdr_.fn_id;
+  hdr.argl = static_cast<uint16_t>(len);
+  hdr.affinity = req_hdr_.affinity;
+
+  hdr.ctl.req_type = rpc_response;
+  hdr.ctl.end_of_stream = end_of_stream ? 1 : 0;
+
+  ccip_send(tx_queue_, tx_ptr, change_bit, hdr,
+            [&](uint8_t* argv) {
+              if (len != 0) memcpy(argv, data, len);
+            });
+}
+
+RpcClientStream_Base::RpcClientStream_Base()
+    : lost_(0),
+      client_(nullptr),
+      rpc_id_(0),
+      fn_id_(0),
+      affinity_(0),
+      next_seq_(0),
+      consumed_(0),
+      items_(0),
+      done_(false) {}
+
+void RpcClientStream_Base::open(RpcClientNonBlock_Base* client,
+                                uint32_t rpc_id, uint8_t fn_id,
+                                uint8_t affinity) {
+  client_ = client;
+  rpc_id_ = rpc_id;
+  fn_id_ = fn_id;
+  affinity_ = affinity;
+
+  received_.clear();
+  next_seq_ = 0;
+  consumed_ = 0;
+  items_ = 0;
+  lost_ = 0;
+  done_ = false;
+}
+
+void RpcClientStream_Base::push(volatile RpcPckt* frame) {
+  lock_.lock();
+  received_.push_back(*const_cast<RpcPckt*>(frame));
+  lock_.unlock();
+}
+
+void RpcClientStream_Base::take_frames(std::vector<RpcPckt>& frames) {
+  lock_.lock();
+  frames.swap(received_);
+  lock_.unlock();
+}
+
+bool RpcClientStream_Base::account(const RpcPckt& frame) {
+  // Items missing before this one; they took the server's credits too
+  uint8_t gap = static_cast<uint8_t>(frame.hdr.frame_id - next_seq_);
+  lost_ += gap;
+  consumed_ += gap;
+  next_seq_ = frame.hdr.frame_id + 1;
+
+  if (frame.hdr.ctl.end_of_stream) {
+    done_ = true;
+    return false;
+  }
+
+  ++items_;
+  ++consumed_;
+  return true;
+}
+
+void RpcClientStream_Base::grant_credits() {
+  if (done_ || client_ == nullptr ||
+      consumed_ < cfg::sys::stream_window / 2) {
+    return;
+  }
+
+  if (client_->send_stream_credits(rpc_id_, fn_id_, affinity_, consumed_) ==
+      0) {
+    consumed_ = 0;
+  }
+}
+
+}  // namespace dagger
@@ -0,0 +1,239 @@
+/**
+ * @file rpc_stream.h
+ * @brief Server-streaming RPCs: functions returning `stream <Item>` in the
+ * IDL answer a single request with a sequence of response frames.
+ * @author Nikita Lazarev
+ */
+#ifndef _RPC_STREAM_H_
+#define _RPC_STREAM_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+#include "config.h"
+#include "rpc_bytes.h"
+#include "rpc_header.h"
+#include "rx_queue.h"
+#include "tx_queue.h"
+
+namespace dagger {
+
+static_assert(cfg::sys::stream_window >= 2 &&
+                  cfg::sys::stream_window <= (1 << cfg::nic::l_rx_queue_size),
+              "stream window must fit the rx queue of the client");
+
+class RpcClientNonBlock_Base;
+
+/// Server side of a stream. The handler of a streaming function writes the
+/// items one by one, each goes out in its own response frame with the
+/// sequence number of the item in frame_id; once the handler returns, the
+/// stream is closed with an empty end_of_stream frame.
+///
+/// Flow control is credit-based: the writer is at most
+/// cfg::sys::stream_window items ahead of the client, which grants more
+/// credits as it consumes them. The grants are one-way requests to the
+/// streaming function with the rpc_id of the stream. As the handler holds
+/// the dispatch thread, the writer takes the packets off the rx queue of the
+/// flow itself as they arrive: it keeps the grants of the stream, and defers
+/// the other requests, which the server thread dispatches once the handler
+/// returns. So the rx queue keeps moving however long the stream is, but the
+/// other requests of the flow wait for the end of the stream.
+class RpcStreamWriter_Base {
+ public:
+  /// Construct the writer of the response to the request @param req_hdr,
+  /// sent through @param tx_queue.
+  RpcStreamWriter_Base(const RpcHeader& req_hdr, TxQueue& tx_queue);
+
+  RpcStreamWriter_Base(const RpcStreamWriter_Base&) = delete;
+
+  /// Send the end-of-stream frame; called by the generated server callback
+  /// once the handler returns.
+  void close();
+
+  size_t get_number_of_items() const { return items_; }
+
+  /// Set the flow whose request is dispatched on the calling thread: the
+  /// writers take the credit grants off its @param rx_queue, and move the
+  /// other requests there to @param deferred. @param request_in_queue is set
+  /// if the request is dispatched in place from the tail slot of the rx
+  /// queue. Called by the server threads before each dispatch.
+  static void set_flow(RxQueue* rx_queue, std::deque<RpcPckt>* deferred,
+                       bool request_in_queue) {
+    flow_.rx_queue = rx_queue;
+    flow_.deferred = deferred;
+    flow_.request_in_queue = request_in_queue;
+  }
+
+  /// Whether the request dispatched in place is still in the tail slot once
+  /// the handler returns; a writer releases it before taking the packets
+  /// behind it.
+  static bool flow_request_in_queue() { return flow_.request_in_queue; }
+
+ protected:
+  /// Send the item of @param len bytes at @param data. Returns 1 if the
+  /// stream is closed, or if it runs out of credits for
+  /// cfg::sys::stream_credit_timeout_cycles.
+  int write_frame(const uint8_t* data, size_t len);
+
+ private:
+  // Take the packets received on the flow off its rx queue: add up the
+  // credit grants of the stream, and defer the other packets.
+  void drain();
+
+  // Drain the rx queue of the flow until there are credits; returns false on
+  // timeout, or if the writer is not on a server thread.
+  bool wait_for_credits();
+
+  void send(const uint8_t* data, size_t len, bool end_of_stream);
+
+ private:
+  RpcHeader req_hdr_;
+  TxQueue& tx_queue_;
+  RxQueue* rx_queue_;
+  std::deque<RpcPckt>* deferred_;
+
+  uint32_t credits_;
+
+  size_t items_;
+  bool stalled_;
+  bool closed_;
+
+  // Flow of the request dispatched on the thread.
+  struct Flow {
+    RxQueue* rx_queue;
+    std::deque<RpcPckt>* deferred;
+    bool request_in_queue;
+  };
+  static thread_local Flow flow_;
+};
+
+/// Typed writer the handlers of functions returning `stream Item` get.
+template <typename Item>
+class RpcStreamWriter : public RpcStreamWriter_Base {
+ public:
+  RpcStreamWriter(const RpcHeader& req_hdr, TxQueue& tx_queue)
+      : RpcStreamWriter_Base(req_hdr, tx_queue) {}
+
+  /// Send @param item to the client. Returns 1 if the item does not fit a
+  /// frame, or the client stopped granting credits; the handler should give
+  /// up the stream then.
+  int write(const Item& item) {
+    uint8_t buff[sizeof(RpcPckt::argv)];
+    size_t len = rpc_encode(item, buff, sizeof(buff));
+    if (len == 0) return 1;
+
+    return write_frame(buff, len);
+  }
+};
+
+/// Client side of a stream. The completion queue thread collects the frames
+/// of the stream, and poll() delivers the items to the callback on the
+/// calling thread, granting the server credits for them. The stream must
+/// outlive its request, i.e. until is_done().
+class RpcClientStream_Base {
+ public:
+  RpcClientStream_Base();
+  virtual ~RpcClientStream_Base() {}
+
+  RpcClientStream_Base(const RpcClientStream_Base&) = delete;
+
+  /// Whether the end-of-stream frame is consumed, i.e. all the items are
+  /// delivered.
+  bool is_done() const { return done_; }
+
+  size_t get_number_of_items() const { return items_; }
+
+  /// Number of items missing in the sequence, e.g. overwritten in the rx
+  /// queue or not decodable.
+  size_t get_number_of_lost_items() const { return lost_; }
+
+ protected:
+  /// Move the frames received since the last call to @param frames.
+  void take_frames(std::vector<RpcPckt>& frames);
+
+  /// Account the frame @param frame in the sequence; returns false for the
+  /// end-of-stream frame, which carries no item.
+  bool account(const RpcPckt& frame);
+
+  /// Grant the server credits for the consumed items, half a window at a
+  /// time.
+  void grant_credits();
+
+  size_t lost_;
+
+ private:
+  friend class CompletionQueue;
+  friend class RpcClientNonBlock_Base;
+
+  // Bind the stream to the request @param rpc_id to the function
+  // @param fn_id of @param client, steered with @param affinity.
+  void open(RpcClientNonBlock_Base* client, uint32_t rpc_id, uint8_t fn_id,
+            uint8_t affinity);
+
+  // Called by the completion queue thread.
+  void push(volatile RpcPckt* frame);
+
+ private:
+  RpcClientNonBlock_Base* client_;
+  uint32_t rpc_id_;
+  uint8_t fn_id_;
+  uint8_t affinity_;
+
+  // Frames received by the completion queue thread.
+  std::mutex lock_;
+  std::vector<RpcPckt> received_;
+
+  uint8_t next_seq_;
+  uint32_t consumed_;
+  size_t items_;
+  bool done_;
+};
+
+/// Typed stream the client stubs of functions returning `stream Item`
+/// take.
+template <typename Item>
+class RpcClientStream : public RpcClientStream_Base {
+ public:
+  typedef std::function<void(const Item&)> Callback;
+
+  explicit RpcClientStream(Callback callback) : callback_(callback) {}
+
+  /// Deliver the items received so far to the callback. Returns the number of
+  /// delivered items. Credit grants are sent from the calling thread, so
+  /// unless the client is in the multi-producer mode, this must be the
+  /// thread issuing its requests.
+  size_t poll() {
+    take_frames(frames_);
+
+    size_t n = 0;
+    for (auto& frame : frames_) {
+      if (!account(frame)) continue;
+
+      Item item;
+      if (!rpc_decode(frame.argv, frame.hdr.argl, item)) {
+        ++lost_;
+        continue;
+      }
+
+      callback_(item);
+      ++n;
+    }
+    frames_.clear();
+
+    grant_credits();
+    return n;
+  }
+
+ private:
+  Callback callback_;
+  std::vector<RpcPckt> frames_;
+};
+
+}  // namespace dagger
+
+#endif
@@ -1,9 +1,16 @@
 #include "rpc_threaded_server.h"
 
+#include <unistd.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <functional>
+#include <utility>
+
 #include "logger.h"
-#include "nic_ccip_dma.h"
-#include "nic_ccip_mmio.h"
-#include "nic_ccip_polling.h"
+#include "nic_ccip_factory.h"
+#include "utils.h"
 
 namespace dagger {
 
@@ -12,9 +19,21 @@ RpcThreadedServer::RpcThreadedServer(uint64_t base_nic_addr,
     : max_num_of_threads_(max_num_of_threads),
       base_nic_addr_(base_nic_addr),
       thread_cnt_(0),
+      parked_flows_(max_num_of_threads),
+      lb_(lb_static),
+      autoscale_(false),
+      autoscaler_rpc_callback_(nullptr),
+      autoscaler_min_num_of_threads_(1),
+      autoscaler_callback_(nullptr),
+      draining_(false),
       nic_is_started_(false) {}
 
 RpcThreadedServer::~RpcThreadedServer() {
+  // Stop autoscaling.
+  if (autoscaler_thread_.joinable()) {
+    stop_autoscaler();
+  }
+
   // Stop all threads.
   if (threads_.size() > 0) {
     stop_all_listening_threads();
@@ -29,29 +48,23 @@ RpcThreadedServer::~RpcThreadedServer() {
 /// This function initializes the backend's nic depending on the exact type of
 /// the nic. The function performs four actions to initialize the nic.
 int RpcThreadedServer::init_nic(int bus) {
+  PhyAddr cl_phy_addr = {0x1A, 0x2B, 0x3C, 0x4D, 0x5E, 0xFF};
+  IPv4 cl_ipv4_addr("192.168.0.2", 0);
+
+  return init_nic(bus, cl_phy_addr, cl_ipv4_addr);
+}
+
+int RpcThreadedServer::init_nic(int bus, const PhyAddr& host_phy,
+                                const IPv4& host_ipv4) {
   // (1) Create nic.
   // In contrast to rpc_client_pool, the server's nic is always the master
   // (even in the ASE mode).
-#ifdef NIC_CCIP_POLLING
-#  pragma message "compiling Nic to run in polling mode"
-  // Simple case so far: number of NIC flows = max_num_of_threads_.
-  nic_ = std::unique_ptr<Nic>(
-      new NicPollingCCIP(base_nic_addr_, max_num_of_threads_, true));
-#elif NIC_CCIP_MMIO
-// MMIO intefrace only works either with write-combine buffering or AVX
-// intrinsics.
-#  pragma message "compiling Nic to run in MMIO mode"
   // Simple case so far: number of NIC flows = max_num_of_threads_.
-  nic_ = std::unique_ptr<Nic>(
-      new NicMmioCCIP(base_nic_addr_, max_num_of_threads_, true));
-#elif NIC_CCIP_DMA
-#  pragma message "compiling Nic to run in DMA mode"
-  // Simple case so far: number of NIC flows = max_num_of_threads_.
-  nic_ = std::unique_ptr<Nic>(
-      new NicDmaCCIP(base_nic_addr_, max_num_of_threads_, true));
-#else
-#  error Nic CCI-P mode is not specified
-#endif
+  nic_ = make_ccip_nic(base_nic_addr_, max_num_of_threads_, true, bus);
+  if (nic_ == nullptr) {
+    FRPC_ERROR("Failed to create nic\n");
+    return 1;
+  }
 
   // (2) Connect to nic.
   int res = nic_->connect_to_nic(bus);
@@ -60,14 +73,11 @@ int RpcThreadedServer::init_nic(int bus) {
 
   // (3) Configure the nic dataplane. Of course, all the clients in this pool
   // share the same configuration.
-  PhyAddr cl_phy_addr = {0x1A, 0x2B, 0x3C, 0x4D, 0x5E, 0xFF};
-  IPv4 cl_ipv4_addr("192.168.0.2", 0);
-
   res = nic_->configure_data_plane();
   if (res != 0) return res;
 
   // (4) Run hardware initialization.
-  res = nic_->initialize_nic(cl_phy_addr, cl_ipv4_addr);
+  res = nic_->initialize_nic(host_phy, host_ipv4);
   if (res != 0) return res;
 
   return 0;
@@ -104,19 +114,38 @@ int RpcThreadedServer::check_hw_errors() const {
 int RpcThreadedServer::run_new_listening_thread(
     const RpcServerCallBack_Base* rpc_callback, int pin_cpu) {
   std::unique_lock<std::mutex> lck(mtx_);
+  wait_for_drain(lck);
 
   if (thread_cnt_ < max_num_of_threads_) {
+    // The thread starts with its own flow; if the flow was parked by
+    // stop_listening_thread(), it is picked up as is
+    size_t flow_id = thread_cnt_;
+    std::unique_ptr<ServerFlow> flow = std::move(parked_flows_[flow_id]);
+    if (flow == nullptr) {
+      flow = std::unique_ptr<ServerFlow>(new ServerFlow(nic_.get(), flow_id));
+    }
+    uint64_t requests = flow->requests.load(std::memory_order_relaxed);
+
     threads_.push_back(std::unique_ptr<RpcServerThread>(new RpcServerThread(
-        nic_.get(), thread_cnt_, thread_cnt_, rpc_callback)));
+        nic_.get(), std::move(flow), thread_cnt_, rpc_callback)));
 
     int r = threads_.back().get()->start_listening(pin_cpu);
     if (r != 0) {
+      threads_.back()->stop_listening();
+      parked_flows_[flow_id] = threads_.back()->detach_flow(flow_id);
       threads_.pop_back();
       return 1;
     }
 
+    if (thread_cnt_ == 0) {
+      last_rebalance_ = std::chrono::steady_clock::now();
+    }
+    flow_thread_.push_back(thread_cnt_);
+    flow_requests_.push_back(requests);
+    flow_rates_.push_back(0);
+
     ++thread_cnt_;
-    return 0;
+    return set_active_flows(thread_cnt_);
   } else {
     FRPC_ERROR("Max number of rpc threads is reached: %zu\n",
                max_num_of_threads_);
@@ -125,15 +154,245 @@ int RpcThreadedServer::run_new_listening_thread(
 }
 
 int RpcThreadedServer::stop_all_listening_threads() {
+  if (autoscaler_thread_.joinable()) {
+    stop_autoscaler();
+  }
+
+  std::unique_lock<std::mutex> lck(mtx_);
+  wait_for_drain(lck);
   for (auto& thread : threads_) {
     thread->stop_listening();
   }
 
   threads_.clear();
   thread_cnt_ = 0;
+
+  flow_thread_.clear();
+  flow_requests_.clear();
+  flow_rates_.clear();
+  return 0;
+}
+
+int RpcThreadedServer::stop_listening_thread() {
+  // The flow mask only applies to the dynamic load balancers, the nic would
+  // keep steering requests to the parked flow
+  if (lb_ == lb_static) {
+    FRPC_ERROR("Stopping threads requires dynamic load balancing on the nic\n");
+    return 1;
+  }
+
+  std::unique_lock<std::mutex> lck(mtx_);
+  wait_for_drain(lck);
+
+  if (thread_cnt_ < 2) {
+    FRPC_ERROR("Can not stop the last listening thread\n");
+    return 1;
+  }
+
+  size_t thread_id = thread_cnt_ - 1;
+  size_t flow = thread_id;
+
+  // (1) Stop steering requests to the flow of the thread.
+  if (set_active_flows(thread_cnt_ - 1) != 0) return 1;
+
+  // (2) Move the other flows of the thread to the least loaded remaining
+  // threads, by the number of flows.
+  int res = 0;
+  for (size_t f = 0; f < flow_thread_.size() && res == 0; ++f) {
+    if (f == flow || flow_thread_[f] != thread_id) continue;
+
+    std::vector<size_t> load(thread_id, 0);
+    for (size_t t : flow_thread_) {
+      if (t < thread_id) ++load[t];
+    }
+    size_t t = static_cast<size_t>(
+        std::min_element(load.begin(), load.end()) - load.begin());
+    res = move_flow_locked(f, t);
+  }
+
+  // (3) Serve the requests already steered to the flow.
+  if (res == 0) res = drain_flow(flow, lck);
+
+  if (res != 0) {
+    FRPC_ERROR("Failed to stop thread %zu\n", thread_id);
+    set_active_flows(thread_cnt_);
+    return 1;
+  }
+
+  // (4) Park the flow and stop the thread.
+  parked_flows_[flow] = threads_[flow_thread_[flow]]->detach_flow(flow);
+  threads_.back()->stop_listening();
+  threads_.pop_back();
+
+  flow_thread_.pop_back();
+  flow_requests_.pop_back();
+  flow_rates_.pop_back();
+  --thread_cnt_;
+
+  FRPC_INFO("Thread %zu is stopped, flow %zu is parked\n", thread_id, flow);
   return 0;
 }
 
+size_t RpcThreadedServer::get_number_of_threads() const { return thread_cnt_; }
+
+int RpcThreadedServer::drain_flow(size_t flow,
+                                  std::unique_lock<std::mutex>& lck) {
+  // No new requests are steered to the flow; the ones already on the way
+  // are in the flow FIFO on the nic or in the rx ring, and the serving thread
+  // picks them up within a drain period. The lock is released meanwhile, the
+  // threads and the flow placement do not change until draining_ is reset
+  RpcServerThread* thread = threads_[flow_thread_[flow]].get();
+  uint64_t requests = thread->get_number_of_requests(flow);
+  draining_ = true;
+
+  int res = 1;
+  auto deadline =
+      std::chrono::steady_clock::now() +
+      std::chrono::microseconds(cfg::sys::flow_drain_timeout_us);
+  while (std::chrono::steady_clock::now() < deadline) {
+    drain_cv_.wait_for(lck,
+                       std::chrono::microseconds(cfg::sys::flow_drain_us));
+
+    Nic::FlowStats stats;
+    if (nic_->get_flow_stats(flow, stats) != 0) break;
+
+    uint64_t new_requests = thread->get_number_of_requests(flow);
+    if (stats.occupancy == 0 && new_requests == requests) {
+      res = 0;
+      break;
+    }
+    requests = new_requests;
+  }
+
+  draining_ = false;
+  drain_cv_.notify_all();
+
+  if (res != 0) {
+    FRPC_ERROR("Flow %zu is not drained in %u us\n", flow,
+               cfg::sys::flow_drain_timeout_us);
+  }
+  return res;
+}
+
+void RpcThreadedServer::wait_for_drain(std::unique_lock<std::mutex>& lck) {
+  drain_cv_.wait(lck, [this]() { return !draining_; });
+}
+
+int RpcThreadedServer::set_active_flows(size_t num_of_flows) {
+  uint64_t mask = ~static_cast<uint64_t>(0);
+  if (num_of_flows < 64) mask = (static_cast<uint64_t>(1) << num_of_flows) - 1;
+  return nic_->set_flow_mask(mask);
+}
+
+int RpcThreadedServer::move_flow(size_t flow, size_t thread_id) {
+  std::unique_lock<std::mutex> lck(mtx_);
+  wait_for_drain(lck);
+  return move_flow_locked(flow, thread_id);
+}
+
+int RpcThreadedServer::move_flow_locked(size_t flow, size_t thread_id) {
+  if (flow >= flow_thread_.size() || thread_id >= threads_.size()) {
+    FRPC_ERROR("Can not move flow %zu to thread %zu: no such flow or thread\n",
+               flow, thread_id);
+    return 1;
+  }
+
+  size_t src = flow_thread_[flow];
+  if (src == thread_id) return 0;
+
+  std::unique_ptr<ServerFlow> f = threads_[src]->detach_flow(flow);
+  if (f == nullptr) {
+    FRPC_ERROR("Flow %zu is not served by thread %zu\n", flow, src);
+    return 1;
+  }
+
+  int res = threads_[thread_id]->attach_flow(std::move(f));
+  if (res != 0) return res;
+
+  flow_thread_[flow] = thread_id;
+  FRPC_INFO("Flow %zu is moved from thread %zu to thread %zu\n", flow, src,
+            thread_id);
+  return 0;
+}
+
+int RpcThreadedServer::rebalance_flows(size_t num_of_threads) {
+  std::vector<size_t> placement;
+
+  {
+    std::unique_lock<std::mutex> lck(mtx_);
+    wait_for_drain(lck);
+
+    if (threads_.empty() || num_of_threads > threads_.size()) {
+      FRPC_ERROR("Can not rebalance flows between %zu threads, %zu running\n",
+                 num_of_threads, threads_.size());
+      return 1;
+    }
+
+    // Observed request rates
+    auto now = std::chrono::steady_clock::now();
+    double duration_s =
+        std::chrono::duration<double>(now - last_rebalance_).count();
+    last_rebalance_ = now;
+
+    double total_rate = 0;
+    std::vector<std::pair<double, size_t>> flows;
+    for (size_t f = 0; f < flow_thread_.size(); ++f) {
+      uint64_t requests = threads_[flow_thread_[f]]->get_number_of_requests(f);
+      flow_rates_[f] =
+          duration_s > 0
+              ? static_cast<double>(requests - flow_requests_[f]) / duration_s
+              : 0;
+      flow_requests_[f] = requests;
+
+      total_rate += flow_rates_[f];
+      flows.push_back(std::make_pair(flow_rates_[f], f));
+    }
+
+    if (num_of_threads == 0) {
+      num_of_threads = static_cast<size_t>(
+          std::ceil(total_rate / cfg::sys::server_thread_target_rps));
+      num_of_threads = std::max(num_of_threads, static_cast<size_t>(1));
+      num_of_threads = std::min(num_of_threads, threads_.size());
+    }
+
+    // Greedy packing: the busiest flows go first, each to the least loaded
+    // thread, <request rate, number of flows>; on ties, flows stay where
+    // they are
+    std::sort(flows.begin(), flows.end(),
+              std::greater<std::pair<double, size_t>>());
+    std::vector<std::pair<double, size_t>> load(num_of_threads,
+                                                std::make_pair(0.0, 0));
+    placement = flow_thread_;
+    for (auto& flow : flows) {
+      size_t t = static_cast<size_t>(
+          std::min_element(load.begin(), load.end()) - load.begin());
+      size_t current = flow_thread_[flow.second];
+      if (current < num_of_threads && load[current] <= load[t]) t = current;
+
+      load[t].first += flow.first;
+      ++load[t].second;
+      placement[flow.second] = t;
+    }
+  }
+
+  int res = 0;
+  for (size_t f = 0; f < placement.size(); ++f) {
+    if (move_flow(f, placement[f]) != 0) res = 1;
+  }
+
+  return res;
+}
+
+size_t RpcThreadedServer::get_flow_thread(size_t flow) const {
+  assert(flow < flow_thread_.size());
+  return flow_thread_[flow];
+}
+
+double RpcThreadedServer::get_flow_rate(size_t flow) const {
+  assert(flow < flow_rates_.size());
+  return flow_rates_[flow];
+}
+
 int RpcThreadedServer::connect(const IPv4& client_addr, ConnectionId c_id,
                                ConnectionFlowId c_flow_id) {
   return nic_->add_connection(c_id, client_addr, c_flow_id);
@@ -149,6 +408,163 @@ int RpcThreadedServer::run_perf_thread(
   return nic_->run_perf_thread(perf_mask, callback);
 }
 
-void RpcThreadedServer::set_lb(int lb) { nic_->set_lb(lb); }
+int RpcThreadedServer::run_autoscaler(
+    const RpcServerCallBack_Base* rpc_callback, size_t min_num_of_threads,
+    void (*callback)(const ScalingEvent&), const std::vector<int>& pin_cpus) {
+  if (autoscaler_thread_.joinable()) {
+    FRPC_ERROR("Autoscaler is already running\n");
+    return 1;
+  }
+
+  if (lb_ == lb_static) {
+    FRPC_ERROR("Autoscaling requires dynamic load balancing on the nic\n");
+    return 1;
+  }
+
+  if (min_num_of_threads == 0 || min_num_of_threads > max_num_of_threads_) {
+    FRPC_ERROR("Wrong minimum number of threads for autoscaling: %zu\n",
+               min_num_of_threads);
+    return 1;
+  }
+
+  // Start from the minimum
+  while (get_number_of_threads() < min_num_of_threads) {
+    size_t t = get_number_of_threads();
+    int res = run_new_listening_thread(
+        rpc_callback, t < pin_cpus.size() ? pin_cpus[t] : -1);
+    if (res != 0) return res;
+  }
+
+  autoscaler_rpc_callback_ = rpc_callback;
+  autoscaler_min_num_of_threads_ = min_num_of_threads;
+  autoscaler_callback_ = callback;
+  autoscaler_pin_cpus_ = pin_cpus;
+
+  FRPC_INFO("Running autoscaler with %zu to %zu threads\n", min_num_of_threads,
+            max_num_of_threads_);
+  autoscale_ = true;
+  autoscaler_thread_ = std::thread(&RpcThreadedServer::autoscaler_loop, this);
+  return 0;
+}
+
+int RpcThreadedServer::stop_autoscaler() {
+  if (!autoscaler_thread_.joinable()) {
+    FRPC_ERROR("Autoscaler is not running\n");
+    return 1;
+  }
+
+  autoscale_ = false;
+  autoscaler_thread_.join();
+  FRPC_INFO("Autoscaler is stopped\n");
+  return 0;
+}
+
+void RpcThreadedServer::autoscaler_loop() {
+  // Busy cycles of the threads at the previous sample
+  std::vector<uint64_t> busy_cycles;
+  uint64_t last_sample = 0;
+  auto cooldown_end = std::chrono::steady_clock::now();
+
+  while (autoscale_) {
+    usleep(cfg::sys::autoscaler_period_us);
+
+    // (1) Sample the handler utilization and the flow backlog.
+    std::vector<uint64_t> cycles;
+    size_t num_of_threads;
+    {
+      std::unique_lock<std::mutex> lck(mtx_);
+      num_of_threads = threads_.size();
+      for (auto& thread : threads_) {
+        cycles.push_back(thread->get_busy_cycles());
+      }
+    }
+    uint64_t now = utils::rdtsc();
+
+    // The thread set has changed, start a new window
+    if (cycles.size() != busy_cycles.size()) {
+      busy_cycles = cycles;
+      last_sample = now;
+      continue;
+    }
+
+    double max_utilization = 0;
+    double avg_utilization = 0;
+    for (size_t t = 0; t < num_of_threads; ++t) {
+      double u = static_cast<double>(cycles[t] - busy_cycles[t]) /
+                 static_cast<double>(now - last_sample);
+      max_utilization = std::max(max_utilization, u);
+      avg_utilization += u / static_cast<double>(num_of_threads);
+    }
+    busy_cycles = cycles;
+    last_sample = now;
+
+    uint64_t backlog = 0;
+    bool congested = false;
+    for (size_t f = 0; f < num_of_threads; ++f) {
+      Nic::FlowStats stats;
+      if (nic_->get_flow_stats(f, stats) != 0) continue;
+      backlog = std::max(backlog, stats.occupancy);
+      congested = congested || stats.congested ||
+                  stats.occupancy >= cfg::sys::autoscaler_backlog;
+    }
+
+    if (std::chrono::steady_clock::now() < cooldown_end) continue;
+
+    // (2) Scale.
+    ScalingEvent event;
+    if ((max_utilization > cfg::sys::autoscaler_high_utilization ||
+         congested) &&
+        num_of_threads < max_num_of_threads_) {
+      int pin_cpu = num_of_threads < autoscaler_pin_cpus_.size()
+                        ? autoscaler_pin_cpus_[num_of_threads]
+                        : -1;
+      if (run_new_listening_thread(autoscaler_rpc_callback_, pin_cpu) != 0) {
+        continue;
+      }
+      event.type = ScalingEvent::scale_up;
+      event.utilization = max_utilization;
+    } else if (!congested &&
+               num_of_threads > autoscaler_min_num_of_threads_ &&
+               avg_utilization * static_cast<double>(num_of_threads) /
+                       static_cast<double>(num_of_threads - 1) <
+                   cfg::sys::autoscaler_low_utilization) {
+      if (stop_listening_thread() != 0) continue;
+      event.type = ScalingEvent::scale_down;
+      event.utilization = avg_utilization;
+    } else {
+      continue;
+    }
+
+    // (3) Report.
+    event.num_of_threads = get_number_of_threads();
+    event.backlog = backlog;
+    FRPC_INFO(
+        "Autoscaler: scaled %s to %zu threads, utilization= %.2f, "
+        "backlog= %lu\n",
+        event.type == ScalingEvent::scale_up ? "up" : "down",
+        event.num_of_threads, event.utilization, event.backlog);
+    if (autoscaler_callback_ != nullptr) autoscaler_callback_(event);
+
+    cooldown_end = std::chrono::steady_clock::now() +
+                   std::chrono::microseconds(cfg::sys::autoscaler_cooldown_us);
+  }
+}
+
+void RpcThreadedServer::set_lb(int lb) {
+  lb_ = lb;
+  nic_->set_lb(lb);
+}
+
+int RpcThreadedServer::perf_counters(Nic::PerfCounters& counters) const {
+  return nic_->get_perf_counters(counters);
+}
+
+int RpcThreadedServer::flow_stats(size_t flow, Nic::FlowStats& stats) const {
+  return nic_->get_flow_stats(flow, stats);
+}
+
+int RpcThreadedServer::run_flow_monitor(uint32_t period_us) {
+  return nic_->run_flow_monitor(period_us);
+}
 
 }  // namespace dagger
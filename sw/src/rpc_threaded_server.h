@@ -6,8 +6,12 @@
 #ifndef _RPC_THREADED_SERVER_H_
 #define _RPC_THREADED_SERVER_H_
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <memory>
 #include <mutex>
+#include <thread>
 #include <vector>
 
 #include "nic.h"
@@ -29,6 +33,9 @@ class RpcThreadedServer {
 
   /// A wrapper on top of the nic's init/start/stop API.
   int init_nic(int bus);
+  /// Same as above, but with the host addresses @param host_phy and
+  /// @param host_ipv4 of the nic, e.g. if the process drives several nics.
+  int init_nic(int bus, const PhyAddr& host_phy, const IPv4& host_ipv4);
   int start_nic();
   int stop_nic();
 
@@ -43,6 +50,61 @@ class RpcThreadedServer {
   /// Stop all currently running RPC threads.
   int stop_all_listening_threads();
 
+  /// Stop the most recently started listening thread. Its own flow is taken
+  /// out of the nic load balancing, drained and parked until a thread is
+  /// started in its place; the other flows it serves are moved to the
+  /// remaining threads. The first thread can not be stopped, and with
+  /// lb_static no thread can, as the nic keeps steering requests to every
+  /// flow.
+  int stop_listening_thread();
+
+  size_t get_number_of_threads() const;
+
+  /// Each listening thread starts with its own nic flow; flows can then be
+  /// moved between the threads at runtime, without stopping the nic. Threads
+  /// left without flows go idle (see IdlePolicy).
+
+  /// Move the nic flow @param flow to the listening thread @param thread_id.
+  int move_flow(size_t flow, size_t thread_id);
+
+  /// Rebalance the flows between the first @param num_of_threads listening
+  /// threads based on the per-flow request rates observed since the previous
+  /// call. If @param num_of_threads is 0, use as many threads as needed to
+  /// keep each below cfg::sys::server_thread_target_rps.
+  int rebalance_flows(size_t num_of_threads = 0);
+
+  /// Listening thread serving the nic flow @param flow.
+  size_t get_flow_thread(size_t flow) const;
+
+  /// Request rate of the nic flow @param flow as observed by the last
+  /// rebalance_flows(), in requests per second.
+  double get_flow_rate(size_t flow) const;
+
+  /// Elastic scaling: the autoscaler thread watches the handler utilization
+  /// of the listening threads and the per-flow backlog on the nic, and starts
+  /// or stops listening threads (together with their own flows) at runtime,
+  /// see cfg::sys::autoscaler_*. The nic only steers requests to the flows of
+  /// the running threads, so scaling requires lb_round_robin or lb_affinity.
+  struct ScalingEvent {
+    enum Type { scale_up = 0, scale_down = 1 };
+
+    Type type;
+    size_t num_of_threads;  // number of listening threads after the event
+    double utilization;     // handler utilization, of the busiest thread for
+                            // scale_up and on average for scale_down
+    uint64_t backlog;       // largest flow FIFO occupancy on the nic
+  };
+
+  /// Run the autoscaler between @param min_num_of_threads and the maximum
+  /// number of threads. New threads run the RPC handler @param rpc_callback,
+  /// the i-th thread is pinned to @param pin_cpus[i] if given. Scaling events
+  /// are reported to @param callback, if not nullptr.
+  int run_autoscaler(const RpcServerCallBack_Base* rpc_callback,
+                     size_t min_num_of_threads,
+                     void (*callback)(const ScalingEvent&) = nullptr,
+                     const std::vector<int>& pin_cpus = std::vector<int>());
+  int stop_autoscaler();
+
   // Connection management API.
   int connect(const IPv4& client_addr, ConnectionId c_id,
               ConnectionFlowId c_flow_id);
@@ -56,10 +118,33 @@ class RpcThreadedServer {
   int run_perf_thread(Nic::NicPerfMask perf_mask,
                       void (*callback)(const std::vector<uint64_t>&));
 
+  /// Read the hardware performance counters of the nic (slow path).
+  int perf_counters(Nic::PerfCounters& counters) const;
+
   /// Set the desired load balancing scheme which will be used to distribute
   /// requests across the RpcServerThread's.
   void set_lb(int lb);
 
+  /// Read the statistics of the nic flow @param flow (slow path).
+  int flow_stats(size_t flow, Nic::FlowStats& stats) const;
+
+  /// A wrapper on top of the nic's flow monitor API.
+  int run_flow_monitor(uint32_t period_us);
+
+ private:
+  // Both expect mtx_ to be held; drain_flow() releases it while waiting,
+  // see draining_.
+  int move_flow_locked(size_t flow, size_t thread_id);
+  int drain_flow(size_t flow, std::unique_lock<std::mutex>& lck);
+
+  // Wait until no flow is drained; expects mtx_ to be held by @param lck.
+  void wait_for_drain(std::unique_lock<std::mutex>& lck);
+
+  // Let the nic steer requests to the first @param num_of_flows flows only.
+  int set_active_flows(size_t num_of_flows);
+
+  void autoscaler_loop();
+
  private:
   size_t max_num_of_threads_;
   uint64_t base_nic_addr_;
@@ -72,9 +157,37 @@ class RpcThreadedServer {
   std::vector<std::unique_ptr<RpcServerThread>> threads_;
   size_t thread_cnt_;
 
+  /// Flow placement: the serving thread of each flow, and the request counts
+  /// and rates at the last rebalancing.
+  std::vector<size_t> flow_thread_;
+  std::vector<uint64_t> flow_requests_;
+  std::vector<double> flow_rates_;
+  std::chrono::steady_clock::time_point last_rebalance_;
+
+  /// Flows of the stopped threads, by flow id; they keep the state of their
+  /// rings until a thread is started in their place.
+  std::vector<std::unique_ptr<ServerFlow>> parked_flows_;
+
+  /// Current load balancing scheme.
+  int lb_;
+
+  /// Autoscaler.
+  std::thread autoscaler_thread_;
+  std::atomic<bool> autoscale_;
+  const RpcServerCallBack_Base* autoscaler_rpc_callback_;
+  size_t autoscaler_min_num_of_threads_;
+  void (*autoscaler_callback_)(const ScalingEvent&);
+  std::vector<int> autoscaler_pin_cpus_;
+
   /// Sync.
   std::mutex mtx_;
 
+  /// A flow is being drained by stop_listening_thread(), without holding
+  /// mtx_; the threads and the flow placement are only changed once it is
+  /// done.
+  bool draining_;
+  std::condition_variable drain_cv_;
+
   /// Status of the underlying hardware nic.
   bool nic_is_started_;
 };
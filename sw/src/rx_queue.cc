@@ -1,7 +1,5 @@
 #include "rx_queue.h"
 
-#include <unistd.h>
-
 namespace dagger {
 
 RxQueue::RxQueue()
@@ -11,34 +9,25 @@ RxQueue::RxQueue()
       l_depth_(0),
       rx_q_(nullptr),
       rx_q_tail_(0),
-      rpc_id_set_(nullptr) {}
+      phase_(1) {}
 
 RxQueue::RxQueue(volatile char* rx_flow_buff, size_t bucket_size_bytes,
                  size_t l_depth)
     : rx_flow_buff_(rx_flow_buff),
       bucket_size_(bucket_size_bytes),
       l_depth_(l_depth),
-      rpc_id_set_(nullptr),
-      rx_q_tail_(0) {
+      rx_q_tail_(0),
+      phase_(1) {
   rx_q_ = rx_flow_buff_;
   depth_ = 1 << l_depth_;
 }
 
-RxQueue::~RxQueue() {
-  if (rpc_id_set_ != nullptr) {
-    delete[] rpc_id_set_;
-  }
-}
+RxQueue::~RxQueue() {}
 
 void RxQueue::init() {
-  int page_size = getpagesize();
-  assert(page_size == 4096);
-
-  rpc_id_set_ = reinterpret_cast<uint32_t*>(
-      aligned_alloc(page_size, depth_ * sizeof(uint32_t)));
-  for (size_t i = 0; i < depth_; ++i) {
-    rpc_id_set_[i] = -1;
-  }
+  // The nic starts with phase 1 on zeroed memory
+  rx_q_tail_ = 0;
+  phase_ = 1;
 }
 
 }  // namespace dagger
@@ -16,6 +16,11 @@ namespace dagger {
 
 /// RX queue implementation. The queue provides the critical path interface with
 /// the hardware for incoming RPC requests.
+///
+/// The nic stamps every packet with the phase of the queue lap it is written
+/// in: 1 on the first lap, flipped on every wrap-around. A slot holds a new
+/// packet when its valid bit is set and its phase bit matches the phase
+/// expected at the tail, so polling is a single load and compare on the slot.
 class alignas(4096) RxQueue {
  public:
   /// Default instantiation.
@@ -36,30 +41,37 @@ class alignas(4096) RxQueue {
   void init();
 
   /// Critical path function to get the tail location in the queue for the
-  /// upcoming read access.
-  inline volatile char* get_read_ptr(uint32_t& rpc_id)
+  /// upcoming read access, and the @param phase a new packet in it has
+  /// (see rx_pckt_is_new()).
+  inline volatile char* get_read_ptr(uint8_t& phase)
       __attribute__((always_inline)) {
-    assert(rpc_id_set_ != nullptr);
     assert(rx_q_ != nullptr);
 
-    volatile char* ptr = rx_q_ + rx_q_tail_ * bucket_size_;
-    rpc_id = rpc_id_set_[rx_q_tail_];
-    return ptr;
+    phase = phase_;
+    return rx_q_ + rx_q_tail_ * bucket_size_;
   }
 
-  /// Critical path function to update the rpc_id (for polling) and increment
-  /// the tail pointer.
-  inline void update_rpc_id(uint32_t rpc_id) __attribute__((always_inline)) {
-    assert(rpc_id_set_ != nullptr);
+  /// Critical path function to consume the packet at the tail: increment the
+  /// tail pointer and flip the expected phase on wrap-around.
+  inline void pop() __attribute__((always_inline)) {
     assert(rx_q_ != nullptr);
 
-    rpc_id_set_[rx_q_tail_] = rpc_id;
     ++rx_q_tail_;
     if (rx_q_tail_ == depth_) {
       rx_q_tail_ = 0;
+      phase_ ^= 1;
     }
   }
 
+  /// Critical path function to prefetch the slot after the tail, so the
+  /// next packet is in the cache by the time the current one is handled.
+  inline void prefetch_next() const __attribute__((always_inline)) {
+    assert(rx_q_ != nullptr);
+
+    size_t next = rx_q_tail_ + 1 == depth_ ? 0 : rx_q_tail_ + 1;
+    __builtin_prefetch(const_cast<const char*>(rx_q_ + next * bucket_size_));
+  }
+
  private:
   // Underlying nic buffer.
   volatile char* rx_flow_buff_;
@@ -72,7 +84,8 @@ class alignas(4096) RxQueue {
   // Rx queue.
   volatile char* rx_q_;
   size_t rx_q_tail_;
-  uint32_t* rpc_id_set_;
+  // Phase of the current lap.
+  uint8_t phase_;
 };
 
 }  // namespace dagger
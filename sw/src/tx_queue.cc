@@ -13,6 +13,12 @@ TxQueue::TxQueue()
       tx_q_head_(0),
       tx_q_tail_(0),
       change_bit_set_(nullptr),
+      mp_(nullptr),
+      tx_mode_(tx_polling),
+      nic_(nullptr),
+      nic_flow_id_(0),
+      dma_batch_ptr_(0),
+      dma_batch_cnt_(0),
       cq_(nullptr) {}
 
 TxQueue::TxQueue(char* tx_flow_buff, size_t bucket_size_bytes, size_t l_depth)
@@ -22,6 +28,12 @@ TxQueue::TxQueue(char* tx_flow_buff, size_t bucket_size_bytes, size_t l_depth)
       tx_q_head_(0),
       tx_q_tail_(0),
       change_bit_set_(nullptr),
+      mp_(nullptr),
+      tx_mode_(tx_polling),
+      nic_(nullptr),
+      nic_flow_id_(0),
+      dma_batch_ptr_(0),
+      dma_batch_cnt_(0),
       cq_(nullptr) {
   // Allocate tx and completion queues.
   tx_q_ = tx_flow_buff_;
@@ -34,6 +46,7 @@ TxQueue::~TxQueue() {
   if (change_bit_set_ != nullptr) {
     delete[] change_bit_set_;
   }
+  delete mp_;
 }
 
 void TxQueue::init() {
@@ -48,6 +61,25 @@ void TxQueue::init() {
     change_bit_set_[i] = 1;
     // free_bit_[i] = 1;
   }
+
+  mp_ = new MpState;
+  mp_->head = 0;
+  mp_->seq = std::unique_ptr<std::atomic<uint64_t>[]>(
+      new std::atomic<uint64_t>[depth_]);
+  for (size_t i = 0; i < depth_; ++i) {
+    mp_->seq[i] = i;
+  }
+}
+
+void TxQueue::bind_transport(TxMode tx_mode, const Nic* nic,
+                             size_t nic_flow_id) {
+  assert(tx_mode != tx_dma || nic != nullptr);
+
+  tx_mode_ = tx_mode;
+  nic_ = nic;
+  nic_flow_id_ = nic_flow_id;
+  dma_batch_ptr_ = 0;
+  dma_batch_cnt_ = 0;
 }
 
 }  // namespace dagger
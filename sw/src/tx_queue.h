@@ -6,11 +6,18 @@
 #ifndef _TX_QUEUE_H_
 #define _TX_QUEUE_H_
 
+#include <immintrin.h>
+#include <sched.h>
 #include <stddef.h>
 #include <stdint.h>
 
+#include <atomic>
 #include <bitset>
 #include <cassert>
+#include <memory>
+
+#include "config.h"
+#include "nic.h"
 
 namespace dagger {
 
@@ -34,6 +41,40 @@ class alignas(4096) TxQueue {
   /// Initialize the queue.
   void init();
 
+  /// Log depth of the queues of the nic transport @param tx_mode: MMIO nics
+  /// have a single tx buffer entry per flow.
+  static size_t get_l_depth(TxMode tx_mode) {
+    return tx_mode == tx_mmio ? 0 : cfg::nic::l_tx_queue_size;
+  }
+
+  /// Bind the queue to the transport @param tx_mode of the hardware flow
+  /// @param nic_flow_id of @param nic; requests written into the queue are
+  /// sent with this transport (see ccip_tx.h). Queues which are not bound
+  /// use the polling transport.
+  void bind_transport(TxMode tx_mode, const Nic* nic, size_t nic_flow_id);
+
+  TxMode get_tx_mode() const { return tx_mode_; }
+
+  /// DMA transport: account the request just written into the queue, and
+  /// notify the nic once a batch of them is ready.
+  inline void commit_dma_write() __attribute__((always_inline)) {
+    assert(tx_mode_ == tx_dma);
+    assert(nic_ != nullptr);
+
+    if (dma_batch_cnt_ == dma_batch_size - 1) {
+      nic_->notify_nic_of_new_dma(nic_flow_id_, dma_batch_ptr_);
+
+      dma_batch_ptr_ += dma_batch_size;
+      if (dma_batch_ptr_ == (depth_ / dma_batch_size) * dma_batch_size) {
+        dma_batch_ptr_ = 0;
+      }
+
+      dma_batch_cnt_ = 0;
+    } else {
+      ++dma_batch_cnt_;
+    }
+  }
+
   /// Critical path function to get the head location in the queue for the
   /// upcoming write access.
   inline char* get_write_ptr(uint8_t& change_bit)
@@ -57,7 +98,68 @@ class alignas(4096) TxQueue {
     return ptr;
   }
 
+  /// Multi-producer version of get_write_ptr(), can be called concurrently
+  /// from many threads. The slot is reserved by a fetch-add on the head; the
+  /// returned @param ticket is a unique, monotonically increasing number of
+  /// the request in the queue. The caller must call release_write_ptr() with
+  /// this ticket after the request has been published to the nic. If the
+  /// producer of the previous lap is still writing into the same slot, the
+  /// call waits until the slot is released.
+  /// The single- and multi-producer interfaces can not be mixed on the same
+  /// queue.
+  inline char* reserve_write_ptr(uint8_t& change_bit, uint64_t& ticket)
+      __attribute__((always_inline)) {
+    assert(tx_q_ != nullptr);
+    assert(mp_ != nullptr);
+
+    ticket = mp_->head.fetch_add(1, std::memory_order_relaxed);
+    size_t slot = ticket & (depth_ - 1);
+
+    // Spin shortly, then yield as the owner of the slot might have been
+    // preempted if there are more application threads than cores
+    size_t spin = 0;
+    while (mp_->seq[slot].load(std::memory_order_acquire) != ticket) {
+      if (++spin < mp_spin_limit) {
+        _mm_pause();
+      } else {
+        sched_yield();
+      }
+    }
+
+    // Same change bit sequence as in get_write_ptr(): starts from 1 and
+    // flips on every lap
+    change_bit = 1 ^ ((ticket >> l_depth_) & 1);
+
+    return tx_q_ + slot * bucket_size_;
+  }
+
+  /// Release the slot reserved with @param ticket to the producer of the next
+  /// lap.
+  inline void release_write_ptr(uint64_t ticket)
+      __attribute__((always_inline)) {
+    mp_->seq[ticket & (depth_ - 1)].store(ticket + depth_,
+                                          std::memory_order_release);
+  }
+
  private:
+  // Number of busy-wait iterations before a producer waiting for a slot
+  // starts yielding the cpu.
+  static constexpr size_t mp_spin_limit = 1024;
+
+  // Number of requests the nic fetches with one DMA notification.
+  static constexpr size_t dma_batch_size =
+      cfg::nic::tx_batch_size == 0 ? 1 : cfg::nic::tx_batch_size;
+
+  // State of the multi-producer interface.
+  struct MpState {
+    // Next ticket to hand out.
+    std::atomic<uint64_t> head;
+    char padding[64 - sizeof(std::atomic<uint64_t>)];
+    // Per-slot sequence numbers, the producer with ticket t owns the slot
+    // t % depth once seq[slot] == t.
+    std::unique_ptr<std::atomic<uint64_t>[]> seq;
+  };
+
   // Underlying nic buffer.
   char* tx_flow_buff_;
 
@@ -75,6 +177,18 @@ class alignas(4096) TxQueue {
   uint8_t* change_bit_set_;
   // uint8_t* free_bit_;
 
+  // Allocated in init().
+  MpState* mp_;
+
+  // Transport of the queue.
+  TxMode tx_mode_;
+  const Nic* nic_;
+  size_t nic_flow_id_;
+
+  // DMA transport: head of the current batch and number of requests in it.
+  size_t dma_batch_ptr_;
+  size_t dma_batch_cnt_;
+
   // Completion queue.
   char* cq_;
 };
@@ -20,6 +20,10 @@
 #include <ctime>
 #include <string>
 
+#ifdef FRPC_LOG_ASYNC
+#include "async_logger.h"
+#endif
+
 namespace dagger {
 
 // Log levels: higher means more verbose
@@ -38,38 +42,43 @@ namespace dagger {
 
 static void output_log_header(int level);
 
-#if FRPC_LOG_LEVEL >= FRPC_LOG_LEVEL_ERROR
-#define FRPC_ERROR(...)                                             \
-  output_log_header(FRPC_LOG_DEFAULT_STREAM, FRPC_LOG_LEVEL_ERROR); \
-  fprintf(FRPC_LOG_DEFAULT_STREAM, __VA_ARGS__);                    \
+// With FRPC_LOG_ASYNC, the messages are recorded in binary and formatted by
+// a background thread (see async_logger.h), so logging on the critical path
+// does not wait on I/O; the format is still checked at compile time
+#ifdef FRPC_LOG_ASYNC
+#define FRPC_LOG_RECORD(level, ...)                                     \
+  do {                                                                  \
+    if (false) fprintf(FRPC_LOG_DEFAULT_STREAM, __VA_ARGS__);           \
+    static ::dagger::LogSite frpc_log_site(level, __FILE__, __LINE__);  \
+    ::dagger::AsyncLogger::log(&frpc_log_site, __VA_ARGS__);            \
+  } while (0)
+#else
+#define FRPC_LOG_RECORD(level, ...)                   \
+  output_log_header(FRPC_LOG_DEFAULT_STREAM, level); \
+  fprintf(FRPC_LOG_DEFAULT_STREAM, __VA_ARGS__);     \
   fflush(FRPC_LOG_DEFAULT_STREAM)
+#endif
+
+#if FRPC_LOG_LEVEL >= FRPC_LOG_LEVEL_ERROR
+#define FRPC_ERROR(...) FRPC_LOG_RECORD(FRPC_LOG_LEVEL_ERROR, __VA_ARGS__)
 #else
 #define FRPC_ERROR(...) ((void)0)
 #endif
 
 #if FRPC_LOG_LEVEL >= FRPC_LOG_LEVEL_WARN
-#define FRPC_WARN(...)                                             \
-  output_log_header(FRPC_LOG_DEFAULT_STREAM, FRPC_LOG_LEVEL_WARN); \
-  fprintf(FRPC_LOG_DEFAULT_STREAM, __VA_ARGS__);                   \
-  fflush(FRPC_LOG_DEFAULT_STREAM)
+#define FRPC_WARN(...) FRPC_LOG_RECORD(FRPC_LOG_LEVEL_WARN, __VA_ARGS__)
 #else
 #define FRPC_WARN(...) ((void)0)
 #endif
 
 #if FRPC_LOG_LEVEL >= FRPC_LOG_LEVEL_INFO
-#define FRPC_INFO(...)                                             \
-  output_log_header(FRPC_LOG_DEFAULT_STREAM, FRPC_LOG_LEVEL_INFO); \
-  fprintf(FRPC_LOG_DEFAULT_STREAM, __VA_ARGS__);                   \
-  fflush(FRPC_LOG_DEFAULT_STREAM)
+#define FRPC_INFO(...) FRPC_LOG_RECORD(FRPC_LOG_LEVEL_INFO, __VA_ARGS__)
 #else
 #define FRPC_INFO(...) ((void)0)
 #endif
 
 #if FRPC_LOG_LEVEL >= FRPC_LOG_LEVEL_FLOW
-#define FRPC_FLOW(...)                                             \
-  output_log_header(FRPC_LOG_DEFAULT_STREAM, FRPC_LOG_LEVEL_FLOW); \
-  fprintf(FRPC_LOG_DEFAULT_STREAM, __VA_ARGS__);                   \
-  fflush(FRPC_LOG_DEFAULT_STREAM)
+#define FRPC_FLOW(...) FRPC_LOG_RECORD(FRPC_LOG_LEVEL_FLOW, __VA_ARGS__)
 #else
 #define FRPC_FLOW(...) ((void)0)
 #endif
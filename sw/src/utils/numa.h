@@ -0,0 +1,72 @@
+/**
+ * @file numa.h
+ * @brief NUMA topology of the host, as reported by sysfs.
+ * @author Nikita Lazarev
+ */
+#ifndef _NUMA_H_
+#define _NUMA_H_
+
+#include <stdio.h>
+
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace dagger {
+namespace utils {
+  // NUMA node of the PCIe device on the bus @param bus (domain 0, device 0,
+  // function 0), -1 if unknown
+  static int get_pci_bus_numa_node(int bus) {
+    char path[64];
+    snprintf(path, sizeof(path), "/sys/bus/pci/devices/0000:%02x:00.0/numa_node",
+             bus);
+
+    std::ifstream f(path);
+    int node = -1;
+    if (!(f >> node)) return -1;
+    return node;
+  }
+
+  // CPUs of the NUMA node @param node, empty if unknown
+  static std::vector<int> get_numa_node_cpus(int node) {
+    std::vector<int> cpus;
+    if (node < 0) return cpus;
+
+    std::ifstream f("/sys/devices/system/node/node" + std::to_string(node) +
+                    "/cpulist");
+    std::string list;
+    if (!std::getline(f, list)) return cpus;
+
+    // Format: 0-13,28-41
+    std::stringstream ss(list);
+    std::string range;
+    while (std::getline(ss, range, ',')) {
+      size_t dash = range.find('-');
+      int first = std::stoi(range.substr(0, dash));
+      int last = dash == std::string::npos ? first
+                                           : std::stoi(range.substr(dash + 1));
+      for (int cpu = first; cpu <= last; ++cpu) {
+        cpus.push_back(cpu);
+      }
+    }
+    return cpus;
+  }
+
+  // NUMA node of the CPU @param cpu, -1 if unknown
+  static int get_cpu_numa_node(int cpu) {
+    for (int node = 0;; ++node) {
+      std::ifstream f("/sys/devices/system/node/node" + std::to_string(node) +
+                      "/cpulist");
+      if (!f) return -1;
+
+      for (int c : get_numa_node_cpus(node)) {
+        if (c == cpu) return node;
+      }
+    }
+  }
+
+}  // namespace utils
+}  // namespace dagger
+
+#endif
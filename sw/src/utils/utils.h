@@ -6,6 +6,9 @@
 #ifndef _UTILS_H_
 #define _UTILS_H_
 
+#include <stddef.h>
+#include <stdint.h>
+
 namespace dagger {
 namespace utils {
   // Perf counter
@@ -15,6 +18,17 @@ namespace utils {
     return ((uint64_t)hi << 32) | lo;
   }
 
+  // Request steering hash for the hdr.affinity field (FNV-1a folded to 8 bits)
+  static inline uint8_t affinity_hash(const void* key, size_t len) {
+    const uint8_t* p = reinterpret_cast<const uint8_t*>(key);
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < len; ++i) {
+      h = (h ^ p[i]) * 16777619u;
+    }
+    h ^= h >> 16;
+    return static_cast<uint8_t>(h ^ (h >> 8));
+  }
+
 }  // namespace utils
 
 }  // namespace dagger
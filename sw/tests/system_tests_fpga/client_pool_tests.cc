@@ -1,5 +1,7 @@
 #include <gtest/gtest.h>
 
+#include <vector>
+
 #include "rpc_client.h"
 #include "rpc_client_pool.h"
 
@@ -80,4 +82,67 @@ TEST(ClientPoolTest, ClientPopTest_2) {
   ASSERT_EQ(res, 0);
 }
 
+TEST(ClientPoolTest, ClientReleaseTest) {
+  uint64_t max_pool_size = 2;
+
+  RpcClientPool<RpcClient> rpc_client_pool(nic_address, max_pool_size);
+
+  int res = rpc_client_pool.init_nic(fpga_bus);
+  ASSERT_EQ(res, 0);
+
+  res = rpc_client_pool.start_nic();
+  ASSERT_EQ(res, 0);
+
+  auto rpc_client_1 = rpc_client_pool.pop();
+  EXPECT_TRUE(rpc_client_1 != nullptr);
+  auto rpc_client_2 = rpc_client_pool.pop();
+  EXPECT_TRUE(rpc_client_2 != nullptr);
+  EXPECT_TRUE(rpc_client_pool.pop() == nullptr);
+
+  // Released clients are recycled
+  rpc_client_pool.release(rpc_client_1);
+  auto rpc_client = rpc_client_pool.pop();
+  EXPECT_EQ(rpc_client, rpc_client_1);
+  EXPECT_TRUE(rpc_client_pool.pop() == nullptr);
+
+  rpc_client_pool.release(rpc_client_1);
+  rpc_client_pool.release(rpc_client_2);
+  EXPECT_TRUE(rpc_client_pool.pop() != nullptr);
+  EXPECT_TRUE(rpc_client_pool.pop() != nullptr);
+  EXPECT_TRUE(rpc_client_pool.pop() == nullptr);
+
+  res = rpc_client_pool.stop_nic();
+  ASSERT_EQ(res, 0);
+}
+
+TEST(ClientPoolTest, LogicalClientPopTest) {
+  uint64_t max_pool_size = 8;
+  size_t num_of_flows = 2;
+
+  RpcClientPool<RpcClient> rpc_client_pool(nic_address, max_pool_size,
+                                           num_of_flows);
+
+  int res = rpc_client_pool.init_nic(fpga_bus);
+  ASSERT_EQ(res, 0);
+
+  res = rpc_client_pool.start_nic();
+  ASSERT_EQ(res, 0);
+
+  std::vector<RpcClient*> rpc_clients;
+  for (size_t i = 0; i < max_pool_size; ++i) {
+    auto rpc_client = rpc_client_pool.pop();
+    ASSERT_TRUE(rpc_client != nullptr);
+
+    // Logical clients have their own completion queues
+    for (auto c : rpc_clients) {
+      EXPECT_NE(c->get_completion_queue(), rpc_client->get_completion_queue());
+    }
+    rpc_clients.push_back(rpc_client);
+  }
+  EXPECT_TRUE(rpc_client_pool.pop() == nullptr);
+
+  res = rpc_client_pool.stop_nic();
+  ASSERT_EQ(res, 0);
+}
+
 }  // namespace dagger
@@ -2,6 +2,7 @@
 
 #include <vector>
 
+#include "rpc_multi_nic_server.h"
 #include "rpc_server_callback.h"
 #include "rpc_threaded_server.h"
 
@@ -185,4 +186,198 @@ TEST(ThreadedServerTest, ListenMultipleThreadsStartStopTest) {
   EXPECT_EQ(res, 0);
 }
 
+TEST(ThreadedServerTest, MoveFlowsTest) {
+  uint64_t max_number_of_threads = 4;
+
+  RpcThreadedServer rpc_server(nic_address, max_number_of_threads);
+
+  int res = rpc_server.init_nic(fpga_bus);
+  ASSERT_EQ(res, 0);
+
+  res = rpc_server.start_nic();
+  ASSERT_EQ(res, 0);
+
+  std::vector<const void*> fn_ptr;
+  fn_ptr.push_back(reinterpret_cast<const void*>(&loopback1));
+  dagger::RpcServerCallBack server_callback(fn_ptr);
+
+  for (int i = 0; i < 4; ++i) {
+    res = rpc_server.run_new_listening_thread(&server_callback);
+    EXPECT_EQ(res, 0);
+    EXPECT_EQ(rpc_server.get_flow_thread(i), i);
+  }
+
+  // Consolidate all flows on thread 0 while listening
+  for (int i = 1; i < 4; ++i) {
+    res = rpc_server.move_flow(i, 0);
+    EXPECT_EQ(res, 0);
+    EXPECT_EQ(rpc_server.get_flow_thread(i), 0);
+  }
+
+  res = rpc_server.move_flow(4, 0);
+  EXPECT_EQ(res, 1);
+
+  // Scale out again to two threads
+  res = rpc_server.rebalance_flows(2);
+  EXPECT_EQ(res, 0);
+  size_t on_thread_0 = 0;
+  for (int i = 0; i < 4; ++i) {
+    EXPECT_LT(rpc_server.get_flow_thread(i), 2);
+    if (rpc_server.get_flow_thread(i) == 0) ++on_thread_0;
+  }
+  EXPECT_EQ(on_thread_0, 2);
+
+  // No load, so a single thread is enough
+  res = rpc_server.rebalance_flows();
+  EXPECT_EQ(res, 0);
+  for (int i = 0; i < 4; ++i) {
+    EXPECT_EQ(rpc_server.get_flow_thread(i), 0);
+  }
+
+  res = rpc_server.stop_all_listening_threads();
+  EXPECT_EQ(res, 0);
+
+  res = rpc_server.stop_nic();
+  ASSERT_EQ(res, 0);
+
+  res = rpc_server.check_hw_errors();
+  EXPECT_EQ(res, 0);
+}
+
+static size_t scale_down_events = 0;
+
+static void on_scaling(const RpcThreadedServer::ScalingEvent& event) {
+  if (event.type == RpcThreadedServer::ScalingEvent::scale_down) {
+    ++scale_down_events;
+  }
+}
+
+TEST(ThreadedServerTest, ElasticScalingTest) {
+  uint64_t max_number_of_threads = 4;
+
+  RpcThreadedServer rpc_server(nic_address, max_number_of_threads);
+
+  int res = rpc_server.init_nic(fpga_bus);
+  ASSERT_EQ(res, 0);
+
+  res = rpc_server.start_nic();
+  ASSERT_EQ(res, 0);
+
+  std::vector<const void*> fn_ptr;
+  fn_ptr.push_back(reinterpret_cast<const void*>(&loopback1));
+  dagger::RpcServerCallBack server_callback(fn_ptr);
+
+  res = rpc_server.run_new_listening_thread(&server_callback);
+  EXPECT_EQ(res, 0);
+
+  // The first thread can not be stopped
+  res = rpc_server.stop_listening_thread();
+  EXPECT_EQ(res, 1);
+
+  // Autoscaling and stopping threads need dynamic steering
+  res = rpc_server.run_autoscaler(&server_callback, 1);
+  EXPECT_EQ(res, 1);
+
+  res = rpc_server.run_new_listening_thread(&server_callback);
+  EXPECT_EQ(res, 0);
+  res = rpc_server.stop_listening_thread();
+  EXPECT_EQ(res, 1);
+  EXPECT_EQ(rpc_server.get_number_of_threads(), 2);
+  rpc_server.set_lb(lb_round_robin);
+
+  for (int i = 2; i < 4; ++i) {
+    res = rpc_server.run_new_listening_thread(&server_callback);
+    EXPECT_EQ(res, 0);
+  }
+
+  // Stop and restart the last thread, the flow is parked in between
+  res = rpc_server.stop_listening_thread();
+  EXPECT_EQ(res, 0);
+  EXPECT_EQ(rpc_server.get_number_of_threads(), 3);
+
+  res = rpc_server.run_new_listening_thread(&server_callback);
+  EXPECT_EQ(res, 0);
+  EXPECT_EQ(rpc_server.get_flow_thread(3), 3);
+
+  // No load, so the autoscaler goes down to the minimum
+  scale_down_events = 0;
+  res = rpc_server.run_autoscaler(&server_callback, 2, &on_scaling);
+  EXPECT_EQ(res, 0);
+
+  sleep(2);
+  EXPECT_EQ(rpc_server.get_number_of_threads(), 2);
+  EXPECT_EQ(scale_down_events, 2);
+
+  res = rpc_server.stop_autoscaler();
+  EXPECT_EQ(res, 0);
+
+  res = rpc_server.stop_all_listening_threads();
+  EXPECT_EQ(res, 0);
+
+  res = rpc_server.stop_nic();
+  ASSERT_EQ(res, 0);
+
+  res = rpc_server.check_hw_errors();
+  EXPECT_EQ(res, 0);
+}
+
+TEST(ThreadedServerTest, MultiNicTest) {
+  uint64_t max_number_of_threads = 2;
+
+  RpcMultiNicServer rpc_server(nic_address, max_number_of_threads);
+
+  // Both FPGAs are only available to the server with physical networking,
+  // otherwise a single nic is striped over
+#if defined(PLATFORM_PAC_A10) && defined(NIC_PHY_NETWORK)
+  std::vector<int> buses = {cfg::platform::pac_a10_fpga_bus_1,
+                            cfg::platform::pac_a10_fpga_bus_2};
+#else
+  std::vector<int> buses = {fpga_bus};
+#endif
+  for (size_t i = 0; i < buses.size(); ++i) {
+    PhyAddr phy_addr = {0x1A, 0x2B, 0x3C, 0x4D, 0x5E,
+                        static_cast<uint8_t>(0xFF - i)};
+    IPv4 ipv4_addr("192.168.0." + std::to_string(2 + i), 0);
+
+    int res = rpc_server.add_nic(buses[i], phy_addr, ipv4_addr);
+    ASSERT_EQ(res, 0);
+  }
+  ASSERT_EQ(rpc_server.get_number_of_nics(), buses.size());
+
+  int res = rpc_server.start_nics();
+  ASSERT_EQ(res, 0);
+
+  std::vector<const void*> fn_ptr;
+  fn_ptr.push_back(reinterpret_cast<const void*>(&loopback1));
+  dagger::RpcServerCallBack server_callback(fn_ptr);
+
+  // Threads are spread evenly across the nics
+  for (size_t i = 0; i < max_number_of_threads * buses.size(); ++i) {
+    int nic = rpc_server.run_new_listening_thread(&server_callback);
+    EXPECT_EQ(nic, static_cast<int>(i % buses.size()));
+  }
+  EXPECT_EQ(rpc_server.get_number_of_threads(),
+            max_number_of_threads * buses.size());
+  for (size_t i = 0; i < buses.size(); ++i) {
+    EXPECT_EQ(rpc_server.get_nic_server(i)->get_number_of_threads(),
+              max_number_of_threads);
+  }
+
+  // No more threads than flows
+  EXPECT_EQ(rpc_server.run_new_listening_thread(&server_callback), -1);
+
+  Nic::PerfCounters counters;
+  res = rpc_server.perf_counters(counters);
+  EXPECT_EQ(res, 0);
+
+  res = rpc_server.stop_all_listening_threads();
+  EXPECT_EQ(res, 0);
+
+  res = rpc_server.stop_nics();
+  ASSERT_EQ(res, 0);
+
+  res = rpc_server.check_hw_errors();
+  EXPECT_EQ(res, 0);
+}
+
 }  // namespace dagger
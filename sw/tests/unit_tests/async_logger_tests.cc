@@ -0,0 +1,75 @@
+#include <gtest/gtest.h>
+
+#include <stdio.h>
+
+#include <string>
+#include <thread>
+
+#include "async_logger.h"
+#include "logger.h"
+
+namespace dagger {
+
+// Log output of the backend.
+static std::string read_log(FILE* stream) {
+  AsyncLogger::flush();
+
+  std::string log;
+  char buf[256];
+  rewind(stream);
+  while (fgets(buf, sizeof(buf), stream) != nullptr) {
+    log += buf;
+  }
+  return log;
+}
+
+TEST(AsyncLoggerTest, TestFormat) {
+  FILE* stream = tmpfile();
+  ASSERT_NE(stream, nullptr);
+  AsyncLogger::set_stream(stream);
+
+  static LogSite site(FRPC_LOG_LEVEL_ERROR, __FILE__, __LINE__);
+  char str[] = "abc";
+  std::string long_str(200, 'x');
+
+  // Arguments are formatted after the logging thread has changed them
+  AsyncLogger::log(&site, "int= %d, str= %s, double= %.2f\n", 42, str, 1.5);
+  str[0] = 'z';
+  std::thread t([&]() {
+    AsyncLogger::log(&site, "long= %s, int= %d\n", long_str.c_str(), 7);
+  });
+  t.join();
+
+  std::string log = read_log(stream);
+  EXPECT_NE(log.find("ERROR: int= 42, str= abc, double= 1.50\n"),
+            std::string::npos);
+  EXPECT_NE(log.find("ERROR: long= xxxxxxxx"), std::string::npos);
+  EXPECT_NE(log.find("x, int= 7\n"), std::string::npos);
+
+  AsyncLogger::set_stream(stdout);
+  fclose(stream);
+}
+
+TEST(AsyncLoggerTest, TestRateLimit) {
+  FILE* stream = tmpfile();
+  ASSERT_NE(stream, nullptr);
+  AsyncLogger::set_stream(stream);
+
+  static LogSite site(FRPC_LOG_LEVEL_WARN, __FILE__, __LINE__);
+  const size_t num_of_records = cfg::sys::log_site_max_records + 50;
+  for (size_t i = 0; i < num_of_records; ++i) {
+    AsyncLogger::log(&site, "record %zu\n", i);
+  }
+
+  std::string log = read_log(stream);
+  EXPECT_NE(log.find("record 0\n"), std::string::npos);
+  EXPECT_EQ(log.find("record " +
+                     std::to_string(cfg::sys::log_site_max_records) + "\n"),
+            std::string::npos);
+  EXPECT_NE(log.find("WARNG: 50 messages suppressed"), std::string::npos);
+
+  AsyncLogger::set_stream(stdout);
+  fclose(stream);
+}
+
+}  // namespace dagger
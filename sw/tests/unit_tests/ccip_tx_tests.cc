@@ -0,0 +1,123 @@
+#include <gtest/gtest.h>
+
+#include <cstring>
+
+#include "ccip_tx.h"
+#include "rpc_header.h"
+#include "tx_queue.h"
+
+namespace dagger {
+
+static constexpr size_t tx_l_depth = 2;
+
+static RpcHeader make_request_hdr(uint32_t rpc_id) {
+  RpcHeader hdr = RpcHeader();
+  hdr.c_id = 3;
+  hdr.rpc_id = rpc_id;
+  hdr.n_of_frames = 1;
+  hdr.frame_id = 0;
+  hdr.fn_id = 5;
+  hdr.argl = sizeof(uint64_t);
+  hdr.affinity = 7;
+  hdr.ctl.req_type = rpc_request;
+  return hdr;
+}
+
+static void expect_request(const RpcPckt& pckt, uint32_t rpc_id,
+                           uint64_t arg) {
+  EXPECT_EQ(pckt.hdr.ctl.valid, 1);
+  EXPECT_EQ(pckt.hdr.ctl.req_type, rpc_request);
+  EXPECT_EQ(pckt.hdr.c_id, 3);
+  EXPECT_EQ(pckt.hdr.rpc_id, rpc_id);
+  EXPECT_EQ(pckt.hdr.n_of_frames, 1);
+  EXPECT_EQ(pckt.hdr.fn_id, 5);
+  EXPECT_EQ(pckt.hdr.argl, sizeof(uint64_t));
+  EXPECT_EQ(pckt.hdr.affinity, 7);
+
+  uint64_t value;
+  memcpy(&value, pckt.argv, sizeof(uint64_t));
+  EXPECT_EQ(value, arg);
+}
+
+TEST(CcipTxTest, TestPollingTx) {
+  alignas(4096) static char tx_buff[sizeof(RpcPckt) << tx_l_depth];
+  memset(tx_buff, 0, sizeof(tx_buff));
+  TxQueue tx_queue(tx_buff, sizeof(RpcPckt), tx_l_depth);
+  tx_queue.init();
+
+  // Two laps over the queue, the update flag flips on every lap
+  const RpcPckt* slots = reinterpret_cast<const RpcPckt*>(tx_buff);
+  for (uint32_t i = 0; i < 2 * (1 << tx_l_depth); ++i) {
+    uint8_t change_bit;
+    char* tx_ptr = tx_queue.get_write_ptr(change_bit);
+    uint64_t arg = 100 + i;
+    PollingTx::send(tx_queue, tx_ptr, change_bit, make_request_hdr(i),
+                    [&](uint8_t* argv) { memcpy(argv, &arg, sizeof(arg)); });
+
+    const RpcPckt& pckt = slots[i % (1 << tx_l_depth)];
+    expect_request(pckt, i, arg);
+    EXPECT_EQ(pckt.hdr.ctl.update_flag, change_bit);
+    EXPECT_EQ(change_bit, i < (1 << tx_l_depth) ? 1 : 0);
+  }
+}
+
+TEST(CcipTxTest, TestMmioTx) {
+  // MMIO nics have a single tx entry per flow
+  EXPECT_EQ(TxQueue::get_l_depth(tx_mmio), 0u);
+  EXPECT_EQ(TxQueue::get_l_depth(tx_polling), cfg::nic::l_tx_queue_size);
+
+  alignas(4096) static char tx_buff[sizeof(RpcPckt)];
+  memset(tx_buff, 0, sizeof(tx_buff));
+  TxQueue tx_queue(tx_buff, sizeof(RpcPckt), TxQueue::get_l_depth(tx_mmio));
+  tx_queue.init();
+  tx_queue.bind_transport(tx_mmio, nullptr, 0);
+
+  // All the requests go to the same entry
+  for (uint32_t i = 0; i < 4; ++i) {
+    uint8_t change_bit;
+    char* tx_ptr = tx_queue.get_write_ptr(change_bit);
+    EXPECT_EQ(tx_ptr, tx_buff);
+
+    uint64_t arg = 200 + i;
+    MmioTx::send(tx_queue, tx_ptr, change_bit, make_request_hdr(i),
+                 [&](uint8_t* argv) { memcpy(argv, &arg, sizeof(arg)); });
+    expect_request(*reinterpret_cast<const RpcPckt*>(tx_buff), i, arg);
+  }
+}
+
+TEST(CcipTxTest, TestDispatchByMode) {
+  alignas(4096) static char polling_buff[sizeof(RpcPckt) << tx_l_depth];
+  memset(polling_buff, 0, sizeof(polling_buff));
+  TxQueue polling_queue(polling_buff, sizeof(RpcPckt), tx_l_depth);
+  polling_queue.init();
+  EXPECT_EQ(polling_queue.get_tx_mode(), tx_polling);
+
+  alignas(4096) static char mmio_buff[sizeof(RpcPckt)];
+  memset(mmio_buff, 0, sizeof(mmio_buff));
+  TxQueue mmio_queue(mmio_buff, sizeof(RpcPckt), 0);
+  mmio_queue.init();
+  mmio_queue.bind_transport(tx_mmio, nullptr, 0);
+  EXPECT_EQ(mmio_queue.get_tx_mode(), tx_mmio);
+
+  uint64_t arg = 42;
+  auto write_argv = [&](uint8_t* argv) { memcpy(argv, &arg, sizeof(arg)); };
+
+  uint8_t change_bit;
+  char* tx_ptr = polling_queue.get_write_ptr(change_bit);
+  ccip_send_by_mode(polling_queue, tx_ptr, change_bit, make_request_hdr(1),
+                    write_argv);
+  const RpcPckt* polling_pckt = reinterpret_cast<const RpcPckt*>(polling_buff);
+  expect_request(*polling_pckt, 1, arg);
+  EXPECT_EQ(polling_pckt->hdr.ctl.update_flag, 1);
+
+  // The MMIO frame is written as a whole with the header as it is, the
+  // update flag is only used by the polling nics
+  tx_ptr = mmio_queue.get_write_ptr(change_bit);
+  ccip_send_by_mode(mmio_queue, tx_ptr, change_bit, make_request_hdr(2),
+                    write_argv);
+  const RpcPckt* mmio_pckt = reinterpret_cast<const RpcPckt*>(mmio_buff);
+  expect_request(*mmio_pckt, 2, arg);
+  EXPECT_EQ(mmio_pckt->hdr.ctl.update_flag, 0);
+}
+
+}  // namespace dagger
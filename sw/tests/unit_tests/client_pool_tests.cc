@@ -0,0 +1,54 @@
+#include <gtest/gtest.h>
+
+#include <sched.h>
+
+#include <thread>
+#include <vector>
+
+#include "rpc_client_pool.h"
+
+namespace dagger {
+
+// Client which only exists in the pool's lists: the pool below is full, so
+// it never creates one.
+struct PooledClient {
+  PooledClient(const Nic*, size_t, size_t) {}
+  PooledClient(PooledClient*, uint16_t) {}
+  int set_multi_producer(bool) { return 0; }
+};
+
+// Move the calling thread to @param cpu.
+static bool pin_to_cpu(int cpu) {
+  cpu_set_t cpuset;
+  CPU_ZERO(&cpuset);
+  CPU_SET(cpu, &cpuset);
+  return sched_setaffinity(0, sizeof(cpuset), &cpuset) == 0 &&
+         sched_getcpu() == cpu;
+}
+
+TEST(ClientPoolTest, TestReleaseOnOtherCore) {
+  cpu_set_t allowed;
+  ASSERT_EQ(sched_getaffinity(0, sizeof(allowed), &allowed), 0);
+  std::vector<int> cpus;
+  for (int cpu = 0; cpu < CPU_SETSIZE && cpus.size() < 2; ++cpu) {
+    if (CPU_ISSET(cpu, &allowed)) cpus.push_back(cpu);
+  }
+  if (cpus.size() < 2 || std::thread::hardware_concurrency() < 2) {
+    GTEST_SKIP() << "needs two cores";
+  }
+
+  // No new clients can be created, so the pop()s only find released ones
+  RpcClientPool<PooledClient> pool(0, 0);
+  PooledClient client(nullptr, 0, 0);
+
+  ASSERT_TRUE(pin_to_cpu(cpus[0]));
+  pool.release(&client);
+
+  ASSERT_TRUE(pin_to_cpu(cpus[1]));
+  EXPECT_EQ(pool.pop(), &client);
+  EXPECT_TRUE(pool.pop() == nullptr);
+
+  sched_setaffinity(0, sizeof(allowed), &allowed);
+}
+
+}  // namespace dagger
@@ -0,0 +1,222 @@
+#include <gtest/gtest.h>
+
+#include <string.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "completion_queue.h"
+#include "config.h"
+#include "rpc_header.h"
+#include "rpc_stream.h"
+
+namespace dagger {
+
+static constexpr size_t rx_depth = 1 << cfg::nic::l_rx_queue_size;
+static constexpr uint16_t client_id = 1;
+
+static uint32_t make_rpc_id(uint16_t cnt) {
+  return client_id | static_cast<uint32_t>(cnt << 16);
+}
+
+// Write the response to @param rpc_id into the rx queue the way the nic does.
+class NicRxWriter {
+ public:
+  explicit NicRxWriter(RpcPckt* slots) : slots_(slots), seq_(0) {}
+
+  void write(uint32_t rpc_id, uint64_t ret, uint8_t frame_id = 0,
+             bool end_of_stream = false) {
+    RpcPckt* pckt = &slots_[seq_ % rx_depth];
+    pckt->hdr.rpc_id = rpc_id;
+    pckt->hdr.n_of_frames = 1;
+    pckt->hdr.frame_id = frame_id;
+    pckt->hdr.argl = end_of_stream ? 0 : sizeof(ret);
+    pckt->hdr.ctl.req_type = rpc_response;
+    pckt->hdr.ctl.end_of_stream = end_of_stream;
+    memcpy(pckt->argv, &ret, sizeof(ret));
+    std::atomic_thread_fence(std::memory_order_release);
+    pckt->hdr.ctl.phase = ((seq_ / rx_depth) & 1) ^ 1;
+    pckt->hdr.ctl.valid = 1;
+    ++seq_;
+  }
+
+ private:
+  RpcPckt* slots_;
+  size_t seq_;
+};
+
+static uint64_t ret_of(const RpcPckt& pckt) {
+  uint64_t ret;
+  memcpy(&ret, pckt.argv, sizeof(ret));
+  return ret;
+}
+
+TEST(CompletionQueueTest, TestSyncResponse) {
+  alignas(64) static RpcPckt slots[rx_depth];
+  memset(slots, 0, sizeof(slots));
+  CompletionQueue cq(client_id, reinterpret_cast<volatile char*>(slots),
+                     sizeof(RpcPckt));
+  NicRxWriter nic(slots);
+
+  // The response to the non-blocking request arrives first
+  cq.track_request(make_rpc_id(0), 0);
+  cq.track_sync_request(make_rpc_id(1));
+  nic.write(make_rpc_id(0), 100);
+  nic.write(make_rpc_id(1), 101);
+
+  RpcPckt response;
+  ASSERT_EQ(cq.wait_response(make_rpc_id(1), 0, response), 0);
+  EXPECT_EQ(response.hdr.rpc_id, make_rpc_id(1));
+  EXPECT_EQ(ret_of(response), 101u);
+
+  // and is delivered to the completion queue on the way
+  ASSERT_EQ(cq.get_number_of_completed_requests(), 1u);
+  RpcPckt completion = cq.pop_response();
+  EXPECT_EQ(completion.hdr.rpc_id, make_rpc_id(0));
+  EXPECT_EQ(ret_of(completion), 100u);
+  EXPECT_EQ(cq.get_number_of_outstanding_requests(), 0u);
+}
+
+TEST(CompletionQueueTest, TestSyncTimeout) {
+  alignas(64) static RpcPckt slots[rx_depth];
+  memset(slots, 0, sizeof(slots));
+  CompletionQueue cq(client_id, reinterpret_cast<volatile char*>(slots),
+                     sizeof(RpcPckt));
+  NicRxWriter nic(slots);
+
+  RpcPckt response;
+  cq.track_sync_request(make_rpc_id(0));
+  EXPECT_EQ(cq.wait_response(make_rpc_id(0), 10000, response), 1);
+  EXPECT_EQ(cq.get_number_of_timeouts(), 1u);
+  EXPECT_EQ(cq.get_number_of_outstanding_requests(), 0u);
+
+  // The response of the timed out request is dropped when it shows up
+  cq.track_sync_request(make_rpc_id(1));
+  nic.write(make_rpc_id(0), 100);
+  nic.write(make_rpc_id(1), 101);
+  ASSERT_EQ(cq.wait_response(make_rpc_id(1), 0, response), 0);
+  EXPECT_EQ(ret_of(response), 101u);
+  EXPECT_EQ(cq.get_number_of_late_responses(), 1u);
+  EXPECT_EQ(cq.get_number_of_completed_requests(), 0u);
+}
+
+TEST(CompletionQueueTest, TestSyncWithCompletionThread) {
+  alignas(64) static RpcPckt slots[rx_depth];
+  memset(slots, 0, sizeof(slots));
+  CompletionQueue cq(client_id, reinterpret_cast<volatile char*>(slots),
+                     sizeof(RpcPckt));
+  NicRxWriter nic(slots);
+  cq.bind();
+
+  // Whoever gets to the rx queue first, the sync response goes to the
+  // waiting thread and the other one to the completion queue
+  RpcPckt response;
+  for (uint16_t i = 0; i < 4 * rx_depth; i += 2) {
+    cq.track_request(make_rpc_id(i), 0);
+    cq.track_sync_request(make_rpc_id(i + 1));
+    nic.write(make_rpc_id(i + 1), i + 1);
+    nic.write(make_rpc_id(i), i);
+
+    ASSERT_EQ(cq.wait_response(make_rpc_id(i + 1), 0, response), 0);
+    EXPECT_EQ(ret_of(response), i + 1u);
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  while (cq.get_number_of_outstanding_requests() != 0 &&
+         std::chrono::steady_clock::now() - start < std::chrono::seconds(1)) {
+    std::this_thread::yield();
+  }
+  cq.unbind();
+
+  std::vector<RpcPckt> completions;
+  ASSERT_EQ(cq.pop_responses(completions), 2 * rx_depth);
+  for (size_t i = 0; i < completions.size(); ++i) {
+    EXPECT_EQ(completions[i].hdr.rpc_id, make_rpc_id(2 * i));
+    EXPECT_EQ(ret_of(completions[i]), 2 * i);
+  }
+  EXPECT_EQ(cq.get_number_of_late_responses(), 0u);
+}
+
+TEST(CompletionQueueTest, TestExpiryWithSyncWaiter) {
+  alignas(64) static RpcPckt slots[rx_depth];
+  memset(slots, 0, sizeof(slots));
+  CompletionQueue cq(client_id, reinterpret_cast<volatile char*>(slots),
+                     sizeof(RpcPckt));
+  NicRxWriter nic(slots);
+  cq.bind();
+
+  // The non-blocking request expires while a thread waits for its
+  // synchronous one
+  cq.track_request(make_rpc_id(0), 10000);
+  cq.track_sync_request(make_rpc_id(1));
+
+  std::atomic<bool> waiting(true);
+  std::thread waiter([&]() {
+    RpcPckt response;
+    EXPECT_EQ(cq.wait_response(make_rpc_id(1), 0, response), 0);
+    waiting = false;
+  });
+
+  auto start = std::chrono::steady_clock::now();
+  while (cq.get_number_of_timeouts() == 0 &&
+         std::chrono::steady_clock::now() - start < std::chrono::seconds(1)) {
+    std::this_thread::yield();
+  }
+  EXPECT_EQ(cq.get_number_of_timeouts(), 1u);
+  EXPECT_TRUE(waiting);
+
+  nic.write(make_rpc_id(1), 101);
+  waiter.join();
+  cq.unbind();
+
+  ASSERT_EQ(cq.get_number_of_completed_requests(), 1u);
+  RpcPckt completion = cq.pop_response();
+  EXPECT_EQ(completion.hdr.rpc_id, make_rpc_id(0));
+  EXPECT_EQ(completion.hdr.n_of_frames, 0);
+}
+
+TEST(CompletionQueueTest, TestStream) {
+  alignas(64) static RpcPckt slots[rx_depth];
+  memset(slots, 0, sizeof(slots));
+  CompletionQueue cq(client_id, reinterpret_cast<volatile char*>(slots),
+                     sizeof(RpcPckt));
+  NicRxWriter nic(slots);
+
+  std::vector<uint64_t> items;
+  RpcClientStream<uint64_t> stream(
+      [&](const uint64_t& item) { items.push_back(item); });
+
+  // The frames of the stream are mixed with other responses, and the item
+  // 2 is lost
+  cq.track_request(make_rpc_id(0), 0);
+  cq.track_stream_request(make_rpc_id(1), &stream);
+  nic.write(make_rpc_id(1), 100, 0);
+  nic.write(make_rpc_id(0), 7);
+  nic.write(make_rpc_id(1), 101, 1);
+  nic.write(make_rpc_id(1), 103, 3);
+  nic.write(make_rpc_id(1), 0, 4, true);
+
+  cq.bind();
+  auto start = std::chrono::steady_clock::now();
+  while (cq.get_number_of_outstanding_requests() != 0 &&
+         std::chrono::steady_clock::now() - start < std::chrono::seconds(1)) {
+    std::this_thread::yield();
+  }
+  cq.unbind();
+
+  // Only the end-of-stream frame retires the request
+  EXPECT_EQ(cq.get_number_of_outstanding_requests(), 0u);
+  EXPECT_EQ(cq.get_number_of_late_responses(), 0u);
+  ASSERT_EQ(cq.get_number_of_completed_requests(), 1u);
+  EXPECT_EQ(cq.pop_response().hdr.rpc_id, make_rpc_id(0));
+
+  EXPECT_EQ(stream.poll(), 3u);
+  EXPECT_EQ(items, std::vector<uint64_t>({100, 101, 103}));
+  EXPECT_TRUE(stream.is_done());
+  EXPECT_EQ(stream.get_number_of_items(), 3u);
+  EXPECT_EQ(stream.get_number_of_lost_items(), 1u);
+}
+
+}  // namespace dagger
@@ -0,0 +1,190 @@
+#include <gtest/gtest.h>
+
+// The coroutine layer is only built with WITH_COROUTINES
+#ifdef __cpp_impl_coroutine
+
+#include <cstring>
+
+#include "completion_queue.h"
+#include "rpc_coro.h"
+#include "rpc_server_callback.h"
+#include "tx_queue.h"
+
+namespace dagger {
+
+static Task<int> add_one(int v) { co_return v + 1; }
+
+static Task<void> add_chain(int& out) {
+  int v = co_await add_one(1);
+  v = co_await add_one(v);
+  out = v;
+}
+
+TEST(CoroTest, TestTaskChain) {
+  RpcScheduler scheduler;
+  int out = 0;
+
+  scheduler.spawn(add_chain(out));
+  EXPECT_EQ(out, 3);
+  EXPECT_EQ(scheduler.get_number_of_tasks(), 0);
+}
+
+TEST(CoroTest, TestFramePool) {
+  RpcScheduler scheduler;
+  int out = 0;
+
+  // Warm-up the pool
+  scheduler.spawn(add_chain(out));
+  size_t heap_allocations = FramePool::get_number_of_heap_allocations();
+
+  for (int i = 0; i < 100; ++i) {
+    scheduler.spawn(add_chain(out));
+  }
+  EXPECT_EQ(FramePool::get_number_of_heap_allocations(), heap_allocations);
+}
+
+struct TestResp {
+  int64_t value;
+};
+
+static Task<void> await_rpc(CompletionQueue* cq, uint32_t rpc_id,
+                            int64_t& value) {
+  cq->track_request(rpc_id, 0);
+  auto res = co_await RpcAwait<TestResp>(cq, rpc_ok, rpc_id);
+  value = res.ok() ? res.resp.value : -1;
+}
+
+static void write_response(volatile char* rx_slot, uint32_t rpc_id,
+                           int64_t value) {
+  RpcPckt* pckt = const_cast<RpcPckt*>(reinterpret_cast<volatile RpcPckt*>(rx_slot));
+  pckt->hdr.rpc_id = rpc_id;
+  pckt->hdr.n_of_frames = 1;
+  memcpy(pckt->argv, &value, sizeof(value));
+  __sync_synchronize();
+  pckt->hdr.ctl.phase = 1;
+  pckt->hdr.ctl.valid = 1;
+}
+
+TEST(CoroTest, TestResumeByRpcId) {
+  constexpr size_t rx_buff_size = sizeof(RpcPckt)
+                                  << cfg::nic::l_rx_queue_size;
+  alignas(4096) static char rx_buff[rx_buff_size];
+  memset(rx_buff, 0, rx_buff_size);
+
+  CompletionQueue cq(0, rx_buff, sizeof(RpcPckt));
+  cq.bind();
+
+  RpcScheduler scheduler;
+  int64_t value_1 = 0, value_2 = 0;
+  scheduler.spawn(await_rpc(&cq, 1 << 16, value_1));
+  scheduler.spawn(await_rpc(&cq, 2 << 16, value_2));
+  EXPECT_EQ(scheduler.get_number_of_waiters(), 2);
+
+  // Responses arrive out of order
+  write_response(rx_buff, 2 << 16, 20);
+  write_response(rx_buff + sizeof(RpcPckt), 1 << 16, 10);
+
+  for (int i = 0; i < 1000000 && scheduler.get_number_of_tasks() != 0; ++i) {
+    scheduler.poll();
+  }
+  EXPECT_EQ(scheduler.get_number_of_tasks(), 0);
+  EXPECT_EQ(value_1, 10);
+  EXPECT_EQ(value_2, 20);
+
+  cq.unbind();
+}
+
+// Downstream completion queue of the suspendable handler.
+static CompletionQueue* downstream_cq = nullptr;
+
+// Mid-tier handler: issues a downstream request with the rpc_id counter
+// given in the argument and returns its response plus the argument.
+static Task<RpcRetCode> nested1(CallHandler handler, Arg1 args, Ret1* ret) {
+  uint32_t rpc_id = static_cast<uint32_t>(args.a) << 16;
+  downstream_cq->track_request(rpc_id, 0);
+
+  auto res = co_await RpcAwait<TestResp>(downstream_cq, rpc_ok, rpc_id);
+  if (!res.ok()) co_return RpcRetCode::Fail;
+
+  ret->f_id = 5;
+  ret->ret_val = static_cast<uint64_t>(res.resp.value) + args.a;
+  co_return RpcRetCode::Success;
+}
+
+static void make_request(RpcPckt& pckt, uint16_t c_id, uint32_t rpc_id,
+                         uint64_t a) {
+  memset(&pckt, 0, sizeof(RpcPckt));
+  pckt.hdr.c_id = c_id;
+  pckt.hdr.rpc_id = rpc_id;
+  pckt.hdr.fn_id = 5;
+  pckt.hdr.n_of_frames = 1;
+  pckt.hdr.ctl.valid = 1;
+  Arg1 args{a};
+  memcpy(pckt.argv, &args, sizeof(Arg1));
+}
+
+TEST(CoroTest, TestSuspendableHandler) {
+  constexpr size_t rx_buff_size = sizeof(RpcPckt)
+                                  << cfg::nic::l_rx_queue_size;
+  alignas(4096) static char rx_buff[rx_buff_size];
+  memset(rx_buff, 0, rx_buff_size);
+
+  constexpr size_t tx_buff_size = sizeof(RpcPckt)
+                                  << cfg::nic::l_tx_queue_size;
+  alignas(4096) static char tx_buff[tx_buff_size];
+  memset(tx_buff, 0, tx_buff_size);
+
+  CompletionQueue cq(0, rx_buff, sizeof(RpcPckt));
+  cq.bind();
+  downstream_cq = &cq;
+
+  TxQueue tx_queue(tx_buff, sizeof(RpcPckt), cfg::nic::l_tx_queue_size);
+  tx_queue.init();
+
+  std::vector<const void*> fn_ptr(5, nullptr);
+  fn_ptr.push_back(reinterpret_cast<const void*>(&nested1));
+  RpcServerCallBack callback(fn_ptr);
+
+  RpcScheduler scheduler;
+
+  // Both handlers suspend on their downstream requests, nothing is sent yet
+  RpcPckt req;
+  make_request(req, 3, 0x10, 1);
+  callback({0}, &req, tx_queue);
+  make_request(req, 4, 0x20, 2);
+  callback({0}, &req, tx_queue);
+  EXPECT_EQ(scheduler.get_number_of_tasks(), 2);
+
+  const RpcPckt* tx_slots = reinterpret_cast<const RpcPckt*>(tx_buff);
+  EXPECT_EQ(tx_slots[0].hdr.ctl.valid, 0);
+
+  // Downstream responses arrive in the reverse order
+  write_response(rx_buff, 2 << 16, 200);
+  write_response(rx_buff + sizeof(RpcPckt), 1 << 16, 100);
+
+  for (int i = 0; i < 1000000 && scheduler.get_number_of_tasks() != 0; ++i) {
+    scheduler.poll();
+  }
+  EXPECT_EQ(scheduler.get_number_of_tasks(), 0);
+
+  // Responses are sent with the saved headers of their requests
+  Ret1 ret;
+  EXPECT_EQ(tx_slots[0].hdr.ctl.valid, 1);
+  EXPECT_EQ(tx_slots[0].hdr.ctl.req_type, rpc_response);
+  EXPECT_EQ(tx_slots[0].hdr.c_id, 4);
+  EXPECT_EQ(tx_slots[0].hdr.rpc_id, 0x20);
+  memcpy(&ret, tx_slots[0].argv, sizeof(Ret1));
+  EXPECT_EQ(ret.ret_val, 202);
+
+  EXPECT_EQ(tx_slots[1].hdr.ctl.valid, 1);
+  EXPECT_EQ(tx_slots[1].hdr.c_id, 3);
+  EXPECT_EQ(tx_slots[1].hdr.rpc_id, 0x10);
+  memcpy(&ret, tx_slots[1].argv, sizeof(Ret1));
+  EXPECT_EQ(ret.ret_val, 101);
+
+  cq.unbind();
+}
+
+}  // namespace dagger
+
+#endif
@@ -0,0 +1,80 @@
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include "idle_policy.h"
+
+namespace dagger {
+
+static const auto no_work = []() { return false; };
+
+// Idle until the policy reaches @param stage, at most for ~1 second.
+static bool idle_until(IdlePolicy& p, volatile const char* line,
+                       IdlePolicy::Stage stage,
+                       IdlePolicy::Stage max_stage = IdlePolicy::sSleep) {
+  auto start = std::chrono::steady_clock::now();
+  while (p.get_stage() != stage) {
+    p.idle(line, no_work, max_stage);
+    if (std::chrono::steady_clock::now() - start > std::chrono::seconds(1)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+TEST(IdlePolicyTest, TestStages) {
+  alignas(64) static char line[64];
+  IdlePolicy p(10000, 10000, 10000, 10);
+
+  EXPECT_EQ(p.get_stage(), IdlePolicy::sSpin);
+  EXPECT_TRUE(idle_until(p, line, IdlePolicy::sPause));
+  EXPECT_TRUE(idle_until(p, line, IdlePolicy::sSleep));
+  EXPECT_EQ(p.get_number_of_entries(IdlePolicy::sPause), 1);
+  EXPECT_EQ(p.get_number_of_entries(IdlePolicy::sSleep), 1);
+  EXPECT_EQ(p.get_number_of_entries(IdlePolicy::sUmwait),
+            IdlePolicy::is_umwait_supported() ? 1 : 0);
+
+  // Work resets the policy
+  p.reset();
+  EXPECT_EQ(p.get_stage(), IdlePolicy::sSpin);
+  EXPECT_TRUE(idle_until(p, line, IdlePolicy::sPause));
+  EXPECT_EQ(p.get_number_of_entries(IdlePolicy::sPause), 2);
+}
+
+TEST(IdlePolicyTest, TestMaxStage) {
+  alignas(64) static char line[64];
+  IdlePolicy p(0, 0, 0, 10);
+
+  EXPECT_TRUE(idle_until(p, line, IdlePolicy::sPause, IdlePolicy::sPause));
+  for (int i = 0; i < 10000; ++i) {
+    p.idle(line, no_work, IdlePolicy::sPause);
+  }
+  EXPECT_EQ(p.get_stage(), IdlePolicy::sPause);
+  EXPECT_EQ(p.get_number_of_entries(IdlePolicy::sSleep), 0);
+}
+
+TEST(IdlePolicyTest, TestNotify) {
+  alignas(64) static char line[64];
+
+  // Sleeps are long enough for the test to time out if notify() is lost
+  IdlePolicy p(0, 0, 0, 10000000);
+  std::atomic<bool> work(false);
+
+  std::thread t([&]() {
+    while (!work) {
+      p.idle(line, [&]() { return work.load(); });
+    }
+  });
+
+  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  auto start = std::chrono::steady_clock::now();
+  work = true;
+  p.notify();
+  t.join();
+
+  EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::seconds(1));
+}
+
+}  // namespace dagger
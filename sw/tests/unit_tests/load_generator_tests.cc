@@ -0,0 +1,106 @@
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <vector>
+
+#include "load_generator.h"
+
+namespace dagger {
+
+// 1 cycle per ns, so rates are in requests per 1e9 cycles
+static constexpr double cycles_in_ns = 1.0;
+static constexpr size_t num_of_samples = 200000;
+
+TEST(LoadGeneratorTest, TestPoissonRate) {
+  const double rps = 1000000;
+  LoadGenerator gen(rps, 1, 0, cycles_in_ns, 1000);
+
+  uint64_t prev = 1000;
+  double sum = 0, sum_sq = 0;
+  for (size_t i = 0; i < num_of_samples; ++i) {
+    uint64_t t = gen.next();
+    ASSERT_GE(t, prev);
+    double gap = t - prev;
+    sum += gap;
+    sum_sq += gap * gap;
+    prev = t;
+  }
+
+  // Exponential gaps: the standard deviation equals the mean of 1000 cycles
+  double mean = sum / num_of_samples;
+  double stddev = std::sqrt(sum_sq / num_of_samples - mean * mean);
+  EXPECT_NEAR(mean, 1000, 10);
+  EXPECT_NEAR(stddev, 1000, 20);
+}
+
+TEST(LoadGeneratorTest, TestAggregateRate) {
+  const double rps = 4000000;
+  const size_t num_of_threads = 4;
+  const uint64_t start_tsc = 1000;
+
+  std::vector<uint64_t> last;
+  std::vector<uint64_t> first;
+  for (size_t thread_id = 0; thread_id < num_of_threads; ++thread_id) {
+    LoadGenerator gen(rps, num_of_threads, thread_id, cycles_in_ns, start_tsc);
+    first.push_back(gen.next());
+
+    uint64_t t = 0;
+    for (size_t i = 1; i < num_of_samples; ++i) {
+      t = gen.next();
+    }
+    last.push_back(t);
+  }
+
+  // Every thread is at rps/num_of_threads from the common start, with its
+  // own arrivals
+  for (size_t thread_id = 0; thread_id < num_of_threads; ++thread_id) {
+    double span = last[thread_id] - start_tsc;
+    EXPECT_NEAR(num_of_samples / span * 1e9, rps / num_of_threads,
+                0.02 * rps / num_of_threads);
+  }
+  EXPECT_NE(first[0], first[1]);
+}
+
+TEST(LoadGeneratorTest, TestBurstyRate) {
+  const double rps = 1000000;
+  const BurstParams burst = {10, 100, 900};
+  const uint64_t start_tsc = 0;
+
+  LoadGenerator gen(rps, 2, 0, cycles_in_ns, start_tsc, burst);
+  LoadGenerator peer(rps, 2, 1, cycles_in_ns, start_tsc, burst);
+
+  // Count the arrivals of both threads per 10us bin
+  const uint64_t bin = 10000;
+  const size_t num_of_bins = 10000;
+  std::vector<size_t> bins(num_of_bins, 0);
+  std::vector<size_t> peer_bins(num_of_bins, 0);
+  for (uint64_t t = gen.next(); t < bin * num_of_bins; t = gen.next()) {
+    ++bins[t / bin];
+  }
+  for (uint64_t t = peer.next(); t < bin * num_of_bins; t = peer.next()) {
+    ++peer_bins[t / bin];
+  }
+
+  // The average rate stays the target one
+  size_t total = 0;
+  for (size_t i = 0; i < num_of_bins; ++i) {
+    total += bins[i] + peer_bins[i];
+  }
+  EXPECT_NEAR(static_cast<double>(total) / (bin * num_of_bins) * 1e9, rps,
+              0.05 * rps);
+
+  // The threads burst together: their counts are correlated, and busier
+  // bins are much busier than the average of 10 arrivals per bin
+  double mean = static_cast<double>(total) / num_of_bins / 2;
+  double cov = 0, var = 0;
+  size_t max_bin = 0;
+  for (size_t i = 0; i < num_of_bins; ++i) {
+    cov += (bins[i] - mean) * (peer_bins[i] - mean);
+    var += (bins[i] - mean) * (bins[i] - mean);
+    if (bins[i] > max_bin) max_bin = bins[i];
+  }
+  EXPECT_GT(cov / var, 0.5);
+  EXPECT_GT(max_bin, 3 * mean);
+}
+
+}  // namespace dagger
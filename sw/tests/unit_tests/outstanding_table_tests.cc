@@ -0,0 +1,180 @@
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <thread>
+
+#include "outstanding_table.h"
+
+namespace dagger {
+
+static uint32_t make_rpc_id(uint16_t cnt) {
+  return 1 | static_cast<uint32_t>(cnt << 16);
+}
+
+TEST(OutstandingTableTest, TestComplete) {
+  OutstandingTable ot;
+  uint64_t issue_tsc = 0;
+
+  ot.issue(make_rpc_id(0), 100, 0);
+  ot.issue(make_rpc_id(1), 200, 0);
+  EXPECT_EQ(ot.get_number_of_outstanding_requests(), 2);
+
+  EXPECT_TRUE(ot.complete(make_rpc_id(1), issue_tsc));
+  EXPECT_EQ(issue_tsc, 200);
+  EXPECT_TRUE(ot.complete(make_rpc_id(0), issue_tsc));
+  EXPECT_EQ(issue_tsc, 100);
+  EXPECT_EQ(ot.get_number_of_outstanding_requests(), 0);
+
+  // Duplicate and never issued responses
+  EXPECT_FALSE(ot.complete(make_rpc_id(0), issue_tsc));
+  EXPECT_FALSE(ot.complete(make_rpc_id(2), issue_tsc));
+}
+
+TEST(OutstandingTableTest, TestExpire) {
+  OutstandingTable ot;
+  std::vector<uint32_t> expired;
+  uint64_t issue_tsc;
+  const uint64_t tick = cfg::sys::deadline_tick_cycles;
+  const uint64_t t0 = 1000 * tick;
+
+  ot.expire(t0, expired);
+  EXPECT_TRUE(expired.empty());
+
+  ot.issue(make_rpc_id(0), t0, 10 * tick);
+  ot.issue(make_rpc_id(1), t0, 20 * tick);
+  ot.issue(make_rpc_id(2), t0, 0);
+
+  ot.expire(t0 + 5 * tick, expired);
+  EXPECT_TRUE(expired.empty());
+
+  ot.expire(t0 + 12 * tick, expired);
+  ASSERT_EQ(expired.size(), 1);
+  EXPECT_EQ(expired[0], make_rpc_id(0));
+  expired.clear();
+
+  // Late response of the expired request
+  EXPECT_FALSE(ot.complete(make_rpc_id(0), issue_tsc));
+
+  // Completed before the deadline
+  EXPECT_TRUE(ot.complete(make_rpc_id(1), issue_tsc));
+  ot.expire(t0 + 30 * tick, expired);
+  EXPECT_TRUE(expired.empty());
+
+  // No deadline
+  ot.expire(t0 + 10000 * tick, expired);
+  EXPECT_TRUE(expired.empty());
+  EXPECT_EQ(ot.get_number_of_outstanding_requests(), 1);
+}
+
+TEST(OutstandingTableTest, TestExpireBeyondWheel) {
+  OutstandingTable ot;
+  std::vector<uint32_t> expired;
+  const uint64_t tick = cfg::sys::deadline_tick_cycles;
+  const uint64_t wheel = cfg::sys::deadline_wheel_size;
+  const uint64_t t0 = 1000 * tick;
+
+  ot.expire(t0, expired);
+  ot.issue(make_rpc_id(0), t0, 3 * wheel * tick / 2);
+
+  for (uint64_t t = 1; t < 3 * wheel / 2; t += 7) {
+    ot.expire(t0 + t * tick, expired);
+  }
+  EXPECT_TRUE(expired.empty());
+
+  ot.expire(t0 + 2 * wheel * tick, expired);
+  ASSERT_EQ(expired.size(), 1);
+  EXPECT_EQ(expired[0], make_rpc_id(0));
+}
+
+TEST(OutstandingTableTest, TestEviction) {
+  OutstandingTable ot;
+  uint64_t issue_tsc;
+  const uint16_t table_size = 1 << cfg::sys::l_outstanding_table_size;
+
+  ot.issue(make_rpc_id(0), 0, 0);
+  ot.issue(make_rpc_id(table_size), 0, 0);
+  EXPECT_EQ(ot.get_number_of_evicted_requests(), 1);
+
+  EXPECT_FALSE(ot.complete(make_rpc_id(0), issue_tsc));
+  EXPECT_TRUE(ot.complete(make_rpc_id(table_size), issue_tsc));
+  EXPECT_EQ(ot.get_number_of_outstanding_requests(), 0);
+}
+
+TEST(OutstandingTableTest, TestSync) {
+  OutstandingTable ot;
+  std::vector<uint32_t> expired;
+  uint64_t issue_tsc;
+  const uint64_t tick = cfg::sys::deadline_tick_cycles;
+  const uint64_t t0 = 1000 * tick;
+
+  ot.expire(t0, expired);
+  ot.issue(make_rpc_id(0), t0, 10 * tick, false, OutstandingTable::rSync);
+  ot.issue(make_rpc_id(1), t0, 0);
+  EXPECT_EQ(ot.get_type(make_rpc_id(0)), OutstandingTable::rSync);
+  EXPECT_EQ(ot.get_type(make_rpc_id(1)), OutstandingTable::rAsync);
+
+  // Sync requests are never expired by the table
+  ot.expire(t0 + 100 * tick, expired);
+  EXPECT_TRUE(expired.empty());
+
+  EXPECT_TRUE(ot.complete(make_rpc_id(0), issue_tsc));
+  EXPECT_EQ(issue_tsc, t0);
+  EXPECT_NE(ot.get_type(make_rpc_id(0)), OutstandingTable::rSync);
+  EXPECT_EQ(ot.get_number_of_outstanding_requests(), 1);
+
+  // Sync requests are evicted like the others
+  ot.issue(make_rpc_id(2), t0, 0, false, OutstandingTable::rSync);
+  ot.issue(make_rpc_id(2 + (1 << cfg::sys::l_outstanding_table_size)), t0, 0);
+  EXPECT_EQ(ot.get_number_of_evicted_requests(), 1);
+  EXPECT_NE(ot.get_type(make_rpc_id(2)), OutstandingTable::rSync);
+}
+
+TEST(OutstandingTableTest, TestStream) {
+  OutstandingTable ot;
+  std::vector<uint32_t> expired;
+  uint64_t issue_tsc;
+  const uint64_t tick = cfg::sys::deadline_tick_cycles;
+  const uint64_t t0 = 1000 * tick;
+
+  ot.expire(t0, expired);
+  ot.issue(make_rpc_id(0), t0, 10 * tick, false, OutstandingTable::rStream);
+  EXPECT_EQ(ot.get_type(make_rpc_id(0)), OutstandingTable::rStream);
+
+  // Streams last until their end
+  ot.expire(t0 + 100 * tick, expired);
+  EXPECT_TRUE(expired.empty());
+
+  EXPECT_TRUE(ot.complete(make_rpc_id(0), issue_tsc));
+  EXPECT_EQ(ot.get_type(make_rpc_id(0)), OutstandingTable::rAsync);
+  EXPECT_EQ(ot.get_number_of_outstanding_requests(), 0);
+}
+
+TEST(OutstandingTableTest, TestConcurrentIssue) {
+  OutstandingTable ot;
+  std::vector<uint32_t> expired;
+  const uint64_t tick = cfg::sys::deadline_tick_cycles;
+  const size_t num_of_threads = 4;
+  const size_t num_of_requests = 256;
+  std::atomic<uint16_t> rpc_cnt(0);
+
+  ot.expire(0, expired);
+
+  std::vector<std::thread> threads;
+  for (size_t t = 0; t < num_of_threads; ++t) {
+    threads.push_back(std::thread([&]() {
+      for (size_t i = 0; i < num_of_requests; ++i) {
+        ot.issue(make_rpc_id(rpc_cnt++), 0, tick, true);
+      }
+    }));
+  }
+  for (auto& t : threads) t.join();
+
+  EXPECT_EQ(ot.get_number_of_outstanding_requests(),
+            num_of_threads * num_of_requests);
+
+  ot.expire(2 * tick, expired);
+  EXPECT_EQ(expired.size(), num_of_threads * num_of_requests);
+  EXPECT_EQ(ot.get_number_of_outstanding_requests(), 0);
+}
+
+}  // namespace dagger
@@ -0,0 +1,70 @@
+#include <gtest/gtest.h>
+
+#include <string.h>
+
+#include "rpc_header.h"
+#include "rx_queue.h"
+
+namespace dagger {
+
+static constexpr size_t l_depth = 2;
+static constexpr size_t depth = 1 << l_depth;
+
+// Write a packet the way the nic does: the nic-side lap counter of the slot
+// gives the phase.
+static void nic_write(RpcPckt* slots, size_t seq, uint32_t rpc_id) {
+  RpcPckt* pckt = &slots[seq % depth];
+  pckt->hdr.rpc_id = rpc_id;
+  pckt->hdr.ctl.phase = ((seq / depth) & 1) ^ 1;
+  pckt->hdr.ctl.valid = 1;
+}
+
+TEST(RxQueueTest, TestCtlBits) {
+  RpcPckt pckt;
+  memset(&pckt, 0, sizeof(RpcPckt));
+
+  pckt.hdr.ctl.valid = 1;
+  EXPECT_EQ(*reinterpret_cast<uint8_t*>(&pckt.hdr.ctl), rpc_ctl_valid_bit);
+  pckt.hdr.ctl.valid = 0;
+  pckt.hdr.ctl.phase = 1;
+  EXPECT_EQ(*reinterpret_cast<uint8_t*>(&pckt.hdr.ctl), rpc_ctl_phase_bit);
+
+  // Only valid packets are new
+  EXPECT_FALSE(rx_pckt_is_new(&pckt, 1));
+  pckt.hdr.ctl.valid = 1;
+  EXPECT_TRUE(rx_pckt_is_new(&pckt, 1));
+  EXPECT_FALSE(rx_pckt_is_new(&pckt, 0));
+
+  // Other control bits do not matter
+  pckt.hdr.ctl.req_type = rpc_response;
+  pckt.hdr.ctl.update_flag = 1;
+  EXPECT_TRUE(rx_pckt_is_new(&pckt, 1));
+}
+
+TEST(RxQueueTest, TestPhaseAcrossLaps) {
+  alignas(64) RpcPckt slots[depth];
+  memset(slots, 0, sizeof(slots));
+
+  RxQueue q(reinterpret_cast<volatile char*>(slots), sizeof(RpcPckt), l_depth);
+  q.init();
+
+  // The same rpc_id lands in the same slot on every lap, as after a wrap of
+  // the client's rpc_id counter
+  for (size_t seq = 0; seq < 4 * depth; ++seq) {
+    uint8_t phase;
+    volatile RpcPckt* pckt =
+        reinterpret_cast<volatile RpcPckt*>(q.get_read_ptr(phase));
+    EXPECT_EQ(pckt, &slots[seq % depth]);
+
+    // The packet of the previous lap (or the zeroed slot) is not new
+    EXPECT_FALSE(rx_pckt_is_new(pckt, phase));
+
+    nic_write(slots, seq, 42);
+    EXPECT_TRUE(rx_pckt_is_new(pckt, phase));
+    EXPECT_EQ(slots[seq % depth].hdr.rpc_id, 42);
+
+    q.pop();
+  }
+}
+
+}  // namespace dagger
@@ -0,0 +1,592 @@
+#include <gtest/gtest.h>
+
+#include <cstring>
+#include <deque>
+#include <vector>
+
+#include "rpc_server_callback.h"
+#include "rpc_service_mux.h"
+#include "rx_queue.h"
+#include "tx_queue.h"
+
+namespace dagger {
+
+// Rings of the flow the requests are dispatched on: the nic writes the
+// requests into the rx one, and the callbacks send the responses to the tx
+// one.
+class TestFlow {
+ public:
+  TestFlow(size_t l_rx_depth, size_t l_tx_depth)
+      : rx_slots_(static_cast<size_t>(1) << l_rx_depth),
+        tx_slots_(static_cast<size_t>(1) << l_tx_depth),
+        rx_written_(0),
+        rx_queue(reinterpret_cast<volatile char*>(rx_slots_.data()),
+                 sizeof(RpcPckt), l_rx_depth),
+        tx_queue(reinterpret_cast<char*>(tx_slots_.data()), sizeof(RpcPckt),
+                 l_tx_depth) {
+    rx_queue.init();
+    tx_queue.init();
+  }
+
+  // Write @param pckt into the next rx slot the way the nic does, with the
+  // phase of the lap.
+  void receive(const RpcPckt& pckt) {
+    RpcPckt& slot = rx_slots_[rx_written_ % rx_slots_.size()];
+    slot = pckt;
+    slot.hdr.ctl.phase = (rx_written_ / rx_slots_.size()) % 2 == 0 ? 1 : 0;
+    slot.hdr.ctl.valid = 1;
+    ++rx_written_;
+  }
+
+  // Slot of the request being dispatched in place.
+  const RpcPckt* rx_tail() {
+    uint8_t phase;
+    volatile RpcPckt* pckt =
+        reinterpret_cast<volatile RpcPckt*>(rx_queue.get_read_ptr(phase));
+    return rx_pckt_is_new(pckt, phase) ? const_cast<const RpcPckt*>(pckt)
+                                       : nullptr;
+  }
+
+  RpcPckt* rx_slots() { return rx_slots_.data(); }
+  const RpcPckt* tx_slots() const { return tx_slots_.data(); }
+
+ private:
+  std::vector<RpcPckt> rx_slots_;
+  std::vector<RpcPckt> tx_slots_;
+  size_t rx_written_;
+
+ public:
+  RxQueue rx_queue;
+  TxQueue tx_queue;
+};
+
+// Function table of the callbacks with the handler @param fn at
+// @param fn_id only.
+template <typename F>
+static std::vector<const void*> make_fn_table(uint8_t fn_id, F* fn) {
+  std::vector<const void*> fn_ptr(fn_id + 1u, nullptr);
+  fn_ptr[fn_id] = reinterpret_cast<const void*>(fn);
+  return fn_ptr;
+}
+
+// Single-frame request @param rpc_id to @param fn_id, with the @param argl
+// bytes of arguments at @param args.
+static RpcPckt make_request(uint32_t rpc_id, uint8_t fn_id, const void* args,
+                            size_t argl) {
+  RpcPckt pckt;
+  memset(&pckt, 0, sizeof(RpcPckt));
+  pckt.hdr.rpc_id = rpc_id;
+  pckt.hdr.fn_id = fn_id;
+  pckt.hdr.n_of_frames = 1;
+  pckt.hdr.argl = static_cast<uint16_t>(argl);
+  memcpy(pckt.argv, args, argl);
+  return pckt;
+}
+
+// Location of the arguments seen by the in-place handler.
+static const Arg2* inplace_args = nullptr;
+
+static RpcRetCode loopback6(CallHandler, const Arg2& args, Ret1* ret) {
+  inplace_args = &args;
+  ret->f_id = 6;
+  ret->ret_val = args.a + args.b + args.c + args.d;
+  return RpcRetCode::Success;
+}
+
+TEST(ServerCallBackTest, TestInplaceDispatch) {
+  TestFlow flow(3, 3);
+  auto fn_ptr = make_fn_table(6, &loopback6);
+  RpcServerCallBack callback(fn_ptr);
+
+  // The nic writes the request into the ring
+  Arg2 args{1, 2, 3, 4};
+  RpcPckt request = make_request(0x30, 6, &args, sizeof(Arg2));
+  request.hdr.c_id = 2;
+  flow.receive(request);
+
+  // The server thread dispatches it right from the slot
+  const RpcPckt* pckt = flow.rx_tail();
+  ASSERT_TRUE(pckt != nullptr);
+  callback({0}, pckt, flow.tx_queue);
+  flow.rx_queue.pop();
+
+  // The handler has read the arguments in the ring, not a copy of them
+  EXPECT_EQ(reinterpret_cast<const char*>(inplace_args),
+            reinterpret_cast<const char*>(flow.rx_slots()[0].argv));
+
+  const RpcPckt* tx_slots = flow.tx_slots();
+  Ret1 ret;
+  EXPECT_EQ(tx_slots[0].hdr.ctl.valid, 1);
+  EXPECT_EQ(tx_slots[0].hdr.c_id, 2);
+  EXPECT_EQ(tx_slots[0].hdr.rpc_id, 0x30);
+  memcpy(&ret, tx_slots[0].argv, sizeof(Ret1));
+  EXPECT_EQ(ret.f_id, 6);
+  EXPECT_EQ(ret.ret_val, 10);
+}
+
+// Rx slot the nic reuses while the handler below runs.
+static RpcPckt* reused_slot = nullptr;
+
+static RpcRetCode loopback6_long(CallHandler, const Arg2& args, Ret1* ret) {
+  ret->f_id = 6;
+  ret->ret_val = args.a + args.b + args.c + args.d;
+
+  // The nic writes the next request of the flow into the slot
+  reused_slot->hdr.c_id = 5;
+  reused_slot->hdr.rpc_id = 0x70;
+  return RpcRetCode::Success;
+}
+
+TEST(ServerCallBackTest, TestInplaceSlotReuse) {
+  TestFlow flow(3, 3);
+  auto fn_ptr = make_fn_table(6, &loopback6_long);
+  RpcServerCallBack callback(fn_ptr);
+
+  Arg2 args{1, 2, 3, 4};
+  RpcPckt request = make_request(0x30, 6, &args, sizeof(Arg2));
+  request.hdr.c_id = 2;
+  flow.receive(request);
+
+  reused_slot = &flow.rx_slots()[0];
+  callback({0}, flow.rx_tail(), flow.tx_queue);
+
+  // The response still goes to the request which has been handled
+  const RpcPckt* tx_slots = flow.tx_slots();
+  Ret1 ret;
+  EXPECT_EQ(tx_slots[0].hdr.ctl.valid, 1);
+  EXPECT_EQ(tx_slots[0].hdr.c_id, 2);
+  EXPECT_EQ(tx_slots[0].hdr.rpc_id, 0x30);
+  memcpy(&ret, tx_slots[0].argv, sizeof(Ret1));
+  EXPECT_EQ(ret.ret_val, 10);
+}
+
+static RpcRetCode loopback7(CallHandler, VarArg args, VarRet* ret) {
+  ret->f_id = 7;
+  ret->value.set(args.value.data(), args.value.size());
+  return RpcRetCode::Success;
+}
+
+TEST(ServerCallBackTest, TestVarFieldsCodec) {
+  VarArg args;
+  args.a = 42;
+  ASSERT_EQ(args.key.set("key"), 0);
+  ASSERT_EQ(args.value.set("abcdef", 6), 0);
+  EXPECT_EQ(args.value.set(std::vector<char>(65).data(), 65), 1);
+
+  // Only the used bytes are on the wire
+  uint8_t buff[sizeof(RpcPckt::argv)];
+  size_t argl = args.encode(buff);
+  EXPECT_EQ(argl, args.encoded_size());
+  EXPECT_EQ(argl, sizeof(uint32_t) + 1 + 3 + 1 + 6);
+
+  VarArg decoded;
+  ASSERT_TRUE(rpc_decode(buff, argl, decoded));
+  EXPECT_EQ(decoded.a, 42);
+  EXPECT_STREQ(decoded.key.c_str(), "key");
+  EXPECT_EQ(decoded.value.size(), 6);
+  EXPECT_EQ(memcmp(decoded.value.data(), "abcdef", 6), 0);
+
+  // Truncated or oversized fields are rejected
+  EXPECT_FALSE(decoded.decode(buff, argl - 1));
+  buff[sizeof(uint32_t)] = 17;
+  EXPECT_FALSE(decoded.decode(buff, argl));
+}
+
+TEST(ServerCallBackTest, TestVarFieldsDispatch) {
+  TestFlow flow(3, 3);
+  auto fn_ptr = make_fn_table(7, &loopback7);
+  RpcServerCallBack callback(fn_ptr);
+
+  VarArg args;
+  args.a = 1;
+  args.key.set("k");
+  args.value.set("0123456789", 10);
+
+  uint8_t buff[sizeof(RpcPckt::argv)];
+  RpcPckt pckt = make_request(0x40, 7, buff, args.encode(buff));
+  pckt.hdr.c_id = 3;
+  callback({0}, &pckt, flow.tx_queue);
+
+  // The response is encoded, and argl is its exact size
+  const RpcPckt* tx_slots = flow.tx_slots();
+  EXPECT_EQ(tx_slots[0].hdr.ctl.valid, 1);
+  EXPECT_EQ(tx_slots[0].hdr.rpc_id, 0x40);
+  EXPECT_EQ(tx_slots[0].hdr.argl, sizeof(uint8_t) + 1 + 10);
+
+  VarRet ret;
+  ASSERT_TRUE(rpc_decode(tx_slots[0].argv, tx_slots[0].hdr.argl, ret));
+  EXPECT_EQ(ret.f_id, 7);
+  EXPECT_EQ(ret.value.size(), 10);
+  EXPECT_EQ(memcmp(ret.value.data(), "0123456789", 10), 0);
+
+  // Malformed requests are dropped
+  pckt.hdr.rpc_id = 0x41;
+  pckt.hdr.argl = 2;
+  callback({0}, &pckt, flow.tx_queue);
+  EXPECT_EQ(tx_slots[1].hdr.ctl.valid, 0);
+
+  // So are the ones with an argl past the frame, even if their fields are
+  // well-formed
+  for (uint16_t argl : {static_cast<uint16_t>(sizeof(RpcPckt::argv) + 1),
+                        static_cast<uint16_t>(0xffff)}) {
+    pckt.hdr.argl = argl;
+    callback({0}, &pckt, flow.tx_queue);
+    EXPECT_EQ(tx_slots[1].hdr.ctl.valid, 0);
+  }
+}
+
+TEST(ServerCallBackTest, TestOversizedArgl) {
+  uint8_t argv[sizeof(RpcPckt::argv)];
+  memset(argv, 0, sizeof(argv));
+
+  // Both the fixed-size and the encoded messages reject an argl past the
+  // frame
+  Arg1 fixed;
+  EXPECT_TRUE(rpc_decode(argv, sizeof(Arg1), fixed));
+  EXPECT_FALSE(rpc_decode(argv, sizeof(argv) + 1, fixed));
+
+  VarRet var;
+  EXPECT_TRUE(rpc_decode(argv, sizeof(argv), var));
+  EXPECT_FALSE(rpc_decode(argv, 0xffff, var));
+}
+
+static RpcRetCode multiget(CallHandler, MultiGetArg args, MultiGetRet* ret) {
+  for (const Key& key : args.keys) {
+    ret->values.push_back(key.timestamp * 2);
+  }
+  ret->nested.d = args.flags;
+  return RpcRetCode::Success;
+}
+
+TEST(ServerCallBackTest, TestRepeatedFieldsDispatch) {
+  TestFlow flow(3, 3);
+  auto fn_ptr = make_fn_table(8, &multiget);
+  RpcServerCallBack callback(fn_ptr);
+
+  MultiGetArg args;
+  args.flags = 5;
+  for (uint32_t i = 1; i <= 3; ++i) {
+    Key key;
+    key.timestamp = i;
+    ASSERT_EQ(args.keys.push_back(key), 0);
+  }
+  EXPECT_EQ(args.keys.push_back(Key()), 1);
+  EXPECT_EQ(args.keys.size(), 3);
+
+  RpcPckt pckt = make_request(0x50, 8, &args, sizeof(MultiGetArg));
+  callback({0}, &pckt, flow.tx_queue);
+
+  const RpcPckt* tx_slots = flow.tx_slots();
+  EXPECT_EQ(tx_slots[0].hdr.ctl.valid, 1);
+  EXPECT_EQ(tx_slots[0].hdr.argl, sizeof(MultiGetRet));
+
+  MultiGetRet ret;
+  memcpy(&ret, tx_slots[0].argv, sizeof(MultiGetRet));
+  ASSERT_EQ(ret.values.size(), 3);
+  EXPECT_EQ(ret.values[0], 2);
+  EXPECT_EQ(ret.values[2], 6);
+  EXPECT_EQ(ret.nested.d, 5);
+
+  // Lengths from the wire do not go past the list
+  ret.values.len = 200;
+  EXPECT_EQ(ret.values.size(), 4);
+}
+
+static RpcRetCode loopback8(CallHandler, OptimizedArg args, PackedRet* ret) {
+  *ret = PackedRet{9, args.b, args.a, args.c, Arg3{1, 2, args.d, 4}};
+  return RpcRetCode::Success;
+}
+
+TEST(ServerCallBackTest, TestOptimizedLayoutDispatch) {
+  TestFlow flow(3, 3);
+  auto fn_ptr = make_fn_table(9, &loopback8);
+  RpcServerCallBack callback(fn_ptr);
+
+  // Brace-initialization follows the declaration order, whatever the layout
+  OptimizedArg args{1, 2, 3, 4, "ab"};
+  EXPECT_EQ(args.a, 1);
+  EXPECT_EQ(args.b, 2);
+  EXPECT_EQ(args.c, 3);
+  EXPECT_EQ(args.d, 4);
+  EXPECT_STREQ(args.e, "ab");
+
+  RpcPckt pckt = make_request(0x60, 9, &args, sizeof(OptimizedArg));
+  callback({0}, &pckt, flow.tx_queue);
+
+  const RpcPckt* tx_slots = flow.tx_slots();
+  EXPECT_EQ(tx_slots[0].hdr.ctl.valid, 1);
+  EXPECT_EQ(tx_slots[0].hdr.argl, sizeof(PackedRet));
+
+  PackedRet ret;
+  memcpy(&ret, tx_slots[0].argv, sizeof(PackedRet));
+  EXPECT_EQ(ret.f_id, 9);
+  EXPECT_EQ(ret.ret_val, 2);
+  EXPECT_EQ(ret.flags, 1);
+  EXPECT_EQ(ret.status, 3);
+  EXPECT_EQ(ret.nested.c, 4);
+}
+
+// Arguments seen by the one-way handler.
+static uint64_t notified = 0;
+
+static RpcRetCode notify1(CallHandler, Arg1 args) {
+  notified = args.a;
+  return RpcRetCode::Success;
+}
+
+TEST(ServerCallBackTest, TestOneWayDispatch) {
+  TestFlow flow(3, 3);
+  auto fn_ptr = make_fn_table(10, &notify1);
+  fn_ptr[9] = reinterpret_cast<const void*>(&loopback8);
+  RpcServerCallBack callback(fn_ptr);
+
+  Arg1 args{42};
+  RpcPckt pckt = make_request(0x80, 10, &args, sizeof(Arg1));
+  pckt.hdr.ctl.one_way = 1;
+  callback({0}, &pckt, flow.tx_queue);
+  EXPECT_EQ(notified, 42u);
+
+  // The one-way call takes no tx slot, the next response goes to the first
+  OptimizedArg loopback_args{1, 2, 3, 4, "ab"};
+  pckt = make_request(0x81, 9, &loopback_args, sizeof(OptimizedArg));
+  callback({0}, &pckt, flow.tx_queue);
+
+  const RpcPckt* tx_slots = flow.tx_slots();
+  EXPECT_EQ(tx_slots[0].hdr.ctl.valid, 1);
+  EXPECT_EQ(tx_slots[0].hdr.ctl.one_way, 0);
+  EXPECT_EQ(tx_slots[0].hdr.rpc_id, 0x81);
+  EXPECT_EQ(tx_slots[1].hdr.ctl.valid, 0);
+}
+
+// Results of the writes of the streaming handler.
+static std::vector<int> scan_results;
+
+static RpcRetCode scan1(CallHandler, Arg1 args,
+                        RpcStreamWriter<Ret1>* writer) {
+  for (uint64_t i = 0; i < args.a; ++i) {
+    Ret1 item;
+    item.f_id = 11;
+    item.ret_val = i;
+    scan_results.push_back(writer->write(item));
+  }
+  return RpcRetCode::Success;
+}
+
+TEST(ServerCallBackTest, TestStreamDispatch) {
+  constexpr uint32_t window = cfg::sys::stream_window;
+
+  TestFlow flow(4, 5);
+  auto fn_ptr = make_fn_table(11, &scan1);
+  RpcServerCallBack callback(fn_ptr);
+
+  // The stream request, and the credit grant the client sends after it
+  Arg1 args{window + 2};
+  RpcPckt request = make_request(0x90, 11, &args, sizeof(Arg1));
+  request.hdr.c_id = 3;
+  flow.receive(request);
+
+  uint32_t credits = 2;
+  RpcPckt grant = make_request(0x90, 11, &credits, sizeof(credits));
+  grant.hdr.c_id = 3;
+  grant.hdr.ctl.one_way = 1;
+  flow.receive(grant);
+
+  // The writer finds the grant behind the request dispatched in place, and
+  // releases the request slot itself
+  std::deque<RpcPckt> deferred;
+  RpcStreamWriter_Base::set_flow(&flow.rx_queue, &deferred, true);
+  callback({0}, flow.rx_tail(), flow.tx_queue);
+  EXPECT_FALSE(RpcStreamWriter_Base::flow_request_in_queue());
+
+  EXPECT_EQ(scan_results, std::vector<int>(window + 2, 0));
+
+  const RpcPckt* tx_slots = flow.tx_slots();
+  Ret1 ret;
+  for (size_t i = 0; i < window + 2; ++i) {
+    EXPECT_EQ(tx_slots[i].hdr.rpc_id, 0x90);
+    EXPECT_EQ(tx_slots[i].hdr.frame_id, i);
+    EXPECT_EQ(tx_slots[i].hdr.ctl.end_of_stream, 0);
+    memcpy(&ret, tx_slots[i].argv, sizeof(Ret1));
+    EXPECT_EQ(ret.ret_val, i);
+  }
+  EXPECT_EQ(tx_slots[window + 2].hdr.rpc_id, 0x90);
+  EXPECT_EQ(tx_slots[window + 2].hdr.frame_id, window + 2);
+  EXPECT_EQ(tx_slots[window + 2].hdr.ctl.end_of_stream, 1);
+  EXPECT_EQ(tx_slots[window + 2].hdr.argl, 0);
+
+  // The grant is consumed
+  EXPECT_TRUE(flow.rx_tail() == nullptr);
+  EXPECT_TRUE(deferred.empty());
+
+  // A grant dispatched after the stream is over is dropped
+  callback({0}, &flow.rx_slots()[1], flow.tx_queue);
+  EXPECT_EQ(tx_slots[window + 3].hdr.ctl.valid, 0);
+
+  // Off server threads, no grants can come: the writer gives up after a
+  // window of items, and the stream is still closed
+  RpcStreamWriter_Base::set_flow(nullptr, nullptr, false);
+  scan_results.clear();
+
+  args.a = window + 1;
+  request = make_request(0x91, 11, &args, sizeof(Arg1));
+  callback({0}, &request, flow.tx_queue);
+
+  std::vector<int> expected(window, 0);
+  expected.push_back(1);
+  EXPECT_EQ(scan_results, expected);
+  EXPECT_EQ(tx_slots[2 * window + 3].hdr.rpc_id, 0x91);
+  EXPECT_EQ(tx_slots[2 * window + 3].hdr.frame_id, window);
+  EXPECT_EQ(tx_slots[2 * window + 3].hdr.ctl.end_of_stream, 1);
+}
+
+// The flow the long stream is dispatched from.
+static TestFlow* stream_flow = nullptr;
+
+static RpcPckt make_grant(uint32_t credits) {
+  RpcPckt grant;
+  memset(&grant, 0, sizeof(RpcPckt));
+  grant.hdr.c_id = 3;
+  grant.hdr.rpc_id = 0x92;
+  grant.hdr.fn_id = 11;
+  grant.hdr.n_of_frames = 1;
+  grant.hdr.ctl.one_way = 1;
+  memcpy(grant.argv, &credits, sizeof(credits));
+  return grant;
+}
+
+// Streaming handler receiving the grants of the client while it writes, just
+// in time, along with the requests of another client.
+static RpcRetCode scan_long(CallHandler, Arg1 args,
+                            RpcStreamWriter<Ret1>* writer) {
+  constexpr uint32_t window = cfg::sys::stream_window;
+
+  for (uint64_t i = 0; i < args.a; ++i) {
+    if (i >= window && i % (window / 2) == 0) {
+      stream_flow->receive(make_grant(window / 2));
+    }
+    if (i % window == 0) {
+      RpcPckt other;
+      memset(&other, 0, sizeof(RpcPckt));
+      other.hdr.c_id = 5;
+      other.hdr.rpc_id = static_cast<uint32_t>(0x1000 + i);
+      other.hdr.fn_id = 0;
+      other.hdr.n_of_frames = 1;
+      stream_flow->receive(other);
+    }
+
+    Ret1 item;
+    item.f_id = 11;
+    item.ret_val = i;
+    if (writer->write(item) != 0) return RpcRetCode::Fail;
+  }
+  return RpcRetCode::Success;
+}
+
+TEST(ServerCallBackTest, TestLongStream) {
+  constexpr size_t l_rx_depth = 4;
+  constexpr uint32_t window = cfg::sys::stream_window;
+  // Many times more frames than the rx queue has slots
+  constexpr uint64_t num_of_items = 20u << l_rx_depth;
+
+  TestFlow flow(l_rx_depth, 9);
+  auto fn_ptr = make_fn_table(11, &scan_long);
+  RpcServerCallBack callback(fn_ptr);
+  stream_flow = &flow;
+
+  RpcPckt request = make_grant(0);
+  request.hdr.ctl.one_way = 0;
+  Arg1 args{num_of_items};
+  memcpy(request.argv, &args, sizeof(Arg1));
+  flow.receive(request);
+
+  // The request is dispatched in place, and its slot is overwritten by the
+  // packets received while the handler runs
+  std::deque<RpcPckt> deferred;
+  RpcStreamWriter_Base::set_flow(&flow.rx_queue, &deferred, true);
+  callback({0}, flow.rx_tail(), flow.tx_queue);
+  EXPECT_FALSE(RpcStreamWriter_Base::flow_request_in_queue());
+  RpcStreamWriter_Base::set_flow(nullptr, nullptr, false);
+  stream_flow = nullptr;
+
+  const RpcPckt* tx_slots = flow.tx_slots();
+  Ret1 ret;
+  for (uint64_t i = 0; i < num_of_items; ++i) {
+    ASSERT_EQ(tx_slots[i].hdr.c_id, 3);
+    ASSERT_EQ(tx_slots[i].hdr.rpc_id, 0x92);
+    ASSERT_EQ(tx_slots[i].hdr.frame_id, static_cast<uint8_t>(i));
+    ASSERT_EQ(tx_slots[i].hdr.ctl.end_of_stream, 0);
+    memcpy(&ret, tx_slots[i].argv, sizeof(Ret1));
+    ASSERT_EQ(ret.ret_val, i);
+  }
+  EXPECT_EQ(tx_slots[num_of_items].hdr.ctl.end_of_stream, 1);
+
+  // All the packets are taken off the rx queue; the requests of the other
+  // client are deferred in order
+  EXPECT_TRUE(flow.rx_tail() == nullptr);
+
+  ASSERT_EQ(deferred.size(), static_cast<size_t>(num_of_items / window));
+  for (size_t i = 0; i < deferred.size(); ++i) {
+    EXPECT_EQ(deferred[i].hdr.c_id, 5);
+    EXPECT_EQ(deferred[i].hdr.rpc_id, 0x1000 + i * window);
+  }
+}
+
+static RpcRetCode loopback1(CallHandler, Arg1 args, Ret1* ret) {
+  ret->f_id = 0;
+  ret->ret_val = args.a;
+  return RpcRetCode::Success;
+}
+
+static RpcRetCode stats(CallHandler, Arg1 args, Ret1* ret) {
+  ret->f_id = 10;
+  ret->ret_val = args.a + 100;
+  return RpcRetCode::Success;
+}
+
+TEST(ServerCallBackTest, TestServiceMux) {
+  TestFlow flow(3, 3);
+
+  // Each service has its own function table
+  auto my_fn_ptr = make_fn_table(0, &loopback1);
+  MyService::RpcServerCallBack my_service(my_fn_ptr);
+
+  auto admin_fn_ptr = make_fn_table(0, &stats);
+  AdminService::RpcServerCallBack admin_service(admin_fn_ptr);
+
+  RpcServiceMux mux;
+  ASSERT_EQ(mux.add_service(&my_service), 0);
+  ASSERT_EQ(mux.add_service(&admin_service), 0);
+  EXPECT_EQ(mux.add_service(&admin_service), 1);
+
+  // The services take consecutive fn_id ranges
+  EXPECT_EQ(static_cast<int>(AdminService::RpcServerCallBack::fn_id_base),
+            static_cast<int>(MyService::RpcServerCallBack::num_of_functions));
+
+  Arg1 args{5};
+  RpcPckt pckt = make_request(0x70, 0, &args, sizeof(Arg1));
+  mux({0}, &pckt, flow.tx_queue);
+
+  pckt.hdr.rpc_id = 0x71;
+  pckt.hdr.fn_id = AdminService::RpcServerCallBack::fn_id_base;
+  mux({0}, &pckt, flow.tx_queue);
+
+  // Not served
+  pckt.hdr.rpc_id = 0x72;
+  pckt.hdr.fn_id = 200;
+  mux({0}, &pckt, flow.tx_queue);
+
+  const RpcPckt* tx_slots = flow.tx_slots();
+  Ret1 ret;
+  EXPECT_EQ(tx_slots[0].hdr.rpc_id, 0x70);
+  memcpy(&ret, tx_slots[0].argv, sizeof(Ret1));
+  EXPECT_EQ(ret.ret_val, 5);
+
+  EXPECT_EQ(tx_slots[1].hdr.rpc_id, 0x71);
+  memcpy(&ret, tx_slots[1].argv, sizeof(Ret1));
+  EXPECT_EQ(ret.f_id, 10);
+  EXPECT_EQ(ret.ret_val, 105);
+
+  EXPECT_EQ(tx_slots[2].hdr.ctl.valid, 0);
+}
+
+}  // namespace dagger
@@ -0,0 +1,77 @@
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "tx_queue.h"
+
+namespace dagger {
+
+static constexpr size_t bucket_size = 64;
+static constexpr size_t l_depth = 3;
+
+TEST(TxQueueTest, TestMultiProducerSequence) {
+  std::vector<char> buff_sp(bucket_size << l_depth);
+  std::vector<char> buff_mp(bucket_size << l_depth);
+  TxQueue q_sp(buff_sp.data(), bucket_size, l_depth);
+  TxQueue q_mp(buff_mp.data(), bucket_size, l_depth);
+  q_sp.init();
+  q_mp.init();
+
+  // A single producer gets the same slots and change bits on both interfaces
+  for (uint64_t i = 0; i < 4 * (1 << l_depth); ++i) {
+    uint8_t cb_sp, cb_mp;
+    uint64_t ticket;
+    char* ptr_sp = q_sp.get_write_ptr(cb_sp);
+    char* ptr_mp = q_mp.reserve_write_ptr(cb_mp, ticket);
+
+    EXPECT_EQ(ticket, i);
+    EXPECT_EQ(ptr_sp - buff_sp.data(), ptr_mp - buff_mp.data());
+    EXPECT_EQ(cb_sp, cb_mp);
+
+    q_mp.release_write_ptr(ticket);
+  }
+}
+
+TEST(TxQueueTest, TestMultiProducerConcurrent) {
+  constexpr size_t num_of_threads = 4;
+  constexpr size_t num_of_requests = 20000;
+  const size_t depth = 1 << l_depth;
+
+  std::vector<char> buff(bucket_size << l_depth);
+  TxQueue q(buff.data(), bucket_size, l_depth);
+  q.init();
+
+  std::vector<std::atomic<uint8_t>> seen(num_of_threads * num_of_requests);
+  for (auto& s : seen) s = 0;
+  std::atomic<size_t> wrong_slot(0);
+
+  std::vector<std::thread> threads;
+  for (size_t t = 0; t < num_of_threads; ++t) {
+    threads.push_back(std::thread([&]() {
+      for (size_t i = 0; i < num_of_requests; ++i) {
+        uint8_t change_bit;
+        uint64_t ticket;
+        char* ptr = q.reserve_write_ptr(change_bit, ticket);
+
+        // The slot is owned exclusively until released
+        *reinterpret_cast<volatile uint64_t*>(ptr) = ticket;
+        if (static_cast<size_t>(ptr - buff.data()) !=
+                (ticket % depth) * bucket_size ||
+            *reinterpret_cast<volatile uint64_t*>(ptr) != ticket) {
+          ++wrong_slot;
+        }
+
+        seen[ticket] += 1;
+        q.release_write_ptr(ticket);
+      }
+    }));
+  }
+  for (auto& t : threads) t.join();
+
+  EXPECT_EQ(wrong_slot, 0);
+  for (auto& s : seen) ASSERT_EQ(s, 1);
+}
+
+}  // namespace dagger